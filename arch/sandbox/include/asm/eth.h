@@ -82,6 +82,7 @@ typedef int sandbox_eth_tx_hand_f(struct udevice *dev, void *pkt,
  * recv_packets - number of packets returned
  * tx_handler - function to generate responses to sent packets
  * priv - a pointer to some structure a test may want to keep track of
+ * mcast_hwaddr - MAC address of the multicast group joined, zero if none
  */
 struct eth_sandbox_priv {
 	uchar fake_host_hwaddr[ARP_HLEN];
@@ -92,6 +93,7 @@ struct eth_sandbox_priv {
 	int recv_packets;
 	sandbox_eth_tx_hand_f *tx_handler;
 	void *priv;
+	uchar mcast_hwaddr[ARP_HLEN];
 };
 
 /*
@@ -357,4 +357,20 @@ bool sandbox_sf_bootdev_enabled(void);
  */
 void sandbox_sf_set_enable_bootdevs(bool enable);
 
+/**
+ * sandbox_nvme_set_fail_lba() - Make NVMe I/O fail at a particular block
+ *
+ * @dev: Sandbox NVMe device
+ * @lba: Any read or write which includes this block fails, or -1 for none
+ */
+void sandbox_nvme_set_fail_lba(struct udevice *dev, s64 lba);
+
+/**
+ * sandbox_nvme_get_max_inflight() - Get the most NVMe commands seen at once
+ *
+ * @dev: Sandbox NVMe device
+ * Return: largest number of I/O commands pending when the controller polled
+ */
+int sandbox_nvme_get_max_inflight(struct udevice *dev);
+
 #endif
@@ -10,8 +10,11 @@
 #include <abuf.h>
 #include <env.h>
 #include <log.h>
+#include <malloc.h>
 #include <mapmem.h>
 #include <net.h>
+#include <of_live.h>
+#include <sort.h>
 #include <stdio_dev.h>
 #include <dm/ofnode.h>
 #include <linux/ctype.h>
@@ -560,30 +563,30 @@ void fdt_fixup_ethernet(void *fdt)
 	char mac[16];
 	const char *path;
 	unsigned char mac_addr[ARP_HLEN];
-	int offset;
+	struct fdt_batch batch;
+	int aliases, nodeoff;
+	int ret;
 #ifdef FDT_SEQ_MACADDR_FROM_ENV
-	int nodeoff;
 	const struct fdt_property *fdt_prop;
 #endif
 
-	if (fdt_path_offset(fdt, "/aliases") < 0)
+	aliases = fdt_path_offset(fdt, "/aliases");
+	if (aliases < 0)
 		return;
 
+	/* The FDT is not changed until the batch is applied */
+	ret = fdt_batch_init(&batch, fdt);
+	if (ret) {
+		printf("Unable to update ethernet nodes, err=%s\n",
+		       fdt_strerror(ret));
+		return;
+	}
+
 	/* Cycle through all aliases */
-	for (prop = 0; ; prop++) {
+	fdt_for_each_property_offset(prop, fdt, aliases) {
 		const char *name;
 
-		/* FDT might have been edited, recompute the offset */
-		offset = fdt_first_property_offset(fdt,
-			fdt_path_offset(fdt, "/aliases"));
-		/* Select property number 'prop' */
-		for (j = 0; j < prop; j++)
-			offset = fdt_next_property_offset(fdt, offset);
-
-		if (offset < 0)
-			break;
-
-		path = fdt_getprop_by_offset(fdt, offset, &name, NULL);
+		path = fdt_getprop_by_offset(fdt, prop, &name, NULL);
 		if (!strncmp(name, "ethernet", 8)) {
 			/* Treat plain "ethernet" same as "ethernet0". */
 			if (!strcmp(name, "ethernet")
@@ -604,8 +607,8 @@ void fdt_fixup_ethernet(void *fdt)
 			} else {
 				continue;
 			}
-#ifdef FDT_SEQ_MACADDR_FROM_ENV
 			nodeoff = fdt_path_offset(fdt, path);
+#ifdef FDT_SEQ_MACADDR_FROM_ENV
 			fdt_prop = fdt_get_property(fdt, nodeoff, "status",
 						    NULL);
 			if (fdt_prop && !strcmp(fdt_prop->data, "disabled"))
@@ -623,12 +626,25 @@ void fdt_fixup_ethernet(void *fdt)
 					tmp = (*end) ? end + 1 : end;
 			}
 
-			do_fixup_by_path(fdt, path, "mac-address",
-					 &mac_addr, 6, 0);
-			do_fixup_by_path(fdt, path, "local-mac-address",
-					 &mac_addr, 6, 1);
+			if (nodeoff < 0) {
+				printf("Unable to update property %s:%s, err=%s\n",
+				       path, "local-mac-address",
+				       fdt_strerror(nodeoff));
+				continue;
+			}
+			if (fdt_get_property(fdt, nodeoff, "mac-address", NULL))
+				fdt_batch_setprop(&batch, nodeoff, "mac-address",
+						  mac_addr, 6);
+			fdt_batch_setprop(&batch, nodeoff, "local-mac-address",
+					  mac_addr, 6);
 		}
 	}
+
+	ret = fdt_batch_apply(&batch, fdt, fdt_totalsize(fdt));
+	if (ret)
+		printf("Unable to update ethernet nodes, err=%s\n",
+		       fdt_strerror(ret));
+	fdt_batch_uninit(&batch);
 }
 
 int fdt_record_loadable(void *blob, u32 index, const char *name,
@@ -2101,6 +2117,52 @@ int fdt_overlay_apply_verbose(void *fdt, void *fdto)
 	}
 	return err;
 }
+
+int fdt_overlay_apply_list(void *fdt, int size, void *const fdto[], int count)
+{
+	struct of_live_overlay *ov;
+	int ret, i;
+
+	if (!IS_ENABLED(CONFIG_OF_LIBFDT_OVERLAY_LIVE)) {
+		ret = fdt_open_into(fdt, fdt, size);
+		if (ret) {
+			printf("failed on fdt_open_into(): %s\n",
+			       fdt_strerror(ret));
+			return ret;
+		}
+		for (i = 0; i < count; i++) {
+			ret = fdt_overlay_apply_verbose(fdt, fdto[i]);
+			if (ret)
+				return ret;
+		}
+
+		return 0;
+	}
+
+	ret = of_live_overlay_begin(fdt, &ov);
+	if (ret) {
+		printf("failed to unflatten devicetree: %dE\n", ret);
+		return ret;
+	}
+	for (i = 0; i < count; i++) {
+		ret = of_live_overlay_apply(ov, fdto[i]);
+		if (ret) {
+			printf("failed to apply overlay %d: %dE\n", i, ret);
+			if (ret == -ENOENT &&
+			    fdt_path_offset(fdt, "/__symbols__") < 0) {
+				printf("base fdt does not have a /__symbols__ node\n");
+				printf("make sure you've compiled with -@\n");
+			}
+			of_live_overlay_abort(ov);
+			return ret;
+		}
+	}
+	ret = of_live_overlay_end(ov, fdt, size);
+	if (ret)
+		printf("failed to write devicetree: %dE\n", ret);
+
+	return ret;
+}
 #endif
 
 /**
@@ -2148,3 +2210,646 @@ int fdt_valid(struct fdt_header **blobp)
 	}
 	return 1;
 }
+
+/**
+ * struct fdt_batch_edit - A property to set or delete
+ *
+ * @node: Offset of the node, or handle of a node added by the batch
+ * @nameoff: Offset of the property name in the new strings block
+ * @val: Offset of the value in the batch's data
+ * @len: Length of the value, or -1 to delete the property
+ * @seq: Sequence number, which keeps the edits to each node in order when
+ *	they are sorted
+ */
+struct fdt_batch_edit {
+	int node;
+	int nameoff;
+	int val;
+	int len;
+	int seq;
+};
+
+/**
+ * struct fdt_batch_node - A node to add
+ *
+ * @parent: Offset of the parent node, or handle of a node added by the batch
+ * @name: Offset of the name in the batch's data
+ */
+struct fdt_batch_node {
+	int parent;
+	int name;
+};
+
+/**
+ * struct fdt_batch_child - Entry in the list of new nodes, sorted by parent
+ *
+ * @parent: Offset or handle of the parent node
+ * @idx: Index of the node in the batch
+ */
+struct fdt_batch_child {
+	int parent;
+	int idx;
+};
+
+/**
+ * struct fdt_batch_out - The devicetree being written
+ *
+ * @buf: Buffer for the devicetree
+ * @size: Size of @buf
+ * @pos: Number of bytes written
+ * @child: New nodes sorted by parent, then in the order they were added
+ */
+struct fdt_batch_out {
+	char *buf;
+	int size;
+	int pos;
+	struct fdt_batch_child *child;
+};
+
+static int batch_fail(struct fdt_batch *batch, int err)
+{
+	if (!batch->err)
+		batch->err = err;
+
+	return err;
+}
+
+/* Make room for @want items of @size bytes in the array at @ptrp */
+static int batch_grow(void *ptrp, int *maxp, int want, int size)
+{
+	void **ptr = ptrp;
+	void *new;
+	int max;
+
+	if (want <= *maxp)
+		return 0;
+	max = max(*maxp * 2, max(want, 16));
+	new = realloc(*ptr, max * size);
+	if (!new)
+		return -FDT_ERR_NOSPACE;
+	*ptr = new;
+	*maxp = max;
+
+	return 0;
+}
+
+/* Copy @len bytes into the batch's data, returning the offset of the copy */
+static int batch_add_data(struct fdt_batch *batch, const void *ptr, int len)
+{
+	int ret, offset = batch->data_size;
+
+	ret = batch_grow(&batch->data, &batch->data_max, offset + len, 1);
+	if (ret)
+		return ret;
+	memcpy(batch->data + offset, ptr, len);
+	batch->data_size += len;
+
+	return offset;
+}
+
+/* Find a string in a table, as libfdt does, returning its offset or -1 */
+static int batch_find_string(const char *tab, int size, const char *s)
+{
+	int len = strlen(s) + 1;
+	const char *p;
+
+	for (p = tab; p + len <= tab + size; p++) {
+		if (!memcmp(p, s, len))
+			return p - tab;
+	}
+
+	return -1;
+}
+
+/*
+ * Get the offset of a property name in the new strings block, which is the old
+ * one followed by any names it does not already hold
+ */
+static int batch_nameoff(struct fdt_batch *batch, const char *name)
+{
+	const void *fdt = batch->fdt;
+	int old_size = fdt_size_dt_strings(fdt);
+	int len = strlen(name) + 1;
+	int offset, ret;
+
+	offset = batch_find_string(fdt + fdt_off_dt_strings(fdt), old_size,
+				   name);
+	if (offset >= 0)
+		return offset;
+	offset = batch_find_string(batch->strings, batch->strings_size, name);
+	if (offset >= 0)
+		return old_size + offset;
+
+	offset = batch->strings_size;
+	ret = batch_grow(&batch->strings, &batch->strings_max, offset + len, 1);
+	if (ret)
+		return ret;
+	memcpy(batch->strings + offset, name, len);
+	batch->strings_size += len;
+
+	return old_size + offset;
+}
+
+static const char *batch_name(struct fdt_batch *batch, int nameoff)
+{
+	int old_size = fdt_size_dt_strings(batch->fdt);
+
+	if (nameoff < old_size)
+		return fdt_string(batch->fdt, nameoff);
+
+	return batch->strings + nameoff - old_size;
+}
+
+static int batch_check_node(struct fdt_batch *batch, int node)
+{
+	int next;
+
+	if (node >= FDT_BATCH_NEW_NODE)
+		return node - FDT_BATCH_NEW_NODE < batch->node_count ? 0 :
+			-FDT_ERR_BADOFFSET;
+	if (node < 0 || node % FDT_TAGSIZE ||
+	    fdt_next_tag(batch->fdt, node, &next) != FDT_BEGIN_NODE)
+		return -FDT_ERR_BADOFFSET;
+
+	return 0;
+}
+
+int fdt_batch_init(struct fdt_batch *batch, const void *fdt)
+{
+	int ret;
+
+	memset(batch, '\0', sizeof(*batch));
+	ret = fdt_check_header(fdt);
+	if (ret)
+		return ret;
+	batch->fdt = fdt;
+
+	return 0;
+}
+
+void fdt_batch_uninit(struct fdt_batch *batch)
+{
+	free(batch->edit);
+	free(batch->node);
+	free(batch->rsv);
+	free(batch->data);
+	free(batch->strings);
+	memset(batch, '\0', sizeof(*batch));
+}
+
+int fdt_batch_subnode(struct fdt_batch *batch, int parent, const char *name)
+{
+	struct fdt_batch_node *nd;
+	int ret, i;
+
+	if (batch->err)
+		return batch->err;
+	ret = batch_check_node(batch, parent);
+	if (ret)
+		return batch_fail(batch, ret);
+
+	if (parent < FDT_BATCH_NEW_NODE) {
+		ret = fdt_subnode_offset(batch->fdt, parent, name);
+		if (ret >= 0)
+			return ret;
+		if (ret != -FDT_ERR_NOTFOUND)
+			return batch_fail(batch, ret);
+	}
+	for (i = 0; i < batch->node_count; i++) {
+		nd = &batch->node[i];
+		if (nd->parent == parent && !strcmp(batch->data + nd->name, name))
+			return FDT_BATCH_NEW_NODE + i;
+	}
+
+	ret = batch_grow(&batch->node, &batch->node_max, batch->node_count + 1,
+			 sizeof(*nd));
+	if (ret)
+		return batch_fail(batch, ret);
+	ret = batch_add_data(batch, name, strlen(name) + 1);
+	if (ret < 0)
+		return batch_fail(batch, ret);
+	nd = &batch->node[batch->node_count];
+	nd->parent = parent;
+	nd->name = ret;
+
+	return FDT_BATCH_NEW_NODE + batch->node_count++;
+}
+
+static int batch_edit(struct fdt_batch *batch, int node, const char *name,
+		      const void *val, int len)
+{
+	struct fdt_batch_edit *edit;
+	int nameoff, offset = 0;
+	int ret;
+
+	if (batch->err)
+		return batch->err;
+	ret = batch_check_node(batch, node);
+	if (ret)
+		return batch_fail(batch, ret);
+	nameoff = batch_nameoff(batch, name);
+	if (nameoff < 0)
+		return batch_fail(batch, nameoff);
+	if (len > 0) {
+		offset = batch_add_data(batch, val, len);
+		if (offset < 0)
+			return batch_fail(batch, offset);
+	}
+	ret = batch_grow(&batch->edit, &batch->edit_max, batch->edit_count + 1,
+			 sizeof(*edit));
+	if (ret)
+		return batch_fail(batch, ret);
+
+	edit = &batch->edit[batch->edit_count];
+	edit->node = node;
+	edit->nameoff = nameoff;
+	edit->val = offset;
+	edit->len = len;
+	edit->seq = batch->edit_count++;
+
+	return 0;
+}
+
+int fdt_batch_setprop(struct fdt_batch *batch, int node, const char *name,
+		      const void *val, int len)
+{
+	if (len < 0)
+		return batch_fail(batch, -FDT_ERR_BADVALUE);
+
+	return batch_edit(batch, node, name, val, len);
+}
+
+int fdt_batch_delprop(struct fdt_batch *batch, int node, const char *name)
+{
+	return batch_edit(batch, node, name, NULL, -1);
+}
+
+int fdt_batch_add_mem_rsv(struct fdt_batch *batch, u64 addr, u64 size)
+{
+	int ret;
+
+	if (batch->err)
+		return batch->err;
+	ret = batch_grow(&batch->rsv, &batch->rsv_max, batch->rsv_count + 1,
+			 2 * sizeof(u64));
+	if (ret)
+		return batch_fail(batch, ret);
+	batch->rsv[batch->rsv_count * 2] = addr;
+	batch->rsv[batch->rsv_count * 2 + 1] = size;
+	batch->rsv_count++;
+
+	return 0;
+}
+
+/* Write to the new devicetree, padding to a multiple of FDT_TAGSIZE */
+static int batch_put(struct fdt_batch_out *out, const void *data, int len)
+{
+	int aligned = ALIGN(len, FDT_TAGSIZE);
+
+	if (out->pos + aligned > out->size)
+		return -FDT_ERR_NOSPACE;
+	memcpy(out->buf + out->pos, data, len);
+	memset(out->buf + out->pos + len, '\0', aligned - len);
+	out->pos += aligned;
+
+	return 0;
+}
+
+static int batch_put_u32(struct fdt_batch_out *out, u32 val)
+{
+	fdt32_t tmp = cpu_to_fdt32(val);
+
+	return batch_put(out, &tmp, sizeof(tmp));
+}
+
+static int batch_put_prop(struct fdt_batch_out *out, int nameoff,
+			  const void *val, int len)
+{
+	int ret;
+
+	ret = batch_put_u32(out, FDT_PROP);
+	if (!ret)
+		ret = batch_put_u32(out, len);
+	if (!ret)
+		ret = batch_put_u32(out, nameoff);
+	if (!ret)
+		ret = batch_put(out, val, len);
+
+	return ret;
+}
+
+static int batch_cmp_edit(const void *a, const void *b)
+{
+	const struct fdt_batch_edit *ea = a, *eb = b;
+
+	if (ea->node != eb->node)
+		return ea->node < eb->node ? -1 : 1;
+
+	return ea->seq - eb->seq;
+}
+
+static int batch_cmp_child(const void *a, const void *b)
+{
+	const struct fdt_batch_child *ca = a, *cb = b;
+
+	if (ca->parent != cb->parent)
+		return ca->parent < cb->parent ? -1 : 1;
+
+	return ca->idx - cb->idx;
+}
+
+/* Find the edits to a node, returning the number and setting @firstp */
+static int batch_node_edits(struct fdt_batch *batch, int node, int *firstp)
+{
+	int lo = 0, hi = batch->edit_count, mid, end;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (batch->edit[mid].node < node)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	for (end = lo; end < batch->edit_count; end++) {
+		if (batch->edit[end].node != node)
+			break;
+	}
+	*firstp = lo;
+
+	return end - lo;
+}
+
+/* Find the last of the edits @first to @end - 1 with the given name, or -1 */
+static int batch_find_edit(struct fdt_batch *batch, int first, int end,
+			   const char *name)
+{
+	int i;
+
+	for (i = end - 1; i >= first; i--) {
+		if (!strcmp(batch_name(batch, batch->edit[i].nameoff), name))
+			return i;
+	}
+
+	return -1;
+}
+
+/*
+ * Write the properties a node does not have yet. fdt_setprop() adds each one
+ * at the start of the node, so they end up in the reverse order of the first
+ * edit to each of them.
+ */
+static int batch_write_new_props(struct fdt_batch *batch,
+				 struct fdt_batch_out *out, int node)
+{
+	struct fdt_batch_edit *edit;
+	const char *name;
+	int first, count, i, last;
+	int ret;
+
+	count = batch_node_edits(batch, node, &first);
+	for (i = first + count - 1; i >= first; i--) {
+		name = batch_name(batch, batch->edit[i].nameoff);
+		if (batch_find_edit(batch, first, i, name) != -1)
+			continue;
+		if (node < FDT_BATCH_NEW_NODE &&
+		    fdt_get_property(batch->fdt, node, name, NULL))
+			continue;
+		last = batch_find_edit(batch, i, first + count, name);
+		edit = &batch->edit[last];
+		if (edit->len < 0)
+			continue;
+		ret = batch_put_prop(out, edit->nameoff,
+				     batch->data + edit->val, edit->len);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+/* Write an existing property, as updated by the batch */
+static int batch_write_prop(struct fdt_batch *batch, struct fdt_batch_out *out,
+			    int node, int offset, int next)
+{
+	const struct fdt_property *prop;
+	struct fdt_batch_edit *edit;
+	int first, count, i;
+	const char *name;
+
+	prop = fdt_get_property_by_offset(batch->fdt, offset, NULL);
+	if (!prop || node < 0)
+		return -FDT_ERR_BADSTRUCTURE;
+	name = fdt_string(batch->fdt, fdt32_to_cpu(prop->nameoff));
+	if (!name)
+		return -FDT_ERR_BADSTRUCTURE;
+
+	count = batch_node_edits(batch, node, &first);
+	i = batch_find_edit(batch, first, first + count, name);
+	if (i == -1)
+		return batch_put(out, prop, next - offset);
+	edit = &batch->edit[i];
+	if (edit->len < 0)
+		return 0;
+
+	return batch_put_prop(out, fdt32_to_cpu(prop->nameoff),
+			      batch->data + edit->val, edit->len);
+}
+
+/*
+ * Write the new subnodes of a node. fdt_add_subnode() adds each one after the
+ * properties of its parent, so they end up in the reverse order they were
+ * added.
+ */
+static int batch_write_children(struct fdt_batch *batch,
+				struct fdt_batch_out *out, int parent)
+{
+	int lo = 0, hi = batch->node_count, mid, i;
+	struct fdt_batch_node *nd;
+	int handle, ret;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (out->child[mid].parent <= parent)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	for (i = lo - 1; i >= 0 && out->child[i].parent == parent; i--) {
+		handle = FDT_BATCH_NEW_NODE + out->child[i].idx;
+		nd = &batch->node[out->child[i].idx];
+		ret = batch_put_u32(out, FDT_BEGIN_NODE);
+		if (!ret)
+			ret = batch_put(out, batch->data + nd->name,
+					strlen(batch->data + nd->name) + 1);
+		if (!ret)
+			ret = batch_write_new_props(batch, out, handle);
+		if (!ret)
+			ret = batch_write_children(batch, out, handle);
+		if (!ret)
+			ret = batch_put_u32(out, FDT_END_NODE);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+/* Write the structure block, copying it from the old one with the edits */
+static int batch_write_struct(struct fdt_batch *batch,
+			      struct fdt_batch_out *out)
+{
+	const void *fdt = batch->fdt;
+	int offset = 0, next, node = -1;
+	int ret;
+	u32 tag;
+
+	do {
+		tag = fdt_next_tag(fdt, offset, &next);
+		if (next < 0)
+			return next;
+		ret = 0;
+		switch (tag) {
+		case FDT_BEGIN_NODE:
+			/* The first subnode ends the parent's properties */
+			if (node != -1)
+				ret = batch_write_children(batch, out, node);
+			if (!ret)
+				ret = batch_put(out,
+						fdt_offset_ptr(fdt, offset,
+							       next - offset),
+						next - offset);
+			node = offset;
+			if (!ret)
+				ret = batch_write_new_props(batch, out, node);
+			break;
+		case FDT_PROP:
+			ret = batch_write_prop(batch, out, node, offset, next);
+			break;
+		case FDT_END_NODE:
+			if (node != -1)
+				ret = batch_write_children(batch, out, node);
+			node = -1;
+			if (!ret)
+				ret = batch_put_u32(out, tag);
+			break;
+		case FDT_END:
+			ret = batch_put_u32(out, tag);
+			break;
+		case FDT_NOP:
+			break;
+		default:
+			return -FDT_ERR_BADSTRUCTURE;
+		}
+		if (ret)
+			return ret;
+		offset = next;
+	} while (tag != FDT_END);
+
+	return 0;
+}
+
+/* Write the memory-reservation block, with the batch's entries at the end */
+static int batch_write_rsvmap(struct fdt_batch *batch,
+			      struct fdt_batch_out *out)
+{
+	struct fdt_reserve_entry re;
+	int count = fdt_num_mem_rsv(batch->fdt);
+	u64 addr, size;
+	int i, ret;
+
+	if (count < 0)
+		return count;
+	for (i = 0; i <= count + batch->rsv_count; i++) {
+		if (i < count) {
+			ret = fdt_get_mem_rsv(batch->fdt, i, &addr, &size);
+			if (ret)
+				return ret;
+		} else if (i < count + batch->rsv_count) {
+			addr = batch->rsv[(i - count) * 2];
+			size = batch->rsv[(i - count) * 2 + 1];
+		} else {
+			addr = 0;
+			size = 0;
+		}
+		re.address = cpu_to_fdt64(addr);
+		re.size = cpu_to_fdt64(size);
+		ret = batch_put(out, &re, sizeof(re));
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+int fdt_batch_apply(struct fdt_batch *batch, void *fdt, int bufsize)
+{
+	int rsv_off, struct_off, strings_off;
+	struct fdt_batch_out out;
+	int ret, i;
+
+	if (batch->err)
+		return batch->err;
+	if (fdt != batch->fdt)
+		return -FDT_ERR_BADVALUE;
+
+	out.buf = malloc(bufsize);
+	out.child = malloc(max(batch->node_count, 1) * sizeof(*out.child));
+	if (!out.buf || !out.child) {
+		ret = -FDT_ERR_NOSPACE;
+		goto err;
+	}
+	out.size = bufsize;
+
+	qsort(batch->edit, batch->edit_count, sizeof(*batch->edit),
+	      batch_cmp_edit);
+	for (i = 0; i < batch->node_count; i++) {
+		out.child[i].parent = batch->node[i].parent;
+		out.child[i].idx = i;
+	}
+	qsort(out.child, batch->node_count, sizeof(*out.child),
+	      batch_cmp_child);
+
+	/* Use the same layout as fdt_open_into() */
+	rsv_off = ALIGN(sizeof(struct fdt_header), 8);
+	out.pos = rsv_off;
+	ret = -FDT_ERR_NOSPACE;
+	if (out.pos > out.size)
+		goto err;
+	ret = batch_write_rsvmap(batch, &out);
+	if (ret)
+		goto err;
+	struct_off = out.pos;
+	ret = batch_write_struct(batch, &out);
+	if (ret)
+		goto err;
+
+	strings_off = out.pos;
+	ret = -FDT_ERR_NOSPACE;
+	if (out.pos + fdt_size_dt_strings(fdt) + batch->strings_size > out.size)
+		goto err;
+	memcpy(out.buf + out.pos, fdt + fdt_off_dt_strings(fdt),
+	       fdt_size_dt_strings(fdt));
+	out.pos += fdt_size_dt_strings(fdt);
+	memcpy(out.buf + out.pos, batch->strings, batch->strings_size);
+	out.pos += batch->strings_size;
+
+	memset(out.buf, '\0', rsv_off);
+	fdt_set_magic(out.buf, FDT_MAGIC);
+	fdt_set_totalsize(out.buf, bufsize);
+	fdt_set_off_dt_struct(out.buf, struct_off);
+	fdt_set_off_dt_strings(out.buf, strings_off);
+	fdt_set_off_mem_rsvmap(out.buf, rsv_off);
+	fdt_set_version(out.buf, 17);
+	fdt_set_last_comp_version(out.buf, 16);
+	fdt_set_boot_cpuid_phys(out.buf, fdt_boot_cpuid_phys(fdt));
+	fdt_set_size_dt_strings(out.buf, out.pos - strings_off);
+	fdt_set_size_dt_struct(out.buf, strings_off - struct_off);
+
+	memcpy(fdt, out.buf, out.pos);
+	ret = 0;
+err:
+	free(out.child);
+	free(out.buf);
+
+	return ret;
+}
@@ -25,6 +25,7 @@
 #include <asm/io.h>
 #include <malloc.h>
 #include <memalign.h>
+#include <of_live.h>
 #include <asm/global_data.h>
 #ifdef CONFIG_DM_HASH
 #include <dm.h>
@@ -1407,6 +1408,190 @@ error:
 	return 0;
 }
 
+int fit_image_hash_start(const void *fit, int image_noffset,
+			 struct fit_hash_stream *hs)
+{
+	struct fit_hash_stream_node *node;
+	struct hash_algo *algo;
+	const char *algo_name;
+	int noffset, ignore;
+
+	hs->count = 0;
+
+	/* The hash uclass has no progressive interface */
+	if (!tools_build() && IS_ENABLED(CONFIG_DM_HASH))
+		return -ENOSYS;
+
+	/* Ciphered images are decrypted before they are hashed */
+	if (fdt_subnode_offset(fit, image_noffset, FIT_CIPHER_NODENAME) >= 0)
+		return -ENOSYS;
+
+	fdt_for_each_subnode(noffset, fit, image_noffset) {
+		const char *name = fit_get_name(fit, noffset, NULL);
+
+		/* Signatures need the whole image, so use the normal path */
+		if (!strncmp(name, FIT_SIG_NODENAME, strlen(FIT_SIG_NODENAME)))
+			goto unsupported;
+		if (strncmp(name, FIT_HASH_NODENAME, strlen(FIT_HASH_NODENAME)))
+			continue;
+
+		if (!tools_build()) {
+			fit_image_hash_get_ignore(fit, noffset, &ignore);
+			if (ignore)
+				continue;
+		}
+		if (hs->count == FIT_HASH_STREAM_MAX ||
+		    fit_image_hash_get_algo(fit, noffset, &algo_name) ||
+		    hash_progressive_lookup_algo(algo_name, &algo))
+			goto unsupported;
+
+		node = &hs->node[hs->count];
+		if (algo->hash_init(algo, &node->ctx))
+			goto unsupported;
+		node->algo = algo;
+		node->noffset = noffset;
+		hs->count++;
+	}
+
+	return 0;
+
+unsupported:
+	fit_image_hash_abort(hs);
+
+	return -ENOSYS;
+}
+
+int fit_image_hash_update(struct fit_hash_stream *hs, const void *data,
+			  size_t size)
+{
+	ALLOC_CACHE_ALIGN_BUFFER(uint8_t, value, FIT_MAX_HASH_LEN);
+	struct fit_hash_stream_node *node;
+	int i;
+
+	for (i = 0; i < hs->count; i++) {
+		node = &hs->node[i];
+		if (!node->ctx)
+			continue;
+		/*
+		 * On error, finish the context to free it; the missing context
+		 * makes verification fail
+		 */
+		if (node->algo->hash_update(node->algo, node->ctx, data, size,
+					    0)) {
+			node->algo->hash_finish(node->algo, node->ctx, value,
+						FIT_MAX_HASH_LEN);
+			node->ctx = NULL;
+			return -EIO;
+		}
+	}
+
+	return 0;
+}
+
+int fit_image_hash_copy(struct fit_hash_stream *hs, void *dst,
+			const void *src, size_t size)
+{
+	size_t chunk;
+	int ret;
+
+	/* Hash each chunk while it is still in the cache */
+	while (size) {
+		chunk = size < FIT_STREAM_CHUNK_SIZE ? size :
+			FIT_STREAM_CHUNK_SIZE;
+		memcpy(dst, src, chunk);
+		ret = fit_image_hash_update(hs, dst, chunk);
+		if (ret)
+			return ret;
+		dst += chunk;
+		src += chunk;
+		size -= chunk;
+	}
+
+	return 0;
+}
+
+void fit_image_hash_abort(struct fit_hash_stream *hs)
+{
+	ALLOC_CACHE_ALIGN_BUFFER(uint8_t, value, FIT_MAX_HASH_LEN);
+	struct fit_hash_stream_node *node;
+	int i;
+
+	/* Finishing is the only way to free the context */
+	for (i = 0; i < hs->count; i++) {
+		node = &hs->node[i];
+		if (node->ctx)
+			node->algo->hash_finish(node->algo, node->ctx, value,
+						FIT_MAX_HASH_LEN);
+		node->ctx = NULL;
+	}
+	hs->count = 0;
+}
+
+int fit_image_verify_stream(const void *fit, int image_noffset,
+			    const void *key_blob, struct fit_hash_stream *hs)
+{
+	ALLOC_CACHE_ALIGN_BUFFER(uint8_t, value, FIT_MAX_HASH_LEN);
+	struct fit_hash_stream_node *node;
+	char *err_msg = "";
+	int noffset = image_noffset;
+	uint8_t *fit_value;
+	int fit_value_len;
+	int verify_all = 1;
+	int i;
+
+	/*
+	 * There are no signature nodes in this image, so this only fails if
+	 * a key insists on one, just as fit_image_verify_with_data() would
+	 */
+	if (FIT_IMAGE_ENABLE_VERIFY &&
+	    fit_image_verify_required_sigs(fit, image_noffset, NULL, 0,
+					   key_blob, &verify_all)) {
+		err_msg = "Unable to verify required signature";
+		goto error;
+	}
+
+	for (i = 0; i < hs->count; i++) {
+		node = &hs->node[i];
+		noffset = node->noffset;
+		printf("%s", node->algo->name);
+		if (!node->ctx) {
+			err_msg = "Hash calculation failed";
+			goto error;
+		}
+		if (node->algo->hash_finish(node->algo, node->ctx, value,
+					    FIT_MAX_HASH_LEN)) {
+			node->ctx = NULL;
+			err_msg = "Hash calculation failed";
+			goto error;
+		}
+		node->ctx = NULL;
+
+		if (fit_image_hash_get_value(fit, noffset, &fit_value,
+					     &fit_value_len)) {
+			err_msg = "Can't get hash value property";
+			goto error;
+		}
+		if (node->algo->digest_size != fit_value_len) {
+			err_msg = "Bad hash value len";
+			goto error;
+		} else if (memcmp(value, fit_value, fit_value_len)) {
+			err_msg = "Bad hash value";
+			goto error;
+		}
+		puts("+ ");
+	}
+	hs->count = 0;
+
+	return 1;
+
+error:
+	fit_image_hash_abort(hs);
+	printf(" error!\n%s for '%s' hash node in '%s' image node\n",
+	       err_msg, fit_get_name(fit, noffset, NULL),
+	       fit_get_name(fit, image_noffset, NULL));
+	return 0;
+}
+
 /**
  * fit_image_verify - verify data integrity
  * @fit: pointer to the FIT format image header
@@ -2069,6 +2254,8 @@ int fit_image_load(struct bootm_headers *images, ulong addr,
 	ulong load, load_end, data, len;
 	uint8_t os, comp;
 	const char *prop_name;
+	struct fit_hash_stream hs;
+	bool stream = false;
 	int ret;
 
 	fit = map_sysmem(addr, 0);
@@ -2142,10 +2329,22 @@ int fit_image_load(struct bootm_headers *images, ulong addr,
 
 	printf("   Trying '%s' %s subimage\n", fit_uname, prop_name);
 
-	ret = fit_image_select(fit, noffset, images->verify);
+	/*
+	 * An image which is just copied to its load address can have its
+	 * hashes worked out during the copy, saving a pass over memory
+	 */
+	if (CONFIG_IS_ENABLED(FIT_STREAM_VERIFY) && images->verify &&
+	    !(!tools_build() && IS_ENABLED(CONFIG_FIT_IMAGE_POST_PROCESS)) &&
+	    (fit_image_get_comp(fit, noffset, &comp) || comp == IH_COMP_NONE ||
+	     image_type == IH_TYPE_KERNEL ||
+	     image_type == IH_TYPE_KERNEL_NOLOAD ||
+	     image_type == IH_TYPE_RAMDISK))
+		stream = !fit_image_hash_start(fit, noffset, &hs);
+
+	ret = fit_image_select(fit, noffset, images->verify && !stream);
 	if (ret) {
 		bootstage_error(bootstage_id + BOOTSTAGE_SUB_HASH);
-		return ret;
+		goto err;
 	}
 
 	bootstage_mark(bootstage_id + BOOTSTAGE_SUB_CHECK_ARCH);
@@ -2153,7 +2352,8 @@ int fit_image_load(struct bootm_headers *images, ulong addr,
 		if (!fit_image_check_target_arch(fit, noffset)) {
 			puts("Unsupported Architecture\n");
 			bootstage_error(bootstage_id + BOOTSTAGE_SUB_CHECK_ARCH);
-			return -ENOEXEC;
+			ret = -ENOEXEC;
+			goto err;
 		}
 	}
 
@@ -2194,7 +2394,8 @@ int fit_image_load(struct bootm_headers *images, ulong addr,
 		       genimg_get_arch_name(arch),
 		       genimg_get_type_name(image_type));
 		bootstage_error(bootstage_id + BOOTSTAGE_SUB_CHECK_ALL);
-		return -EIO;
+		ret = -EIO;
+		goto err;
 	}
 
 	bootstage_mark(bootstage_id + BOOTSTAGE_SUB_CHECK_ALL_OK);
@@ -2204,7 +2405,8 @@ int fit_image_load(struct bootm_headers *images, ulong addr,
 					(const void **)&buf, &size)) {
 		printf("Could not find %s subimage data!\n", prop_name);
 		bootstage_error(bootstage_id + BOOTSTAGE_SUB_GET_DATA);
-		return -ENOENT;
+		ret = -ENOENT;
+		goto err;
 	}
 
 	/* Decrypt data before uncompress/move */
@@ -2212,7 +2414,8 @@ int fit_image_load(struct bootm_headers *images, ulong addr,
 		puts("   Decrypting Data ... ");
 		if (fit_image_uncipher(fit, noffset, &buf, &size)) {
 			puts("Error\n");
-			return -EACCES;
+			ret = -EACCES;
+			goto err;
 		}
 		puts("OK\n");
 	}
@@ -2234,7 +2437,8 @@ int fit_image_load(struct bootm_headers *images, ulong addr,
 			printf("Can't get %s subimage load address!\n",
 			       prop_name);
 			bootstage_error(bootstage_id + BOOTSTAGE_SUB_LOAD);
-			return -EBADF;
+			ret = -EBADF;
+			goto err;
 		}
 	} else if (load_op != FIT_LOAD_OPTIONAL_NON_ZERO || load) {
 		ulong image_start, image_end;
@@ -2250,7 +2454,8 @@ int fit_image_load(struct bootm_headers *images, ulong addr,
 		if (image_type != IH_TYPE_KERNEL &&
 		    load < image_end && load_end > image_start) {
 			printf("Error: %s overwritten\n", prop_name);
-			return -EXDEV;
+			ret = -EXDEV;
+			goto err;
 		}
 
 		printf("   Loading %s from 0x%08lx to 0x%08lx\n",
@@ -2277,13 +2482,31 @@ int fit_image_load(struct bootm_headers *images, ulong addr,
 		if (image_decomp(comp, load, data, image_type,
 				loadbuf, buf, len, max_decomp_len, &load_end)) {
 			printf("Error decompressing %s\n", prop_name);
-
-			return -ENOEXEC;
+			ret = -ENOEXEC;
+			goto err;
 		}
 		len = load_end - load;
 	} else if (load != data) {
 		loadbuf = map_sysmem(load, len);
-		memcpy(loadbuf, buf, len);
+		if (stream)
+			fit_image_hash_copy(&hs, loadbuf, buf, len);
+		else
+			memcpy(loadbuf, buf, len);
+	} else if (stream) {
+		fit_image_hash_update(&hs, buf, len);
+	}
+
+	if (stream) {
+		puts("   Verifying Hash Integrity ... ");
+		if (!fit_image_verify_stream(fit, noffset, gd_fdt_blob(),
+					     &hs)) {
+			puts("Bad Data Hash\n");
+			bootstage_error(bootstage_id + BOOTSTAGE_SUB_HASH);
+			ret = -EACCES;
+			goto err;
+		}
+		puts("OK\n");
+		stream = false;
 	}
 
 	if (image_type == IH_TYPE_RAMDISK && comp != IH_COMP_NONE)
@@ -2293,7 +2516,8 @@ int fit_image_load(struct bootm_headers *images, ulong addr,
 	/* verify that image data is a proper FDT blob */
 	if (image_type == IH_TYPE_FLATDT && fdt_check_header(loadbuf)) {
 		puts("Subimage data is not a FDT");
-		return -ENOEXEC;
+		ret = -ENOEXEC;
+		goto err;
 	}
 
 	bootstage_mark(bootstage_id + BOOTSTAGE_SUB_LOAD);
@@ -2307,6 +2531,13 @@ int fit_image_load(struct bootm_headers *images, ulong addr,
 					      fit_base_uname_config);
 
 	return noffset;
+
+err:
+	/* Release the hash contexts if the image was not fully verified */
+	if (stream)
+		fit_image_hash_abort(&hs);
+
+	return ret;
 }
 
 int boot_get_setup_fit(struct bootm_headers *images, uint8_t arch,
@@ -2343,7 +2574,8 @@ int boot_get_fdt_fit(struct bootm_headers *images, ulong addr,
 	ulong load, len;
 #ifdef CONFIG_OF_LIBFDT_OVERLAY
 	ulong image_start, image_end;
-	ulong ovload, ovlen, ovcopylen;
+	ulong ovload, ovlen, ovcopylen, extra = 0;
+	struct of_live_overlay *live = NULL;
 	const char *uconfig;
 	const char *uname;
 	void *base, *ov, *ovcopy = NULL;
@@ -2460,6 +2692,32 @@ int boot_get_fdt_fit(struct bootm_headers *images, ulong addr,
 			goto out;
 		}
 
+		/*
+		 * Apply to a livetree and flatten just once, when all the
+		 * overlays are done. The overlay is copied into the livetree.
+		 */
+		if (IS_ENABLED(CONFIG_OF_LIBFDT_OVERLAY_LIVE)) {
+			if (!live) {
+				err = of_live_overlay_begin(base, &live);
+				if (err) {
+					printf("failed to unflatten FDT: %dE\n",
+					       err);
+					fdt_noffset = err;
+					goto out;
+				}
+			}
+			err = of_live_overlay_apply(live, ovcopy);
+			if (err) {
+				printf("failed to apply overlay: %dE\n", err);
+				fdt_noffset = err;
+				goto out;
+			}
+			free(ovcopy);
+			ovcopy = NULL;
+			extra += ovlen;
+			continue;
+		}
+
 		base = map_sysmem(load, len + ovlen);
 		err = fdt_open_into(base, base, len + ovlen);
 		if (err < 0) {
@@ -2477,6 +2735,20 @@ int boot_get_fdt_fit(struct bootm_headers *images, ulong addr,
 		fdt_pack(base);
 		len = fdt_totalsize(base);
 	}
+
+	if (IS_ENABLED(CONFIG_OF_LIBFDT_OVERLAY_LIVE) && live) {
+		base = map_sysmem(load, len + extra);
+		/* this frees the session, even on error */
+		err = of_live_overlay_end(live, base, len + extra);
+		live = NULL;
+		if (err) {
+			printf("failed to flatten FDT: %dE\n", err);
+			fdt_noffset = err;
+			goto out;
+		}
+		fdt_pack(base);
+		len = fdt_totalsize(base);
+	}
 #else
 	printf("config with overlays but CONFIG_OF_LIBFDT_OVERLAY not set\n");
 	fdt_noffset = -EBADF;
@@ -2493,6 +2765,8 @@ out:
 		*fit_uname_configp = fit_uname_config;
 
 #ifdef CONFIG_OF_LIBFDT_OVERLAY
+	if (IS_ENABLED(CONFIG_OF_LIBFDT_OVERLAY_LIVE) && live)
+		of_live_overlay_abort(live);
 	free(ovcopy);
 #endif
 	free(fit_uname_config_copy);
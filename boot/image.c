@@ -534,6 +534,99 @@ int image_decomp(int comp, ulong load, ulong image_start, int type,
 	return 0;
 }
 
+int image_decomp_stream_start(struct image_decomp_stream *ds, int comp,
+			      void *load_buf, ulong unc_len)
+{
+	ds->comp = comp;
+	ds->load_buf = load_buf;
+	ds->unc_len = unc_len;
+	ds->pos = 0;
+	ds->priv = NULL;
+
+	switch (comp) {
+	case IH_COMP_NONE:
+		return 0;
+	case IH_COMP_GZIP:
+		if (!tools_build() && CONFIG_IS_ENABLED(GZIP)) {
+			struct gunzip_stream *gs;
+			int ret;
+
+			gs = malloc(sizeof(*gs));
+			if (!gs)
+				return -ENOMEM;
+			ret = gunzip_stream_start(gs, load_buf, unc_len);
+			if (ret) {
+				free(gs);
+				return ret;
+			}
+			ds->priv = gs;
+			return 0;
+		}
+		break;
+	case IH_COMP_ZSTD:
+		if (!tools_build() && CONFIG_IS_ENABLED(ZSTD)) {
+			struct zstd_stream *zs;
+
+			zs = malloc(sizeof(*zs));
+			if (!zs)
+				return -ENOMEM;
+			zstd_stream_start(zs, load_buf, unc_len);
+			ds->priv = zs;
+			return 0;
+		}
+		break;
+	}
+
+	return -ENOSYS;
+}
+
+int image_decomp_stream_write(struct image_decomp_stream *ds, const void *buf,
+			      ulong len)
+{
+	switch (ds->comp) {
+	case IH_COMP_NONE:
+		if (ds->pos + len > ds->unc_len)
+			return -ENOSPC;
+		memcpy(ds->load_buf + ds->pos, buf, len);
+		ds->pos += len;
+		return 0;
+	case IH_COMP_GZIP:
+		if (!tools_build() && CONFIG_IS_ENABLED(GZIP))
+			return gunzip_stream_write(ds->priv, buf, len);
+		break;
+	case IH_COMP_ZSTD:
+		if (!tools_build() && CONFIG_IS_ENABLED(ZSTD))
+			return zstd_stream_write(ds->priv, buf, len);
+		break;
+	}
+
+	return -ENOSYS;
+}
+
+int image_decomp_stream_end(struct image_decomp_stream *ds, ulong *lenp)
+{
+	int ret = -ENOSYS;
+
+	*lenp = ds->pos;
+	switch (ds->comp) {
+	case IH_COMP_NONE:
+		ret = 0;
+		break;
+	case IH_COMP_GZIP:
+		if (!tools_build() && CONFIG_IS_ENABLED(GZIP))
+			ret = gunzip_stream_end(ds->priv, lenp);
+		break;
+	case IH_COMP_ZSTD:
+		if (!tools_build() && CONFIG_IS_ENABLED(ZSTD))
+			ret = zstd_stream_end(ds->priv, lenp);
+		break;
+	}
+	free(ds->priv);
+	ds->priv = NULL;
+
+	return ret;
+}
+
 const table_entry_t *get_table_entry(const table_entry_t *table, int id)
 {
 	for (; table->id >= 0; ++table) {
@@ -18,11 +18,18 @@ static int blkc_show(struct cmd_tbl *cmdtp, int flag,
 
 	printf("hits: %u\n"
 	       "misses: %u\n"
+	       "evictions: %u\n"
+	       "read-aheads: %u\n"
 	       "entries: %u\n"
 	       "max blocks/entry: %u\n"
-	       "max cache entries: %u\n",
-	       stats.hits, stats.misses, stats.entries,
-	       stats.max_blocks_per_entry, stats.max_entries);
+	       "max cache entries: %u\n"
+	       "entries/set: %u\n"
+	       "max bytes/device: %#lx\n"
+	       "max read-ahead blocks: %u\n",
+	       stats.hits, stats.misses, stats.evictions, stats.readaheads,
+	       stats.entries, stats.max_blocks_per_entry, stats.max_entries,
+	       stats.ways, stats.max_dev_bytes, stats.readahead_blocks);
+	blkcache_show_devs();
 	return 0;
 }
 
@@ -41,9 +48,27 @@ static int blkc_configure(struct cmd_tbl *cmdtp, int flag,
 	return 0;
 }
 
+static int blkc_device(struct cmd_tbl *cmdtp, int flag,
+		       int argc, char *const argv[])
+{
+	ulong max_bytes;
+	unsigned readahead;
+
+	if (argc != 3)
+		return CMD_RET_USAGE;
+
+	max_bytes = hextoul(argv[1], NULL);
+	readahead = simple_strtoul(argv[2], 0, 0);
+	blkcache_configure_dev(max_bytes, readahead);
+	printf("changed to max of %#lx bytes per device, %u blocks read-ahead\n",
+	       max_bytes, readahead);
+	return 0;
+}
+
 static struct cmd_tbl cmd_blkc_sub[] = {
 	U_BOOT_CMD_MKENT(show, 0, 0, blkc_show, "", ""),
 	U_BOOT_CMD_MKENT(configure, 3, 0, blkc_configure, "", ""),
+	U_BOOT_CMD_MKENT(device, 3, 0, blkc_device, "", ""),
 };
 
 static int do_blkcache(struct cmd_tbl *cmdtp, int flag,
@@ -72,4 +97,6 @@ U_BOOT_CMD(
 	"show - show and reset statistics\n"
 	"blkcache configure <blocks> <entries> "
 	"- set max blocks per entry and max cache entries\n"
+	"blkcache device <bytes> <readahead> "
+	"- set max bytes cached per device (hex) and max read-ahead blocks\n"
 );
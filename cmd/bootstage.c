@@ -6,6 +6,8 @@
 #include <common.h>
 #include <bootstage.h>
 #include <command.h>
+#include <env.h>
+#include <mapmem.h>
 
 static int do_bootstage_report(struct cmd_tbl *cmdtp, int flag, int argc,
 			       char *const argv[])
@@ -59,10 +61,57 @@ static int do_bootstage_stash(struct cmd_tbl *cmdtp, int flag, int argc,
 	return 0;
 }
 
+#if CONFIG_IS_ENABLED(BOOTSTAGE_TREE)
+static int do_bootstage_tree(struct cmd_tbl *cmdtp, int flag, int argc,
+			     char *const argv[])
+{
+	bootstage_tree_report();
+
+	return 0;
+}
+
+static int do_bootstage_trace(struct cmd_tbl *cmdtp, int flag, int argc,
+			      char *const argv[])
+{
+	int size, len, ret;
+	ulong addr;
+	char *buf;
+
+	if (argc < 2) {
+		ret = bootstage_trace_to_bloblist();
+		if (ret) {
+			printf("Cannot add trace to bloblist (err=%dE)\n", ret);
+			return CMD_RET_FAILURE;
+		}
+
+		return 0;
+	}
+	if (argc < 3)
+		return CMD_RET_USAGE;
+
+	addr = hextoul(argv[1], NULL);
+	size = hextoul(argv[2], NULL);
+	buf = map_sysmem(addr, size);
+	len = bootstage_trace_export(buf, size);
+	unmap_sysmem(buf);
+	if (len >= size) {
+		printf("Trace needs %#x bytes\n", len + 1);
+		return CMD_RET_FAILURE;
+	}
+	env_set_hex("filesize", len);
+
+	return 0;
+}
+#endif
+
 static struct cmd_tbl cmd_bootstage_sub[] = {
 	U_BOOT_CMD_MKENT(report, 2, 1, do_bootstage_report, "", ""),
 	U_BOOT_CMD_MKENT(stash, 4, 0, do_bootstage_stash, "", ""),
 	U_BOOT_CMD_MKENT(unstash, 4, 0, do_bootstage_stash, "", ""),
+#if CONFIG_IS_ENABLED(BOOTSTAGE_TREE)
+	U_BOOT_CMD_MKENT(tree, 2, 1, do_bootstage_tree, "", ""),
+	U_BOOT_CMD_MKENT(trace, 4, 0, do_bootstage_trace, "", ""),
+#endif
 };
 
 /*
@@ -93,4 +142,9 @@ U_BOOT_CMD(bootstage, 4, 1, do_boostage,
 	"report                      - Print a report\n"
 	"stash [<start> [<size>]]    - Stash data into memory\n"
 	"unstash [<start> [<size>]]  - Unstash data from memory"
+#if CONFIG_IS_ENABLED(BOOTSTAGE_TREE)
+	"\ntree                        - Show initcall/device timing as a tree\n"
+	"trace [<start> <size>]      - Write Chrome trace-event JSON to memory,\n"
+	"                              or to the bloblist if no address"
+#endif
 );
@@ -43,6 +43,7 @@ static int do_dm_dump_mem(struct cmd_tbl *cmdtp, int flag, int argc,
 
 	dm_get_mem(&mem);
 	dm_dump_mem(&mem);
+	dm_dump_of_live();
 
 	return 0;
 }
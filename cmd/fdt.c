@@ -17,6 +17,7 @@
 #include <linux/libfdt.h>
 #include <fdt_support.h>
 #include <mapmem.h>
+#include <time.h>
 #include <asm/io.h>
 
 #define MAX_LEVEL	32		/* how deeply nested we will go */
@@ -750,25 +751,42 @@ static int do_fdt(struct cmd_tbl *cmdtp, int flag, int argc, char *const argv[])
 #ifdef CONFIG_OF_LIBFDT_OVERLAY
 	/* apply an overlay */
 	else if (strncmp(argv[1], "ap", 2) == 0) {
-		unsigned long addr;
+		void *blobs[CONFIG_SYS_MAXARGS];
 		struct fdt_header *blob;
-		int ret;
+		bool show_time = false;
+		ulong start;
+		int ret, i;
 
-		if (argc != 3)
+		argc -= 2;
+		argv += 2;
+		if (argc > 0 && !strcmp(*argv, "-t")) {
+			show_time = true;
+			argc--;
+			argv++;
+		}
+		if (argc < 1)
 			return CMD_RET_USAGE;
 
 		if (!working_fdt)
 			return CMD_RET_FAILURE;
 
-		addr = hextoul(argv[2], NULL);
-		blob = map_sysmem(addr, 0);
-		if (!fdt_valid(&blob))
-			return CMD_RET_FAILURE;
+		for (i = 0; i < argc; i++) {
+			blob = map_sysmem(hextoul(argv[i], NULL), 0);
+			if (!fdt_valid(&blob))
+				return CMD_RET_FAILURE;
+			blobs[i] = blob;
+		}
 
 		/* apply method prints messages on error */
-		ret = fdt_overlay_apply_verbose(working_fdt, blob);
+		start = timer_get_us();
+		ret = fdt_overlay_apply_list(working_fdt,
+					     fdt_totalsize(working_fdt), blobs,
+					     argc);
 		if (ret)
 			return CMD_RET_FAILURE;
+		if (show_time)
+			printf("Applied %d overlay%s in %lu us\n", argc,
+			       argc > 1 ? "s" : "", timer_get_us() - start);
 	}
 #endif
 	/* resize the fdt */
@@ -1116,7 +1134,8 @@ static int fdt_print(const char *pathp, char *prop, int depth)
 U_BOOT_LONGHELP(fdt,
 	"addr [-c] [-q] <addr> [<size>]  - Set the [control] fdt location to <addr>\n"
 #ifdef CONFIG_OF_LIBFDT_OVERLAY
-	"fdt apply <addr>                    - Apply overlay to the DT\n"
+	"fdt apply [-t] <addr> [<addr>...]   - Apply overlays to the DT\n"
+	"                                      (-t: show the time taken)\n"
 #endif
 #ifdef CONFIG_OF_BOARD_SETUP
 	"fdt boardsetup                      - Do board-specific set up\n"
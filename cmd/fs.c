@@ -41,6 +41,25 @@ U_BOOT_CMD(
 	"      If 'pos' is 0 or omitted, the file is read from the start."
 )
 
+#if IS_ENABLED(CONFIG_CMD_LOADZ)
+static int do_loadz_wrapper(struct cmd_tbl *cmdtp, int flag, int argc,
+			    char *const argv[])
+{
+	return do_loadz(cmdtp, flag, argc, argv, FS_TYPE_ANY);
+}
+
+U_BOOT_CMD(
+	loadz,	6,	0,	do_loadz_wrapper,
+	"load and decompress a file from a filesystem",
+	"<interface> <dev[:part]> <addr> <filename> [max_bytes]\n"
+	"    - Load file 'filename' from partition 'part' on device type\n"
+	"      'interface' instance 'dev', decompressing it to address 'addr'\n"
+	"      as it is read. gzip and zstd files are supported; other files\n"
+	"      are loaded as they are.\n"
+	"      'max_bytes' limits the size of the uncompressed data."
+);
+#endif
+
 static int do_save_wrapper(struct cmd_tbl *cmdtp, int flag, int argc,
 			   char *const argv[])
 {
@@ -22,8 +22,11 @@
 #include <net/udp.h>
 #include <net/sntp.h>
 #include <net/ncsi.h>
+#include <net/neigh.h>
+#include <net/wget.h>
 
 static int netboot_common(enum proto_t, struct cmd_tbl *, int, char * const []);
+static void netboot_update_env(void);
 
 #ifdef CONFIG_CMD_BOOTP
 static int do_bootp(struct cmd_tbl *cmdtp, int flag, int argc,
@@ -196,15 +199,71 @@ U_BOOT_CMD(
 #endif
 
 #if defined(CONFIG_CMD_WGET)
+#if IS_ENABLED(CONFIG_WGET_STORAGE)
+/* Download straight to a block device or MTD partition, not to memory */
+static int do_wget_storage(int argc, char *const argv[])
+{
+	int ret, skip;
+
+	if (!strcmp(argv[1], "-b") && argc >= 4)
+		skip = 4;
+	else if (!strcmp(argv[1], "-m") && argc >= 3)
+		skip = 3;
+	else
+		return CMD_RET_USAGE;
+	if (argc > skip + 1)
+		return CMD_RET_USAGE;
+
+	if (skip == 4)
+		ret = wget_set_blk(argv[2], argv[3]);
+	else
+		ret = wget_set_mtd(argv[2]);
+	if (ret) {
+		printf("Cannot write to %s (err=%d)\n", argv[2], ret);
+		return CMD_RET_FAILURE;
+	}
+
+	if (argc > skip) {
+		net_boot_file_name_explicit = true;
+		copy_filename(net_boot_file_name, argv[skip],
+			      sizeof(net_boot_file_name));
+	} else {
+		net_boot_file_name_explicit = false;
+		copy_filename(net_boot_file_name, env_get("bootfile"),
+			      sizeof(net_boot_file_name));
+	}
+
+	ret = net_loop(WGET);
+	wget_clear_storage();
+	if (ret < 0)
+		return CMD_RET_FAILURE;
+
+	netboot_update_env();
+
+	return CMD_RET_SUCCESS;
+}
+#endif
+
 static int do_wget(struct cmd_tbl *cmdtp, int flag, int argc, char * const argv[])
 {
+#if IS_ENABLED(CONFIG_WGET_STORAGE)
+	if (argc > 1 && *argv[1] == '-')
+		return do_wget_storage(argc, argv);
+#endif
+
 	return netboot_common(WGET, cmdtp, argc, argv);
 }
 
 U_BOOT_CMD(
-	wget,   3,      1,      do_wget,
+	wget,   5,      1,      do_wget,
 	"boot image via network using HTTP protocol",
 	"[loadAddress] [[hostIPaddr:]path and image name]"
+#if IS_ENABLED(CONFIG_WGET_STORAGE)
+	"\nwget -b <interface> <dev[:part]> [[hostIPaddr:]path]\n"
+	"    - write the file to a block device or partition\n"
+	"wget -m <mtd-partition> [[hostIPaddr:]path]\n"
+	"    - write the file to an MTD device or partition"
+#endif
 );
 #endif
 
@@ -509,6 +568,34 @@ U_BOOT_CMD(
 );
 #endif /* CONFIG_CMD_PING6 */
 
+#if defined(CONFIG_CMD_NEIGH)
+static int do_neigh(struct cmd_tbl *cmdtp, int flag, int argc,
+		    char *const argv[])
+{
+	if (argc > 2)
+		return CMD_RET_USAGE;
+
+	if (argc == 2) {
+		if (strcmp(argv[1], "flush"))
+			return CMD_RET_USAGE;
+		neigh_flush();
+		return CMD_RET_SUCCESS;
+	}
+
+	if (!neigh_show())
+		printf("No neighbours\n");
+
+	return CMD_RET_SUCCESS;
+}
+
+U_BOOT_CMD(
+	neigh,	2,	1,	do_neigh,
+	"show or flush the ARP/IPv6 neighbour cache",
+	"       - show the cached neighbours\n"
+	"neigh flush - remove all cached neighbours"
+);
+#endif
+
 #if defined(CONFIG_CMD_CDP)
 
 static void cdp_update_env(void)
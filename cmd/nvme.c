@@ -7,11 +7,36 @@
 #include <common.h>
 #include <blk.h>
 #include <command.h>
+#include <div64.h>
 #include <dm.h>
 #include <nvme.h>
+#include <time.h>
 
 static int nvme_curr_dev;
 
+/* Run a read or write and report the throughput achieved */
+static int nvme_timed_rw(int argc, char *const argv[])
+{
+	struct blk_desc *desc;
+	ulong start, us;
+	u64 bytes;
+	int ret;
+
+	desc = blk_get_devnum_by_uclass_id(UCLASS_NVME, nvme_curr_dev);
+	start = timer_get_us();
+	ret = blk_common_cmd(argc, argv, UCLASS_NVME, &nvme_curr_dev);
+	us = max(timer_get_us() - start, 1UL);
+	if (ret || !desc)
+		return ret;
+
+	bytes = (u64)hextoul(argv[4], NULL) * desc->blksz;
+	/* bytes per microsecond is MB/s */
+	printf("%llu bytes in %lu us: %llu.%02llu MB/s\n", bytes, us,
+	       lldiv(bytes, us), lldiv(bytes * 100, us) % 100);
+
+	return 0;
+}
+
 static int do_nvme(struct cmd_tbl *cmdtp, int flag, int argc,
 		   char *const argv[])
 {
@@ -39,6 +64,10 @@ static int do_nvme(struct cmd_tbl *cmdtp, int flag, int argc,
 		}
 	}
 
+	if (argc == 5 && (!strcmp(argv[1], "read") ||
+			  !strcmp(argv[1], "write")))
+		return nvme_timed_rw(argc, argv);
+
 	return blk_common_cmd(argc, argv, UCLASS_NVME, &nvme_curr_dev);
 }
 
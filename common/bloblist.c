@@ -53,6 +53,9 @@ static struct tag_name {
 	{ BLOBLISTT_U_BOOT_SPL_HANDOFF, "SPL hand-off" },
 	{ BLOBLISTT_VBE, "VBE" },
 	{ BLOBLISTT_U_BOOT_VIDEO, "SPL video handoff" },
+	{ BLOBLISTT_U_BOOT_BOOT_TRACE, "Boot-time trace" },
+	{ BLOBLISTT_U_BOOT_DM_PLAN_F, "DM probe plan (pre-reloc)" },
+	{ BLOBLISTT_U_BOOT_DM_PLAN_R, "DM probe plan" },
 
 	/* BLOBLISTT_VENDOR_AREA */
 };
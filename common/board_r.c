@@ -233,6 +233,11 @@ static int initr_dm(void)
 	/* Save the pre-reloc driver model and start a new one */
 	gd->dm_root_f = gd->dm_root;
 	gd->dm_root = NULL;
+	/*
+	 * The compatible index was allocated from the pre-reloc heap, or not
+	 * built for lack of space there
+	 */
+	gd_set_dm_compat_index(NULL);
 #ifdef CONFIG_TIMER
 	gd->timer = NULL;
 #endif
@@ -274,7 +279,8 @@ static int initr_bootstage(void)
 {
 	bootstage_mark_name(BOOTSTAGE_ID_START_UBOOT_R, "board_init_r");
 
-	return 0;
+	/* The pre-relocation heap is not available for much longer */
+	return bootstage_span_relocate();
 }
 
 __weak int power_init_board(void)
@@ -12,12 +12,14 @@
 #define LOG_CATEGORY	LOGC_BOOT
 
 #include <common.h>
+#include <bloblist.h>
 #include <bootstage.h>
 #include <hang.h>
 #include <log.h>
 #include <malloc.h>
 #include <sort.h>
 #include <spl.h>
+#include <stdarg.h>
 #include <asm/global_data.h>
 #include <linux/compiler.h>
 #include <linux/libfdt.h>
@@ -36,10 +38,51 @@ struct bootstage_record {
 	enum bootstage_id id;
 };
 
+enum {
+	SPAN_NONE	= 0xffff,	/* Parent of a top-level span */
+	SPAN_NAME_LEN	= 16,
+};
+
+/* Flags for each bootstage span */
+enum bootstage_span_flags {
+	BOOTSTAGE_SPANF_OPEN	= 1 << 0,	/* Span has not ended yet */
+};
+
+/**
+ * struct bootstage_span - Time taken by an activity in the bootstage tree
+ *
+ * @start_us: Time the activity started
+ * @time_us: Time the activity took, or 0 if it has not ended
+ * @parent: Span which was open when this one started, or SPAN_NONE
+ * @type: Type of activity (enum bootstage_span_t)
+ * @flags: Flags (enum bootstage_span_flags)
+ * @name: Name of the activity, truncated if needed
+ * @addr: Address of the initcall function, if @type is
+ *	BOOTSTAGE_SPAN_INITCALL
+ */
+struct bootstage_span {
+	u32 start_us;
+	u32 time_us;
+	u16 parent;
+	u8 type;
+	u8 flags;
+	union {
+		char name[SPAN_NAME_LEN];
+		ulong addr;
+	};
+};
+
 struct bootstage_data {
 	uint rec_count;
 	uint next_id;
 	struct bootstage_record record[RECORD_COUNT];
+#if CONFIG_IS_ENABLED(BOOTSTAGE_TREE)
+	struct bootstage_span *span;	/* Table of spans, in start order */
+	uint span_count;		/* Number of spans in use */
+	uint span_max;			/* Number of spans in the table */
+	uint span_dropped;		/* Number of spans with no space */
+	uint span_cur;			/* Innermost open span, or SPAN_NONE */
+#endif
 };
 
 enum {
@@ -359,6 +402,299 @@ void bootstage_report(void)
 	}
 }
 
+#if CONFIG_IS_ENABLED(BOOTSTAGE_TREE)
+static const char *const span_type_name[BOOTSTAGE_SPAN_COUNT] = {
+	[BOOTSTAGE_SPAN_INITCALL]	= "initcall",
+	[BOOTSTAGE_SPAN_EVENT]		= "event",
+	[BOOTSTAGE_SPAN_BIND]		= "bind",
+	[BOOTSTAGE_SPAN_PROBE]		= "probe",
+};
+
+int bootstage_span_start(enum bootstage_span_t type, const char *name,
+			 ulong addr)
+{
+	struct bootstage_data *data = gd->bootstage;
+	struct bootstage_span *span;
+	uint idx;
+
+	if (!data)
+		return -ENOENT;
+	if (data->span_count >= data->span_max) {
+		data->span_dropped++;
+		return -ENOSPC;
+	}
+
+	idx = data->span_count++;
+	span = &data->span[idx];
+	span->time_us = 0;
+	span->parent = data->span_cur;
+	span->type = type;
+	span->flags = BOOTSTAGE_SPANF_OPEN;
+	if (type == BOOTSTAGE_SPAN_INITCALL)
+		span->addr = addr;
+	else
+		strlcpy(span->name, name ? name : "", sizeof(span->name));
+	data->span_cur = idx;
+
+	/* Read the timer last, so the time above is not counted */
+	span->start_us = timer_get_boot_us();
+
+	return idx;
+}
+
+void bootstage_span_end(int idx)
+{
+	struct bootstage_data *data = gd->bootstage;
+	struct bootstage_span *span;
+
+	if (idx < 0 || !data || idx >= data->span_count)
+		return;
+	span = &data->span[idx];
+	span->time_us = (u32)timer_get_boot_us() - span->start_us;
+	span->flags &= ~BOOTSTAGE_SPANF_OPEN;
+	data->span_cur = span->parent;
+}
+
+int bootstage_span_relocate(void)
+{
+	struct bootstage_data *data = gd->bootstage;
+	struct bootstage_span *span;
+
+	if (!data || data->span_max >= CONFIG_BOOTSTAGE_TREE_COUNT)
+		return 0;
+
+	/* The old table was in the pre-relocation heap, so is not freed */
+	span = calloc(CONFIG_BOOTSTAGE_TREE_COUNT, sizeof(*span));
+	if (!span)
+		return log_msg_ret("spn", -ENOMEM);
+	memcpy(span, data->span, data->span_count * sizeof(*span));
+	data->span = span;
+	data->span_max = CONFIG_BOOTSTAGE_TREE_COUNT;
+
+	return 0;
+}
+
+/* Get the time taken by a span, so far if it has not ended yet */
+static u32 span_time(const struct bootstage_span *span, u32 now)
+{
+	if (span->flags & BOOTSTAGE_SPANF_OPEN)
+		return now - span->start_us;
+
+	return span->time_us;
+}
+
+static const char *get_span_name(char *buf, int len,
+				 const struct bootstage_span *span)
+{
+	if (span->type == BOOTSTAGE_SPAN_INITCALL) {
+		snprintf(buf, len, "initcall %#lx", span->addr);
+		return buf;
+	}
+
+	return span->name;
+}
+
+/**
+ * struct span_order - Self time of a span, for sorting
+ *
+ * @self_us: Time taken by the span less the time taken by its children
+ * @idx: Index of the span in the table
+ */
+struct span_order {
+	u32 self_us;
+	uint idx;
+};
+
+static int h_compare_span(const void *o1, const void *o2)
+{
+	const struct span_order *ord1 = o1, *ord2 = o2;
+
+	if (ord1->self_us == ord2->self_us)
+		return ord1->idx > ord2->idx ? 1 : -1;
+
+	return ord1->self_us < ord2->self_us ? 1 : -1;
+}
+
+static void show_span_tree(const struct bootstage_data *data,
+			   const struct span_order *order, uint parent,
+			   int depth, u32 now)
+{
+	char buf[30];
+	int i;
+
+	for (i = 0; i < data->span_count; i++) {
+		const struct span_order *ord = &order[i];
+		const struct bootstage_span *span = &data->span[ord->idx];
+
+		if (span->parent != parent)
+			continue;
+		print_grouped_ull(span->start_us, BOOTSTAGE_DIGITS);
+		print_grouped_ull(span_time(span, now), BOOTSTAGE_DIGITS);
+		print_grouped_ull(ord->self_us, BOOTSTAGE_DIGITS);
+		printf("  %-9s%*s%s\n", span_type_name[span->type], depth * 2,
+		       "", get_span_name(buf, sizeof(buf), span));
+		show_span_tree(data, order, ord->idx, depth + 1, now);
+	}
+}
+
+void bootstage_tree_report(void)
+{
+	struct bootstage_data *data = gd->bootstage;
+	u32 now = timer_get_boot_us();
+	struct span_order *order;
+	int i;
+
+	printf("Boot-time tree in microseconds (%d spans):\n",
+	       data->span_count);
+	if (!data->span_count)
+		return;
+	order = calloc(data->span_count, sizeof(*order));
+	if (!order) {
+		printf("Out of memory\n");
+		return;
+	}
+
+	/* Work out the self time, using the unsorted order */
+	for (i = 0; i < data->span_count; i++) {
+		order[i].idx = i;
+		order[i].self_us = span_time(&data->span[i], now);
+	}
+	for (i = 0; i < data->span_count; i++) {
+		const struct bootstage_span *span = &data->span[i];
+		struct span_order *ord;
+
+		if (span->parent == SPAN_NONE)
+			continue;
+		ord = &order[span->parent];
+		ord->self_us -= min(ord->self_us, span_time(span, now));
+	}
+	qsort(order, data->span_count, sizeof(*order), h_compare_span);
+
+	printf("%11s%11s%11s  %-9s%s\n", "Start", "Total", "Self", "Type",
+	       "Name");
+	show_span_tree(data, order, SPAN_NONE, 0, now);
+	free(order);
+
+	if (data->span_dropped)
+		printf("Dropped %d spans: please increase CONFIG_BOOTSTAGE_TREE_COUNT\n",
+		       data->span_dropped);
+}
+
+/**
+ * struct trace_out - Output buffer for the trace-event export
+ *
+ * @buf: Buffer to write to, or NULL to just count the bytes
+ * @size: Size of @buf
+ * @len: Number of bytes needed so far, which may be more than @size
+ */
+struct trace_out {
+	char *buf;
+	int size;
+	int len;
+};
+
+static __printf(2, 3) void trace_add(struct trace_out *out,
+				     const char *fmt, ...)
+{
+	int space = 0;
+	va_list args;
+
+	if (out->buf && out->len < out->size)
+		space = out->size - out->len;
+	va_start(args, fmt);
+	out->len += vsnprintf(space ? out->buf + out->len : NULL, space, fmt,
+			      args);
+	va_end(args);
+}
+
+static void trace_add_event(struct trace_out *out, bool *first,
+			    const char *name, const char *cat)
+{
+	trace_add(out, "%s\n{\"name\":\"%s\",\"cat\":\"%s\",\"pid\":1,\"tid\":1,",
+		  *first ? "" : ",", name, cat);
+	*first = false;
+}
+
+int bootstage_trace_export(char *buf, int size)
+{
+	struct bootstage_data *data = gd->bootstage;
+	u32 now = timer_get_boot_us();
+	struct trace_out out;
+	bool first = true;
+	char str[30];
+	int i;
+
+	out.buf = buf;
+	out.size = size;
+	out.len = 0;
+	if (buf && size)
+		*buf = '\0';
+	trace_add(&out, "{\"traceEvents\":[");
+
+	for (i = 0; i < data->rec_count; i++) {
+		const struct bootstage_record *rec = &data->record[i];
+
+		/* Skip accumulated times, which have no single point in time */
+		if (rec->start_us)
+			continue;
+		trace_add_event(&out, &first,
+				get_record_name(str, sizeof(str), rec), "mark");
+		trace_add(&out, "\"ph\":\"i\",\"s\":\"g\",\"ts\":%lu}",
+			  rec->time_us);
+	}
+
+	for (i = 0; i < data->span_count; i++) {
+		const struct bootstage_span *span = &data->span[i];
+
+		trace_add_event(&out, &first,
+				get_span_name(str, sizeof(str), span),
+				span_type_name[span->type]);
+		trace_add(&out, "\"ph\":\"X\",\"ts\":%u,\"dur\":%u}",
+			  span->start_us, span_time(span, now));
+	}
+	trace_add(&out, "\n],\n\"displayTimeUnit\":\"ms\",");
+	trace_add(&out, "\"otherData\":{\"dropped_spans\":%u}}\n",
+		  data->span_dropped);
+
+	return out.len;
+}
+
+int bootstage_trace_to_bloblist(void)
+{
+	void *blob;
+	int size;
+	int ret;
+
+	if (!CONFIG_IS_ENABLED(BLOBLIST))
+		return -ENOSYS;
+
+	/* Allow for the trace getting a little longer while we add it */
+	size = bootstage_trace_export(NULL, 0) + 0x100;
+	blob = bloblist_find(BLOBLISTT_U_BOOT_BOOT_TRACE, 0);
+	if (blob) {
+		ret = bloblist_resize(BLOBLISTT_U_BOOT_BOOT_TRACE, size);
+		if (ret)
+			return log_msg_ret("res", ret);
+		blob = bloblist_find(BLOBLISTT_U_BOOT_BOOT_TRACE, size);
+	} else {
+		blob = bloblist_add(BLOBLISTT_U_BOOT_BOOT_TRACE, size, 0);
+	}
+	if (!blob)
+		return log_msg_ret("add", -ENOSPC);
+	if (bootstage_trace_export(blob, size) >= size)
+		return log_msg_ret("exp", -ENOSPC);
+
+	return 0;
+}
+
+static void bootstage_span_init(struct bootstage_data *data, uint span_max)
+{
+	data->span = (struct bootstage_span *)(data + 1);
+	data->span_max = span_max;
+	data->span_cur = SPAN_NONE;
+}
+#endif /* BOOTSTAGE_TREE */
+
 /**
  * Append data to a memory buffer
  *
@@ -535,12 +871,22 @@ int bootstage_init(bool first)
 {
 	struct bootstage_data *data;
 	int size = sizeof(struct bootstage_data);
+#if CONFIG_IS_ENABLED(BOOTSTAGE_TREE)
+	uint span_max = gd->flags & GD_FLG_RELOC ?
+		CONFIG_BOOTSTAGE_TREE_COUNT : CONFIG_BOOTSTAGE_TREE_COUNT_F;
+
+	/* The spans follow the data, until bootstage_span_relocate() */
+	size += span_max * sizeof(struct bootstage_span);
+#endif
 
 	gd->bootstage = (struct bootstage_data *)malloc(size);
 	if (!gd->bootstage)
 		return -ENOMEM;
 	data = gd->bootstage;
 	memset(data, '\0', size);
+#if CONFIG_IS_ENABLED(BOOTSTAGE_TREE)
+	bootstage_span_init(data, span_max);
+#endif
 	if (first) {
 		data->next_id = BOOTSTAGE_ID_USER;
 		bootstage_add_record(BOOTSTAGE_ID_AWAKE, "reset", 0, 0);
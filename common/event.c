@@ -15,6 +15,7 @@
 #include <log.h>
 #include <linker_lists.h>
 #include <malloc.h>
+#include <time.h>
 #include <asm/global_data.h>
 #include <linux/list.h>
 #include <relocate.h>
@@ -62,14 +63,65 @@ const char *event_type_name(enum event_t type)
 #endif
 }
 
-static int notify_static(struct event *ev)
+/**
+ * event_index() - Find the static spies for each event type
+ *
+ * The linker sorts the spies by name and each name starts with the event type,
+ * so the spies for each type are adjacent. Record where they are, so that an
+ * event only has to look at its own spies.
+ *
+ * @state: Event state to update
+ */
+static void event_index(struct event_state *state)
 {
 	struct evspy_info *start =
 		ll_entry_start(struct evspy_info, evspy_info);
 	const int n_ents = ll_entry_count(struct evspy_info, evspy_info);
+	int i;
+
+	for (i = 0; i < n_ents; i++) {
+		struct event_type_info *info;
+
+		if (start[i].type >= EVT_COUNT)
+			continue;
+		info = &state->type[start[i].type];
+		if (!info->end)
+			info->first = i;
+		info->end = i + 1;
+	}
+	state->indexed = true;
+}
+
+/**
+ * event_time_us() - Read the time for event statistics
+ *
+ * The timer may not be ready before relocation, and starting it may itself
+ * send events (e.g. when probing a timer device), so those are not timed.
+ *
+ * @state: Event state
+ * Return: time in microseconds, or 0 if not available
+ */
+static ulong event_time_us(struct event_state *state)
+{
+	ulong now;
+
+	if (state->timing || !(gd->flags & GD_FLG_RELOC))
+		return 0;
+	state->timing = true;
+	now = timer_get_us();
+	state->timing = false;
+
+	return now;
+}
+
+static int notify_static(struct event_state *state, struct event *ev)
+{
+	struct evspy_info *start =
+		ll_entry_start(struct evspy_info, evspy_info);
+	struct event_type_info *info = &state->type[ev->type];
 	struct evspy_info *spy;
 
-	for (spy = start; spy != start + n_ents; spy++) {
+	for (spy = start + info->first; spy < start + info->end; spy++) {
 		if (spy->type == ev->type) {
 			int ret;
 
@@ -127,25 +179,40 @@ static int notify_dynamic(struct event *ev)
 
 int event_notify(enum event_t type, void *data, int size)
 {
+	struct event_state *state = gd_event_state();
+	struct event_type_info *info;
 	struct event event;
+	ulong start = 0;
 	int ret;
 
 	event.type = type;
+	if (type >= EVT_COUNT)
+		return log_msg_ret("type", -EINVAL);
 	if (size > sizeof(event.data))
 		return log_msg_ret("size", -E2BIG);
 	memcpy(&event.data, data, size);
 
-	ret = notify_static(&event);
-	if (ret)
-		return log_msg_ret("sta", ret);
+	if (!state->indexed)
+		event_index(state);
+	info = &state->type[type];
+	if (CONFIG_IS_ENABLED(EVENT_DEBUG)) {
+		info->count++;
+		start = event_time_us(state);
+	}
 
-	if (CONFIG_IS_ENABLED(EVENT_DYNAMIC)) {
+	ret = notify_static(state, &event);
+	if (ret) {
+		ret = log_msg_ret("sta", ret);
+	} else if (CONFIG_IS_ENABLED(EVENT_DYNAMIC) && info->dynamic) {
 		ret = notify_dynamic(&event);
 		if (ret)
-			return log_msg_ret("dyn", ret);
+			ret = log_msg_ret("dyn", ret);
 	}
 
-	return 0;
+	if (CONFIG_IS_ENABLED(EVENT_DEBUG) && start)
+		info->time_us += event_time_us(state) - start;
+
+	return ret;
 }
 
 int event_notify_null(enum event_t type)
@@ -158,8 +225,10 @@ void event_show_spy_list(void)
 	struct evspy_info *start =
 		ll_entry_start(struct evspy_info, evspy_info);
 	const int n_ents = ll_entry_count(struct evspy_info, evspy_info);
+	struct event_state *state = gd_event_state();
 	struct evspy_info *spy;
 	const int size = sizeof(ulong) * 2;
+	int type;
 
 	printf("Seq  %-24s  %*s  %s\n", "Type", size, "Function", "ID");
 	for (spy = start; spy != start + n_ents; spy++) {
@@ -167,11 +236,33 @@ void event_show_spy_list(void)
 		       spy->type, event_type_name(spy->type), size, spy->func,
 		       event_spy_id(spy));
 	}
+
+	if (!CONFIG_IS_ENABLED(EVENT_DEBUG))
+		return;
+	if (!state->indexed)
+		event_index(state);
+	printf("\n%-24s  %6s  %7s  %8s  %10s\n", "Type", "Static", "Dynamic",
+	       "Count", "Time(us)");
+	for (type = 0; type < EVT_COUNT; type++) {
+		struct event_type_info *info = &state->type[type];
+		int nstatic = 0;
+
+		for (spy = start + info->first; spy < start + info->end; spy++)
+			nstatic += spy->type == type;
+		if (!nstatic && !info->dynamic && !info->count)
+			continue;
+		printf("%-3x %-20s  %6x  %7x  %8x  %10lu\n", type,
+		       event_type_name(type), nstatic, info->dynamic,
+		       info->count, info->time_us);
+	}
 }
 
 #if CONFIG_IS_ENABLED(EVENT_DYNAMIC)
 static void spy_free(struct event_spy *spy)
 {
+	struct event_state *state = gd_event_state();
+
+	state->type[spy->type].dynamic--;
 	list_del(&spy->sibling_node);
 }
 
@@ -180,6 +271,8 @@ int event_register(const char *id, enum event_t type, event_handler_t func, void
 	struct event_state *state = gd_event_state();
 	struct event_spy *spy;
 
+	if (type >= EVT_COUNT)
+		return log_msg_ret("type", -EINVAL);
 	spy = malloc(sizeof(*spy));
 	if (!spy)
 		return log_msg_ret("alloc", -ENOMEM);
@@ -189,6 +282,7 @@ int event_register(const char *id, enum event_t type, event_handler_t func, void
 	spy->func = func;
 	spy->ctx = ctx;
 	list_add_tail(&spy->sibling_node, &state->spy_head);
+	state->type[type].dynamic++;
 
 	return 0;
 }
@@ -207,8 +301,11 @@ int event_uninit(void)
 int event_init(void)
 {
 	struct event_state *state = gd_event_state();
+	int type;
 
 	INIT_LIST_HEAD(&state->spy_head);
+	for (type = 0; type < EVT_COUNT; type++)
+		state->type[type].dynamic = 0;
 
 	return 0;
 }
@@ -208,6 +208,45 @@ static int get_aligned_image_size(struct spl_load_info *info, int data_size,
 	return (data_size + info->bl_len - 1) / info->bl_len;
 }
 
+/**
+ * read_hashed() - read external image data, hashing it as it arrives
+ *
+ * The data is read in chunks, each being added to the image hashes as soon
+ * as it is in memory, so that there is no second pass over the whole image.
+ *
+ * @info:	points to information about the device to load data from
+ * @sector:	first sector (or byte offset for a filesystem) to read
+ * @count:	number of sectors (or bytes) to read
+ * @buf:	buffer to read into
+ * @overhead:	offset of the image data in the first sector
+ * @length:	length of the image data
+ * @hs:		hash state to update
+ * Return: 0 if OK, -EIO on read or hash error
+ */
+static int read_hashed(struct spl_load_info *info, ulong sector, ulong count,
+		       void *buf, ulong overhead, ulong length,
+		       struct fit_hash_stream *hs)
+{
+	ulong unit = info->filename ? 1 : info->bl_len;
+	ulong chunk = max(FIT_STREAM_CHUNK_SIZE / unit, 1UL);
+	ulong done, hashed = 0, avail, todo;
+
+	for (done = 0; done < count; done += todo) {
+		todo = min(count - done, chunk);
+		if (info->read(info, sector + done, todo,
+			       buf + done * unit) != todo)
+			return -EIO;
+
+		avail = min((done + todo) * unit - overhead, length);
+		if (fit_image_hash_update(hs, buf + overhead + hashed,
+					  avail - hashed))
+			return -EIO;
+		hashed = avail;
+	}
+
+	return 0;
+}
+
 /**
  * load_simple_fit(): load the image described in a certain FIT node
  * @info:	points to information about the device to load data from
@@ -239,6 +278,9 @@ static int load_simple_fit(struct spl_load_info *info, ulong sector,
 	const void *data;
 	const void *fit = ctx->fit;
 	bool external_data = false;
+	struct fit_hash_stream hs;
+	bool stream = false;
+	int ret;
 
 	if (IS_ENABLED(CONFIG_SPL_FPGA) ||
 	    (IS_ENABLED(CONFIG_SPL_OS_BOOT) && spl_decompression_enabled())) {
@@ -293,10 +335,21 @@ static int load_simple_fit(struct spl_load_info *info, ulong sector,
 		overhead = get_aligned_image_overhead(info, offset);
 		nr_sectors = get_aligned_image_size(info, length, offset);
 
-		if (info->read(info,
-			       sector + get_aligned_image_offset(info, offset),
-			       nr_sectors, src_ptr) != nr_sectors)
+		if (CONFIG_IS_ENABLED(FIT_STREAM_VERIFY))
+			stream = !fit_image_hash_start(fit, node, &hs);
+		if (stream) {
+			if (read_hashed(info,
+					sector + get_aligned_image_offset(info, offset),
+					nr_sectors, src_ptr, overhead, length,
+					&hs)) {
+				ret = -EIO;
+				goto err_stream;
+			}
+		} else if (info->read(info,
+				      sector + get_aligned_image_offset(info, offset),
+				      nr_sectors, src_ptr) != nr_sectors) {
 			return -EIO;
+		}
 
 		debug("External data: dst=%p, offset=%x, size=%lx\n",
 		      src_ptr, offset, (unsigned long)length);
@@ -315,9 +368,14 @@ static int load_simple_fit(struct spl_load_info *info, ulong sector,
 	if (CONFIG_IS_ENABLED(FIT_SIGNATURE)) {
 		printf("## Checking hash(es) for Image %s ... ",
 		       fit_get_name(fit, node, NULL));
-		if (!fit_image_verify_with_data(fit, node, gd_fdt_blob(), src,
-						length))
+		if (stream) {
+			if (!fit_image_verify_stream(fit, node, gd_fdt_blob(),
+						     &hs))
+				return -EPERM;
+		} else if (!fit_image_verify_with_data(fit, node, gd_fdt_blob(),
+						       src, length)) {
 			return -EPERM;
+		}
 		puts("OK\n");
 	}
 
@@ -359,6 +417,12 @@ static int load_simple_fit(struct spl_load_info *info, ulong sector,
 	}
 
 	return 0;
+
+err_stream:
+	/* Finish the hashes so that their contexts are freed */
+	fit_image_hash_abort(&hs);
+
+	return ret;
 }
 
 static bool os_takes_devicetree(uint8_t os)
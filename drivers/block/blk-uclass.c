@@ -15,6 +15,7 @@
 #include <dm/device-internal.h>
 #include <dm/lists.h>
 #include <dm/uclass-internal.h>
+#include <asm/cache.h>
 #include <linux/err.h>
 
 #define blk_get_ops(dev)	((struct blk_ops *)(dev)->driver->ops)
@@ -428,11 +429,180 @@ static int blk_buffer_aligned(struct bounce_buffer *state)
 	return 1;	/* Default, any buffer is OK */
 }
 
+/**
+ * blk_range_aligned() - check whether a driver can use part of a buffer as is
+ *
+ * @dev: Block device
+ * @buf: Start of the range within the caller's buffer
+ * @blkcnt: Number of blocks in the range
+ * Return: true if the range can be passed to the driver without bouncing
+ */
+static bool blk_range_aligned(struct udevice *dev, void *buf, lbaint_t blkcnt)
+{
+	struct blk_desc *desc = dev_get_uclass_plat(dev);
+	struct blk_bounce_buffer bbstate = { .dev = dev };
+
+	bbstate.state.user_buffer = buf;
+	bbstate.state.bounce_buffer = buf;
+	bbstate.state.len = blkcnt * desc->blksz;
+	bbstate.state.len_aligned = bbstate.state.len;
+
+	return blk_buffer_aligned(&bbstate.state);
+}
+
+static ulong blk_xfer_direct(struct udevice *dev, lbaint_t start,
+			     lbaint_t blkcnt, void *buf, bool write)
+{
+	const struct blk_ops *ops = blk_get_ops(dev);
+
+	if (write)
+		return ops->write(dev, start, blkcnt, buf);
+
+	return ops->read(dev, start, blkcnt, buf);
+}
+
+static ulong blk_xfer_bounce(struct udevice *dev, lbaint_t start,
+			     lbaint_t blkcnt, void *buf, bool write)
+{
+	struct blk_desc *desc = dev_get_uclass_plat(dev);
+	struct blk_bounce_buffer bbstate = { .dev = dev };
+	ulong blks;
+	int ret;
+
+	ret = bounce_buffer_start_extalign(&bbstate.state, buf,
+					   blkcnt * desc->blksz,
+					   write ? GEN_BB_READ : GEN_BB_WRITE,
+					   desc->blksz, blk_buffer_aligned);
+	if (ret)
+		return ret;
+
+	blks = blk_xfer_direct(dev, start, blkcnt, bbstate.state.bounce_buffer,
+			       write);
+
+	bounce_buffer_stop(&bbstate.state);
+
+	return blks;
+}
+
+/**
+ * blk_xfer_dev() - transfer blocks, bouncing only what the driver cannot use
+ *
+ * When the driver rejects the caller's buffer, the blocks at either end which
+ * it rejects are bounced on their own and the rest of the buffer is handed to
+ * the driver as is, so that a buffer which is only unsuitable at its head or
+ * tail is not copied as a whole. If the middle is still rejected, or the
+ * buffer does not start at the alignment from blk_get_buffer_align(), the whole
+ * transfer is bounced in one go.
+ *
+ * @dev: Block device
+ * @start: First block to transfer
+ * @blkcnt: Number of blocks to transfer
+ * @buf: Caller's buffer
+ * @write: true to write @buf to the device, false to read into it
+ * Return: number of blocks transferred, or -ve on error
+ */
+static ulong blk_xfer_dev(struct udevice *dev, lbaint_t start, lbaint_t blkcnt,
+			  void *buf, bool write)
+{
+	struct blk_desc *desc = dev_get_uclass_plat(dev);
+	lbaint_t head, tail;
+	ulong blks;
+
+	if (!IS_ENABLED(CONFIG_BOUNCE_BUFFER) || !desc->bb ||
+	    blk_range_aligned(dev, buf, blkcnt))
+		return blk_xfer_direct(dev, start, blkcnt, buf, write);
+
+	/*
+	 * Every block of a buffer with a misaligned start is misaligned too, so
+	 * bounce the whole transfer at once instead of checking block by block
+	 */
+	if (!IS_ALIGNED((ulong)buf, blk_get_buffer_align(desc)))
+		return blk_xfer_bounce(dev, start, blkcnt, buf, write);
+
+	for (head = 0; head < blkcnt; head++) {
+		if (blk_range_aligned(dev, buf + head * desc->blksz, 1))
+			break;
+	}
+	for (tail = blkcnt; tail > head; tail--) {
+		if (blk_range_aligned(dev, buf + (tail - 1) * desc->blksz, 1))
+			break;
+	}
+
+	if (head == tail ||
+	    !blk_range_aligned(dev, buf + head * desc->blksz, tail - head))
+		return blk_xfer_bounce(dev, start, blkcnt, buf, write);
+
+	/*
+	 * A short transfer or an error (which is larger than any block count
+	 * once converted to ulong) ends the request early
+	 */
+	if (head) {
+		blks = blk_xfer_bounce(dev, start, head, buf, write);
+		if (blks != head)
+			return blks;
+	}
+
+	blks = blk_xfer_direct(dev, start + head, tail - head,
+			       buf + head * desc->blksz, write);
+	if (blks != tail - head)
+		return blks > tail - head ? blks : head + blks;
+
+	if (tail < blkcnt) {
+		blks = blk_xfer_bounce(dev, start + tail, blkcnt - tail,
+				       buf + tail * desc->blksz, write);
+		if (blks != blkcnt - tail)
+			return blks > blkcnt - tail ? blks : tail + blks;
+	}
+
+	return blkcnt;
+}
+
+static ulong blk_read_dev(struct udevice *dev, lbaint_t start,
+			  lbaint_t blkcnt, void *buf)
+{
+	return blk_xfer_dev(dev, start, blkcnt, buf, false);
+}
+
+/**
+ * blk_read_ahead() - read a block range and continue into the read-ahead window
+ *
+ * @dev: Block device to read from
+ * @start: Start block of the read that missed in the cache
+ * @blkcnt: Number of blocks requested
+ * @ra: Number of blocks to read after @start + @blkcnt
+ * @buf: Buffer for the requested blocks
+ * Return: number of requested blocks read, or -ENOMEM if there is no space for
+ *	the read-ahead buffer
+ */
+static long blk_read_ahead(struct udevice *dev, lbaint_t start,
+			   lbaint_t blkcnt, lbaint_t ra, void *buf)
+{
+	struct blk_desc *desc = dev_get_uclass_plat(dev);
+	ulong blks_read;
+	void *ra_buf;
+
+	ra_buf = memalign(ARCH_DMA_MINALIGN, (blkcnt + ra) * desc->blksz);
+	if (!ra_buf)
+		return -ENOMEM;
+
+	blks_read = blk_read_dev(dev, start, blkcnt + ra, ra_buf);
+	if (blks_read == blkcnt + ra) {
+		blkcache_fill_readahead(desc->uclass_id, desc->devnum, start,
+					blkcnt + ra, desc->blksz, ra_buf);
+		memcpy(buf, ra_buf, blkcnt * desc->blksz);
+		blks_read = blkcnt;
+	}
+	free(ra_buf);
+
+	return blks_read == blkcnt ? blkcnt : -EIO;
+}
+
 long blk_read(struct udevice *dev, lbaint_t start, lbaint_t blkcnt, void *buf)
 {
 	struct blk_desc *desc = dev_get_uclass_plat(dev);
 	const struct blk_ops *ops = blk_get_ops(dev);
 	ulong blks_read;
+	lbaint_t ra;
 
 	if (!ops->read)
 		return -ENOSYS;
@@ -441,24 +611,18 @@ long blk_read(struct udevice *dev, lbaint_t start, lbaint_t blkcnt, void *buf)
 			  start, blkcnt, desc->blksz, buf))
 		return blkcnt;
 
-	if (IS_ENABLED(CONFIG_BOUNCE_BUFFER) && desc->bb) {
-		struct blk_bounce_buffer bbstate = { .dev = dev };
-		int ret;
+	ra = blkcache_readahead(desc->uclass_id, desc->devnum, start, blkcnt);
+	if (ra && start + blkcnt < desc->lba) {
+		long ret;
 
-		ret = bounce_buffer_start_extalign(&bbstate.state, buf,
-						   blkcnt * desc->blksz,
-						   GEN_BB_WRITE, desc->blksz,
-						   blk_buffer_aligned);
-		if (ret)
+		ra = min(ra, desc->lba - start - blkcnt);
+		ret = blk_read_ahead(dev, start, blkcnt, ra, buf);
+		if (ret == blkcnt)
 			return ret;
-
-		blks_read = ops->read(dev, start, blkcnt, bbstate.state.bounce_buffer);
-
-		bounce_buffer_stop(&bbstate.state);
-	} else {
-		blks_read = ops->read(dev, start, blkcnt, buf);
+		/* fall back to a plain read */
 	}
 
+	blks_read = blk_read_dev(dev, start, blkcnt, buf);
 	if (blks_read == blkcnt)
 		blkcache_fill(desc->uclass_id, desc->devnum, start, blkcnt,
 			      desc->blksz, buf);
@@ -471,33 +635,13 @@ long blk_write(struct udevice *dev, lbaint_t start, lbaint_t blkcnt,
 {
 	struct blk_desc *desc = dev_get_uclass_plat(dev);
 	const struct blk_ops *ops = blk_get_ops(dev);
-	long blks_written;
 
 	if (!ops->write)
 		return -ENOSYS;
 
 	blkcache_invalidate(desc->uclass_id, desc->devnum);
 
-	if (IS_ENABLED(CONFIG_BOUNCE_BUFFER) && desc->bb) {
-		struct blk_bounce_buffer bbstate = { .dev = dev };
-		int ret;
-
-		ret = bounce_buffer_start_extalign(&bbstate.state, (void *)buf,
-						   blkcnt * desc->blksz,
-						   GEN_BB_READ, desc->blksz,
-						   blk_buffer_aligned);
-		if (ret)
-			return ret;
-
-		blks_written = ops->write(dev, start, blkcnt,
-					  bbstate.state.bounce_buffer);
-
-		bounce_buffer_stop(&bbstate.state);
-	} else {
-		blks_written = ops->write(dev, start, blkcnt, buf);
-	}
-
-	return blks_written;
+	return blk_xfer_dev(dev, start, blkcnt, (void *)buf, true);
 }
 
 long blk_erase(struct udevice *dev, lbaint_t start, lbaint_t blkcnt)
@@ -530,6 +674,22 @@ ulong blk_derase(struct blk_desc *desc, lbaint_t start, lbaint_t blkcnt)
 	return blk_erase(desc->bdev, start, blkcnt);
 }
 
+ulong blk_get_buffer_align(struct blk_desc *desc)
+{
+	const struct blk_ops *ops = blk_get_ops(desc->bdev);
+
+	/*
+	 * Cache maintenance around DMA is the common requirement. Restrictions
+	 * reported through the buffer_aligned() operation are not about the
+	 * alignment of the start of the buffer, blk_xfer_dev() bounces only
+	 * the blocks they apply to.
+	 */
+	if (ops->get_align)
+		return ops->get_align(desc->bdev);
+
+	return ARCH_DMA_MINALIGN;
+}
+
 int blk_find_from_parent(struct udevice *parent, struct udevice **devp)
 {
 	struct udevice *dev;
@@ -11,141 +11,399 @@
 #include <part.h>
 #include <asm/global_data.h>
 #include <linux/ctype.h>
+#include <linux/kernel.h>
 #include <linux/list.h>
+#include <linux/log2.h>
 
+/*
+ * The cache is organised as a set-associative array. Each device is divided
+ * into lines of max_blocks_per_entry blocks; a line is hashed (together with
+ * the interface type and device number) to pick a set and may then occupy any
+ * of the ways within that set. An entry never crosses a line boundary, so a
+ * lookup only needs to examine the ways of one set per line touched.
+ */
 struct block_cache_node {
-	struct list_head lh;
 	int iftype;
 	int devnum;
 	lbaint_t start;
-	lbaint_t blkcnt;
+	lbaint_t blkcnt;	/* 0 if this way is empty */
 	unsigned long blksz;
+	ulong lru;		/* value of cache_tick when last used */
+	size_t size;		/* number of bytes allocated for @cache */
 	char *cache;
 };
 
-static LIST_HEAD(block_cache);
+/*
+ * Per-device state, used for capacity accounting and to detect sequential
+ * streams, which trigger read-ahead
+ */
+struct block_cache_dev {
+	struct list_head lh;
+	int iftype;
+	int devnum;
+	ulong bytes;		/* number of cached bytes held by this device */
+	lbaint_t next;		/* block following the previous read */
+	uint seq;		/* number of back-to-back sequential reads */
+	lbaint_t ra_win;	/* current read-ahead window, in blocks */
+	uint hits;
+	uint misses;
+};
+
+/* Number of sequential reads needed before read-ahead kicks in */
+#define BLKCACHE_SEQ_THRESHOLD	2
+
+static LIST_HEAD(block_cache_devs);
+static struct block_cache_node *block_cache;
+static uint cache_sets;		/* number of sets (power of two) */
+static uint cache_ways;		/* number of ways per set */
+static uint cache_line_shift;	/* log2(max_blocks_per_entry) */
+static ulong cache_tick;
 
 static struct block_cache_stats _stats = {
-	.max_blocks_per_entry = 8,
-	.max_entries = 32
+	.max_blocks_per_entry = CONFIG_BLOCK_CACHE_BLOCKS,
+	.max_entries = CONFIG_BLOCK_CACHE_ENTRIES,
+	.max_dev_bytes = CONFIG_BLOCK_CACHE_DEV_SIZE,
+	.readahead_blocks = CONFIG_BLOCK_CACHE_READAHEAD,
 };
 
+static struct block_cache_dev *cache_dev(int iftype, int devnum, bool create)
+{
+	struct block_cache_dev *bdev;
+
+	list_for_each_entry(bdev, &block_cache_devs, lh) {
+		if (bdev->iftype == iftype && bdev->devnum == devnum) {
+			if (block_cache_devs.next != &bdev->lh) {
+				/* keep the most recently used device first */
+				list_del(&bdev->lh);
+				list_add(&bdev->lh, &block_cache_devs);
+			}
+			return bdev;
+		}
+	}
+	if (!create)
+		return NULL;
+
+	bdev = calloc(1, sizeof(*bdev));
+	if (!bdev)
+		return NULL;
+	bdev->iftype = iftype;
+	bdev->devnum = devnum;
+	list_add(&bdev->lh, &block_cache_devs);
+
+	return bdev;
+}
+
+static lbaint_t line_start(lbaint_t blk)
+{
+	return blk & ~(((lbaint_t)1 << cache_line_shift) - 1);
+}
+
+static struct block_cache_node *cache_set(int iftype, int devnum, lbaint_t blk)
+{
+	lbaint_t line = blk >> cache_line_shift;
+	u32 key;
+
+	key = lower_32_bits(line) ^ upper_32_bits(line);
+	key ^= ((u32)iftype << 24) ^ ((u32)devnum << 16);
+	key *= 0x9e3779b1;	/* golden-ratio multiplicative hash */
+	if (cache_sets > 1)
+		key >>= 32 - ilog2(cache_sets);
+	else
+		key = 0;
+
+	return &block_cache[key * cache_ways];
+}
+
+static bool cache_setup(void)
+{
+	uint entries = _stats.max_entries;
+
+	if (block_cache)
+		return true;
+	if (!entries || !_stats.max_blocks_per_entry)
+		return false;
+
+	cache_ways = min_t(uint, entries, CONFIG_BLOCK_CACHE_WAYS);
+	cache_sets = rounddown_pow_of_two(entries / cache_ways);
+	cache_line_shift = ilog2(_stats.max_blocks_per_entry);
+	block_cache = calloc(cache_sets * cache_ways, sizeof(*block_cache));
+	if (!block_cache)
+		return false;
+
+	return true;
+}
+
+static void cache_drop(struct block_cache_node *node, bool release)
+{
+	struct block_cache_dev *bdev;
+
+	if (node->blkcnt) {
+		bdev = cache_dev(node->iftype, node->devnum, false);
+		if (bdev)
+			bdev->bytes -= node->blkcnt * node->blksz;
+		node->blkcnt = 0;
+		_stats.entries--;
+	}
+	if (release) {
+		free(node->cache);
+		node->cache = NULL;
+		node->size = 0;
+	}
+}
+
 static struct block_cache_node *cache_find(int iftype, int devnum,
 					   lbaint_t start, lbaint_t blkcnt,
 					   unsigned long blksz)
 {
-	struct block_cache_node *node;
+	struct block_cache_node *node = cache_set(iftype, devnum, start);
+	uint way;
 
-	list_for_each_entry(node, &block_cache, lh)
-		if ((node->iftype == iftype) &&
+	for (way = 0; way < cache_ways; way++, node++)
+		if (node->blkcnt &&
+		    (node->iftype == iftype) &&
 		    (node->devnum == devnum) &&
 		    (node->blksz == blksz) &&
 		    (node->start <= start) &&
 		    (node->start + node->blkcnt >= start + blkcnt)) {
-			if (block_cache.next != &node->lh) {
-				/* maintain MRU ordering */
-				list_del(&node->lh);
-				list_add(&node->lh, &block_cache);
-			}
+			node->lru = ++cache_tick;
 			return node;
 		}
-	return 0;
+	return NULL;
+}
+
+/* Insert a run of blocks that does not cross a line boundary */
+static void cache_insert(struct block_cache_dev *bdev, int iftype, int devnum,
+			 lbaint_t start, lbaint_t blkcnt, unsigned long blksz,
+			 const void *buffer)
+{
+	struct block_cache_node *set = cache_set(iftype, devnum, start);
+	struct block_cache_node *node, *victim = NULL;
+	ulong bytes = blkcnt * blksz;
+	bool over_budget;
+	uint way;
+
+	over_budget = _stats.max_dev_bytes &&
+		bdev->bytes + bytes > _stats.max_dev_bytes;
+	for (way = 0, node = set; way < cache_ways; way++, node++) {
+		bool same_dev = node->blkcnt && node->iftype == iftype &&
+			node->devnum == devnum && node->blksz == blksz;
+
+		if (same_dev && node->start <= start &&
+		    node->start + node->blkcnt >= start + blkcnt) {
+			/* already cached */
+			node->lru = ++cache_tick;
+			return;
+		}
+		if (same_dev && node->start >= start &&
+		    node->start + node->blkcnt <= start + blkcnt) {
+			/* the new run supersedes this entry */
+			victim = node;
+			break;
+		}
+		if (over_budget) {
+			/* only replace this device's own entries */
+			if (!same_dev)
+				continue;
+		} else if (!node->blkcnt) {
+			victim = node;
+			break;
+		}
+		if (!victim || node->lru < victim->lru)
+			victim = node;
+	}
+	if (!victim)
+		return;
+
+	if (victim->blkcnt) {
+		if (victim->iftype != iftype || victim->devnum != devnum ||
+		    victim->start < start ||
+		    victim->start + victim->blkcnt > start + blkcnt) {
+			debug("drop: start " LBAF ", count " LBAFU "\n",
+			      victim->start, victim->blkcnt);
+			_stats.evictions++;
+		}
+		cache_drop(victim, false);
+	}
+	if (_stats.max_dev_bytes && bdev->bytes + bytes > _stats.max_dev_bytes)
+		return;
+
+	if (victim->size < bytes) {
+		free(victim->cache);
+		victim->size = 0;
+		victim->cache = malloc(bytes);
+		if (!victim->cache)
+			return;
+		victim->size = bytes;
+	}
+
+	debug("fill: start " LBAF ", count " LBAFU "\n", start, blkcnt);
+
+	victim->iftype = iftype;
+	victim->devnum = devnum;
+	victim->start = start;
+	victim->blkcnt = blkcnt;
+	victim->blksz = blksz;
+	victim->lru = ++cache_tick;
+	memcpy(victim->cache, buffer, bytes);
+	bdev->bytes += bytes;
+	_stats.entries++;
+}
+
+static void cache_fill(int iftype, int devnum, lbaint_t start,
+		       lbaint_t blkcnt, unsigned long blksz,
+		       void const *buffer)
+{
+	struct block_cache_dev *bdev;
+	const char *src = buffer;
+	lbaint_t blk, end, n;
+
+	if (!cache_setup())
+		return;
+	bdev = cache_dev(iftype, devnum, true);
+	if (!bdev)
+		return;
+
+	end = start + blkcnt;
+	for (blk = start; blk < end; blk += n, src += n * blksz) {
+		n = min(line_start(blk) + _stats.max_blocks_per_entry, end) -
+			blk;
+		cache_insert(bdev, iftype, devnum, blk, n, blksz, src);
+	}
 }
 
 int blkcache_read(int iftype, int devnum,
 		  lbaint_t start, lbaint_t blkcnt,
 		  unsigned long blksz, void *buffer)
 {
-	struct block_cache_node *node = cache_find(iftype, devnum, start,
-						   blkcnt, blksz);
-	if (node) {
-		const char *src = node->cache + (start - node->start) * blksz;
-		memcpy(buffer, src, blksz * blkcnt);
-		debug("hit: start " LBAF ", count " LBAFU "\n",
-		      start, blkcnt);
-		++_stats.hits;
-		return 1;
+	struct block_cache_dev *bdev = cache_dev(iftype, devnum, true);
+	struct block_cache_node *node;
+	lbaint_t blk, end, n;
+	char *dst = buffer;
+
+	/* track sequential streams so that misses can trigger read-ahead */
+	if (bdev) {
+		if (start == bdev->next) {
+			bdev->seq++;
+		} else {
+			bdev->seq = 0;
+			bdev->ra_win = 0;
+		}
+		bdev->next = start + blkcnt;
+	}
+
+	if (!block_cache || blkcnt > _stats.max_blocks_per_entry)
+		goto miss;
+
+	end = start + blkcnt;
+	for (blk = start; blk < end; blk += n, dst += n * blksz) {
+		n = min(line_start(blk) + _stats.max_blocks_per_entry, end) -
+			blk;
+		node = cache_find(iftype, devnum, blk, n, blksz);
+		if (!node)
+			goto miss;
+		memcpy(dst, node->cache + (blk - node->start) * blksz,
+		       n * blksz);
 	}
 
+	debug("hit: start " LBAF ", count " LBAFU "\n",
+	      start, blkcnt);
+	++_stats.hits;
+	if (bdev)
+		bdev->hits++;
+	return 1;
+
+miss:
 	debug("miss: start " LBAF ", count " LBAFU "\n",
 	      start, blkcnt);
 	++_stats.misses;
+	if (bdev)
+		bdev->misses++;
 	return 0;
 }
 
+lbaint_t blkcache_readahead(int iftype, int devnum,
+			    lbaint_t start, lbaint_t blkcnt)
+{
+	struct block_cache_dev *bdev;
+	lbaint_t end;
+
+	if (!_stats.readahead_blocks || !_stats.max_entries ||
+	    blkcnt > _stats.max_blocks_per_entry)
+		return 0;
+
+	bdev = cache_dev(iftype, devnum, false);
+	if (!bdev || bdev->seq < BLKCACHE_SEQ_THRESHOLD)
+		return 0;
+
+	/* double the window on each miss within the same stream */
+	if (!bdev->ra_win)
+		bdev->ra_win = _stats.max_blocks_per_entry;
+	else
+		bdev->ra_win = min_t(lbaint_t, bdev->ra_win * 2,
+				     _stats.readahead_blocks);
+
+	/* finish on a line boundary so the next stream read is a full hit */
+	end = line_start(start + blkcnt + bdev->ra_win - 1) +
+		_stats.max_blocks_per_entry;
+
+	return end - start - blkcnt;
+}
+
 void blkcache_fill(int iftype, int devnum,
 		   lbaint_t start, lbaint_t blkcnt,
 		   unsigned long blksz, void const *buffer)
 {
-	lbaint_t bytes;
-	struct block_cache_node *node;
-
 	/* don't cache big stuff */
 	if (blkcnt > _stats.max_blocks_per_entry)
 		return;
 
-	if (_stats.max_entries == 0)
-		return;
-
-	bytes = blksz * blkcnt;
-	if (_stats.max_entries <= _stats.entries) {
-		/* pop LRU */
-		node = (struct block_cache_node *)block_cache.prev;
-		list_del(&node->lh);
-		_stats.entries--;
-		debug("drop: start " LBAF ", count " LBAFU "\n",
-		      node->start, node->blkcnt);
-		if (node->blkcnt * node->blksz < bytes) {
-			free(node->cache);
-			node->cache = 0;
-		}
-	} else {
-		node = malloc(sizeof(*node));
-		if (!node)
-			return;
-		node->cache = 0;
-	}
-
-	if (!node->cache) {
-		node->cache = malloc(bytes);
-		if (!node->cache) {
-			free(node);
-			return;
-		}
-	}
-
-	debug("fill: start " LBAF ", count " LBAFU "\n",
-	      start, blkcnt);
+	cache_fill(iftype, devnum, start, blkcnt, blksz, buffer);
+}
 
-	node->iftype = iftype;
-	node->devnum = devnum;
-	node->start = start;
-	node->blkcnt = blkcnt;
-	node->blksz = blksz;
-	memcpy(node->cache, buffer, bytes);
-	list_add(&node->lh, &block_cache);
-	_stats.entries++;
+void blkcache_fill_readahead(int iftype, int devnum,
+			     lbaint_t start, lbaint_t blkcnt,
+			     unsigned long blksz, void const *buffer)
+{
+	_stats.readaheads++;
+	cache_fill(iftype, devnum, start, blkcnt, blksz, buffer);
 }
 
 void blkcache_invalidate(int iftype, int devnum)
 {
-	struct list_head *entry, *n;
-	struct block_cache_node *node;
+	struct block_cache_dev *bdev, *n;
+	uint i;
+
+	if (block_cache) {
+		for (i = 0; i < cache_sets * cache_ways; i++) {
+			struct block_cache_node *node = &block_cache[i];
+
+			if (iftype == -1 ||
+			    (node->iftype == iftype &&
+			     node->devnum == devnum))
+				cache_drop(node, true);
+		}
+	}
 
-	list_for_each_safe(entry, n, &block_cache) {
-		node = (struct block_cache_node *)entry;
+	list_for_each_entry_safe(bdev, n, &block_cache_devs, lh) {
 		if (iftype == -1 ||
-		    (node->iftype == iftype && node->devnum == devnum)) {
-			list_del(entry);
-			free(node->cache);
-			free(node);
-			--_stats.entries;
+		    (bdev->iftype == iftype && bdev->devnum == devnum)) {
+			list_del(&bdev->lh);
+			free(bdev);
 		}
 	}
+
+	if (iftype == -1) {
+		free(block_cache);
+		block_cache = NULL;
+	}
 }
 
 void blkcache_configure(unsigned blocks, unsigned entries)
 {
+	/* entries never cross a line, so the line size is a power of two */
+	if (blocks)
+		blocks = rounddown_pow_of_two(blocks);
+
 	/* invalidate cache if there is a change */
 	if ((blocks != _stats.max_blocks_per_entry) ||
 	    (entries != _stats.max_entries))
@@ -156,13 +414,48 @@ void blkcache_configure(unsigned blocks, unsigned entries)
 
 	_stats.hits = 0;
 	_stats.misses = 0;
+	_stats.evictions = 0;
+	_stats.readaheads = 0;
+}
+
+void blkcache_configure_dev(ulong max_bytes, unsigned readahead)
+{
+	if (max_bytes != _stats.max_dev_bytes)
+		blkcache_invalidate(-1, 0);
+
+	_stats.max_dev_bytes = max_bytes;
+	_stats.readahead_blocks = readahead;
 }
 
 void blkcache_stats(struct block_cache_stats *stats)
 {
 	memcpy(stats, &_stats, sizeof(*stats));
+	if (block_cache)
+		stats->max_entries = cache_sets * cache_ways;
+	stats->ways = block_cache ? cache_ways :
+		min_t(uint, _stats.max_entries, CONFIG_BLOCK_CACHE_WAYS);
 	_stats.hits = 0;
 	_stats.misses = 0;
+	_stats.evictions = 0;
+	_stats.readaheads = 0;
+}
+
+void blkcache_show_devs(void)
+{
+	struct block_cache_dev *bdev;
+
+	if (list_empty(&block_cache_devs))
+		return;
+
+	printf("%-10s %4s %10s %8s %8s\n", "Interface", "Dev", "Bytes",
+	       "Hits", "Misses");
+	list_for_each_entry(bdev, &block_cache_devs, lh) {
+		printf("%-10s %4d %10lu %8u %8u\n",
+		       blk_get_uclass_name(bdev->iftype), bdev->devnum,
+		       bdev->bytes, bdev->hits, bdev->misses);
+		bdev->hits = 0;
+		bdev->misses = 0;
+	}
 }
 
 void blkcache_free(void)
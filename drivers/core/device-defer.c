@@ -0,0 +1,277 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Deferred device probing
+ *
+ * Some hardware takes a long time to come up after being enabled: PCIe links
+ * train, USB hubs power up their ports, eMMC cards leave their busy state.
+ * A driver which simply waits in its probe() method holds up every other
+ * device. Instead, the driver can hand its wait point to dev_probe_defer().
+ * While driver model probes devices at start-up these waits are recorded
+ * and polled together, so that the time taken approaches that of the
+ * slowest device rather than the sum of them all.
+ */
+
+#define LOG_CATEGORY LOGC_DM
+
+#include <common.h>
+#include <cyclic.h>
+#include <dm.h>
+#include <errno.h>
+#include <log.h>
+#include <malloc.h>
+#include <time.h>
+#include <dm/device-internal.h>
+#include <linux/delay.h>
+#include <linux/list.h>
+#include <asm/global_data.h>
+
+DECLARE_GLOBAL_DATA_PTR;
+
+/**
+ * struct dm_probe_wait - A device waiting for its hardware
+ *
+ * @sibling_node: Node in the pending or done list
+ * @dev: Device being probed
+ * @ready: Function to check whether the hardware is ready
+ * @cont: Function to complete probing, or NULL
+ * @start: Time the wait started, from get_timer()
+ * @timeout_ms: Time to wait before giving up
+ * @ret: -EAGAIN while waiting, else the result of the wait
+ */
+struct dm_probe_wait {
+	struct list_head sibling_node;
+	struct udevice *dev;
+	dm_probe_ready_t ready;
+	dm_probe_cont_t cont;
+	ulong start;
+	ulong timeout_ms;
+	int ret;
+};
+
+/**
+ * struct dm_probe_async - State of deferred probing
+ *
+ * @active: true if waits are deferred, false to wait synchronously
+ * @polling: true while polling, to avoid recursion through schedule()
+ * @pending: Devices waiting for their hardware (struct dm_probe_wait)
+ * @done: Devices which have been probed since being deferred
+ * @cyclic: Cyclic function which polls the pending devices
+ */
+static struct dm_probe_async {
+	bool active;
+	bool polling;
+	struct list_head pending;
+	struct list_head done;
+	struct cyclic_info *cyclic;
+} probe_async;
+
+int dev_probe_defer(struct udevice *dev, dm_probe_ready_t ready,
+		    dm_probe_cont_t cont, ulong timeout_ms)
+{
+	struct dm_probe_wait *wait;
+	ulong start = get_timer(0);
+	int ret;
+
+	if (CONFIG_IS_ENABLED(DM_PROBE_ASYNC) && probe_async.active) {
+		wait = malloc(sizeof(*wait));
+		if (wait) {
+			wait->dev = dev;
+			wait->ready = ready;
+			wait->cont = cont;
+			wait->start = start;
+			wait->timeout_ms = timeout_ms;
+			wait->ret = -EAGAIN;
+			list_add_tail(&wait->sibling_node, &probe_async.pending);
+			dev_or_flags(dev, DM_FLAG_PROBE_DEFERRED);
+
+			return 0;
+		}
+		/* Without memory, just wait here */
+	}
+
+	for (;;) {
+		ret = ready(dev);
+		if (ret != -EAGAIN)
+			break;
+		if (get_timer(start) >= timeout_ms)
+			return -ETIMEDOUT;
+		udelay(10);
+	}
+	if (ret)
+		return ret;
+
+	return cont ? cont(dev) : 0;
+}
+
+#if CONFIG_IS_ENABLED(DM_PROBE_ASYNC)
+static int dm_probe_check(struct dm_probe_wait *wait)
+{
+	int ret;
+
+	ret = wait->ready(wait->dev);
+	if (ret == -EAGAIN && get_timer(wait->start) >= wait->timeout_ms)
+		ret = -ETIMEDOUT;
+
+	return ret;
+}
+
+/* Poll all waiting devices; this also runs from schedule() */
+static void dm_probe_poll(void *ctx)
+{
+	struct dm_probe_wait *wait;
+
+	if (probe_async.polling)
+		return;
+	probe_async.polling = true;
+	list_for_each_entry(wait, &probe_async.pending, sibling_node) {
+		if (wait->ret == -EAGAIN)
+			wait->ret = dm_probe_check(wait);
+	}
+	probe_async.polling = false;
+}
+
+static struct dm_probe_wait *dm_probe_find(struct udevice *dev)
+{
+	struct dm_probe_wait *wait;
+
+	list_for_each_entry(wait, &probe_async.pending, sibling_node) {
+		if (wait->dev == dev)
+			return wait;
+	}
+
+	return NULL;
+}
+
+/**
+ * dm_probe_resume() - Carry on probing a device whose wait is over
+ *
+ * @wait: Wait record, which is moved to the done list if the device probes
+ *	successfully, else freed
+ * Return: 0 if OK (or deferred again), -ve on error
+ */
+static int dm_probe_resume(struct dm_probe_wait *wait)
+{
+	struct udevice *dev = wait->dev;
+	int ret = wait->ret;
+
+	list_del(&wait->sibling_node);
+	dev_bic_flags(dev, DM_FLAG_PROBE_DEFERRED);
+	if (!ret && wait->cont)
+		ret = wait->cont(dev);
+	if (ret) {
+		log_debug("Device '%s' failed to probe after waiting: %dE\n",
+			  dev->name, ret);
+		dev_bic_flags(dev, DM_FLAG_ACTIVATED);
+		device_free(dev);
+		free(wait);
+		return ret;
+	}
+
+	/* @cont has another wait point */
+	if (dev_get_flags(dev) & DM_FLAG_PROBE_DEFERRED) {
+		free(wait);
+		return 0;
+	}
+
+	ret = device_probe_finish(dev);
+	if (ret) {
+		free(wait);
+		return ret;
+	}
+	list_add_tail(&wait->sibling_node, &probe_async.done);
+
+	return 0;
+}
+
+int device_probe_wait(struct udevice *dev)
+{
+	struct dm_probe_wait *wait;
+
+	while (dev_get_flags(dev) & DM_FLAG_PROBE_DEFERRED) {
+		wait = dm_probe_find(dev);
+		if (!wait)
+			return log_msg_ret("wait", -ENOENT);
+		dm_probe_poll(NULL);
+		if (wait->ret == -EAGAIN) {
+			schedule();
+			continue;
+		}
+		return dm_probe_resume(wait);
+	}
+
+	return 0;
+}
+
+int dm_probe_async_begin(void)
+{
+	/* The state lives in BSS, so is not available before relocation */
+	if (!(gd->flags & GD_FLG_RELOC))
+		return -ENOSYS;
+	if (probe_async.active)
+		return -EBUSY;
+
+	INIT_LIST_HEAD(&probe_async.pending);
+	INIT_LIST_HEAD(&probe_async.done);
+	probe_async.polling = false;
+
+	/* Keep polling while other drivers wait in udelay(), etc. */
+	probe_async.cyclic = cyclic_register(dm_probe_poll, 0, "dm_probe",
+					     NULL);
+	probe_async.active = true;
+
+	return 0;
+}
+
+int dm_probe_async_end(dm_probe_done_t done, void *ctx)
+{
+	struct dm_probe_wait *wait, *ready;
+	struct udevice *dev;
+	int err = 0;
+	int ret;
+
+	if (!probe_async.active)
+		return 0;
+
+	for (;;) {
+		if (!list_empty(&probe_async.done)) {
+			wait = list_first_entry(&probe_async.done,
+						struct dm_probe_wait,
+						sibling_node);
+			dev = wait->dev;
+			list_del(&wait->sibling_node);
+			free(wait);
+			if (done) {
+				ret = done(dev, ctx);
+				if (ret && !err)
+					err = ret;
+			}
+			continue;
+		}
+		if (list_empty(&probe_async.pending))
+			break;
+
+		dm_probe_poll(NULL);
+		ready = NULL;
+		list_for_each_entry(wait, &probe_async.pending, sibling_node) {
+			if (wait->ret != -EAGAIN) {
+				ready = wait;
+				break;
+			}
+		}
+		if (ready) {
+			ret = dm_probe_resume(ready);
+			if (ret && !err)
+				err = ret;
+		} else {
+			schedule();
+		}
+	}
+
+	if (probe_async.cyclic)
+		cyclic_unregister(probe_async.cyclic);
+	probe_async.cyclic = NULL;
+	probe_async.active = false;
+
+	return err;
+}
+#endif
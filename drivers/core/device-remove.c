@@ -204,6 +204,9 @@ int device_remove(struct udevice *dev, uint flags)
 	if (!dev)
 		return -EINVAL;
 
+	/* Don't pull a device out from under its own probe */
+	device_probe_wait(dev);
+
 	if (!(dev_get_flags(dev) & DM_FLAG_ACTIVATED))
 		return 0;
 
@@ -9,6 +9,7 @@
  */
 
 #include <common.h>
+#include <bootstage.h>
 #include <cpu_func.h>
 #include <event.h>
 #include <log.h>
@@ -37,10 +38,9 @@
 
 DECLARE_GLOBAL_DATA_PTR;
 
-static int device_bind_common(struct udevice *parent, const struct driver *drv,
-			      const char *name, void *plat,
-			      ulong driver_data, ofnode node,
-			      uint of_plat_size, struct udevice **devp)
+static int device_do_bind(struct udevice *parent, const struct driver *drv,
+			  const char *name, void *plat, ulong driver_data,
+			  ofnode node, uint of_plat_size, struct udevice **devp)
 {
 	struct udevice *dev;
 	struct uclass *uc;
@@ -237,6 +237,21 @@ fail_alloc1:
 	return ret;
 }
 
+static int device_bind_common(struct udevice *parent, const struct driver *drv,
+			      const char *name, void *plat,
+			      ulong driver_data, ofnode node,
+			      uint of_plat_size, struct udevice **devp)
+{
+	int span, ret;
+
+	span = bootstage_span_start(BOOTSTAGE_SPAN_BIND, name, 0);
+	ret = device_do_bind(parent, drv, name, plat, driver_data, node,
+			     of_plat_size, devp);
+	bootstage_span_end(span);
+
+	return ret;
+}
+
 int device_bind_with_driver_data(struct udevice *parent,
 				 const struct driver *drv, const char *name,
 				 ulong driver_data, ofnode node,
@@ -478,17 +493,11 @@ static int device_get_dma_constraints(struct udevice *dev)
 	return 0;
 }
 
-int device_probe(struct udevice *dev)
+static int device_do_probe(struct udevice *dev)
 {
 	const struct driver *drv;
 	int ret;
 
-	if (!dev)
-		return -EINVAL;
-
-	if (dev_get_flags(dev) & DM_FLAG_ACTIVATED)
-		return 0;
-
 	ret = device_notify(dev, EVT_DM_PRE_PROBE);
 	if (ret)
 		return ret;
@@ -513,7 +522,7 @@ int device_probe(struct udevice *dev)
 		 * so that we don't mess up the device.
 		 */
 		if (dev_get_flags(dev) & DM_FLAG_ACTIVATED)
-			return 0;
+			return device_probe_wait(dev);
 	}
 
 	dev_or_flags(dev, DM_FLAG_ACTIVATED);
@@ -586,6 +595,40 @@ int device_probe(struct udevice *dev)
 			goto fail;
 	}
 
+	/* The driver is waiting for its hardware; see dev_probe_defer() */
+	if (dev_get_flags(dev) & DM_FLAG_PROBE_DEFERRED)
+		return 0;
+
+	return device_probe_finish(dev);
+fail:
+	dev_bic_flags(dev, DM_FLAG_ACTIVATED);
+
+	device_free(dev);
+
+	return ret;
+}
+
+int device_probe(struct udevice *dev)
+{
+	int span, ret;
+
+	if (!dev)
+		return -EINVAL;
+
+	if (dev_get_flags(dev) & DM_FLAG_ACTIVATED)
+		return device_probe_wait(dev);
+
+	span = bootstage_span_start(BOOTSTAGE_SPAN_PROBE, dev->name, 0);
+	ret = device_do_probe(dev);
+	bootstage_span_end(span);
+
+	return ret;
+}
+
+int device_probe_finish(struct udevice *dev)
+{
+	int ret;
+
 	ret = uclass_post_probe_device(dev);
 	if (ret)
 		goto fail_uclass;
@@ -608,7 +651,6 @@ fail_uclass:
 		dm_warn("%s: Device '%s' failed to remove on error path\n",
 			__func__, dev->name);
 	}
-fail:
 	dev_bic_flags(dev, DM_FLAG_ACTIVATED);
 
 	device_free(dev);
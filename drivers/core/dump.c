@@ -7,6 +7,7 @@
 #include <dm.h>
 #include <malloc.h>
 #include <mapmem.h>
+#include <of_live.h>
 #include <sort.h>
 #include <dm/root.h>
 #include <dm/util.h>
@@ -357,3 +358,31 @@ void dm_dump_mem(struct dm_stats *stats)
 	printf("Drop device name (not SRAM): %x (%d)\n", stats->dev_name_size,
 	       stats->dev_name_size);
 }
+
+void dm_dump_of_live(void)
+{
+	struct of_live_stats stats;
+	int ret;
+
+	if (!CONFIG_IS_ENABLED(OF_LIVE_LAZY) || !of_live_active())
+		return;
+	ret = of_live_get_stats(&stats);
+	if (ret) {
+		if (ret != -ENOENT)
+			printf("Cannot get livetree stats (err=%d)\n", ret);
+		return;
+	}
+
+	printf("\n");
+	printf("%-16s %6s %6s %8s %8s\n", "Livetree", "Nodes", "Props",
+	       "Size", "Time(us)");
+	printf("%-16s %6s %6s %8s %8s\n", "---------------", "------",
+	       "------", "--------", "--------");
+	printf("%-16s %6x %6x %8x %8lu\n", "Expanded (lazy)", stats.nodes,
+	       stats.props, stats.size, stats.time_us);
+	printf("%-16s %6x %6x %8x %8lu\n", "Full tree", stats.full_nodes,
+	       stats.full_props, stats.full_size, stats.full_time_us);
+	printf("Saved: %x (%d) bytes, %ld us\n",
+	       stats.full_size - stats.size, stats.full_size - stats.size,
+	       (long)(stats.full_time_us - stats.time_us));
+}
@@ -11,6 +11,7 @@
 #include <common.h>
 #include <errno.h>
 #include <log.h>
+#include <malloc.h>
 #include <dm/device.h>
 #include <dm/device-internal.h>
 #include <dm/lists.h>
@@ -18,7 +19,12 @@
 #include <dm/uclass.h>
 #include <dm/util.h>
 #include <fdtdec.h>
+#include <asm/global_data.h>
 #include <linux/compiler.h>
+#include <linux/err.h>
+#include <linux/log2.h>
+
+DECLARE_GLOBAL_DATA_PTR;
 
 struct driver *lists_driver_lookup_name(const char *name)
 {
@@ -181,11 +187,152 @@ static int driver_check_compatible(const struct udevice_id *of_match,
 	return -ENOENT;
 }
 
-int lists_bind_fdt(struct udevice *parent, ofnode node, struct udevice **devp,
-		   struct driver *drv, bool pre_reloc_only)
+/**
+ * struct lists_compat_index - hash index of driver compatible strings
+ *
+ * Each slot holds the linker-list index of a driver plus one, or 0 if empty.
+ * Slots are found by hashing a compatible string and probing linearly. Only
+ * the first driver (in linker-list order) matching a string is recorded, so
+ * a lookup returns the same driver as a walk through the driver list would.
+ *
+ * @mask: Number of slots minus one, the number of slots is a power of two
+ * @slot: Slots
+ */
+struct lists_compat_index {
+	uint mask;
+	u16 slot[];
+};
+
+static uint lists_compat_hash(const char *str)
+{
+	uint hash = 5381;
+
+	while (*str)
+		hash = hash * 33 + (u8)*str++;
+
+	return hash;
+}
+
+/**
+ * lists_compat_lookup() - find the driver for a compatible string
+ *
+ * @idx: Compatible index
+ * @compat: Compatible string to look up
+ * @of_idp: Returns the match that was found
+ * Return: driver, or NULL if no driver matches @compat
+ */
+static struct driver *lists_compat_lookup(struct lists_compat_index *idx,
+					  const char *compat,
+					  const struct udevice_id **of_idp)
+{
+	struct driver *driver = ll_entry_start(struct driver, driver);
+	uint i;
+
+	for (i = lists_compat_hash(compat) & idx->mask; idx->slot[i];
+	     i = (i + 1) & idx->mask) {
+		struct driver *entry = driver + idx->slot[i] - 1;
+
+		if (!driver_check_compatible(entry->of_match, of_idp, compat))
+			return entry;
+	}
+
+	return NULL;
+}
+
+/**
+ * lists_compat_index() - get the compatible index, building it on first use
+ *
+ * Before relocation the index is only built if it takes no more than a quarter
+ * of what is left of the early heap, which is needed for devices. If it is not
+ * built, that is remembered until initr_dm() clears it after relocation.
+ *
+ * Return: index, or NULL if it is not enabled or there is not enough memory,
+ * in which case the driver list must be walked instead
+ */
+static struct lists_compat_index *lists_compat_index(void)
+{
+	struct driver *driver = ll_entry_start(struct driver, driver);
+	const int n_ents = ll_entry_count(struct driver, driver);
+	const struct udevice_id *of_match, *id;
+	struct lists_compat_index *idx;
+	struct driver *entry;
+	uint count = 0, size;
+	ulong bytes;
+
+	if (!CONFIG_IS_ENABLED(DM_COMPAT_INDEX) || n_ents >= U16_MAX)
+		return NULL;
+	idx = gd_dm_compat_index();
+	if (idx)
+		return IS_ERR(idx) ? NULL : idx;
+
+	for (entry = driver; entry != driver + n_ents; entry++) {
+		for (of_match = entry->of_match; of_match && of_match->compatible;
+		     of_match++)
+			count++;
+	}
+
+	/* Keep the load factor below 1/2 so that probe sequences stay short */
+	size = roundup_pow_of_two(count * 2 + 1);
+	bytes = sizeof(*idx) + size * sizeof(idx->slot[0]);
+#if CONFIG_IS_ENABLED(SYS_MALLOC_F)
+	if (!(gd->flags & GD_FLG_FULL_MALLOC_INIT) &&
+	    bytes > (gd->malloc_limit - gd->malloc_ptr) / 4) {
+		log_debug("No space for compatible index (%lx bytes)\n", bytes);
+		gd_set_dm_compat_index(ERR_PTR(-ENOSPC));
+		return NULL;
+	}
+#endif
+	idx = calloc(1, bytes);
+	if (!idx) {
+		gd_set_dm_compat_index(ERR_PTR(-ENOMEM));
+		return NULL;
+	}
+	idx->mask = size - 1;
+
+	for (entry = driver; entry != driver + n_ents; entry++) {
+		for (of_match = entry->of_match; of_match && of_match->compatible;
+		     of_match++) {
+			uint i;
+
+			/* An earlier driver takes priority */
+			if (lists_compat_lookup(idx, of_match->compatible, &id))
+				continue;
+
+			for (i = lists_compat_hash(of_match->compatible) &
+			     idx->mask; idx->slot[i]; i = (i + 1) & idx->mask)
+				;
+			idx->slot[i] = entry - driver + 1;
+		}
+	}
+	gd_set_dm_compat_index(idx);
+	log_debug("Indexed %u compatible strings in %u slots\n", count, size);
+
+	return idx;
+}
+
+struct driver *lists_driver_lookup_compat(const char *compat,
+					  const struct udevice_id **of_idp)
 {
 	struct driver *driver = ll_entry_start(struct driver, driver);
 	const int n_ents = ll_entry_count(struct driver, driver);
+	struct lists_compat_index *idx;
+	struct driver *entry;
+
+	idx = lists_compat_index();
+	if (idx)
+		return lists_compat_lookup(idx, compat, of_idp);
+
+	for (entry = driver; entry != driver + n_ents; entry++) {
+		if (!driver_check_compatible(entry->of_match, of_idp, compat))
+			return entry;
+	}
+
+	return NULL;
+}
+
+int lists_bind_fdt(struct udevice *parent, ofnode node, struct udevice **devp,
+		   struct driver *drv, bool pre_reloc_only)
+{
 	const struct udevice_id *id;
 	struct driver *entry;
 	struct udevice *dev;
@@ -223,20 +370,17 @@ int lists_bind_fdt(struct udevice *parent, ofnode node, struct udevice **devp,
 			  compat);
 
 		id = NULL;
-		for (entry = driver; entry != driver + n_ents; entry++) {
-			if (drv) {
-				if (drv != entry)
-					continue;
-				if (!entry->of_match)
-					break;
-			}
-			ret = driver_check_compatible(entry->of_match, &id,
-						      compat);
-			if (!ret)
-				break;
+		if (drv) {
+			entry = drv;
+			if (entry->of_match &&
+			    driver_check_compatible(entry->of_match, &id,
+						    compat))
+				continue;
+		} else {
+			entry = lists_driver_lookup_compat(compat, &id);
+			if (!entry)
+				continue;
 		}
-		if (entry == driver + n_ents)
-			continue;
 
 		if (pre_reloc_only) {
 			if (!ofnode_pre_reloc(node) &&
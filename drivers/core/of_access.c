@@ -22,6 +22,7 @@
 #include <common.h>
 #include <log.h>
 #include <malloc.h>
+#include <of_live.h>
 #include <asm/global_data.h>
 #include <linux/bug.h>
 #include <linux/libfdt.h>
@@ -29,6 +30,7 @@
 #include <linux/ctype.h>
 #include <linux/err.h>
 #include <linux/ioport.h>
+#include <linux/log2.h>
 
 DECLARE_GLOBAL_DATA_PTR;
 
@@ -131,7 +133,7 @@ struct property *of_find_property(const struct device_node *np,
 	if (!np)
 		return NULL;
 
-	for (pp = np->properties; pp; pp = pp->next) {
+	for (pp = of_node_properties(np); pp; pp = pp->next) {
 		if (strcmp(pp->name, name) == 0) {
 			if (lenp)
 				*lenp = pp->length;
@@ -150,7 +152,7 @@ struct device_node *of_find_all_nodes(struct device_node *prev)
 
 	if (!prev) {
 		np = gd->of_root;
-	} else if (prev->child) {
+	} else if (of_node_child(prev)) {
 		np = prev->child;
 	} else {
 		/*
@@ -179,7 +181,7 @@ const struct property *of_get_first_property(const struct device_node *np)
 	if (!np)
 		return NULL;
 
-	return  np->properties;
+	return of_node_properties(np);
 }
 
 const struct property *of_get_next_property(const struct device_node *np,
@@ -302,7 +304,7 @@ static struct device_node *__of_get_next_child(const struct device_node *node,
 	if (!node)
 		return NULL;
 
-	next = prev ? prev->sibling : node->child;
+	next = prev ? prev->sibling : of_node_child(node);
 	/*
 	 * coverity[dead_error_line : FALSE]
 	 * Dead code here since our current implementation of of_node_get()
@@ -341,7 +343,7 @@ static struct device_node *__of_find_node_by_path(struct device_node *parent,
 }
 
 #define for_each_property_of_node(dn, pp) \
-	for (pp = dn->properties; pp != NULL; pp = pp->next)
+	for (pp = of_node_properties(dn); pp != NULL; pp = pp->next)
 
 struct device_node *of_find_node_opts_by_path(struct device_node *root,
 					      const char *path,
@@ -445,17 +447,100 @@ struct device_node *of_find_node_by_prop_value(struct device_node *from,
 	return np;
 }
 
+/*
+ * Phandle index for the tree which was searched last, so that resolving the
+ * phandles of clocks, GPIOs, regulators, etc. does not walk the whole tree
+ * each time. Slots are indexed by phandle and probed linearly; dtc allocates
+ * phandles sequentially so they rarely collide.
+ */
+static struct {
+	struct device_node *root;	/* @root passed by the caller */
+	struct device_node *top;	/* the tree root it resolved to */
+	struct device_node **slot;
+	uint mask;
+} of_phandle_cache;
+
+void of_phandle_cache_invalidate(void)
+{
+	free(of_phandle_cache.slot);
+	of_phandle_cache.slot = NULL;
+	of_phandle_cache.root = NULL;
+	of_phandle_cache.top = NULL;
+}
+
+static bool of_phandle_cache_build(struct device_node *root)
+{
+	struct device_node *np;
+	uint count = 0, size, i;
+
+	of_phandle_cache_invalidate();
+
+	for_each_of_allnodes_from(root, np) {
+		if (np->phandle)
+			count++;
+	}
+
+	size = roundup_pow_of_two(count * 2 + 1);
+	of_phandle_cache.slot = calloc(size, sizeof(*of_phandle_cache.slot));
+	if (!of_phandle_cache.slot)
+		return false;
+	of_phandle_cache.mask = size - 1;
+
+	for_each_of_allnodes_from(root, np) {
+		if (!np->phandle)
+			continue;
+		for (i = np->phandle & of_phandle_cache.mask;
+		     of_phandle_cache.slot[i];
+		     i = (i + 1) & of_phandle_cache.mask) {
+			/* A duplicate phandle, the first node found wins */
+			if (of_phandle_cache.slot[i]->phandle == np->phandle)
+				break;
+		}
+		if (!of_phandle_cache.slot[i])
+			of_phandle_cache.slot[i] = np;
+	}
+	of_phandle_cache.root = root;
+	of_phandle_cache.top = root ? root : gd_of_root();
+
+	return true;
+}
+
 struct device_node *of_find_node_by_phandle(struct device_node *root,
 					    phandle handle)
 {
 	struct device_node *np;
+	uint i;
 
 	if (!handle)
 		return NULL;
 
+	/* Avoid expanding the whole of a lazy tree to find one node */
+	if (CONFIG_IS_ENABLED(OF_LIVE_LAZY) &&
+	    of_live_is_lazy(root ? root : gd_of_root()))
+		return of_live_find_phandle(handle);
+
+	if (CONFIG_IS_ENABLED(OF_PHANDLE_CACHE) &&
+	    ((of_phandle_cache.slot && of_phandle_cache.root == root &&
+	      of_phandle_cache.top == (root ? root : gd_of_root())) ||
+	     of_phandle_cache_build(root))) {
+		for (i = handle & of_phandle_cache.mask;
+		     (np = of_phandle_cache.slot[i]);
+		     i = (i + 1) & of_phandle_cache.mask) {
+			if (np->phandle == handle)
+				return np;
+		}
+	}
+
+	/*
+	 * Either the phandle does not exist or the tree changed since it was
+	 * indexed. Find out the slow way, and index it again next time if the
+	 * node is there after all.
+	 */
 	for_each_of_allnodes_from(root, np)
 		if (np->phandle == handle)
 			break;
+	if (np)
+		of_phandle_cache_invalidate();
 	(void)of_node_get(np);
 
 	return np;
@@ -945,7 +1030,13 @@ int of_write_prop(struct device_node *np, const char *propname, int len,
 	if (!np)
 		return -EINVAL;
 
-	for (pp = np->properties; pp; pp = pp->next) {
+	/* Keep phandle lookups in step with the property */
+	if (!strcmp(propname, "phandle")) {
+		np->phandle = len == sizeof(u32) ? be32_to_cpup(value) : 0;
+		of_phandle_cache_invalidate();
+	}
+
+	for (pp = of_node_properties(np); pp; pp = pp->next) {
 		if (strcmp(pp->name, propname) == 0) {
 			/* Property exists -> change value */
 			pp->value = (void *)value;
@@ -1035,6 +1126,7 @@ int of_add_subnode(struct device_node *parent, const char *name, int len,
 	if (!parent->child)
 		parent->child = new;
 	new->parent = parent;
+	of_phandle_cache_invalidate();
 
 	*childp = new;
 
@@ -1087,6 +1179,8 @@ int of_remove_node(struct device_node *to_remove)
 	if (!np)
 		return -EFAULT;
 
+	of_phandle_cache_invalidate();
+
 	/* if there is a previous node, link it to this one's sibling */
 	if (prev)
 		prev->sibling = np->sibling;
@@ -573,7 +573,7 @@ ofnode ofnode_find_subnode(ofnode node, const char *subnode_name)
 	if (ofnode_is_np(node)) {
 		struct device_node *np = ofnode_to_np(node);
 
-		for (np = np->child; np; np = np->sibling) {
+		for (np = of_node_child(np); np; np = np->sibling) {
 			if (!strcmp(subnode_name, np->name))
 				break;
 		}
@@ -631,7 +631,7 @@ ofnode ofnode_first_subnode(ofnode node)
 {
 	assert(ofnode_valid(node));
 	if (ofnode_is_np(node))
-		return np_to_ofnode(node.np->child);
+		return np_to_ofnode(of_node_child(node.np));
 
 	return noffset_to_ofnode(node,
 		fdt_first_subnode(ofnode_to_fdt(node), ofnode_to_offset(node)));
@@ -707,8 +707,8 @@ ofnode ofnode_get_by_phandle(uint phandle)
 	if (of_live_active())
 		node = np_to_ofnode(of_find_node_by_phandle(NULL, phandle));
 	else
-		node.of_offset = fdt_node_offset_by_phandle(gd->fdt_blob,
-							    phandle);
+		node.of_offset = fdtdec_node_offset_by_phandle(gd->fdt_blob,
+							       phandle);
 
 	return node;
 }
@@ -721,8 +721,8 @@ ofnode oftree_get_by_phandle(oftree tree, uint phandle)
 		node = np_to_ofnode(of_find_node_by_phandle(tree.np, phandle));
 	else
 		node = ofnode_from_tree_offset(tree,
-			fdt_node_offset_by_phandle(oftree_lookup_fdt(tree),
-						   phandle));
+			fdtdec_node_offset_by_phandle(oftree_lookup_fdt(tree),
+						      phandle));
 
 	return node;
 }
@@ -0,0 +1,460 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Probe plan: binding devices from a record of a previous scan
+ *
+ * See dm/plan.h for the format of the plan
+ */
+
+#define LOG_CATEGORY LOGC_DM
+
+#include <common.h>
+#include <bloblist.h>
+#include <dm.h>
+#include <errno.h>
+#include <log.h>
+#include <malloc.h>
+#include <u-boot/crc.h>
+#include <version_string.h>
+#include <asm/global_data.h>
+#include <dm/device-internal.h>
+#include <dm/plan.h>
+#include <dm/root.h>
+#include <dm/util.h>
+#include <linux/libfdt.h>
+
+DECLARE_GLOBAL_DATA_PTR;
+
+enum {
+	PLAN_CHUNK_RECS	= 32,
+};
+
+/**
+ * struct dm_plan_rec - A node bound while recording a plan
+ *
+ * @dev: Device bound, or NULL if not bound yet
+ * @parent: Parent device
+ * @node: Offset of the node in the devicetree
+ * @idx: Index of the entry in the saved plan, or -1 if it is left out
+ */
+struct dm_plan_rec {
+	struct udevice *dev;
+	struct udevice *parent;
+	int node;
+	int idx;
+};
+
+/**
+ * struct dm_plan_chunk - A block of records
+ *
+ * Records are allocated in chunks since before relocation free() does nothing
+ * and realloc() would waste the space used by each old copy
+ *
+ * @next: Next chunk, or NULL
+ * @count: Number of records used in this chunk
+ * @rec: Records
+ */
+struct dm_plan_chunk {
+	struct dm_plan_chunk *next;
+	int count;
+	struct dm_plan_rec rec[PLAN_CHUNK_RECS];
+};
+
+/**
+ * struct dm_plan_state - State while recording or binding from a plan
+ *
+ * @replay: true if binding from a plan, false if recording one
+ * @failed: true if recording failed, so the plan must not be saved
+ * @first: First chunk of records, when recording
+ * @last: Last chunk of records, when recording
+ * @cur_node: Node offset of the entry being bound, when replaying
+ * @cur_drv: Driver of the entry being bound, when replaying
+ */
+struct dm_plan_state {
+	bool replay;
+	bool failed;
+	struct dm_plan_chunk *first;
+	struct dm_plan_chunk *last;
+	int cur_node;
+	const struct driver *cur_drv;
+};
+
+static uint plan_tag(bool pre_reloc_only)
+{
+	return pre_reloc_only ? BLOBLISTT_U_BOOT_DM_PLAN_F :
+		BLOBLISTT_U_BOOT_DM_PLAN_R;
+}
+
+static u32 plan_key(void)
+{
+	struct driver *drv = ll_entry_start(struct driver, driver);
+	const void *blob = gd->fdt_blob;
+	u32 n_ents = ll_entry_count(struct driver, driver);
+	u32 key, i;
+
+	key = crc32(0, (const uchar *)version_string, strlen(version_string));
+	key = crc32(key, (const uchar *)&n_ents, sizeof(n_ents));
+
+	/* The version may not change when drivers are added or reordered */
+	for (i = 0; i < n_ents; i++, drv++)
+		key = crc32(key, (const uchar *)drv->name,
+			    strlen(drv->name) + 1);
+	key = crc32(key, blob + fdt_off_dt_struct(blob),
+		    fdt_size_dt_struct(blob));
+	key = crc32(key, blob + fdt_off_dt_strings(blob),
+		    fdt_size_dt_strings(blob));
+
+	return key;
+}
+
+/**
+ * plan_check_match() - Check that an entry's node still matches its driver
+ *
+ * @drv: Driver of the entry
+ * @entry: Entry to check
+ * Return: true if the node is compatible with the of_match entry that the
+ *	driver was bound with, or the entry has no match
+ */
+static bool plan_check_match(struct driver *drv, struct dm_plan_entry *entry)
+{
+	const struct udevice_id *of_match = drv->of_match;
+	int i;
+
+	if (entry->match == DM_PLAN_NO_MATCH)
+		return true;
+	for (i = 0; of_match && of_match[i].compatible; i++) {
+		if (i == entry->match)
+			break;
+	}
+	if (!of_match || !of_match[i].compatible)
+		return false;
+
+	return ofnode_device_is_compatible(offset_to_ofnode(entry->node),
+					   of_match[i].compatible);
+}
+
+/**
+ * plan_find() - Find a valid plan in the bloblist
+ *
+ * @pre_reloc_only: true to find the pre-relocation plan
+ * @key: Key for the current devicetree and U-Boot
+ * Return: plan header, or NULL if there is no valid plan
+ */
+static struct dm_plan_hdr *plan_find(bool pre_reloc_only, u32 key)
+{
+	struct driver *drivers = ll_entry_start(struct driver, driver);
+	const int n_ents = ll_entry_count(struct driver, driver);
+	struct dm_plan_entry *entry;
+	struct dm_plan_hdr *hdr;
+	int size;
+	uint i;
+
+	hdr = bloblist_find(plan_tag(pre_reloc_only), 0);
+	if (!hdr || hdr->magic != DM_PLAN_MAGIC || hdr->key != key)
+		return NULL;
+	size = sizeof(*hdr) + hdr->count * sizeof(*entry);
+	if (!bloblist_find(plan_tag(pre_reloc_only), size))
+		return NULL;
+
+	entry = (struct dm_plan_entry *)(hdr + 1);
+	for (i = 0; i < hdr->count; i++, entry++) {
+		if (entry->driver >= n_ents ||
+		    (entry->parent != DM_PLAN_ROOT && entry->parent >= i))
+			return NULL;
+		if (!plan_check_match(drivers + entry->driver, entry)) {
+			log_debug("Plan entry %d does not match its node\n", i);
+			return NULL;
+		}
+	}
+
+	return hdr;
+}
+
+static int plan_bind(struct dm_plan_state *state, struct dm_plan_hdr *hdr)
+{
+	struct driver *drivers = ll_entry_start(struct driver, driver);
+	struct dm_plan_entry *entry;
+	struct udevice **devs;
+	int ret = 0;
+	uint i;
+
+	devs = calloc(hdr->count, sizeof(*devs));
+	if (hdr->count && !devs)
+		return log_msg_ret("pln", -ENOMEM);
+
+	entry = (struct dm_plan_entry *)(hdr + 1);
+	for (i = 0; i < hdr->count; i++, entry++) {
+		struct driver *drv = drivers + entry->driver;
+		struct udevice *parent;
+		ulong driver_data = 0;
+		ofnode node;
+		int err;
+
+		if (entry->parent == DM_PLAN_ROOT)
+			parent = gd->dm_root;
+		else
+			parent = devs[entry->parent];
+
+		/* The parent failed to bind, so neither can its children */
+		if (!parent)
+			continue;
+
+		if (entry->match != DM_PLAN_NO_MATCH)
+			driver_data = drv->of_match[entry->match].data;
+		node = offset_to_ofnode(entry->node);
+		state->cur_node = entry->node;
+		state->cur_drv = drv;
+		err = device_bind_with_driver_data(parent, drv,
+						   ofnode_get_name(node),
+						   driver_data, node, &devs[i]);
+		if (err) {
+			dm_warn("Error binding driver '%s': %d\n", drv->name,
+				err);
+			if (!ret)
+				ret = err;
+		}
+	}
+	free(devs);
+
+	return ret;
+}
+
+bool dm_plan_skip_scan(struct udevice *parent)
+{
+	struct dm_plan_state *state = gd_dm_plan();
+
+	if (!state || !state->replay)
+		return false;
+
+	/* Only skip the scan in the bind() of a device from the plan */
+	return parent == gd->dm_root ||
+		(parent->driver == state->cur_drv &&
+		 ofnode_to_offset(dev_ofnode(parent)) == state->cur_node);
+}
+
+void *dm_plan_add(struct udevice *parent, int node_offset)
+{
+	struct dm_plan_state *state = gd_dm_plan();
+	struct dm_plan_chunk *chunk;
+	struct dm_plan_rec *rec;
+
+	if (!state || state->replay || state->failed)
+		return NULL;
+
+	chunk = state->last;
+	if (!chunk || chunk->count == PLAN_CHUNK_RECS) {
+		chunk = calloc(1, sizeof(*chunk));
+		if (!chunk) {
+			state->failed = true;
+			return NULL;
+		}
+		if (state->last)
+			state->last->next = chunk;
+		else
+			state->first = chunk;
+		state->last = chunk;
+	}
+	rec = &chunk->rec[chunk->count++];
+	rec->parent = parent;
+	rec->node = node_offset;
+	rec->dev = NULL;
+
+	return rec;
+}
+
+void dm_plan_set_dev(void *ptr, struct udevice *dev, int ret)
+{
+	struct dm_plan_state *state = gd_dm_plan();
+	struct dm_plan_rec *rec = ptr;
+
+	if (!rec)
+		return;
+	if (ret)
+		state->failed = true;
+
+	/*
+	 * Without a device no bind() method ran, so nothing was added after
+	 * this record and it can simply be dropped
+	 */
+	if (!dev) {
+		state->last->count--;
+		return;
+	}
+	rec->dev = dev;
+}
+
+/**
+ * plan_find_dev() - Find the entry which bound a device
+ *
+ * @state: Plan state
+ * @dev: Device to look for
+ * @idxp: Returns the index of the entry, or DM_PLAN_ROOT for the root device
+ * Return: true if found, false if @dev is not in the plan
+ */
+static bool plan_find_dev(struct dm_plan_state *state, struct udevice *dev,
+			  u32 *idxp)
+{
+	struct dm_plan_chunk *chunk;
+	int i;
+
+	if (dev == gd->dm_root) {
+		*idxp = DM_PLAN_ROOT;
+		return true;
+	}
+	for (chunk = state->first; chunk; chunk = chunk->next) {
+		for (i = 0; i < chunk->count; i++) {
+			struct dm_plan_rec *rec = &chunk->rec[i];
+
+			if (rec->dev == dev) {
+				*idxp = rec->idx;
+				return rec->idx != -1;
+			}
+		}
+	}
+
+	return false;
+}
+
+/* Find the of_match entry used to bind @dev */
+static int plan_find_match(struct udevice *dev)
+{
+	const struct udevice_id *of_match = dev->driver->of_match;
+	const char *compat_list, *compat;
+	int compat_length, i, j;
+
+	compat_list = ofnode_get_property(dev_ofnode(dev), "compatible",
+					  &compat_length);
+	for (i = 0; of_match && compat_list && i < compat_length;
+	     i += strlen(compat) + 1) {
+		compat = compat_list + i;
+		for (j = 0; of_match[j].compatible; j++) {
+			if (!strcmp(of_match[j].compatible, compat))
+				return j;
+		}
+	}
+
+	return DM_PLAN_NO_MATCH;
+}
+
+/**
+ * plan_save() - Write the recorded plan to the bloblist
+ *
+ * Return: 0 if OK, -ENOSPC if there is not enough space, other -ve on error
+ */
+static int plan_save(struct dm_plan_state *state, bool pre_reloc_only,
+		     u32 key)
+{
+	struct driver *drivers = ll_entry_start(struct driver, driver);
+	uint tag = plan_tag(pre_reloc_only);
+	struct dm_plan_entry *entry;
+	struct dm_plan_chunk *chunk;
+	struct dm_plan_hdr *hdr;
+	int count, size, ret, i;
+	u32 parent;
+
+	/*
+	 * Number the entries, leaving out those whose parent is not in the
+	 * plan, e.g. because the parent was bound by its own parent's bind()
+	 * method. Those are still bound by scanning, when using the plan.
+	 * Parents come first, so are numbered by the time they are needed.
+	 */
+	count = 0;
+	for (chunk = state->first; chunk; chunk = chunk->next) {
+		for (i = 0; i < chunk->count; i++) {
+			struct dm_plan_rec *rec = &chunk->rec[i];
+
+			rec->idx = -1;
+			if (plan_find_dev(state, rec->parent, &parent))
+				rec->idx = count++;
+		}
+	}
+
+	size = sizeof(*hdr) + count * sizeof(*entry);
+	hdr = bloblist_find(tag, 0);
+	if (hdr) {
+		ret = bloblist_resize(tag, size);
+		if (ret)
+			return log_msg_ret("res", ret);
+		hdr = bloblist_find(tag, size);
+	} else {
+		hdr = bloblist_add(tag, size, 0);
+	}
+	if (!hdr)
+		return log_msg_ret("add", -ENOSPC);
+
+	hdr->magic = 0;
+	entry = (struct dm_plan_entry *)(hdr + 1);
+	for (chunk = state->first; chunk; chunk = chunk->next) {
+		for (i = 0; i < chunk->count; i++) {
+			struct dm_plan_rec *rec = &chunk->rec[i];
+			struct udevice *dev = rec->dev;
+			ulong driver_data = 0;
+
+			if (rec->idx == -1)
+				continue;
+			entry->node = rec->node;
+			entry->driver = dev->driver - drivers;
+			entry->match = plan_find_match(dev);
+			plan_find_dev(state, rec->parent, &entry->parent);
+
+			/* Make sure the plan gives the same driver data */
+			if (entry->match != DM_PLAN_NO_MATCH)
+				driver_data = dev->driver->of_match[entry->match].data;
+			if (dev->driver_data != driver_data)
+				return log_msg_ret("dat", -EINVAL);
+			entry++;
+		}
+	}
+	hdr->key = key;
+	hdr->count = count;
+	hdr->magic = DM_PLAN_MAGIC;
+	log_debug("Saved plan with %d entries\n", count);
+
+	return 0;
+}
+
+static void plan_free(struct dm_plan_state *state)
+{
+	struct dm_plan_chunk *chunk, *next;
+
+	for (chunk = state->first; chunk; chunk = next) {
+		next = chunk->next;
+		free(chunk);
+	}
+	free(state);
+}
+
+int dm_plan_scan(bool pre_reloc_only)
+{
+	struct dm_plan_state *state;
+	struct dm_plan_hdr *hdr;
+	u32 key;
+	int ret;
+
+	if (of_live_active() || !gd->bloblist)
+		return dm_extended_scan(pre_reloc_only);
+
+	state = calloc(1, sizeof(*state));
+	if (!state)
+		return dm_extended_scan(pre_reloc_only);
+
+	key = plan_key();
+	hdr = plan_find(pre_reloc_only, key);
+	gd_set_dm_plan(state);
+	if (hdr) {
+		log_debug("Binding %d devices from plan\n", hdr->count);
+		state->replay = true;
+		ret = plan_bind(state, hdr);
+	} else {
+		ret = dm_extended_scan(pre_reloc_only);
+		if (!ret && !state->failed) {
+			ret = plan_save(state, pre_reloc_only, key);
+			if (ret)
+				log_debug("Cannot save plan (err=%dE)\n", ret);
+			ret = 0;
+		}
+	}
+	gd_set_dm_plan(NULL);
+	plan_free(state);
+
+	return ret;
+}
@@ -22,6 +22,7 @@
 #include <dm/lists.h>
 #include <dm/of.h>
 #include <dm/of_access.h>
+#include <dm/plan.h>
 #include <dm/platdata.h>
 #include <dm/read.h>
 #include <dm/root.h>
@@ -105,6 +106,9 @@ int dm_init(bool of_live)
 	} else {
 		gd->uclass_root = &DM_UCLASS_ROOT_S_NON_CONST;
 		INIT_LIST_HEAD(DM_UCLASS_ROOT_NON_CONST);
+#if CONFIG_IS_ENABLED(DM_UCLASS_ARRAY)
+		memset(gd->uclass_array, '\0', sizeof(gd->uclass_array));
+#endif
 	}
 
 	if (CONFIG_IS_ENABLED(OF_PLATDATA_INST)) {
@@ -191,11 +195,17 @@ static int dm_scan_fdt_node(struct udevice *parent, ofnode parent_node,
 			    bool pre_reloc_only)
 {
 	int ret = 0, err = 0;
+	struct udevice *dev;
 	ofnode node;
+	void *rec;
 
 	if (!ofnode_valid(parent_node))
 		return 0;
 
+	/* When binding from a probe plan, the children are in the plan too */
+	if (dm_plan_skip_scan(parent))
+		return 0;
+
 	for (node = ofnode_first_subnode(parent_node);
 	     ofnode_valid(node);
 	     node = ofnode_next_subnode(node)) {
@@ -205,7 +215,9 @@ static int dm_scan_fdt_node(struct udevice *parent, ofnode parent_node,
 			pr_debug("   - ignoring disabled device\n");
 			continue;
 		}
-		err = lists_bind_fdt(parent, node, NULL, NULL, pre_reloc_only);
+		rec = dm_plan_add(parent, ofnode_to_offset(node));
+		err = lists_bind_fdt(parent, node, &dev, NULL, pre_reloc_only);
+		dm_plan_set_dev(rec, dev, err);
 		if (err && !ret) {
 			ret = err;
 			debug("%s: ret=%d\n", node_name, ret);
@@ -296,6 +308,13 @@ static int dm_probe_devices(struct udevice *dev, bool pre_reloc_only)
 		ret = device_probe(dev);
 		if (ret)
 			return ret;
+
+		/*
+		 * The device is waiting for its hardware, so come back for the
+		 * children when it is ready, rather than wait for it now
+		 */
+		if (dev_get_flags(dev) & DM_FLAG_PROBE_DEFERRED)
+			return 0;
 	}
 
 probe_children:
@@ -305,6 +324,45 @@ probe_children:
 	return 0;
 }
 
+static int dm_probe_children(struct udevice *dev, void *ctx)
+{
+	bool pre_reloc_only = *(bool *)ctx;
+	struct udevice *child;
+	int err = 0;
+	int ret;
+
+	list_for_each_entry(child, &dev->child_head, sibling_node) {
+		ret = dm_probe_devices(child, pre_reloc_only);
+		if (ret && !err)
+			err = ret;
+	}
+
+	return err;
+}
+
+/**
+ * dm_probe_all() - Probe devices which must be probed after binding
+ *
+ * Where drivers defer waiting for their hardware (see dev_probe_defer()),
+ * the other devices are probed meanwhile, then the children of each deferred
+ * device once it is ready.
+ *
+ * @pre_reloc_only: If true, probe only pre-relocation devices
+ * Return: 0 if OK, -ve on error
+ */
+static int dm_probe_all(bool pre_reloc_only)
+{
+	int ret, err;
+
+	if (dm_probe_async_begin())
+		return dm_probe_devices(gd->dm_root, pre_reloc_only);
+
+	ret = dm_probe_devices(gd->dm_root, pre_reloc_only);
+	err = dm_probe_async_end(dm_probe_children, &pre_reloc_only);
+
+	return ret ? ret : err;
+}
+
 /**
  * dm_scan() - Scan tables to bind devices
  *
@@ -326,7 +384,10 @@ static int dm_scan(bool pre_reloc_only)
 	}
 
 	if (CONFIG_IS_ENABLED(OF_REAL)) {
-		ret = dm_extended_scan(pre_reloc_only);
+		if (CONFIG_IS_ENABLED(DM_PLAN))
+			ret = dm_plan_scan(pre_reloc_only);
+		else
+			ret = dm_extended_scan(pre_reloc_only);
 		if (ret) {
 			debug("dm_extended_scan() failed: %d\n", ret);
 			return ret;
@@ -337,7 +398,7 @@ static int dm_scan(bool pre_reloc_only)
 	if (ret)
 		return ret;
 
-	return dm_probe_devices(gd->dm_root, pre_reloc_only);
+	return dm_probe_all(pre_reloc_only);
 }
 
 int dm_init_and_scan(bool pre_reloc_only)
@@ -29,11 +29,9 @@ struct uclass *uclass_find(enum uclass_id key)
 
 	if (!gd->dm_root)
 		return NULL;
-	/*
-	 * TODO(sjg@chromium.org): Optimise this, perhaps moving the found
-	 * node to the start of the list, or creating a linear array mapping
-	 * id to node.
-	 */
+	if (CONFIG_IS_ENABLED(DM_UCLASS_ARRAY))
+		return (uint)key < UCLASS_COUNT ? gd_uclass(key) : NULL;
+
 	list_for_each_entry(uc, gd->uclass_root, sibling_node) {
 		if (uc->uc_drv->id == key)
 			return uc;
@@ -86,6 +84,7 @@ static int uclass_add(enum uclass_id id, struct uclass **ucp)
 	INIT_LIST_HEAD(&uc->sibling_node);
 	INIT_LIST_HEAD(&uc->dev_head);
 	list_add(&uc->sibling_node, DM_UCLASS_ROOT_NON_CONST);
+	gd_set_uclass(id, uc);
 
 	if (uc_drv->init) {
 		ret = uc_drv->init(uc);
@@ -102,6 +101,7 @@ fail:
 		uclass_set_priv(uc, NULL);
 	}
 	list_del(&uc->sibling_node);
+	gd_set_uclass(id, NULL);
 fail_mem:
 	free(uc);
 
@@ -135,6 +135,7 @@ int uclass_destroy(struct uclass *uc)
 	if (uc_drv->destroy)
 		uc_drv->destroy(uc);
 	list_del(&uc->sibling_node);
+	gd_set_uclass(uc_drv->id, NULL);
 	if (uc_drv->priv_auto)
 		free(uclass_get_priv(uc));
 	free(uc);
@@ -403,6 +403,20 @@ static int sb_eth_write_hwaddr(struct udevice *dev)
 	return 0;
 }
 
+static int sb_eth_mcast(struct udevice *dev, const u8 *enetaddr, int join)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+
+	debug("eth_sandbox %s: %s multicast %pM\n", dev->name,
+	      join ? "Join" : "Leave", enetaddr);
+	if (join)
+		memcpy(priv->mcast_hwaddr, enetaddr, ARP_HLEN);
+	else if (!memcmp(priv->mcast_hwaddr, enetaddr, ARP_HLEN))
+		memset(priv->mcast_hwaddr, '\0', ARP_HLEN);
+
+	return 0;
+}
+
 static const struct eth_ops sb_eth_ops = {
 	.start			= sb_eth_start,
 	.send			= sb_eth_send,
@@ -410,6 +424,7 @@ static const struct eth_ops sb_eth_ops = {
 	.free_pkt		= sb_eth_free_pkt,
 	.stop			= sb_eth_stop,
 	.write_hwaddr		= sb_eth_write_hwaddr,
+	.mcast			= sb_eth_mcast,
 };
 
 static int sb_eth_remove(struct udevice *dev)
@@ -8,6 +8,7 @@
 #include <blk.h>
 #include <bootdev.h>
 #include <cpu_func.h>
+#include <cyclic.h>
 #include <dm.h>
 #include <errno.h>
 #include <log.h>
@@ -18,7 +19,8 @@
 #include <linux/compat.h>
 #include "nvme.h"
 
-#define NVME_Q_DEPTH		2
+#define NVME_Q_DEPTH		CONFIG_NVME_QUEUE_DEPTH
+#define NVME_SYNC_Q_DEPTH	2
 #define NVME_AQ_DEPTH		2
 #define NVME_SQ_SIZE(depth)	(depth * sizeof(struct nvme_command))
 #define NVME_CQ_SIZE(depth)	(depth * sizeof(struct nvme_completion))
@@ -40,13 +42,27 @@ static int nvme_wait_csts(struct nvme_dev *dev, u32 mask, u32 val)
 	while (get_timer(start) < timeout) {
 		if ((readl(&dev->bar->csts) & mask) == val)
 			return 0;
+		schedule();
 	}
 
 	return -ETIME;
 }
 
-static int nvme_setup_prps(struct nvme_dev *dev, u64 *prp2,
-			   int total_len, u64 dma_addr)
+/**
+ * nvme_setup_prp_pool() - set up the PRPs for a transfer
+ *
+ * @dev:	NVMe device
+ * @prp2:	Returns the value to use for PRP entry 2
+ * @total_len:	Number of bytes to transfer
+ * @dma_addr:	Address of the buffer
+ * @poolp:	PRP list to use if one is needed; this is reallocated if it is
+ *		too small
+ * @entry_num:	Number of entries in @poolp, updated if it is reallocated
+ * Return: 0 if OK, -ENOMEM if the PRP list cannot be allocated
+ */
+static int nvme_setup_prp_pool(struct nvme_dev *dev, u64 *prp2,
+			       int total_len, u64 dma_addr,
+			       u64 **poolp, u32 *entry_num)
 {
 	u32 page_size = dev->page_size;
 	int offset = dma_addr & (page_size - 1);
@@ -74,41 +90,49 @@ static int nvme_setup_prps(struct nvme_dev *dev, u64 *prp2,
 	nprps = DIV_ROUND_UP(length, page_size);
 	num_pages = DIV_ROUND_UP(nprps - 1, prps_per_page - 1);
 
-	if (nprps > dev->prp_entry_num) {
-		free(dev->prp_pool);
+	if (nprps > *entry_num) {
+		free(*poolp);
 		/*
 		 * Always increase in increments of pages.  It doesn't waste
 		 * much memory and reduces the number of allocations.
 		 */
-		dev->prp_pool = memalign(page_size, num_pages * page_size);
-		if (!dev->prp_pool) {
+		*poolp = memalign(page_size, num_pages * page_size);
+		if (!*poolp) {
 			printf("Error: malloc prp_pool fail\n");
+			*entry_num = 0;
 			return -ENOMEM;
 		}
-		dev->prp_entry_num = num_pages * (prps_per_page - 1) + 1;
+		*entry_num = num_pages * (prps_per_page - 1) + 1;
 	}
 
-	prp_pool = dev->prp_pool;
+	prp_pool = *poolp;
 	i = 0;
 	while (nprps) {
 		if ((i == (prps_per_page - 1)) && nprps > 1) {
 			*(prp_pool + i) = cpu_to_le64((ulong)prp_pool +
 					page_size);
 			i = 0;
-			prp_pool += page_size;
+			prp_pool += prps_per_page;
 		}
 		*(prp_pool + i++) = cpu_to_le64(dma_addr);
 		dma_addr += page_size;
 		nprps--;
 	}
-	*prp2 = (ulong)dev->prp_pool;
+	*prp2 = (ulong)*poolp;
 
-	flush_dcache_range((ulong)dev->prp_pool, (ulong)dev->prp_pool +
+	flush_dcache_range((ulong)*poolp, (ulong)*poolp +
 			   num_pages * page_size);
 
 	return 0;
 }
 
+static int nvme_setup_prps(struct nvme_dev *dev, u64 *prp2,
+			   int total_len, u64 dma_addr)
+{
+	return nvme_setup_prp_pool(dev, prp2, total_len, dma_addr,
+				   &dev->prp_pool, &dev->prp_entry_num);
+}
+
 static __le16 nvme_get_cmd_id(void)
 {
 	static unsigned short cmdid;
@@ -182,6 +206,7 @@ static int nvme_submit_sync_cmd(struct nvme_queue *nvmeq,
 		if (timeout_us > 0 && (timer_get_us() - start_time)
 		    >= timeout_us)
 			return -ETIMEDOUT;
+		schedule();
 	}
 
 	ops = (struct nvme_ops *)nvmeq->dev->udev->driver->ops;
@@ -740,8 +765,8 @@ static int nvme_blk_probe(struct udevice *udev)
 	return 0;
 }
 
-static ulong nvme_blk_rw(struct udevice *udev, lbaint_t blknr,
-			 lbaint_t blkcnt, void *buffer, bool read)
+static ulong nvme_blk_rw_sync(struct udevice *udev, lbaint_t blknr,
+			      lbaint_t blkcnt, void *buffer, bool read)
 {
 	struct nvme_ns *ns = dev_get_priv(udev);
 	struct nvme_dev *dev = ns->dev;
@@ -757,9 +782,6 @@ static ulong nvme_blk_rw(struct udevice *udev, lbaint_t blknr,
 	u16 lbas = 1 << (dev->max_transfer_shift - ns->lba_shift);
 	u64 total_lbas = blkcnt;
 
-	flush_dcache_range((unsigned long)buffer,
-			   (unsigned long)buffer + total_len);
-
 	c.rw.opcode = read ? nvme_cmd_read : nvme_cmd_write;
 	c.rw.flags = 0;
 	c.rw.nsid = cpu_to_le32(ns->ns_id);
@@ -794,11 +816,238 @@ static ulong nvme_blk_rw(struct udevice *udev, lbaint_t blknr,
 		temp_buffer += lbas << ns->lba_shift;
 	}
 
+	return (total_len - temp_len) >> desc->log2blksz;
+}
+
+/**
+ * nvme_reap_completions() - process all completions posted to an I/O queue
+ *
+ * This handles every new entry in the completion queue and then updates the
+ * head doorbell once, for the whole batch.
+ *
+ * @nvmeq:	I/O queue
+ * @failed:	Updated to the lowest starting block of any command which
+ *		failed
+ * Return: number of completions processed
+ */
+static int nvme_reap_completions(struct nvme_queue *nvmeq, u64 *failed)
+{
+	struct nvme_dev *dev = nvmeq->dev;
+	u16 head = nvmeq->cq_head;
+	u16 phase = nvmeq->cq_phase;
+	int reaped = 0;
+
+	for (;;) {
+		struct nvme_io_slot *slot;
+		u16 status, cid;
+
+		status = nvme_read_completion_status(nvmeq, head);
+		if ((status & 0x01) != phase)
+			break;
+
+		cid = readw(&nvmeq->cqes[head].command_id);
+		slot = &dev->slots[cid % nvmeq->q_depth];
+		status >>= 1;
+		if (status) {
+			printf("ERROR: status = %x, slba = %llx, head = %d\n",
+			       status, slot->slba, head);
+			*failed = min(*failed, slot->slba);
+		}
+		slot->busy = false;
+		reaped++;
+
+		if (++head == nvmeq->q_depth) {
+			head = 0;
+			phase = !phase;
+		}
+	}
+
+	if (reaped) {
+		writel(head, nvmeq->q_db + dev->db_stride);
+		nvmeq->cq_head = head;
+		nvmeq->cq_phase = phase;
+	}
+
+	return reaped;
+}
+
+/**
+ * nvme_reset_io_queue() - abort all commands in flight on the I/O queue
+ *
+ * Deleting the submission queue makes the controller abort the commands in
+ * it. Both queues are then created again, empty, and all slots are freed.
+ *
+ * @dev:	NVMe device
+ * Return: 0 if OK, -ve on error
+ */
+static int nvme_reset_io_queue(struct nvme_dev *dev)
+{
+	struct nvme_queue *nvmeq = dev->queues[NVME_IO_Q];
+	int i;
+
+	nvme_delete_sq(dev, NVME_IO_Q);
+	nvme_delete_cq(dev, NVME_IO_Q);
+	for (i = 0; i < nvmeq->q_depth; i++)
+		dev->slots[i].busy = false;
+
+	/* nvme_init_queue() counts the queue as online again */
+	dev->online_queues--;
+
+	return nvme_create_queue(nvmeq, NVME_IO_Q);
+}
+
+/**
+ * nvme_release_slots() - free the I/O slots after a transfer
+ *
+ * This marks all slots as free and frees their PRP lists
+ *
+ * @dev:	NVMe device
+ */
+static void nvme_release_slots(struct nvme_dev *dev)
+{
+	int i;
+
+	for (i = 0; i < dev->q_depth; i++) {
+		struct nvme_io_slot *slot = &dev->slots[i];
+
+		free(slot->prp_pool);
+		slot->prp_pool = NULL;
+		slot->prp_entry_num = 0;
+		slot->busy = false;
+	}
+}
+
+/**
+ * nvme_blk_rw_queued() - transfer blocks with many commands in flight
+ *
+ * The transfer is split into commands of at most the maximum transfer size,
+ * each with its own PRP list. The submission queue is kept as full as
+ * possible, with one doorbell write per batch of new commands, and
+ * completions are reaped in batches as they arrive.
+ *
+ * If commands stop completing, the I/O queue is reset so that no slot is left
+ * busy. The slots are released whatever happens.
+ *
+ * Return: number of blocks transferred before the first failure, which
+ * includes any command which timed out
+ */
+static ulong nvme_blk_rw_queued(struct udevice *udev, lbaint_t blknr,
+				lbaint_t blkcnt, void *buffer, bool read)
+{
+	struct nvme_ns *ns = dev_get_priv(udev);
+	struct nvme_dev *dev = ns->dev;
+	struct nvme_queue *nvmeq = dev->queues[NVME_IO_Q];
+	u16 max_lbas = 1 << (dev->max_transfer_shift - ns->lba_shift);
+	uintptr_t temp_buffer = (uintptr_t)buffer;
+	ulong timeout_us = IO_TIMEOUT * 100000;
+	u64 slba = blknr;
+	u64 end = blknr + blkcnt;
+	u64 failed = end;
+	int inflight = 0;
+	ulong start_time;
+	struct nvme_command c;
+	int i;
+
+	memset(&c, 0, sizeof(c));
+	c.rw.opcode = read ? nvme_cmd_read : nvme_cmd_write;
+	c.rw.nsid = cpu_to_le32(ns->ns_id);
+
+	start_time = timer_get_us();
+	while (slba < end || inflight) {
+		int queued = 0;
+		int reaped;
+
+		/* keep one entry free so a full queue looks different to empty */
+		while (slba < end && failed == end &&
+		       inflight < nvmeq->q_depth - 1) {
+			struct nvme_io_slot *slot;
+			u16 lbas = min_t(u64, max_lbas, end - slba);
+			u16 cid;
+			u64 prp2;
+
+			for (cid = 0; cid < nvmeq->q_depth; cid++) {
+				if (!dev->slots[cid].busy)
+					break;
+			}
+			if (cid == nvmeq->q_depth)
+				break;
+			slot = &dev->slots[cid];
+			if (nvme_setup_prp_pool(dev, &prp2,
+						lbas << ns->lba_shift,
+						temp_buffer, &slot->prp_pool,
+						&slot->prp_entry_num)) {
+				failed = slba;
+				break;
+			}
+
+			c.rw.command_id = cpu_to_le16(cid);
+			c.rw.slba = cpu_to_le64(slba);
+			c.rw.length = cpu_to_le16(lbas - 1);
+			c.rw.prp1 = cpu_to_le64(temp_buffer);
+			c.rw.prp2 = cpu_to_le64(prp2);
+			memcpy(&nvmeq->sq_cmds[nvmeq->sq_tail], &c, sizeof(c));
+			flush_dcache_range((ulong)&nvmeq->sq_cmds[nvmeq->sq_tail],
+					   (ulong)&nvmeq->sq_cmds[nvmeq->sq_tail] +
+					   sizeof(c));
+			if (++nvmeq->sq_tail == nvmeq->q_depth)
+				nvmeq->sq_tail = 0;
+
+			slot->busy = true;
+			slot->slba = slba;
+			inflight++;
+			queued++;
+			slba += lbas;
+			temp_buffer += lbas << ns->lba_shift;
+		}
+		if (queued)
+			writel(nvmeq->sq_tail, nvmeq->q_db);
+		if (!inflight)
+			break;
+
+		reaped = nvme_reap_completions(nvmeq, &failed);
+		if (reaped) {
+			inflight -= reaped;
+			start_time = timer_get_us();
+		} else if (timer_get_us() - start_time >= timeout_us) {
+			printf("ERROR: %d commands timed out\n", inflight);
+			for (i = 0; i < nvmeq->q_depth; i++) {
+				if (dev->slots[i].busy)
+					failed = min(failed, dev->slots[i].slba);
+			}
+			if (nvme_reset_io_queue(dev))
+				printf("ERROR: cannot reset I/O queue\n");
+			break;
+		} else {
+			schedule();
+		}
+	}
+	nvme_release_slots(dev);
+
+	return min(failed, end) - blknr;
+}
+
+static ulong nvme_blk_rw(struct udevice *udev, lbaint_t blknr,
+			 lbaint_t blkcnt, void *buffer, bool read)
+{
+	struct nvme_ns *ns = dev_get_priv(udev);
+	struct nvme_dev *dev = ns->dev;
+	struct blk_desc *desc = dev_get_uclass_plat(udev);
+	u64 total_len = blkcnt << desc->log2blksz;
+	ulong done;
+
+	flush_dcache_range((unsigned long)buffer,
+			   (unsigned long)buffer + total_len);
+
+	if (dev->slots)
+		done = nvme_blk_rw_queued(udev, blknr, blkcnt, buffer, read);
+	else
+		done = nvme_blk_rw_sync(udev, blknr, blkcnt, buffer, read);
+
 	if (read)
 		invalidate_dcache_range((unsigned long)buffer,
 					(unsigned long)buffer + total_len);
 
-	return (total_len - temp_len) >> desc->log2blksz;
+	return done;
 }
 
 static ulong nvme_blk_read(struct udevice *udev, lbaint_t blknr,
@@ -830,6 +1079,7 @@ int nvme_init(struct udevice *udev)
 {
 	struct nvme_dev *ndev = dev_get_priv(udev);
 	struct nvme_id_ns *id;
+	struct nvme_ops *ops;
 	int ret;
 
 	ndev->udev = udev;
@@ -850,6 +1100,13 @@ int nvme_init(struct udevice *udev)
 
 	ndev->cap = nvme_readq(&ndev->bar->cap);
 	ndev->q_depth = min_t(int, NVME_CAP_MQES(ndev->cap) + 1, NVME_Q_DEPTH);
+	/*
+	 * Controller-specific submission hooks expect commands to complete in
+	 * the order they were submitted, so only use them synchronously
+	 */
+	ops = (struct nvme_ops *)udev->driver->ops;
+	if (ops && (ops->submit_cmd || ops->complete_cmd))
+		ndev->q_depth = min(ndev->q_depth, NVME_SYNC_Q_DEPTH);
 	ndev->db_stride = 1 << NVME_CAP_STRIDE(ndev->cap);
 	ndev->dbs = ((void __iomem *)ndev->bar) + 4096;
 
@@ -876,6 +1133,13 @@ int nvme_init(struct udevice *udev)
 
 	nvme_get_info_from_identify(ndev);
 
+	/* Use the queued path if more than one command can be in flight */
+	if (ndev->q_depth > NVME_SYNC_Q_DEPTH) {
+		ndev->slots = calloc(ndev->q_depth, sizeof(*ndev->slots));
+		if (!ndev->slots)
+			log_debug("No memory for I/O slots, using sync I/O\n");
+	}
+
 	/* Create a blk device for each namespace */
 
 	id = memalign(ndev->page_size, sizeof(struct nvme_id_ns));
@@ -925,6 +1189,8 @@ int nvme_init(struct udevice *udev)
 free_id:
 	free(id);
 free_queue:
+	free(ndev->slots);
+	ndev->slots = NULL;
 	free((void *)ndev->queues);
 free_nvme:
 	return ret;
@@ -935,6 +1201,10 @@ int nvme_shutdown(struct udevice *udev)
 	struct nvme_dev *ndev = dev_get_priv(udev);
 	int ret;
 
+	/* Any later transfers use sync I/O */
+	free(ndev->slots);
+	ndev->slots = NULL;
+
 	ret = nvme_shutdown_ctrl(ndev);
 	if (ret < 0) {
 		printf("Error: %s: Shutdown timed out!\n", udev->name);
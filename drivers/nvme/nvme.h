@@ -594,6 +594,23 @@ enum {
 	NVME_CSTS_SHST_MASK	= 3 << 2,
 };
 
+/**
+ * struct nvme_io_slot - a read or write command in flight on the I/O queue
+ *
+ * The command ID of each queued command is the index of its slot.
+ *
+ * @prp_pool:		PRP list for this command
+ * @prp_entry_num:	Number of entries in @prp_pool
+ * @slba:		Starting block of the command
+ * @busy:		true if the command has not completed yet
+ */
+struct nvme_io_slot {
+	u64 *prp_pool;
+	u32 prp_entry_num;
+	u64 slba;
+	bool busy;
+};
+
 /* Represents an NVM Express device. Each nvme_dev is a PCI function. */
 struct nvme_dev {
 	struct udevice *udev;
@@ -621,6 +638,7 @@ struct nvme_dev {
 	u64 *prp_pool;
 	u32 prp_entry_num;
 	u32 nn;
+	struct nvme_io_slot *slots;	/* q_depth entries, NULL for sync I/O */
 };
 
 /* Admin queue and a single I/O queue. */
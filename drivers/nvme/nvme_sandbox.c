@@ -0,0 +1,388 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Sandbox NVMe controller
+ *
+ * This emulates enough of an NVMe controller to run the driver against it,
+ * with a single namespace held in memory. Commands are processed whenever
+ * the driver calls schedule() while waiting for them.
+ */
+
+#define LOG_CATEGORY UCLASS_NVME
+
+#include <common.h>
+#include <cyclic.h>
+#include <dm.h>
+#include <malloc.h>
+#include <memalign.h>
+#include <asm/test.h>
+#include <linux/sizes.h>
+#include "nvme.h"
+
+#define SB_NVME_PAGE_SIZE	SZ_4K
+#define SB_NVME_REGS_SIZE	SZ_8K	/* registers, then the doorbells */
+#define SB_NVME_DEPTH		16
+#define SB_NVME_MDTS		3	/* 32KB per command, with PRP lists */
+#define SB_NVME_LBA_SHIFT	9
+#define SB_NVME_BLOCKS		0x400
+
+/**
+ * struct sb_nvme_queue - a queue pair as seen by the controller
+ *
+ * @sq: Submission queue, in host memory
+ * @cq: Completion queue, in host memory
+ * @depth: Number of entries in each queue
+ * @sq_head: Next submission-queue entry to process
+ * @cq_tail: Next completion-queue entry to fill in
+ * @phase: Phase bit to use for completions
+ * @live: true if the submission queue has been created
+ */
+struct sb_nvme_queue {
+	struct nvme_command *sq;
+	struct nvme_completion *cq;
+	u16 depth;
+	u16 sq_head;
+	u16 cq_tail;
+	bool phase;
+	bool live;
+};
+
+/**
+ * struct sandbox_nvme_priv - private data for the emulator
+ *
+ * @ndev: NVMe device, which must come first for nvme_init()
+ * @regs: Controller registers
+ * @dbs: Doorbells, following the registers
+ * @queues: Admin and I/O queues
+ * @cyclic: Cyclic function which processes commands
+ * @disk: Contents of the namespace
+ * @fail_lba: Fail I/O which includes this block, or -1 for none
+ * @max_inflight: Most I/O commands seen pending at once
+ */
+struct sandbox_nvme_priv {
+	struct nvme_dev ndev;
+	struct nvme_bar *regs;
+	u32 *dbs;
+	struct sb_nvme_queue queues[NVME_Q_NUM];
+	struct cyclic_info *cyclic;
+	char *disk;
+	s64 fail_lba;
+	int max_inflight;
+};
+
+/* Copy data to or from the host using the PRPs in a command */
+static void sb_nvme_xfer(void *data, u64 prp1, u64 prp2, ulong len,
+			 bool to_host)
+{
+	u64 *list = NULL;
+	u64 addr = prp1;
+	int i = 0;
+
+	while (len) {
+		ulong chunk = min_t(ulong, len, SB_NVME_PAGE_SIZE -
+				    (addr & (SB_NVME_PAGE_SIZE - 1)));
+		void *ptr = (void *)(ulong)addr;
+
+		if (to_host)
+			memcpy(ptr, data, chunk);
+		else
+			memcpy(data, ptr, chunk);
+		data += chunk;
+		len -= chunk;
+		if (!len)
+			break;
+
+		/* PRP2 is either the second page or a list of pages */
+		if (!list) {
+			if (len <= SB_NVME_PAGE_SIZE) {
+				addr = prp2;
+				continue;
+			}
+			list = (u64 *)(ulong)prp2;
+		}
+
+		/* The last entry in a full list points to the next list */
+		if (i == SB_NVME_PAGE_SIZE / sizeof(u64) - 1 &&
+		    len > SB_NVME_PAGE_SIZE) {
+			list = (u64 *)(ulong)le64_to_cpu(list[i]);
+			i = 0;
+		}
+		addr = le64_to_cpu(list[i++]);
+	}
+}
+
+static u16 sb_nvme_identify(struct nvme_command *cmd)
+{
+	struct nvme_id_ctrl *ctrl;
+	struct nvme_id_ns *ns;
+	void *buf;
+
+	buf = calloc(1, SB_NVME_PAGE_SIZE);
+	if (!buf)
+		return NVME_SC_INTERNAL;
+	ctrl = buf;
+	ns = buf;
+	switch (le32_to_cpu(cmd->identify.cns)) {
+	case 0:
+		if (le32_to_cpu(cmd->identify.nsid) != 1) {
+			free(buf);
+			return NVME_SC_INVALID_NS;
+		}
+		ns->nsze = cpu_to_le64(SB_NVME_BLOCKS);
+		ns->ncap = cpu_to_le64(SB_NVME_BLOCKS);
+		ns->lbaf[0].ds = SB_NVME_LBA_SHIFT;
+		break;
+	case 1:
+		ctrl->nn = cpu_to_le32(1);
+		ctrl->mdts = SB_NVME_MDTS;
+		memcpy(ctrl->sn, "sandbox", 7);
+		memcpy(ctrl->mn, "sandbox-nvme", 12);
+		memcpy(ctrl->fr, "1.0", 3);
+		break;
+	default:
+		free(buf);
+		return NVME_SC_INVALID_FIELD;
+	}
+	sb_nvme_xfer(buf, le64_to_cpu(cmd->identify.prp1),
+		     le64_to_cpu(cmd->identify.prp2), SB_NVME_PAGE_SIZE, true);
+	free(buf);
+
+	return NVME_SC_SUCCESS;
+}
+
+static u16 sb_nvme_admin(struct sandbox_nvme_priv *priv,
+			 struct nvme_command *cmd, u32 *resultp)
+{
+	struct sb_nvme_queue *q;
+	uint qid;
+
+	switch (cmd->common.opcode) {
+	case nvme_admin_identify:
+		return sb_nvme_identify(cmd);
+	case nvme_admin_set_features:
+		if (le32_to_cpu(cmd->features.fid) != NVME_FEAT_NUM_QUEUES)
+			return NVME_SC_INVALID_FIELD;
+		/* one I/O queue of each type */
+		*resultp = 0;
+		return NVME_SC_SUCCESS;
+	case nvme_admin_create_cq:
+		qid = le16_to_cpu(cmd->create_cq.cqid);
+		if (!qid || qid >= NVME_Q_NUM)
+			return NVME_SC_INVALID_FIELD;
+		q = &priv->queues[qid];
+		q->cq = (void *)(ulong)le64_to_cpu(cmd->create_cq.prp1);
+		q->depth = le16_to_cpu(cmd->create_cq.qsize) + 1;
+		q->cq_tail = 0;
+		q->phase = true;
+		priv->dbs[qid * 2 + 1] = 0;
+		return NVME_SC_SUCCESS;
+	case nvme_admin_create_sq:
+		qid = le16_to_cpu(cmd->create_sq.sqid);
+		if (!qid || qid >= NVME_Q_NUM ||
+		    le16_to_cpu(cmd->create_sq.cqid) != qid)
+			return NVME_SC_INVALID_FIELD;
+		q = &priv->queues[qid];
+		q->sq = (void *)(ulong)le64_to_cpu(cmd->create_sq.prp1);
+		q->sq_head = 0;
+		q->live = true;
+		priv->dbs[qid * 2] = 0;
+		return NVME_SC_SUCCESS;
+	case nvme_admin_delete_sq:
+		qid = le16_to_cpu(cmd->delete_queue.qid);
+		if (!qid || qid >= NVME_Q_NUM)
+			return NVME_SC_INVALID_FIELD;
+		/* commands still in the queue are dropped */
+		priv->queues[qid].live = false;
+		return NVME_SC_SUCCESS;
+	case nvme_admin_delete_cq:
+		return NVME_SC_SUCCESS;
+	default:
+		return NVME_SC_INVALID_OPCODE;
+	}
+}
+
+static u16 sb_nvme_io(struct sandbox_nvme_priv *priv, struct nvme_command *cmd)
+{
+	u64 slba = le64_to_cpu(cmd->rw.slba);
+	uint count = le16_to_cpu(cmd->rw.length) + 1;
+	ulong len = (ulong)count << SB_NVME_LBA_SHIFT;
+	void *data;
+
+	if (cmd->rw.opcode == nvme_cmd_flush)
+		return NVME_SC_SUCCESS;
+	if (cmd->rw.opcode != nvme_cmd_read &&
+	    cmd->rw.opcode != nvme_cmd_write)
+		return NVME_SC_INVALID_OPCODE;
+	if (le32_to_cpu(cmd->rw.nsid) != 1)
+		return NVME_SC_INVALID_NS;
+	if (slba + count > SB_NVME_BLOCKS)
+		return NVME_SC_LBA_RANGE;
+	if (priv->fail_lba >= (s64)slba &&
+	    priv->fail_lba < (s64)(slba + count))
+		return NVME_SC_INTERNAL;
+
+	data = priv->disk + (slba << SB_NVME_LBA_SHIFT);
+	sb_nvme_xfer(data, le64_to_cpu(cmd->rw.prp1),
+		     le64_to_cpu(cmd->rw.prp2), len,
+		     cmd->rw.opcode == nvme_cmd_read);
+
+	return NVME_SC_SUCCESS;
+}
+
+static void sb_nvme_complete(struct sb_nvme_queue *q, uint qid, u16 cid,
+			     u16 status, u32 result, u16 sq_head)
+{
+	struct nvme_completion *cqe = &q->cq[q->cq_tail];
+
+	cqe->result = cpu_to_le32(result);
+	cqe->sq_head = cpu_to_le16(sq_head);
+	cqe->sq_id = cpu_to_le16(qid);
+	cqe->command_id = cid;
+	cqe->status = cpu_to_le16(status << 1 | q->phase);
+	if (++q->cq_tail == q->depth) {
+		q->cq_tail = 0;
+		q->phase = !q->phase;
+	}
+}
+
+static void sb_nvme_run_queue(struct sandbox_nvme_priv *priv, uint qid)
+{
+	struct sb_nvme_queue *q = &priv->queues[qid];
+	u16 tail;
+	int count, i;
+
+	if (!q->live)
+		return;
+	tail = priv->dbs[qid * 2];
+	count = (tail + q->depth - q->sq_head) % q->depth;
+	if (!count)
+		return;
+	if (qid != NVME_ADMIN_Q)
+		priv->max_inflight = max(priv->max_inflight, count);
+
+	/* Complete commands in reverse order, which the driver must allow */
+	for (i = count - 1; i >= 0; i--) {
+		struct nvme_command *cmd;
+		u32 result = 0;
+		u16 status;
+
+		cmd = &q->sq[(q->sq_head + i) % q->depth];
+		if (qid == NVME_ADMIN_Q)
+			status = sb_nvme_admin(priv, cmd, &result);
+		else
+			status = sb_nvme_io(priv, cmd);
+		sb_nvme_complete(q, qid, cmd->common.command_id, status,
+				 result, tail);
+	}
+	q->sq_head = tail;
+}
+
+static void sb_nvme_poll(void *ctx)
+{
+	struct sandbox_nvme_priv *priv = ctx;
+	struct nvme_bar *regs = priv->regs;
+	u32 cc = regs->cc;
+	u32 csts = regs->csts;
+	uint qid;
+
+	if ((cc & NVME_CC_ENABLE) && !(csts & NVME_CSTS_RDY)) {
+		struct sb_nvme_queue *q = &priv->queues[NVME_ADMIN_Q];
+
+		memset(priv->queues, '\0', sizeof(priv->queues));
+		memset(priv->dbs, '\0', NVME_Q_NUM * 2 * sizeof(u32));
+		q->sq = (void *)(ulong)regs->asq;
+		q->cq = (void *)(ulong)regs->acq;
+		q->depth = (regs->aqa & 0xfff) + 1;
+		q->phase = true;
+		q->live = true;
+		csts = NVME_CSTS_RDY;
+	} else if (!(cc & NVME_CC_ENABLE)) {
+		csts &= ~NVME_CSTS_RDY;
+	}
+	if ((cc & NVME_CC_SHN_MASK) == NVME_CC_SHN_NORMAL)
+		csts = (csts & ~NVME_CSTS_SHST_MASK) | NVME_CSTS_SHST_CMPLT;
+	regs->csts = csts;
+	if (!(csts & NVME_CSTS_RDY))
+		return;
+
+	for (qid = 0; qid < NVME_Q_NUM; qid++)
+		sb_nvme_run_queue(priv, qid);
+}
+
+void sandbox_nvme_set_fail_lba(struct udevice *dev, s64 lba)
+{
+	struct sandbox_nvme_priv *priv = dev_get_priv(dev);
+
+	priv->fail_lba = lba;
+}
+
+int sandbox_nvme_get_max_inflight(struct udevice *dev)
+{
+	struct sandbox_nvme_priv *priv = dev_get_priv(dev);
+
+	return priv->max_inflight;
+}
+
+static void sandbox_nvme_free(struct sandbox_nvme_priv *priv)
+{
+	if (priv->cyclic)
+		cyclic_unregister(priv->cyclic);
+	priv->cyclic = NULL;
+	free(priv->disk);
+	priv->disk = NULL;
+	free(priv->regs);
+	priv->regs = NULL;
+}
+
+static int sandbox_nvme_probe(struct udevice *dev)
+{
+	struct sandbox_nvme_priv *priv = dev_get_priv(dev);
+	int ret;
+
+	priv->regs = memalign(SB_NVME_PAGE_SIZE, SB_NVME_REGS_SIZE);
+	priv->disk = calloc(SB_NVME_BLOCKS, 1 << SB_NVME_LBA_SHIFT);
+	priv->cyclic = cyclic_register(sb_nvme_poll, 0, dev->name, priv);
+	if (!priv->regs || !priv->disk || !priv->cyclic) {
+		sandbox_nvme_free(priv);
+		return -ENOMEM;
+	}
+	memset(priv->regs, '\0', SB_NVME_REGS_SIZE);
+	priv->dbs = (void *)priv->regs + SZ_4K;
+	priv->fail_lba = -1;
+
+	/* queue depth, and a timeout of 5 seconds */
+	priv->regs->cap = (SB_NVME_DEPTH - 1) | 10 << 24;
+	priv->regs->vs = NVME_VS(1, 4);
+
+	priv->ndev.bar = priv->regs;
+	ret = nvme_init(dev);
+	if (ret) {
+		sandbox_nvme_free(priv);
+		return ret;
+	}
+
+	return 0;
+}
+
+static int sandbox_nvme_remove(struct udevice *dev)
+{
+	struct sandbox_nvme_priv *priv = dev_get_priv(dev);
+
+	nvme_shutdown(dev);
+	sandbox_nvme_free(priv);
+
+	return 0;
+}
+
+static const struct udevice_id sandbox_nvme_ids[] = {
+	{ .compatible = "sandbox,nvme" },
+	{ }
+};
+
+U_BOOT_DRIVER(sandbox_nvme) = {
+	.name		= "sandbox_nvme",
+	.id		= UCLASS_NVME,
+	.of_match	= sandbox_nvme_ids,
+	.probe		= sandbox_nvme_probe,
+	.remove		= sandbox_nvme_remove,
+	.priv_auto	= sizeof(struct sandbox_nvme_priv),
+};
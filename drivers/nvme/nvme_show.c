@@ -119,6 +119,8 @@ int nvme_print_info(struct udevice *udev)
 		goto free_ctrl;
 	}
 
+	printf("Blk device %d: I/O queue depth: %d (%s)\n", ns->devnum,
+	       dev->q_depth, dev->slots ? "queued" : "synchronous");
 	print_optional_admin_cmd(le16_to_cpu(ctrl->oacs), ns->devnum);
 	print_optional_nvm_cmd(le16_to_cpu(ctrl->oncs), ns->devnum);
 	print_format_nvme_attributes(ctrl->fna, ns->devnum);
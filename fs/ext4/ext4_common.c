@@ -2000,6 +2000,233 @@ long int read_allocated_block(struct ext2_inode *inode, int fileblock,
 	return blknr;
 }
 
+/**
+ * struct ext4_extent_map - a run of file blocks which are contiguous on disk
+ *
+ * @lblk: First logical block in the file
+ * @len: Number of blocks
+ * @pblk: First physical block
+ */
+struct ext4_extent_map {
+	uint32_t lblk;
+	uint32_t len;
+	uint64_t pblk;
+};
+
+/*
+ * All the leaf extents of the inode read most recently, in logical order,
+ * so that reading a file does not need to walk the extent tree from its root
+ * for every block. This survives ext4fs_close() since the fs layer closes
+ * the filesystem after each operation; it is keyed on the filesystem and
+ * inode, and is dropped whenever the filesystem is written.
+ */
+static struct {
+	struct blk_desc *dev_desc;
+	char fs_uuid[16];
+	int ino;
+	uint32_t ctime;
+	uint32_t version;
+	uint32_t size;
+	int count;
+	int max;
+	struct ext4_extent_map *map;
+} ext4fs_emap;
+
+void ext4fs_emap_invalidate(void)
+{
+	ext4fs_emap.ino = 0;
+	ext4fs_emap.count = 0;
+}
+
+static int ext4fs_emap_add(uint32_t lblk, uint32_t len, uint64_t pblk)
+{
+	struct ext4_extent_map *map;
+
+	if (!len)
+		return 0;
+
+	/* Merge with the previous extent if it continues on disk */
+	if (ext4fs_emap.count) {
+		map = &ext4fs_emap.map[ext4fs_emap.count - 1];
+		if (map->lblk + map->len == lblk &&
+		    map->pblk + map->len == pblk) {
+			map->len += len;
+			return 0;
+		}
+	}
+
+	if (ext4fs_emap.count == ext4fs_emap.max) {
+		int max = ext4fs_emap.max ? ext4fs_emap.max * 2 : 16;
+
+		map = malloc(max * sizeof(*map));
+		if (!map)
+			return -ENOMEM;
+		memcpy(map, ext4fs_emap.map, ext4fs_emap.count * sizeof(*map));
+		free(ext4fs_emap.map);
+		ext4fs_emap.map = map;
+		ext4fs_emap.max = max;
+	}
+	map = &ext4fs_emap.map[ext4fs_emap.count++];
+	map->lblk = lblk;
+	map->len = len;
+	map->pblk = pblk;
+
+	return 0;
+}
+
+/* Add all the leaf extents below an extent tree node, in order */
+static int ext4fs_emap_walk(struct ext4_extent_header *ext_block, int depth)
+{
+	int blksz = EXT2_BLOCK_SIZE(ext4fs_root);
+	int log2_blksz = LOG2_BLOCK_SIZE(ext4fs_root) -
+		get_fs()->dev_desc->log2blksz;
+	struct ext4_extent_idx *index;
+	struct ext4_extent *extent;
+	unsigned long long block;
+	char *buf;
+	int i, ret;
+
+	if (le16_to_cpu(ext_block->eh_magic) != EXT4_EXT_MAGIC ||
+	    depth > EXT4_EXT_MAX_DEPTH)
+		return -EINVAL;
+
+	if (!ext_block->eh_depth) {
+		extent = (struct ext4_extent *)(ext_block + 1);
+		for (i = 0; i < le16_to_cpu(ext_block->eh_entries); i++) {
+			block = le16_to_cpu(extent[i].ee_start_hi);
+			block = (block << 32) +
+				le32_to_cpu(extent[i].ee_start_lo);
+			ret = ext4fs_emap_add(le32_to_cpu(extent[i].ee_block),
+					      le16_to_cpu(extent[i].ee_len),
+					      block);
+			if (ret)
+				return ret;
+		}
+		return 0;
+	}
+
+	buf = memalign(ARCH_DMA_MINALIGN, blksz);
+	if (!buf)
+		return -ENOMEM;
+	index = (struct ext4_extent_idx *)(ext_block + 1);
+	for (i = 0; i < le16_to_cpu(ext_block->eh_entries); i++) {
+		block = le16_to_cpu(index[i].ei_leaf_hi);
+		block = (block << 32) + le32_to_cpu(index[i].ei_leaf_lo);
+		if (!ext4fs_devread((lbaint_t)block << log2_blksz, 0, blksz,
+				    buf)) {
+			ret = -EIO;
+			break;
+		}
+		ret = ext4fs_emap_walk((struct ext4_extent_header *)buf,
+				       depth + 1);
+		if (ret)
+			break;
+	}
+	free(buf);
+
+	return ret;
+}
+
+/* Make sure ext4fs_emap holds the extents of @node */
+static int ext4fs_emap_get(struct ext2fs_node *node)
+{
+	struct ext2_inode *inode = &node->inode;
+	char *fs_uuid = (char *)ext4fs_root->sblock.unique_id;
+	int ret;
+
+	if (ext4fs_emap.ino == node->ino &&
+	    ext4fs_emap.dev_desc == get_fs()->dev_desc &&
+	    !memcmp(ext4fs_emap.fs_uuid, fs_uuid, sizeof(ext4fs_emap.fs_uuid)) &&
+	    ext4fs_emap.ctime == le32_to_cpu(inode->ctime) &&
+	    ext4fs_emap.version == le32_to_cpu(inode->version) &&
+	    ext4fs_emap.size == le32_to_cpu(inode->size))
+		return 0;
+
+	ext4fs_emap_invalidate();
+	ret = ext4fs_emap_walk((struct ext4_extent_header *)
+			       inode->b.blocks.dir_blocks, 0);
+	if (ret) {
+		printf("invalid extent block\n");
+		ext4fs_emap_invalidate();
+		return ret;
+	}
+	debug("ext4fs: inode %d has %d extents\n", node->ino,
+	      ext4fs_emap.count);
+
+	ext4fs_emap.dev_desc = get_fs()->dev_desc;
+	memcpy(ext4fs_emap.fs_uuid, fs_uuid, sizeof(ext4fs_emap.fs_uuid));
+	ext4fs_emap.ctime = le32_to_cpu(inode->ctime);
+	ext4fs_emap.version = le32_to_cpu(inode->version);
+	ext4fs_emap.size = le32_to_cpu(inode->size);
+	ext4fs_emap.ino = node->ino;
+
+	return 0;
+}
+
+/**
+ * ext4fs_map_blocks() - find where a run of file blocks is on disk
+ *
+ * For extent-mapped files this uses the extent map of the inode, which is
+ * built once and kept, rather than walking the tree for each block.
+ *
+ * @node: File to look in
+ * @fileblock: Logical block within the file
+ * @max: Largest number of blocks of interest
+ * @countp: Returns the number of blocks from @fileblock which follow on
+ *	contiguously on disk (or which are all holes); this may be more than
+ *	@max for extent-mapped files
+ * @cache: Extent block cache used for files without extents
+ * Return: physical block, 0 for a hole, -ve on error
+ */
+long int ext4fs_map_blocks(struct ext2fs_node *node, uint32_t fileblock,
+			   uint32_t max, uint32_t *countp,
+			   struct ext_block_cache *cache)
+{
+	struct ext4_extent_map *map;
+	long int blknr, next;
+	int lo, hi, mid;
+
+	if (!(le32_to_cpu(node->inode.flags) & EXT4_EXTENTS_FL)) {
+		/* Look up following blocks while they are contiguous */
+		blknr = read_allocated_block(&node->inode, fileblock, cache);
+		for (*countp = 1; blknr >= 0 && *countp < max; (*countp)++) {
+			next = read_allocated_block(&node->inode,
+						    fileblock + *countp, cache);
+			if (next < 0 || next != (blknr ? blknr + *countp : 0))
+				break;
+		}
+		return blknr;
+	}
+
+	if (ext4fs_emap_get(node))
+		return -EINVAL;
+
+	/* Find the last extent starting at or before fileblock */
+	lo = 0;
+	hi = ext4fs_emap.count;
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (ext4fs_emap.map[mid].lblk <= fileblock)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	map = lo ? &ext4fs_emap.map[lo - 1] : NULL;
+	if (map && fileblock < map->lblk + map->len) {
+		*countp = map->lblk + map->len - fileblock;
+		return map->pblk + fileblock - map->lblk;
+	}
+
+	/* A hole, up to the next extent or the end of the file */
+	if (lo < ext4fs_emap.count)
+		*countp = ext4fs_emap.map[lo].lblk - fileblock;
+	else
+		*countp = UINT32_MAX - fileblock;
+
+	return 0;
+}
+
 /**
  * ext4fs_reinit_global() - Reinitialize values of ext4 write implementation's
  *			    global pointers
@@ -22,6 +22,7 @@
 #include <malloc.h>
 #include <memalign.h>
 #include <asm/cache.h>
+#include <asm/unaligned.h>
 #include <linux/compiler.h>
 #include <linux/ctype.h>
 
@@ -44,6 +45,46 @@ static struct disk_partition cur_part_info;
 #define DOS_BOOT_MAGIC_OFFSET	0x1fe
 #define DOS_FS_TYPE_OFFSET	0x36
 #define DOS_FS32_TYPE_OFFSET	0x52
+#define DOS_VOL_ID_OFFSET	0x27
+#define DOS_VOL32_ID_OFFSET	0x43
+
+/**
+ * struct fat_extent - a run of consecutive clusters in a cluster chain
+ *
+ * @start: First cluster in the run
+ * @count: Number of clusters in the run
+ */
+struct fat_extent {
+	__u32 start;
+	__u32 count;
+};
+
+/*
+ * Cluster chain of the file read most recently, held as a list of extents.
+ * Reading a large file in pieces then needs no more FAT lookups, and each
+ * extent is read from the disk in one go. The cache is keyed on the volume
+ * and the file's first cluster and size, and is dropped whenever the FAT is
+ * written.
+ */
+static struct {
+	struct blk_desc *dev;
+	lbaint_t part_start;
+	__u32 vol_id;
+	__u32 start_clust;
+	__u32 nclust;
+	int count;
+	int max;
+	struct fat_extent *ext;
+} fat_extents;
+
+/* Volume ID of the current device, to spot a change of media */
+static __u32 cur_vol_id;
+
+static void fat_extents_invalidate(void)
+{
+	fat_extents.dev = NULL;
+	fat_extents.count = 0;
+}
 
 static int disk_read(__u32 block, __u32 nr_blocks, void *buf)
 {
@@ -80,10 +121,14 @@ int fat_set_blk_dev(struct blk_desc *dev_desc, struct disk_partition *info)
 	}
 
 	/* Check for FAT12/FAT16/FAT32 filesystem */
-	if (!memcmp(buffer + DOS_FS_TYPE_OFFSET, "FAT", 3))
+	if (!memcmp(buffer + DOS_FS_TYPE_OFFSET, "FAT", 3)) {
+		cur_vol_id = get_unaligned_le32(buffer + DOS_VOL_ID_OFFSET);
 		return 0;
-	if (!memcmp(buffer + DOS_FS32_TYPE_OFFSET, "FAT32", 5))
+	}
+	if (!memcmp(buffer + DOS_FS32_TYPE_OFFSET, "FAT32", 5)) {
+		cur_vol_id = get_unaligned_le32(buffer + DOS_VOL32_ID_OFFSET);
 		return 0;
+	}
 
 	cur_dev = NULL;
 	return -1;
@@ -259,22 +304,36 @@ get_cluster(fsdata *mydata, __u32 clustnum, __u8 *buffer, unsigned long size)
 
 	debug("gc - clustnum: %d, startsect: %d\n", clustnum, startsect);
 
-	if ((unsigned long)buffer & (ARCH_DMA_MINALIGN - 1)) {
-		ALLOC_CACHE_ALIGN_BUFFER(__u8, tmpbuf, mydata->sect_size);
+	if ((unsigned long)buffer & (blk_get_buffer_align(cur_dev) - 1)) {
+		__u32 max_sects = MAX_CLUSTSIZE / mydata->sect_size;
+		__u32 sect_count = size / mydata->sect_size;
+		__u8 *tmpbuf;
 
 		debug("FAT: Misaligned buffer address (%p)\n", buffer);
 
-		while (size >= mydata->sect_size) {
-			ret = disk_read(startsect++, 1, tmpbuf);
-			if (ret != 1) {
+		/* Bounce as many sectors as possible per read */
+		tmpbuf = malloc_cache_aligned(min(sect_count, max_sects) *
+					      mydata->sect_size);
+		if (!tmpbuf)
+			return -1;
+
+		while (sect_count) {
+			__u32 n = min(sect_count, max_sects);
+
+			ret = disk_read(startsect, n, tmpbuf);
+			if (ret != n) {
 				debug("Error reading data (got %d)\n", ret);
+				free(tmpbuf);
 				return -1;
 			}
 
-			memcpy(buffer, tmpbuf, mydata->sect_size);
-			buffer += mydata->sect_size;
-			size -= mydata->sect_size;
+			memcpy(buffer, tmpbuf, n * mydata->sect_size);
+			startsect += n;
+			sect_count -= n;
+			buffer += n * mydata->sect_size;
+			size -= n * mydata->sect_size;
 		}
+		free(tmpbuf);
 	} else if (size >= mydata->sect_size) {
 		__u32 bytes_read;
 		__u32 sect_count = size / mydata->sect_size;
@@ -304,6 +363,77 @@ get_cluster(fsdata *mydata, __u32 clustnum, __u8 *buffer, unsigned long size)
 	return 0;
 }
 
+/**
+ * fat_get_extents() - get the cluster chain of a file as a list of extents
+ *
+ * This walks the FAT once for the file and records runs of consecutive
+ * clusters in fat_extents, unless they are already there.
+ *
+ * @mydata:	file system description
+ * @dentptr:	directory entry of the file
+ * Return:	-1 on error, otherwise 0
+ */
+static int fat_get_extents(fsdata *mydata, dir_entry *dentptr)
+{
+	__u32 filesize = FAT2CPU32(dentptr->size);
+	unsigned int bytesperclust = mydata->clust_size * mydata->sect_size;
+	__u32 clust = START(dentptr);
+	__u32 nclust, found;
+	struct fat_extent *ext;
+
+	nclust = filesize / bytesperclust + !!(filesize % bytesperclust);
+	if (fat_extents.dev == cur_dev &&
+	    fat_extents.part_start == cur_part_info.start &&
+	    fat_extents.vol_id == cur_vol_id &&
+	    fat_extents.start_clust == clust && fat_extents.nclust == nclust)
+		return 0;
+
+	fat_extents_invalidate();
+	for (found = 0; found < nclust; found++) {
+		if (CHECK_CLUST(clust, mydata->fatsize)) {
+			debug("curclust: 0x%x\n", clust);
+			printf("Invalid FAT entry\n");
+			return -1;
+		}
+
+		ext = fat_extents.count ?
+			&fat_extents.ext[fat_extents.count - 1] : NULL;
+		if (ext && ext->start + ext->count == clust) {
+			ext->count++;
+		} else {
+			if (fat_extents.count == fat_extents.max) {
+				int max = fat_extents.max ? fat_extents.max * 2 : 16;
+
+				ext = malloc(max * sizeof(*ext));
+				if (!ext) {
+					debug("Error: allocating extents\n");
+					return -1;
+				}
+				memcpy(ext, fat_extents.ext,
+				       fat_extents.count * sizeof(*ext));
+				free(fat_extents.ext);
+				fat_extents.ext = ext;
+				fat_extents.max = max;
+			}
+			ext = &fat_extents.ext[fat_extents.count++];
+			ext->start = clust;
+			ext->count = 1;
+		}
+
+		if (found + 1 < nclust)
+			clust = get_fatent(mydata, clust);
+	}
+	debug("%u clusters in %d extents\n", nclust, fat_extents.count);
+
+	fat_extents.dev = cur_dev;
+	fat_extents.part_start = cur_part_info.start;
+	fat_extents.vol_id = cur_vol_id;
+	fat_extents.start_clust = START(dentptr);
+	fat_extents.nclust = nclust;
+
+	return 0;
+}
+
 /**
  * get_contents() - read from file
  *
@@ -324,9 +454,10 @@ static int get_contents(fsdata *mydata, dir_entry *dentptr, loff_t pos,
 {
 	loff_t filesize = FAT2CPU32(dentptr->size);
 	unsigned int bytesperclust = mydata->clust_size * mydata->sect_size;
-	__u32 curclust = START(dentptr);
-	__u32 endclust, newclust;
-	loff_t actsize;
+	loff_t extstart, extend, actsize;
+	struct fat_extent *ext;
+	__u32 clust, offset;
+	int i;
 
 	*gotsize = 0;
 	debug("Filesize: %llu bytes\n", filesize);
@@ -341,101 +472,66 @@ static int get_contents(fsdata *mydata, dir_entry *dentptr, loff_t pos,
 
 	debug("%llu bytes\n", filesize);
 
-	actsize = bytesperclust;
+	if (fat_get_extents(mydata, dentptr))
+		return -1;
 
-	/* go to cluster at pos */
-	while (actsize <= pos) {
-		curclust = get_fatent(mydata, curclust);
-		if (CHECK_CLUST(curclust, mydata->fatsize)) {
-			debug("curclust: 0x%x\n", curclust);
-			printf("Invalid FAT entry\n");
-			return -1;
+	extstart = 0;
+	for (i = 0; i < fat_extents.count && pos < filesize; i++) {
+		ext = &fat_extents.ext[i];
+		extend = extstart + (loff_t)ext->count * bytesperclust;
+		if (pos >= extend) {
+			extstart = extend;
+			continue;
 		}
-		actsize += bytesperclust;
-	}
 
-	/* actsize > pos */
-	actsize -= bytesperclust;
-	filesize -= actsize;
-	pos -= actsize;
+		/* FAT files are smaller than 4GiB, so this fits */
+		clust = ext->start + (__u32)(pos - extstart) / bytesperclust;
+		offset = (__u32)(pos - extstart) % bytesperclust;
 
-	/* align to beginning of next cluster if any */
-	if (pos) {
-		__u8 *tmp_buffer;
-
-		actsize = min(filesize, (loff_t)bytesperclust);
-		tmp_buffer = malloc_cache_aligned(actsize);
-		if (!tmp_buffer) {
-			debug("Error: allocating buffer\n");
-			return -1;
-		}
-
-		if (get_cluster(mydata, curclust, tmp_buffer, actsize) != 0) {
-			printf("Error reading cluster\n");
-			free(tmp_buffer);
-			return -1;
-		}
-		filesize -= actsize;
-		actsize -= pos;
-		memcpy(buffer, tmp_buffer + pos, actsize);
-		free(tmp_buffer);
-		*gotsize += actsize;
-		if (!filesize)
-			return 0;
-		buffer += actsize;
+		/* read up to the beginning of the next cluster */
+		if (offset) {
+			__u8 *tmp_buffer;
 
-		curclust = get_fatent(mydata, curclust);
-		if (CHECK_CLUST(curclust, mydata->fatsize)) {
-			debug("curclust: 0x%x\n", curclust);
-			printf("Invalid FAT entry\n");
-			return -1;
-		}
-	}
+			actsize = min(filesize - pos + offset,
+				      (loff_t)bytesperclust);
+			tmp_buffer = malloc_cache_aligned(actsize);
+			if (!tmp_buffer) {
+				debug("Error: allocating buffer\n");
+				return -1;
+			}
 
-	actsize = bytesperclust;
-	endclust = curclust;
-
-	do {
-		/* search for consecutive clusters */
-		while (actsize < filesize) {
-			newclust = get_fatent(mydata, endclust);
-			if ((newclust - 1) != endclust)
-				goto getit;
-			if (CHECK_CLUST(newclust, mydata->fatsize)) {
-				debug("curclust: 0x%x\n", newclust);
-				printf("Invalid FAT entry\n");
+			if (get_cluster(mydata, clust, tmp_buffer,
+					actsize) != 0) {
+				printf("Error reading cluster\n");
+				free(tmp_buffer);
 				return -1;
 			}
-			endclust = newclust;
-			actsize += bytesperclust;
+			actsize -= offset;
+			memcpy(buffer, tmp_buffer + offset, actsize);
+			free(tmp_buffer);
+			*gotsize += actsize;
+			buffer += actsize;
+			pos += actsize;
+			clust++;
+			if (pos >= filesize || pos >= extend) {
+				extstart = extend;
+				continue;
+			}
 		}
 
-		/* get remaining bytes */
-		actsize = filesize;
-		if (get_cluster(mydata, curclust, buffer, (int)actsize) != 0) {
+		/* the rest of the extent is contiguous on the disk */
+		actsize = min(filesize, extend) - pos;
+		if (get_cluster(mydata, clust, buffer, actsize) != 0) {
 			printf("Error reading cluster\n");
 			return -1;
 		}
 		*gotsize += actsize;
-		return 0;
-getit:
-		if (get_cluster(mydata, curclust, buffer, (int)actsize) != 0) {
-			printf("Error reading cluster\n");
-			return -1;
-		}
-		*gotsize += (int)actsize;
-		filesize -= actsize;
 		buffer += actsize;
+		pos += actsize;
+		extstart = extend;
+	}
 
-		curclust = get_fatent(mydata, endclust);
-		if (CHECK_CLUST(curclust, mydata->fatsize)) {
-			debug("curclust: 0x%x\n", curclust);
-			printf("Invalid FAT entry\n");
-			return -1;
-		}
-		actsize = bytesperclust;
-		endclust = curclust;
-	} while (1);
+	return 0;
 }
 
 /*
@@ -1236,6 +1332,9 @@ int fat_size(const char *filename, loff_t *size)
 	}
 
 	*size = FAT2CPU32(itr->dent->size);
+
+	/* The file is likely to be read next, so get its clusters ready */
+	fat_get_extents(&fsdata, itr->dent);
 out_free_both:
 	free(fsdata.fatbuf);
 out_free_itr:
@@ -443,6 +443,8 @@ static int set_fatent_value(fsdata *mydata, __u32 entry, __u32 entry_value)
 	__u32 bufnum, offset, off16;
 	__u16 val1, val2;
 
+	fat_extents_invalidate();
+
 	switch (mydata->fatsize) {
 	case 32:
 		bufnum = entry / FAT32BUFSIZE;
@@ -582,22 +584,36 @@ set_sectors(fsdata *mydata, u32 startsect, u8 *buffer, u32 size)
 
 	debug("startsect: %d\n", startsect);
 
-	if ((unsigned long)buffer & (ARCH_DMA_MINALIGN - 1)) {
-		ALLOC_CACHE_ALIGN_BUFFER(__u8, tmpbuf, mydata->sect_size);
+	if ((unsigned long)buffer & (blk_get_buffer_align(cur_dev) - 1)) {
+		u32 max_sects = MAX_CLUSTSIZE / mydata->sect_size;
+		u32 nsects = size / mydata->sect_size;
+		u8 *tmpbuf;
 
 		debug("FAT: Misaligned buffer address (%p)\n", buffer);
 
-		while (size >= mydata->sect_size) {
-			memcpy(tmpbuf, buffer, mydata->sect_size);
-			ret = disk_write(startsect++, 1, tmpbuf);
-			if (ret != 1) {
+		/* Bounce as many sectors as possible per write */
+		tmpbuf = malloc_cache_aligned(min(nsects, max_sects) *
+					      mydata->sect_size);
+		if (!tmpbuf)
+			return -1;
+
+		while (nsects) {
+			u32 n = min(nsects, max_sects);
+
+			memcpy(tmpbuf, buffer, n * mydata->sect_size);
+			ret = disk_write(startsect, n, tmpbuf);
+			if (ret != n) {
 				debug("Error writing data (got %d)\n", ret);
+				free(tmpbuf);
 				return -1;
 			}
 
-			buffer += mydata->sect_size;
-			size -= mydata->sect_size;
+			startsect += n;
+			nsects -= n;
+			buffer += n * mydata->sect_size;
+			size -= n * mydata->sect_size;
 		}
+		free(tmpbuf);
 	} else if (size >= mydata->sect_size) {
 		u32 nsects;
 
@@ -14,15 +14,18 @@
 #include <lmb.h>
 #include <log.h>
 #include <malloc.h>
+#include <memalign.h>
 #include <mapmem.h>
 #include <part.h>
 #include <ext4fs.h>
 #include <fat.h>
 #include <fs.h>
+#include <image.h>
 #include <sandboxfs.h>
 #include <semihostingfs.h>
 #include <ubifs_uboot.h>
 #include <btrfs.h>
+#include <watchdog.h>
 #include <asm/global_data.h>
 #include <asm/io.h>
 #include <div64.h>
@@ -598,6 +601,99 @@ int fs_read(const char *filename, ulong addr, loff_t offset, loff_t len,
 	return _fs_read(filename, addr, offset, len, 0, actread);
 }
 
+/* Amount of compressed data read at a time by fs_read_decomp() */
+#define FS_DECOMP_CHUNK		SZ_1M
+
+int fs_read_decomp(const char *filename, ulong addr, ulong unc_len,
+		   loff_t *filesizep, ulong *lenp)
+{
+	struct fstype_info *info = fs_get_info(fs_type);
+	struct image_decomp_stream ds;
+	loff_t size, pos, actread;
+	void *load_buf, *buf;
+	ulong todo;
+	int comp, ret, end;
+
+	*lenp = 0;
+	ret = info->size(filename, &size);
+	if (ret)
+		goto out;
+	*filesizep = size;
+
+#ifdef CONFIG_LMB
+	{
+		struct lmb lmb;
+		phys_size_t max_size;
+
+		/*
+		 * The decompressed size is not known until the end, so do not
+		 * let the output run into reserved memory
+		 */
+		lmb_init_and_reserve(&lmb, gd->bd, (void *)gd->fdt_blob);
+		max_size = lmb_get_free_size(&lmb, addr);
+		if (!max_size) {
+			log_err("** Reading file would overwrite reserved memory **\n");
+			ret = -ENOSPC;
+			goto out;
+		}
+		unc_len = min_t(phys_size_t, unc_len, max_size);
+	}
+#endif
+
+	buf = malloc_cache_aligned(FS_DECOMP_CHUNK);
+	if (!buf) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	load_buf = map_sysmem(addr, unc_len);
+
+	todo = min_t(loff_t, size, FS_DECOMP_CHUNK);
+	ret = info->read(filename, buf, 0, todo, &actread);
+	if (ret || actread != todo)
+		goto err_read;
+
+	comp = image_decomp_type(buf, actread);
+	if (comp < 0)
+		comp = IH_COMP_NONE;
+	ret = image_decomp_stream_start(&ds, comp, load_buf, unc_len);
+	if (ret)
+		goto out_free;
+	log_debug("%s: compression %s\n", filename,
+		  genimg_get_comp_name(comp));
+
+	/*
+	 * Each chunk is decompressed as soon as it is read, while it is still
+	 * in the cache, and goes straight to its final place. This avoids
+	 * staging the compressed file in memory and a second pass over it.
+	 */
+	for (pos = 0; !ret && pos < size; pos += actread) {
+		if (pos) {
+			todo = min_t(loff_t, size - pos, FS_DECOMP_CHUNK);
+			ret = info->read(filename, buf, pos, todo, &actread);
+			if (ret || actread != todo) {
+				ret = -EIO;
+				break;
+			}
+		}
+		ret = image_decomp_stream_write(&ds, buf, actread);
+		schedule();
+	}
+	end = image_decomp_stream_end(&ds, lenp);
+	if (!ret)
+		ret = end;
+	goto out_free;
+
+err_read:
+	ret = -EIO;
+out_free:
+	unmap_sysmem(load_buf);
+	free(buf);
+out:
+	fs_close();
+
+	return ret;
+}
+
 int fs_write(const char *filename, ulong addr, loff_t offset, loff_t len,
 	     loff_t *actwrite)
 {
@@ -810,6 +906,52 @@ int do_load(struct cmd_tbl *cmdtp, int flag, int argc, char *const argv[],
 	return 0;
 }
 
+int do_loadz(struct cmd_tbl *cmdtp, int flag, int argc, char *const argv[],
+	     int fstype)
+{
+	loff_t filesize;
+	ulong addr, max_len, len;
+	ulong time;
+	int ret;
+
+	if (argc < 5 || argc > 6)
+		return CMD_RET_USAGE;
+
+	addr = hextoul(argv[3], NULL);
+	max_len = argc > 5 ? hextoul(argv[5], NULL) : CONFIG_SYS_BOOTM_LEN;
+
+	if (fs_set_blk_dev(argv[1], argv[2], fstype)) {
+		log_err("Can't set block device\n");
+		return 1;
+	}
+
+	time = get_timer(0);
+	ret = fs_read_decomp(argv[4], addr, max_len, &filesize, &len);
+	time = get_timer(time);
+	if (ret) {
+		if (ret == -ENOSPC)
+			log_err("Image too large: increase max_bytes or move it away from reserved memory\n");
+		else if (ret == -ENOSYS)
+			log_err("Unsupported compression\n");
+		log_err("Failed to load '%s' (err=%d)\n", argv[4], ret);
+		return 1;
+	}
+
+	printf("%llu bytes read, %lu bytes written in %lu ms", filesize, len,
+	       time);
+	if (time > 0) {
+		puts(" (");
+		print_size(div_u64((u64)filesize * 1000, time), "/s");
+		puts(")");
+	}
+	puts("\n");
+
+	env_set_hex("fileaddr", addr);
+	env_set_hex("filesize", len);
+
+	return 0;
+}
+
 int do_ls(struct cmd_tbl *cmdtp, int flag, int argc, char *const argv[],
 	  int fstype)
 {
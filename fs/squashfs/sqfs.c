@@ -14,6 +14,7 @@
 #include <linux/types.h>
 #include <asm/byteorder.h>
 #include <linux/compat.h>
+#include <linux/list.h>
 #include <memalign.h>
 #include <stdlib.h>
 #include <string.h>
@@ -57,6 +58,164 @@ static int sqfs_read_sblk(struct squashfs_super_block **sblk)
 	return 0;
 }
 
+/*
+ * Decompressed block cache
+ *
+ * The fs layer probes and closes the filesystem around every operation, so
+ * without a cache each ls/load decompresses the whole inode and directory
+ * tables again, and every file stored in a fragment decompresses its fragment
+ * block again. Entries are kept across sqfs_close() in LRU order, keyed by
+ * their on-disk offset, and the whole cache is dropped as soon as a different
+ * filesystem is probed. Entries handed out to callers are reference counted
+ * so that eviction never frees a table which is still in use.
+ */
+enum sqfs_cache_type {
+	SQFS_CACHE_INODE_TABLE,
+	SQFS_CACHE_DIR_TABLE,
+	SQFS_CACHE_FRAG_ENTRIES,
+	SQFS_CACHE_FRAGMENT,
+};
+
+struct sqfs_cache_entry {
+	struct list_head list;
+	enum sqfs_cache_type type;
+	u64 offset;
+	/* Decompressed data and its length */
+	void *data;
+	unsigned long len;
+	/* Directory table only: metadata block positions and their count */
+	u32 *pos_list;
+	int count;
+	/* Memory accounted against CONFIG_SQUASHFS_CACHE_SIZE */
+	size_t size;
+	int refs;
+	bool cached;
+};
+
+static LIST_HEAD(sqfs_cache);
+static size_t sqfs_cache_used;
+
+static struct {
+	struct blk_desc *dev;
+	lbaint_t part_start;
+	u32 mkfs_time;
+	u64 bytes_used;
+	u64 inode_table_start;
+} sqfs_cache_fs;
+
+static void sqfs_cache_free(struct sqfs_cache_entry *e)
+{
+	free(e->data);
+	free(e->pos_list);
+	free(e);
+}
+
+static void sqfs_cache_drop(struct sqfs_cache_entry *e)
+{
+	list_del(&e->list);
+	sqfs_cache_used -= e->size;
+	e->cached = false;
+	if (!e->refs)
+		sqfs_cache_free(e);
+}
+
+/* Drop the cache unless it belongs to the filesystem being probed */
+static void sqfs_cache_check_fs(struct squashfs_super_block *sblk)
+{
+	struct sqfs_cache_entry *e, *tmp;
+
+	if (sqfs_cache_fs.dev == ctxt.cur_dev &&
+	    sqfs_cache_fs.part_start == ctxt.cur_part_info.start &&
+	    sqfs_cache_fs.mkfs_time == get_unaligned_le32(&sblk->mkfs_time) &&
+	    sqfs_cache_fs.bytes_used == get_unaligned_le64(&sblk->bytes_used) &&
+	    sqfs_cache_fs.inode_table_start ==
+	    get_unaligned_le64(&sblk->inode_table_start))
+		return;
+
+	list_for_each_entry_safe(e, tmp, &sqfs_cache, list)
+		sqfs_cache_drop(e);
+
+	sqfs_cache_fs.dev = ctxt.cur_dev;
+	sqfs_cache_fs.part_start = ctxt.cur_part_info.start;
+	sqfs_cache_fs.mkfs_time = get_unaligned_le32(&sblk->mkfs_time);
+	sqfs_cache_fs.bytes_used = get_unaligned_le64(&sblk->bytes_used);
+	sqfs_cache_fs.inode_table_start =
+		get_unaligned_le64(&sblk->inode_table_start);
+}
+
+/* Look up an entry and take a reference on it, release with sqfs_cache_put() */
+static struct sqfs_cache_entry *sqfs_cache_get(enum sqfs_cache_type type,
+					       u64 offset)
+{
+	struct sqfs_cache_entry *e;
+
+	list_for_each_entry(e, &sqfs_cache, list) {
+		if (e->type == type && e->offset == offset) {
+			list_move(&e->list, &sqfs_cache);
+			e->refs++;
+			return e;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Wrap freshly decompressed data into a referenced entry and try to keep it,
+ * evicting the least recently used entries as needed. Data which does not fit
+ * in the budget is still returned, and freed by the last sqfs_cache_put().
+ * On failure, the caller keeps ownership of @data and @pos_list.
+ */
+static struct sqfs_cache_entry *sqfs_cache_add(enum sqfs_cache_type type,
+					       u64 offset, void *data,
+					       unsigned long len,
+					       u32 *pos_list, int count)
+{
+	struct sqfs_cache_entry *e, *old, *tmp;
+
+	e = calloc(1, sizeof(*e));
+	if (!e)
+		return NULL;
+
+	INIT_LIST_HEAD(&e->list);
+	e->type = type;
+	e->offset = offset;
+	e->data = data;
+	e->len = len;
+	e->pos_list = pos_list;
+	e->count = count;
+	e->size = len + (pos_list ? count * sizeof(u32) : 0);
+	e->refs = 1;
+
+	if (e->size > CONFIG_SQUASHFS_CACHE_SIZE)
+		return e;
+
+	list_for_each_entry_safe_reverse(old, tmp, &sqfs_cache, list) {
+		if (sqfs_cache_used + e->size <= CONFIG_SQUASHFS_CACHE_SIZE)
+			break;
+		if (!old->refs)
+			sqfs_cache_drop(old);
+	}
+
+	if (sqfs_cache_used + e->size > CONFIG_SQUASHFS_CACHE_SIZE)
+		return e;
+
+	list_add(&e->list, &sqfs_cache);
+	sqfs_cache_used += e->size;
+	e->cached = true;
+
+	return e;
+}
+
+static void sqfs_cache_put(struct sqfs_cache_entry *e)
+{
+	if (!e)
+		return;
+
+	if (!--e->refs && !e->cached)
+		sqfs_cache_free(e);
+}
+
 static int sqfs_count_tokens(const char *filename)
 {
 	int token_count = 1, l;
@@ -104,6 +263,7 @@ static int sqfs_frag_lookup(u32 inode_fragment_index,
 	unsigned char *metadata_buffer, *metadata, *table;
 	struct squashfs_fragment_block_entry *entries;
 	struct squashfs_super_block *sblk = ctxt.sblk;
+	struct sqfs_cache_entry *cached = NULL;
 	unsigned long dest_len;
 	int block, offset, ret;
 	u16 header;
@@ -149,6 +309,12 @@ static int sqfs_frag_lookup(u32 inode_fragment_index,
 	start_block = get_unaligned_le64(table + table_offset + block *
 					 sizeof(u64));
 
+	cached = sqfs_cache_get(SQFS_CACHE_FRAG_ENTRIES, start_block);
+	if (cached) {
+		entries = cached->data;
+		goto found;
+	}
+
 	start = start_block / ctxt.cur_dev->blksz;
 	n_blks = sqfs_calc_n_blks(cpu_to_le64(start_block),
 				  sblk->fragment_table_start, &table_offset);
@@ -192,10 +358,20 @@ static int sqfs_frag_lookup(u32 inode_fragment_index,
 		memcpy(entries, metadata, SQFS_METADATA_SIZE(header));
 	}
 
+	cached = sqfs_cache_add(SQFS_CACHE_FRAG_ENTRIES, start_block, entries,
+				SQFS_METADATA_BLOCK_SIZE, NULL, 0);
+	if (!cached) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+found:
 	*e = entries[offset];
 	ret = SQFS_COMPRESSED_BLOCK(e->size);
+	entries = NULL;
 
 out:
+	sqfs_cache_put(cached);
 	free(entries);
 	free(metadata_buffer);
 	free(table);
@@ -691,11 +867,12 @@ static int sqfs_get_metablk_pos(u32 *pos_list, void *table, u32 offset,
 	return ret;
 }
 
+/* Returns the number of metadata blocks in the table, or a negative error */
 static int sqfs_read_inode_table(unsigned char **inode_table)
 {
 	struct squashfs_super_block *sblk = ctxt.sblk;
 	u64 start, n_blks, table_offset, table_size;
-	int j, ret = 0, metablks_count;
+	int j, ret = 0, metablks_count = 0;
 	unsigned char *src_table, *itb;
 	u32 src_len, dest_offset = 0;
 	unsigned long dest_len = 0;
@@ -775,7 +952,7 @@ static int sqfs_read_inode_table(unsigned char **inode_table)
 free_itb:
 	free(itb);
 
-	return ret;
+	return ret ? ret : metablks_count;
 }
 
 static int sqfs_read_directory_table(unsigned char **dir_table, u32 **pos_list)
@@ -878,13 +1055,63 @@ out:
 	return metablks_count;
 }
 
+static int sqfs_get_inode_table(struct sqfs_cache_entry **entry)
+{
+	u64 key = get_unaligned_le64(&ctxt.sblk->inode_table_start);
+	unsigned char *inode_table;
+	int metablks_count;
+
+	*entry = sqfs_cache_get(SQFS_CACHE_INODE_TABLE, key);
+	if (*entry)
+		return 0;
+
+	metablks_count = sqfs_read_inode_table(&inode_table);
+	if (metablks_count < 0)
+		return metablks_count;
+
+	*entry = sqfs_cache_add(SQFS_CACHE_INODE_TABLE, key, inode_table,
+				metablks_count * SQFS_METADATA_BLOCK_SIZE,
+				NULL, 0);
+	if (!*entry) {
+		free(inode_table);
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+static int sqfs_get_directory_table(struct sqfs_cache_entry **entry)
+{
+	u64 key = get_unaligned_le64(&ctxt.sblk->directory_table_start);
+	unsigned char *dir_table;
+	int metablks_count;
+	u32 *pos_list;
+
+	*entry = sqfs_cache_get(SQFS_CACHE_DIR_TABLE, key);
+	if (*entry)
+		return (*entry)->count;
+
+	metablks_count = sqfs_read_directory_table(&dir_table, &pos_list);
+	if (metablks_count < 1)
+		return metablks_count;
+
+	*entry = sqfs_cache_add(SQFS_CACHE_DIR_TABLE, key, dir_table,
+				metablks_count * SQFS_METADATA_BLOCK_SIZE,
+				pos_list, metablks_count);
+	if (!*entry) {
+		free(dir_table);
+		free(pos_list);
+		return -ENOMEM;
+	}
+
+	return metablks_count;
+}
+
 int sqfs_opendir(const char *filename, struct fs_dir_stream **dirsp)
 {
-	unsigned char *inode_table = NULL, *dir_table = NULL;
 	int j, token_count = 0, ret = 0, metablks_count;
 	struct squashfs_dir_stream *dirs;
 	char **token_list = NULL, *path = NULL;
-	u32 *pos_list = NULL;
 
 	dirs = calloc(1, sizeof(*dirs));
 	if (!dirs)
@@ -897,13 +1124,13 @@ int sqfs_opendir(const char *filename, struct fs_dir_stream **dirsp)
 	dirs->inode_table = NULL;
 	dirs->dir_table = NULL;
 
-	ret = sqfs_read_inode_table(&inode_table);
+	ret = sqfs_get_inode_table(&dirs->inode_entry);
 	if (ret) {
 		ret = -EINVAL;
 		goto out;
 	}
 
-	metablks_count = sqfs_read_directory_table(&dir_table, &pos_list);
+	metablks_count = sqfs_get_directory_table(&dirs->dir_entry);
 	if (metablks_count < 1) {
 		ret = -EINVAL;
 		goto out;
@@ -936,10 +1163,10 @@ int sqfs_opendir(const char *filename, struct fs_dir_stream **dirsp)
 	 * ldir's (extended directory) size is greater than dir, so it works as
 	 * a general solution for the malloc size, since 'i' is a union.
 	 */
-	dirs->inode_table = inode_table;
-	dirs->dir_table = dir_table;
-	ret = sqfs_search_dir(dirs, token_list, token_count, pos_list,
-			      metablks_count);
+	dirs->inode_table = dirs->inode_entry->data;
+	dirs->dir_table = dirs->dir_entry->data;
+	ret = sqfs_search_dir(dirs, token_list, token_count,
+			      dirs->dir_entry->pos_list, metablks_count);
 	if (ret)
 		goto out;
 
@@ -963,10 +1190,11 @@ out:
 	for (j = 0; j < token_count; j++)
 		free(token_list[j]);
 	free(token_list);
-	free(pos_list);
 	free(path);
 	if (ret) {
-		free(inode_table);
+		sqfs_cache_put(dirs->inode_entry);
+		sqfs_cache_put(dirs->dir_entry);
+		free(dirs->dir_header);
 		free(dirs);
 	}
 
@@ -1108,6 +1336,7 @@ int sqfs_probe(struct blk_desc *fs_dev_desc, struct disk_partition *fs_partition
 	}
 
 	ctxt.sblk = sblk;
+	sqfs_cache_check_fs(sblk);
 
 	ret = sqfs_decompressor_init(&ctxt);
 	if (ret) {
@@ -1326,6 +1555,7 @@ int sqfs_read(const char *filename, void *buf, loff_t offset, loff_t len,
 	int ret, j, i_number, datablk_count = 0;
 	struct squashfs_super_block *sblk = ctxt.sblk;
 	struct squashfs_fragment_block_entry frag_entry;
+	struct sqfs_cache_entry *frag_cached = NULL;
 	struct squashfs_file_info finfo = {0};
 	struct squashfs_symlink_inode *symlink;
 	struct fs_dir_stream *dirsp = NULL;
@@ -1526,6 +1756,16 @@ int sqfs_read(const char *filename, void *buf, loff_t offset, loff_t len,
 		goto out;
 	}
 
+	/* Fragment blocks are shared by many small files, keep them around */
+	if (finfo.comp) {
+		frag_cached = sqfs_cache_get(SQFS_CACHE_FRAGMENT,
+					     frag_entry.start);
+		if (frag_cached) {
+			ret = 0;
+			goto copy_fragment;
+		}
+	}
+
 	start = lldiv(frag_entry.start, ctxt.cur_dev->blksz);
 	table_size = SQFS_BLOCK_SIZE(frag_entry.size);
 	table_offset = frag_entry.start - (start * ctxt.cur_dev->blksz);
@@ -1559,11 +1799,24 @@ int sqfs_read(const char *filename, void *buf, loff_t offset, loff_t len,
 			goto out;
 		}
 
-		memcpy(buf + *actread, &fragment_block[finfo.offset], finfo.size - *actread);
-		*actread = finfo.size;
+		frag_cached = sqfs_cache_add(SQFS_CACHE_FRAGMENT,
+					     frag_entry.start, fragment_block,
+					     dest_len, NULL, 0);
+		if (!frag_cached) {
+			free(fragment_block);
+			ret = -ENOMEM;
+			goto out;
+		}
 
-		free(fragment_block);
+copy_fragment:
+		if (finfo.offset + finfo.size - *actread > frag_cached->len) {
+			ret = -EINVAL;
+			goto out;
+		}
 
+		fragment_block = frag_cached->data;
+		memcpy(buf + *actread, &fragment_block[finfo.offset], finfo.size - *actread);
+		*actread = finfo.size;
 	} else if (finfo.frag && !finfo.comp) {
 		fragment_block = (void *)fragment + table_offset;
 
@@ -1572,6 +1825,7 @@ int sqfs_read(const char *filename, void *buf, loff_t offset, loff_t len,
 	}
 
 out:
+	sqfs_cache_put(frag_cached);
 	free(fragment);
 	free(datablock);
 	free(file);
@@ -1725,8 +1979,8 @@ void sqfs_closedir(struct fs_dir_stream *dirs)
 		return;
 
 	sqfs_dirs = (struct squashfs_dir_stream *)dirs;
-	free(sqfs_dirs->inode_table);
-	free(sqfs_dirs->dir_table);
+	sqfs_cache_put(sqfs_dirs->inode_entry);
+	sqfs_cache_put(sqfs_dirs->dir_entry);
 	free(sqfs_dirs->dir_header);
 	free(sqfs_dirs);
 }
@@ -274,10 +274,13 @@ struct squashfs_dir_stream {
 	struct squashfs_ldir_inode i_ldir;
 	/*
 	 * References to the tables' beginnings. They are assigned in
-	 * sqfs_opendir() and freed in sqfs_closedir().
+	 * sqfs_opendir() from the decompressed block cache, and the cache
+	 * entries holding them are released in sqfs_closedir().
 	 */
 	unsigned char *inode_table;
 	unsigned char *dir_table;
+	struct sqfs_cache_entry *inode_entry;
+	struct sqfs_cache_entry *dir_entry;
 };
 
 struct squashfs_file_info {
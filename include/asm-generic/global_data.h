@@ -21,6 +21,7 @@
 
 #ifndef __ASSEMBLY__
 #include <cyclic.h>
+#include <dm/uclass-id.h>
 #include <event_internal.h>
 #include <fdtdec.h>
 #include <membuff.h>
@@ -217,6 +218,16 @@ struct global_data {
 	 * @uclass_root_s.
 	 */
 	struct list_head *uclass_root;
+# if CONFIG_IS_ENABLED(DM_UCLASS_ARRAY)
+	/**
+	 * @uclass_array: uclasses indexed by their ID, NULL if not created
+	 *
+	 * This mirrors the list at @uclass_root so that uclass_find() does not
+	 * need to walk it. It is kept up to date by uclass_add() and
+	 * uclass_destroy().
+	 */
+	struct uclass *uclass_array[UCLASS_COUNT];
+# endif
 # if CONFIG_IS_ENABLED(OF_PLATDATA_DRIVER_RT)
 	/** @dm_driver_rt: Dynamic info about the driver */
 	struct driver_rt *dm_driver_rt;
@@ -231,6 +242,21 @@ struct global_data {
 	 */
 	void *dm_priv_base;
 # endif
+#if CONFIG_IS_ENABLED(DM_COMPAT_INDEX)
+	/**
+	 * @dm_compat_index: hash index of driver compatible strings, built on
+	 * first use by lists_bind_fdt(), or an ERR_PTR() if it could not be
+	 * built
+	 */
+	struct lists_compat_index *dm_compat_index;
+# endif
+# if CONFIG_IS_ENABLED(DM_PLAN)
+	/**
+	 * @dm_plan: state of the probe plan being recorded or used, while
+	 * binding devices from the devicetree
+	 */
+	struct dm_plan_state *dm_plan;
+# endif
 #endif
 #ifdef CONFIG_TIMER
 	/**
@@ -542,6 +568,30 @@ static_assert(sizeof(struct global_data) == GD_SIZE);
 #define gd_dm_priv_base()		NULL
 #endif
 
+#if CONFIG_IS_ENABLED(DM_UCLASS_ARRAY)
+#define gd_uclass(id)			gd->uclass_array[id]
+#define gd_set_uclass(id, uc)		gd->uclass_array[id] = uc
+#else
+#define gd_uclass(id)			NULL
+#define gd_set_uclass(id, uc)
+#endif
+
+#if CONFIG_IS_ENABLED(DM_COMPAT_INDEX)
+#define gd_set_dm_compat_index(idx)	gd->dm_compat_index = idx
+#define gd_dm_compat_index()		gd->dm_compat_index
+#else
+#define gd_set_dm_compat_index(idx)
+#define gd_dm_compat_index()		NULL
+#endif
+
+#if CONFIG_IS_ENABLED(DM_PLAN)
+#define gd_set_dm_plan(state)		gd->dm_plan = state
+#define gd_dm_plan()			gd->dm_plan
+#else
+#define gd_set_dm_plan(state)
+#define gd_dm_plan()			NULL
+#endif
+
 #ifdef CONFIG_ACPI
 #define gd_acpi_ctx()		gd->acpi_ctx
 #define gd_acpi_start()		gd->acpi_start
@@ -568,7 +618,7 @@ static_assert(sizeof(struct global_data) == GD_SIZE);
 #define gd_set_multi_dtb_fit(_dtb)
 #endif
 
-#if CONFIG_IS_ENABLED(EVENT_DYNAMIC)
+#if CONFIG_IS_ENABLED(EVENT)
 #define gd_event_state()	((struct event_state *)&gd->event_state)
 #else
 #define gd_event_state()	NULL
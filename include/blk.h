@@ -140,6 +140,42 @@ void blkcache_fill(int iftype, int dev,
 		   lbaint_t start, lbaint_t blkcnt,
 		   unsigned long blksz, void const *buffer);
 
+/**
+ * blkcache_readahead() - get the number of blocks to read ahead after a miss
+ *
+ * Once a device is seen to be read sequentially, a cache miss may be
+ * extended to read beyond the requested blocks so that following reads in
+ * the stream are served from the cache. The window grows on each miss up to
+ * the configured read-ahead limit.
+ *
+ * @param iftype - uclass_id_x for type of device
+ * @param dev - device index of particular type
+ * @param start - starting block number of the read that missed
+ * @param blkcnt - number of blocks in the read that missed
+ *
+ * Return: number of extra blocks to read after @start + @blkcnt, or 0 if
+ * no read-ahead should be done
+ */
+lbaint_t blkcache_readahead(int iftype, int dev,
+			    lbaint_t start, lbaint_t blkcnt);
+
+/**
+ * blkcache_fill_readahead() - add data read ahead to the block cache
+ *
+ * This is like blkcache_fill() but accepts runs longer than the maximum
+ * blocks per entry, splitting them up as needed.
+ *
+ * @param iftype - uclass_id_x for type of device
+ * @param dev - device index of particular type
+ * @param start - starting block number
+ * @param blkcnt - number of blocks available
+ * @param blksz - size in bytes of each block
+ * @param buffer - buffer containing data to cache
+ */
+void blkcache_fill_readahead(int iftype, int dev,
+			     lbaint_t start, lbaint_t blkcnt,
+			     unsigned long blksz, void const *buffer);
+
 /**
  * blkcache_invalidate() - discard the cache for a set of blocks
  * because of a write or device (re)initialization.
@@ -157,15 +193,30 @@ void blkcache_invalidate(int iftype, int dev);
  */
 void blkcache_configure(unsigned blocks, unsigned entries);
 
+/**
+ * blkcache_configure_dev() - configure per-device limits of the block cache
+ *
+ * @param max_bytes - maximum number of bytes cached for any one device, or
+ *	0 for no limit
+ * @param readahead - maximum number of blocks to read ahead for sequential
+ *	streams, or 0 to disable read-ahead
+ */
+void blkcache_configure_dev(ulong max_bytes, unsigned readahead);
+
 /*
  * statistics of the block cache
  */
 struct block_cache_stats {
 	unsigned hits;
 	unsigned misses;
+	unsigned evictions; /* entries dropped to make room for others */
+	unsigned readaheads; /* number of read-ahead fills */
 	unsigned entries; /* current entry count */
 	unsigned max_blocks_per_entry;
 	unsigned max_entries;
+	unsigned ways; /* number of entries per hash set */
+	ulong max_dev_bytes; /* per-device limit, 0 for none */
+	unsigned readahead_blocks; /* maximum read-ahead window */
 };
 
 /**
@@ -175,6 +226,11 @@ struct block_cache_stats {
  */
 void blkcache_stats(struct block_cache_stats *stats);
 
+/**
+ * blkcache_show_devs() - show per-device statistics and reset them
+ */
+void blkcache_show_devs(void);
+
 /** blkcache_free() - free all memory allocated to the block cache */
 void blkcache_free(void);
 
@@ -191,6 +247,17 @@ static inline void blkcache_fill(int iftype, int dev,
 				 lbaint_t start, lbaint_t blkcnt,
 				 unsigned long blksz, void const *buffer) {}
 
+static inline lbaint_t blkcache_readahead(int iftype, int dev,
+					  lbaint_t start, lbaint_t blkcnt)
+{
+	return 0;
+}
+
+static inline void blkcache_fill_readahead(int iftype, int dev,
+					   lbaint_t start, lbaint_t blkcnt,
+					   unsigned long blksz,
+					   void const *buffer) {}
+
 static inline void blkcache_invalidate(int iftype, int dev) {}
 
 static inline void blkcache_free(void) {}
@@ -259,6 +326,18 @@ struct blk_ops {
 	 */
 	int (*select_hwpart)(struct udevice *dev, int hwpart);
 
+	/**
+	 * get_align() - get the buffer alignment needed by the device
+	 *
+	 * Buffers which start at this alignment can be used for DMA without
+	 * being bounced. This is optional; ARCH_DMA_MINALIGN is used if it is
+	 * not provided.
+	 *
+	 * @dev:	Block device to check
+	 * @return alignment in bytes, which must be a power of two
+	 */
+	ulong (*get_align)(struct udevice *dev);
+
 #if IS_ENABLED(CONFIG_BOUNCE_BUFFER)
 	/**
 	 * buffer_aligned() - test memory alignment of block operation buffer
@@ -291,6 +370,20 @@ unsigned long blk_dwrite(struct blk_desc *block_dev, lbaint_t start,
 unsigned long blk_derase(struct blk_desc *block_dev, lbaint_t start,
 			 lbaint_t blkcnt);
 
+/**
+ * blk_get_buffer_align() - get the buffer alignment for zero-copy transfers
+ *
+ * Buffers starting at this alignment can be handed to the device as they are.
+ * Anything else may be bounced through a temporary buffer, so callers which
+ * are free to choose where data goes (e.g. filesystems allocating buffers or
+ * picking load addresses) should use it instead of assuming a value. It comes
+ * from the driver's get_align() operation, if there is one.
+ *
+ * @block_dev: Block device descriptor
+ * Return: alignment in bytes, always a power of two
+ */
+ulong blk_get_buffer_align(struct blk_desc *block_dev);
+
 /**
  * blk_read() - Read from a block device
  *
@@ -530,6 +623,7 @@ int blk_get_desc(enum uclass_id uclass_id, int devnum, struct blk_desc **descp);
 
 #else
 #include <errno.h>
+#include <asm/cache.h>
 /*
  * These functions should take struct udevice instead of struct blk_desc,
  * but this is convenient for migration to driver model. Add a 'd' prefix
@@ -571,6 +665,11 @@ static inline ulong blk_derase(struct blk_desc *block_dev, lbaint_t start,
 	return block_dev->block_erase(block_dev, start, blkcnt);
 }
 
+static inline ulong blk_get_buffer_align(struct blk_desc *block_dev)
+{
+	return ARCH_DMA_MINALIGN;
+}
+
 /**
  * struct blk_driver - Driver for block interface types
  *
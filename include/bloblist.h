@@ -114,6 +114,9 @@ enum bloblist_tag_t {
 	BLOBLISTT_U_BOOT_SPL_HANDOFF = 0x8000, /* Hand-off info from SPL */
 	BLOBLISTT_VBE		= 0x8001,	/* VBE per-phase state */
 	BLOBLISTT_U_BOOT_VIDEO = 0x8002, /* Video information from SPL */
+	BLOBLISTT_U_BOOT_BOOT_TRACE = 0x8003, /* Boot-time trace events (JSON) */
+	BLOBLISTT_U_BOOT_DM_PLAN_F = 0x8004, /* Probe plan before relocation */
+	BLOBLISTT_U_BOOT_DM_PLAN_R = 0x8005, /* Probe plan after relocation */
 
 	/*
 	 * Vendor-specific tags are permitted here. Projects can be open source
@@ -11,6 +11,7 @@
 #ifndef _BOOTSTAGE_H
 #define _BOOTSTAGE_H
 
+#include <linux/errno.h>
 #include <linux/types.h>
 #include <linux/kconfig.h>
 
@@ -20,6 +21,23 @@ enum bootstage_flags {
 	BOOTSTAGEF_ALLOC	= 1 << 1,	/* Allocate an id */
 };
 
+/**
+ * enum bootstage_span_t - Types of activity timed by the bootstage tree
+ *
+ * @BOOTSTAGE_SPAN_INITCALL: Function in an initcall list
+ * @BOOTSTAGE_SPAN_EVENT: Event sent from an initcall list
+ * @BOOTSTAGE_SPAN_BIND: Binding a device
+ * @BOOTSTAGE_SPAN_PROBE: Probing a device
+ */
+enum bootstage_span_t {
+	BOOTSTAGE_SPAN_INITCALL,
+	BOOTSTAGE_SPAN_EVENT,
+	BOOTSTAGE_SPAN_BIND,
+	BOOTSTAGE_SPAN_PROBE,
+
+	BOOTSTAGE_SPAN_COUNT,
+};
+
 /* bootstate sub-IDs used for kernel and ramdisk ranges */
 enum {
 	BOOTSTAGE_SUB_FORMAT,
@@ -455,6 +473,88 @@ static inline int bootstage_init(bool first)
 
 #endif /* ENABLE_BOOTSTAGE */
 
+#if !defined(USE_HOSTCC) && CONFIG_IS_ENABLED(BOOTSTAGE_TREE)
+/**
+ * bootstage_span_start() - Start timing an activity in the bootstage tree
+ *
+ * Spans nest: any span started before this one is ended becomes its child.
+ *
+ * @type: Type of activity
+ * @name: Name of the activity (copied, so it need not persist), or NULL
+ * @addr: Address of the code involved (used for initcalls which have no name)
+ * Return: span number to pass to bootstage_span_end(), or -ve if the span
+ *	is not recorded (e.g. -ENOSPC if there is no more space)
+ */
+int bootstage_span_start(enum bootstage_span_t type, const char *name,
+			 ulong addr);
+
+/**
+ * bootstage_span_end() - Finish timing an activity
+ *
+ * @span: Value returned by bootstage_span_start(); -ve values are ignored
+ */
+void bootstage_span_end(int span);
+
+/**
+ * bootstage_span_relocate() - Move the spans into the full malloc() heap
+ *
+ * Before relocation there is only room for CONFIG_BOOTSTAGE_TREE_COUNT_F
+ * spans, in the pre-relocation heap. This copies them to a new table with
+ * space for CONFIG_BOOTSTAGE_TREE_COUNT spans.
+ *
+ * Return: 0 if OK, -ENOMEM if out of memory
+ */
+int bootstage_span_relocate(void);
+
+/**
+ * bootstage_tree_report() - Show the spans as a tree
+ *
+ * Children of each span are shown in order of decreasing self time, i.e. the
+ * time spent in the span itself and not in its children.
+ */
+void bootstage_tree_report(void);
+
+/**
+ * bootstage_trace_export() - Write the timings as Chrome trace-event JSON
+ *
+ * Spans are written as complete ('X') events and bootstage marks as instant
+ * ('i') events, all with times in microseconds, so the result can be loaded
+ * into chrome://tracing or Perfetto. The output is nul-terminated.
+ *
+ * @buf: Buffer for the output, or NULL to just find the size
+ * @size: Size of @buf in bytes
+ * Return: number of bytes needed for the output, not including the nul
+ *	terminator. If this is >= @size then the output was truncated
+ */
+int bootstage_trace_export(char *buf, int size);
+
+/**
+ * bootstage_trace_to_bloblist() - Add a trace-event export to the bloblist
+ *
+ * This adds a BLOBLISTT_U_BOOT_BOOT_TRACE record holding the output of
+ * bootstage_trace_export(), for the OS to pick up
+ *
+ * Return: 0 if OK, -ENOSYS if bloblist is not enabled, -ENOSPC if there is
+ *	no space in the bloblist
+ */
+int bootstage_trace_to_bloblist(void);
+#else
+static inline int bootstage_span_start(enum bootstage_span_t type,
+				       const char *name, ulong addr)
+{
+	return -ENOSYS;
+}
+
+static inline void bootstage_span_end(int span)
+{
+}
+
+static inline int bootstage_span_relocate(void)
+{
+	return 0;
+}
+#endif
+
 /* helpers for SPL */
 int _bootstage_stash_default(void);
 int _bootstage_unstash_default(void);
@@ -13,6 +13,7 @@
 #include <event.h>
 #include <linker_lists.h>
 #include <dm/ofnode.h>
+#include <linux/errno.h>
 
 struct device_node;
 struct driver_info;
@@ -230,6 +231,81 @@ void device_free(struct udevice *dev);
 static inline void device_free(struct udevice *dev) {}
 #endif
 
+/**
+ * device_probe_finish() - Complete probing a device
+ *
+ * This runs the steps which follow the driver's probe() method, such as the
+ * uclass post_probe() method. If anything fails, the device is removed.
+ *
+ * @dev: Device whose driver has been probed
+ * Return: 0 if OK, -ve on error
+ */
+int device_probe_finish(struct udevice *dev);
+
+/**
+ * typedef dm_probe_done_t - Called when a deferred device has been probed
+ *
+ * @dev: Device which has finished probing
+ * @ctx: Context passed to dm_probe_async_end()
+ * Return: 0 if OK, -ve on error
+ */
+typedef int (*dm_probe_done_t)(struct udevice *dev, void *ctx);
+
+#if CONFIG_IS_ENABLED(DM_PROBE_ASYNC)
+/**
+ * device_probe_wait() - Wait for a deferred probe to complete
+ *
+ * If @dev is waiting for its hardware (see dev_probe_defer()) this waits for
+ * it and completes the probe. Other waiting devices are polled meanwhile.
+ *
+ * @dev: Device to wait for
+ * Return: 0 if OK (or not waiting), -ve if the probe failed
+ */
+int device_probe_wait(struct udevice *dev);
+
+/**
+ * dm_probe_async_begin() - Start deferring probe waits
+ *
+ * After this, dev_probe_defer() records waits instead of carrying them out,
+ * until dm_probe_async_end() is called. This is only possible after
+ * relocation.
+ *
+ * Return: 0 if OK, -ENOSYS if not possible
+ */
+int dm_probe_async_begin(void);
+
+/**
+ * dm_probe_async_end() - Wait for all deferred probes to complete
+ *
+ * This polls the waiting devices until each one is either probed or has
+ * failed. @done is called for each device which probes successfully, after
+ * being deferred, so that the caller can pick up where it left off, e.g. to
+ * probe the device's children. More waits may be deferred by @done.
+ *
+ * Finally dev_probe_defer() goes back to waiting synchronously.
+ *
+ * @done: Function to call for each probed device, or NULL
+ * @ctx: Context to pass to @done
+ * Return: 0 if OK, else the first error from a deferred probe or from @done
+ */
+int dm_probe_async_end(dm_probe_done_t done, void *ctx);
+#else
+static inline int device_probe_wait(struct udevice *dev)
+{
+	return 0;
+}
+
+static inline int dm_probe_async_begin(void)
+{
+	return -ENOSYS;
+}
+
+static inline int dm_probe_async_end(dm_probe_done_t done, void *ctx)
+{
+	return 0;
+}
+#endif
+
 /**
  * device_chld_unbind() - Unbind all device's children from the device if bound
  *			  to drv
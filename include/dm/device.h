@@ -84,6 +84,9 @@ struct driver_info;
 /* Device must be probed after it was bound */
 #define DM_FLAG_PROBE_AFTER_BIND	(1 << 15)
 
+/* Device probe is waiting for its hardware, see dev_probe_defer() */
+#define DM_FLAG_PROBE_DEFERRED		(1 << 16)
+
 /*
  * One or multiple of these flags are passed to device_remove() so that
  * a selective device removal as specified by the remove-stage and the
@@ -1064,6 +1067,55 @@ static inline bool device_is_on_pci_bus(const struct udevice *dev)
 	for (int _ret = device_first_child_err(parent, &pos); !_ret; \
 	     _ret = device_next_child_err(&pos))
 
+/**
+ * typedef dm_probe_ready_t - Check whether a device's hardware is ready
+ *
+ * This is called repeatedly while a device is waiting, possibly from
+ * schedule(), so it must only check the hardware status and return quickly.
+ * It must not delay or probe other devices.
+ *
+ * @dev: Device being probed
+ * Return: 0 if ready, -EAGAIN if still waiting, other -ve on error
+ */
+typedef int (*dm_probe_ready_t)(struct udevice *dev);
+
+/**
+ * typedef dm_probe_cont_t - Carry on probing a device once it is ready
+ *
+ * @dev: Device being probed
+ * Return: 0 if OK, -ve on error
+ */
+typedef int (*dm_probe_cont_t)(struct udevice *dev);
+
+/**
+ * dev_probe_defer() - Wait for the hardware of a device being probed
+ *
+ * Drivers whose probe() method must wait for the hardware (link training,
+ * power-up delays, card init) can call this at the wait point, as the last
+ * thing they do, and move the rest of the probe into @cont::
+ *
+ *	return dev_probe_defer(dev, foo_link_up, foo_probe_cont, 100);
+ *
+ * While driver model probes the devices at start-up (see
+ * CONFIG_DM_PROBE_ASYNC) this records the wait and returns straight away, so
+ * that other devices are probed in the meantime. The device is marked with
+ * DM_FLAG_PROBE_DEFERRED until @ready reports that the hardware is ready;
+ * then @cont is called and probing completes as normal. Anything which probes
+ * the device in the meantime, e.g. one of its children, waits for that to
+ * happen. @cont may itself call this function for a later wait point.
+ *
+ * Otherwise this simply waits for @ready and then calls @cont.
+ *
+ * @dev: Device being probed
+ * @ready: Function to check whether the hardware is ready
+ * @cont: Function to complete probing once ready, or NULL if none
+ * @timeout_ms: Time to wait before giving up, in milliseconds
+ * Return: 0 if OK or the wait was deferred, -ETIMEDOUT if the hardware did not
+ *	become ready in time, other -ve on error from @ready or @cont
+ */
+int dev_probe_defer(struct udevice *dev, dm_probe_ready_t ready,
+		    dm_probe_cont_t cont, ulong timeout_ms);
+
 /**
  * dm_scan_fdt_dev() - Bind child device in the device tree
  *
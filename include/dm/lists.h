@@ -45,6 +45,20 @@ struct uclass_driver *lists_uclass_lookup(enum uclass_id id);
  */
 int lists_bind_drivers(struct udevice *parent, bool pre_reloc_only);
 
+/**
+ * lists_driver_lookup_compat() - find the driver for a compatible string
+ *
+ * This returns the first driver, in linker-list order, which has @compat in its
+ * of_match table. With DM_COMPAT_INDEX this uses a hash index of all
+ * compatible strings, otherwise it walks the driver list.
+ *
+ * @compat: Compatible string to look up
+ * @of_idp: Returns the entry in the driver's of_match table which matched
+ * Return: pointer to driver, or NULL if not found
+ */
+struct driver *lists_driver_lookup_compat(const char *compat,
+					  const struct udevice_id **of_idp);
+
 /**
  * lists_bind_fdt() - bind a device tree node
  *
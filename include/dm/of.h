@@ -9,6 +9,7 @@
 
 #include <asm/u-boot.h>
 #include <asm/global_data.h>
+#include <linux/bitops.h>
 
 /* integer value within a device tree property which references another node */
 typedef u32 phandle;
@@ -50,6 +51,10 @@ struct property {
  * @parent: Pointer to parent node, or NULL if this is the root node
  * @child: Pointer to head of child node list, or NULL if no children
  * @sibling: Pointer to the next sibling node, or NULL if this is the last
+ * @offset: Offset of the node in the flat tree, for a lazily expanded tree
+ * @lazy: Parts of the node not expanded yet (OF_LAZY_...), for a lazily
+ *	expanded tree. Use of_node_child() and of_node_properties() rather than
+ *	accessing @child and @properties directly, so they are expanded first
  */
 struct device_node {
 	const char *name;
@@ -61,6 +66,16 @@ struct device_node {
 	struct device_node *parent;
 	struct device_node *child;
 	struct device_node *sibling;
+#if CONFIG_IS_ENABLED(OF_LIVE_LAZY)
+	int offset;
+	u8 lazy;
+#endif
+};
+
+/* Parts of a lazily expanded node which are still in the flat tree */
+enum {
+	OF_LAZY_CHILDREN	= BIT(0),
+	OF_LAZY_PROPS		= BIT(1),
 };
 
 #define BAD_OF_ROOT	0xdead11e3
@@ -114,6 +129,52 @@ static inline const char *of_node_full_name(const struct device_node *np)
 	return np ? np->full_name : "<no-node>";
 }
 
+#if CONFIG_IS_ENABLED(OF_LIVE_LAZY)
+/**
+ * of_live_expand() - Expand part of a node from the flat tree
+ *
+ * @np: Node to expand
+ * @what: Parts to expand (OF_LAZY_...)
+ */
+void of_live_expand(struct device_node *np, uint what);
+#endif
+
+/**
+ * of_node_child() - Get the first child of a node
+ *
+ * With a lazily expanded tree, this creates the children of the node first,
+ * if needed
+ *
+ * @np: Node to check
+ * Return: first child, or NULL if none
+ */
+static inline struct device_node *of_node_child(const struct device_node *np)
+{
+#if CONFIG_IS_ENABLED(OF_LIVE_LAZY)
+	if (np->lazy & OF_LAZY_CHILDREN)
+		of_live_expand((struct device_node *)np, OF_LAZY_CHILDREN);
+#endif
+	return np->child;
+}
+
+/**
+ * of_node_properties() - Get the first property of a node
+ *
+ * With a lazily expanded tree, this creates the properties of the node first,
+ * if needed
+ *
+ * @np: Node to check
+ * Return: first property, or NULL if none
+ */
+static inline struct property *of_node_properties(const struct device_node *np)
+{
+#if CONFIG_IS_ENABLED(OF_LIVE_LAZY)
+	if (np->lazy & OF_LAZY_PROPS)
+		of_live_expand((struct device_node *)np, OF_LAZY_PROPS);
+#endif
+	return np->properties;
+}
+
 /* Default #address and #size cells */
 #if !defined(OF_ROOT_NODE_ADDR_CELLS_DEFAULT)
 #define OF_ROOT_NODE_ADDR_CELLS_DEFAULT 2
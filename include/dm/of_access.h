@@ -258,6 +258,10 @@ struct device_node *of_find_node_by_prop_value(struct device_node *from,
 /**
  * of_find_node_by_phandle() - Find a node given a phandle
  *
+ * With CONFIG_OF_PHANDLE_CACHE, the phandles of the tree are indexed on first
+ * use, so that later lookups in the same tree do not walk it. A phandle which
+ * is not in the index is still looked for by walking the tree.
+ *
  * @root:	root node to start from (NULL for default device tree)
  * @handle:	phandle of the node to find
  *
@@ -266,6 +270,15 @@ struct device_node *of_find_node_by_prop_value(struct device_node *from,
 struct device_node *of_find_node_by_phandle(struct device_node *root,
 					    phandle handle);
 
+/**
+ * of_phandle_cache_invalidate() - Drop the phandle index
+ *
+ * This must be called when nodes are added to or removed from a tree, when a
+ * phandle changes or when a tree is freed, so that of_find_node_by_phandle()
+ * does not return stale nodes.
+ */
+void of_phandle_cache_invalidate(void);
+
 /**
  * of_read_u8() - Find and read a 8-bit integer from a property
  *
@@ -573,6 +586,8 @@ struct device_node *of_get_stdout(void);
 /**
  * of_write_prop() - Write a property to the device tree
  *
+ * Writing the "phandle" property also updates the phandle of @np.
+ *
  * @np:		device node to which the property value is to be written
  * @propname:	name of the property to write
  * @value:	value of the property
@@ -0,0 +1,130 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * Probe plan: a record of which devices were bound from the devicetree
+ *
+ * On every boot, driver model walks the devicetree and matches each node
+ * against the compatible strings of all drivers. When neither the devicetree
+ * nor U-Boot has changed, the result is the same each time. A probe plan
+ * records the result (node, driver and parent of each device) so that later
+ * boots can bind the devices directly, in the same order. It is the runtime
+ * equivalent of what dtoc does at build time for of-platdata.
+ */
+
+#ifndef _DM_PLAN_H_
+#define _DM_PLAN_H_
+
+#include <linux/types.h>
+
+enum {
+	DM_PLAN_MAGIC		= 0x6e6c7064,	/* "dpln" */
+	DM_PLAN_ROOT		= 0xffffffff,	/* Parent is the root device */
+	DM_PLAN_NO_MATCH	= 0xffff,	/* Bound without an of_match */
+};
+
+/**
+ * struct dm_plan_entry - A device to bind
+ *
+ * @node: Offset of the device's node in the control devicetree
+ * @driver: Index of the driver in the driver linker list. This also determines
+ *	the uclass
+ * @match: Index of the matching entry in the driver's of_match table, used to
+ *	obtain the driver data, or DM_PLAN_NO_MATCH if the driver data is 0
+ * @parent: Index of the entry for the parent device, which is always lower
+ *	than that of this entry, or DM_PLAN_ROOT
+ */
+struct dm_plan_entry {
+	u32 node;
+	u16 driver;
+	u16 match;
+	u32 parent;
+};
+
+/**
+ * struct dm_plan_hdr - Header of a probe plan
+ *
+ * This is stored in the bloblist with the tag BLOBLISTT_U_BOOT_DM_PLAN_F for
+ * the devices bound before relocation and BLOBLISTT_U_BOOT_DM_PLAN_R for those
+ * bound after. It is followed by @count entries of struct dm_plan_entry, in
+ * the order the devices were bound.
+ *
+ * @magic: DM_PLAN_MAGIC
+ * @key: CRC32 of the U-Boot version string, the number and names of the
+ *	drivers and the structure and strings of the control devicetree. The
+ *	plan is only used if this matches and each entry's node is still
+ *	compatible with the of_match entry it refers to
+ * @count: Number of entries
+ */
+struct dm_plan_hdr {
+	u32 magic;
+	u32 key;
+	u32 count;
+};
+
+struct udevice;
+
+/**
+ * dm_plan_scan() - Bind devices from the devicetree, using a probe plan
+ *
+ * If the bloblist holds a valid probe plan for this devicetree, this binds
+ * the devices in the plan. Otherwise it calls dm_extended_scan() and records
+ * a plan in the bloblist, if the scan succeeds.
+ *
+ * Plans are not used with a live tree, since nodes are found by their offset
+ * in the flat tree.
+ *
+ * @pre_reloc_only: If true, bind only nodes with special devicetree properties,
+ * or drivers with the DM_FLAG_PRE_RELOC flag. If false bind all drivers.
+ * Return: 0 if OK, -ve on error
+ */
+int dm_plan_scan(bool pre_reloc_only);
+
+#if CONFIG_IS_ENABLED(DM_PLAN)
+/**
+ * dm_plan_skip_scan() - Check whether a scan of a device's node is needed
+ *
+ * While binding from a plan, the children of each device in the plan are in
+ * the plan too, so a driver scanning for them in its bind() method must not
+ * bind them again.
+ *
+ * @parent: Device whose children are to be scanned
+ * Return: true to skip the scan, false to scan as normal
+ */
+bool dm_plan_skip_scan(struct udevice *parent);
+
+/**
+ * dm_plan_add() - Record that a node is about to be bound
+ *
+ * This reserves an entry in the plan being recorded, so that entries are in
+ * the order devices are bound, with each parent before its children.
+ *
+ * @parent: Parent device for the node
+ * @node_offset: Offset of the node in the devicetree
+ * Return: opaque entry to pass to dm_plan_set_dev(), or NULL if not recording
+ */
+void *dm_plan_add(struct udevice *parent, int node_offset);
+
+/**
+ * dm_plan_set_dev() - Record the result of binding a node
+ *
+ * @rec: Value returned by dm_plan_add()
+ * @dev: Device bound for the node, or NULL if none
+ * @ret: Result of binding, 0 if OK
+ */
+void dm_plan_set_dev(void *rec, struct udevice *dev, int ret);
+#else
+static inline bool dm_plan_skip_scan(struct udevice *parent)
+{
+	return false;
+}
+
+static inline void *dm_plan_add(struct udevice *parent, int node_offset)
+{
+	return NULL;
+}
+
+static inline void dm_plan_set_dev(void *rec, struct udevice *dev, int ret)
+{
+}
+#endif
+
+#endif
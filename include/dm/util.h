@@ -66,6 +66,15 @@ void dm_dump_static_driver_info(void);
  */
 void dm_dump_mem(struct dm_stats *stats);
 
+/**
+ * dm_dump_of_live() - Dump memory and time saved by a lazy livetree
+ *
+ * This shows how much of the tree has been expanded, compared to
+ * unflattening all of it. It does nothing unless the control tree is
+ * expanded lazily (CONFIG_OF_LIVE_LAZY)
+ */
+void dm_dump_of_live(void);
+
 #if CONFIG_IS_ENABLED(OF_PLATDATA_INST) && CONFIG_IS_ENABLED(READ_ONLY)
 void *dm_priv_to_rw(void *priv);
 #else
@@ -28,8 +28,41 @@ struct event_spy {
 	void *ctx;
 };
 
+/**
+ * struct event_type_info - Spies and statistics for one event type
+ *
+ * Static spies are sorted by the linker, so those for each type are normally
+ * adjacent. @first and @end give the range of the linker list to search.
+ *
+ * @first: Index of the first static spy for this type
+ * @end: Index after the last static spy for this type (0 if none)
+ * @dynamic: Number of dynamic spies for this type
+ * @count: Number of times this event has been sent (EVENT_DEBUG only)
+ * @time_us: Total time spent in the spies for this event, in microseconds
+ *	(EVENT_DEBUG only)
+ */
+struct event_type_info {
+	u16 first;
+	u16 end;
+	u16 dynamic;
+	uint count;
+	ulong time_us;
+};
+
+/**
+ * struct event_state - State of events
+ *
+ * @spy_head: List of dynamic spies (struct event_spy)
+ * @type: Information for each event type
+ * @indexed: true if the static spies have been indexed in @type
+ * @timing: true while reading the timer, so that events sent by the timer
+ *	driver are not timed
+ */
 struct event_state {
 	struct list_head spy_head;
+	struct event_type_info type[EVT_COUNT];
+	bool indexed;
+	bool timing;
 };
 
 #endif
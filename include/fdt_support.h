@@ -176,6 +176,170 @@ int fdt_pci_dma_ranges(void *blob, int phb_off, struct pci_controller *hose);
 
 int fdt_find_or_add_subnode(void *fdt, int parentoffset, const char *name);
 
+/* Node handles at or above this value refer to nodes added by a batch */
+#define FDT_BATCH_NEW_NODE	0x40000000
+
+/**
+ * struct fdt_batch - A set of edits to write to a devicetree in one pass
+ *
+ * Each fdt_setprop() or fdt_add_subnode() call moves everything after the
+ * point of the edit, so making many edits to a large devicetree takes time
+ * proportional to their product. A batch instead collects the edits, leaving
+ * the devicetree untouched, so node offsets stay valid throughout. Then
+ * fdt_batch_apply() writes the new devicetree in a single pass.
+ *
+ * Errors are sticky: once an edit fails, the others are ignored and
+ * fdt_batch_apply() returns the error, so a caller may queue several edits
+ * and check the result once.
+ *
+ * @fdt: Devicetree being edited, which must not change until the batch is
+ *	applied
+ * @edit: Property edits, in the order they were made
+ * @edit_count: Number of property edits
+ * @edit_max: Number of property edits allocated
+ * @node: Nodes to add, in the order they were added
+ * @node_count: Number of nodes to add
+ * @node_max: Number of nodes allocated
+ * @rsv: Memory reservations to add, each an address and a size
+ * @rsv_count: Number of memory reservations to add
+ * @rsv_max: Number of memory reservations allocated
+ * @data: Property values and node names
+ * @data_size: Number of bytes used in @data
+ * @data_max: Number of bytes allocated for @data
+ * @strings: Property names not in the devicetree's strings block
+ * @strings_size: Number of bytes used in @strings
+ * @strings_max: Number of bytes allocated for @strings
+ * @err: First error, or 0 if none
+ */
+struct fdt_batch {
+	const void *fdt;
+	struct fdt_batch_edit *edit;
+	int edit_count;
+	int edit_max;
+	struct fdt_batch_node *node;
+	int node_count;
+	int node_max;
+	u64 *rsv;
+	int rsv_count;
+	int rsv_max;
+	char *data;
+	int data_size;
+	int data_max;
+	char *strings;
+	int strings_size;
+	int strings_max;
+	int err;
+};
+
+/**
+ * fdt_batch_init() - Start a batch of edits to a devicetree
+ *
+ * @batch: Batch to set up
+ * @fdt: Devicetree to edit
+ * Return: 0 if OK, -FDT_ERR_... if @fdt is not valid
+ */
+int fdt_batch_init(struct fdt_batch *batch, const void *fdt);
+
+/**
+ * fdt_batch_uninit() - Free the memory used by a batch
+ *
+ * @batch: Batch to free
+ */
+void fdt_batch_uninit(struct fdt_batch *batch);
+
+/**
+ * fdt_batch_subnode() - Find or add a subnode
+ *
+ * This is the batch equivalent of fdt_find_or_add_subnode(). New nodes are
+ * placed before any existing subnodes of @parent, as fdt_add_subnode() does.
+ *
+ * @batch: Batch to update
+ * @parent: Offset of parent node, or handle of a node added by this batch
+ * @name: Name of the subnode
+ * Return: offset of the existing subnode, handle of the new subnode, or
+ *	-FDT_ERR_... on error
+ */
+int fdt_batch_subnode(struct fdt_batch *batch, int parent, const char *name);
+
+/**
+ * fdt_batch_setprop() - Set the value of a property
+ *
+ * The value is copied, so need not remain valid. If the property is set more
+ * than once, the last value is used.
+ *
+ * @batch: Batch to update
+ * @node: Offset of the node, or handle of a node added by this batch
+ * @name: Name of the property
+ * @val: Value of the property
+ * @len: Length of @val in bytes
+ * Return: 0 if OK, -FDT_ERR_... on error
+ */
+int fdt_batch_setprop(struct fdt_batch *batch, int node, const char *name,
+		      const void *val, int len);
+
+/**
+ * fdt_batch_delprop() - Delete a property
+ *
+ * It is not an error if the property does not exist.
+ *
+ * @batch: Batch to update
+ * @node: Offset of the node, or handle of a node added by this batch
+ * @name: Name of the property
+ * Return: 0 if OK, -FDT_ERR_... on error
+ */
+int fdt_batch_delprop(struct fdt_batch *batch, int node, const char *name);
+
+/**
+ * fdt_batch_add_mem_rsv() - Add a memory reservation
+ *
+ * @batch: Batch to update
+ * @addr: Start address of the region
+ * @size: Size of the region in bytes
+ * Return: 0 if OK, -FDT_ERR_NOSPACE if out of memory
+ */
+int fdt_batch_add_mem_rsv(struct fdt_batch *batch, u64 addr, u64 size);
+
+/**
+ * fdt_batch_apply() - Write a batch of edits to the devicetree
+ *
+ * The new devicetree is built in a temporary buffer and then copied over the
+ * old one, which is left unchanged on error. Properties set on existing nodes
+ * keep their place; new properties and nodes are placed as fdt_setprop() and
+ * fdt_add_subnode() would place them. NOP tags are dropped.
+ *
+ * Afterwards the batch can only be freed, since its node offsets refer to the
+ * old devicetree.
+ *
+ * @batch: Batch to apply
+ * @fdt: Devicetree passed to fdt_batch_init()
+ * @bufsize: Size of the buffer holding @fdt; this becomes its total size
+ * Return: 0 if OK, -FDT_ERR_NOSPACE if the result does not fit or there is not
+ *	enough memory, other -FDT_ERR_... on error
+ */
+int fdt_batch_apply(struct fdt_batch *batch, void *fdt, int bufsize);
+
+static inline int fdt_batch_setprop_u32(struct fdt_batch *batch, int node,
+					const char *name, u32 val)
+{
+	fdt32_t tmp = cpu_to_fdt32(val);
+
+	return fdt_batch_setprop(batch, node, name, &tmp, sizeof(tmp));
+}
+
+static inline int fdt_batch_setprop_u64(struct fdt_batch *batch, int node,
+					const char *name, u64 val)
+{
+	fdt64_t tmp = cpu_to_fdt64(val);
+
+	return fdt_batch_setprop(batch, node, name, &tmp, sizeof(tmp));
+}
+
+static inline int fdt_batch_setprop_string(struct fdt_batch *batch, int node,
+					   const char *name, const char *str)
+{
+	return fdt_batch_setprop(batch, node, name, str, strlen(str) + 1);
+}
+
 /**
  * Add board-specific data to the FDT before booting the OS.
  *
@@ -406,6 +570,22 @@ int fdt_setup_simplefb_node(void *fdt, int node, u64 base_address, u32 width,
 
 int fdt_overlay_apply_verbose(void *fdt, void *fdto);
 
+/**
+ * fdt_overlay_apply_list() - Apply several overlays, reporting any errors
+ *
+ * With CONFIG_OF_LIBFDT_OVERLAY_LIVE the overlays are applied to a livetree,
+ * which is flattened into @fdt once they have all been applied. If any of them
+ * fails, @fdt is left unchanged. Otherwise each is applied in turn with
+ * fdt_overlay_apply_verbose().
+ *
+ * @fdt: Devicetree to update
+ * @size: Size of the buffer holding @fdt, which becomes its total size
+ * @fdto: List of overlays, each of which is left unusable
+ * @count: Number of overlays
+ * Return: 0 if OK, -ve on error
+ */
+int fdt_overlay_apply_list(void *fdt, int size, void *const fdto[], int count);
+
 int fdt_valid(struct fdt_header **blobp);
 
 /**
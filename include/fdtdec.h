@@ -690,6 +690,21 @@ int fdtdec_get_chosen_node(const void *blob, const char *name);
  */
 const char *fdtdec_get_compatible(enum fdt_compat_id id);
 
+/**
+ * fdtdec_node_offset_by_phandle() - find a node by its phandle
+ *
+ * This behaves like fdt_node_offset_by_phandle(), which walks the whole tree
+ * on each call. With CONFIG_OF_PHANDLE_CACHE, and once full malloc() is
+ * available, the phandles of @blob are indexed on first use instead. Hits are
+ * checked against the tree, so the index never returns a wrong node after
+ * the tree is modified; it is rebuilt when a phandle turns out to be missing.
+ *
+ * @blob:	FDT blob
+ * @phandle:	phandle to look for
+ * Return: node offset if found, -ve FDT error code on error
+ */
+int fdtdec_node_offset_by_phandle(const void *blob, uint phandle);
+
 /* Look up a phandle and follow it to its node. Then return the offset
  * of that node.
  *
@@ -151,6 +151,27 @@ int fs_size(const char *filename, loff_t *size);
 int fs_read(const char *filename, ulong addr, loff_t offset, loff_t len,
 	    loff_t *actread);
 
+/**
+ * fs_read_decomp() - read a file, decompressing it as it is read
+ *
+ * The compression type is worked out from the start of the file. The file is
+ * read in chunks, each being decompressed straight to @addr, so there is no
+ * need for a buffer holding the compressed file. An uncompressed file is just
+ * copied to @addr.
+ *
+ * @filename:	full path of the file to read from
+ * @addr:	address to decompress to
+ * @unc_len:	space available at @addr; this is further limited so that the
+ *		output does not run into memory reserved in the LMB
+ * @filesizep:	returns the size of the file
+ * @lenp:	returns the number of bytes written to @addr
+ * Return:	0 if OK, -ENOSPC if @unc_len (or the free memory at @addr) is
+ *		too small, -ENOSYS if the
+ *		compression type is not supported, other -ve on error
+ */
+int fs_read_decomp(const char *filename, ulong addr, ulong unc_len,
+		   loff_t *filesizep, ulong *lenp);
+
 /**
  * fs_write() - write file to the partition previously set by fs_set_blk_dev()
  *
@@ -261,6 +282,8 @@ int fs_mkdir(const char *filename);
  */
 int do_size(struct cmd_tbl *cmdtp, int flag, int argc, char *const argv[],
 	    int fstype);
+int do_loadz(struct cmd_tbl *cmdtp, int flag, int argc, char *const argv[],
+	     int fstype);
 int do_load(struct cmd_tbl *cmdtp, int flag, int argc, char *const argv[],
 	    int fstype);
 int do_ls(struct cmd_tbl *cmdtp, int flag, int argc, char *const argv[],
@@ -45,6 +45,52 @@ int gunzip(void *dst, int dstlen, unsigned char *src, unsigned long *lenp);
 int zunzip(void *dst, int dstlen, unsigned char *src, unsigned long *lenp,
 	   int stoponerr, int offset);
 
+/**
+ * struct gunzip_stream - state for decompressing gzip data piece by piece
+ *
+ * @zs: zlib stream (z_stream), allocated by gunzip_stream_start()
+ * @header_done: true once the gzip header has been skipped
+ * @done: true once the end of the compressed data has been seen
+ */
+struct gunzip_stream {
+	void *zs;
+	bool header_done;
+	bool done;
+};
+
+/**
+ * gunzip_stream_start() - Start decompressing gzip data as it arrives
+ *
+ * @gs: Stream state to set up
+ * @dst: Destination for uncompressed data
+ * @dstlen: Size of destination buffer
+ * Return: 0 if OK, -ENOMEM if out of memory, -EIO if zlib failed
+ */
+int gunzip_stream_start(struct gunzip_stream *gs, void *dst, ulong dstlen);
+
+/**
+ * gunzip_stream_write() - Decompress the next piece of gzip data
+ *
+ * The first piece must hold the whole gzip header. Data after the end of the
+ * compressed stream (such as the gzip trailer) is ignored.
+ *
+ * @gs: Stream state
+ * @src: Next compressed data
+ * @len: Length of compressed data in bytes
+ * Return: 0 if OK, -ENOSPC if the destination buffer is full, -EINVAL if the
+ *	data is corrupt
+ */
+int gunzip_stream_write(struct gunzip_stream *gs, const void *src, ulong len);
+
+/**
+ * gunzip_stream_end() - Finish decompressing and free the stream
+ *
+ * @gs: Stream state
+ * @lenp: Returns the number of bytes of uncompressed data
+ * Return: 0 if OK, -EINVAL if the compressed data was incomplete
+ */
+int gunzip_stream_end(struct gunzip_stream *gs, ulong *lenp);
+
 /**
  * gzwrite progress indicators: defined weak to allow board-specific
  * overrides:
@@ -946,6 +946,64 @@ int image_decomp(int comp, ulong load, ulong image_start, int type,
 		 void *load_buf, void *image_buf, ulong image_len,
 		 uint unc_len, ulong *load_end);
 
+/**
+ * struct image_decomp_stream - state for decompressing an image as it loads
+ *
+ * @comp:	Compression algorithm that is used (IH_COMP_...)
+ * @load_buf:	Place to decompress to
+ * @unc_len:	Available space for decompression
+ * @pos:	Number of bytes written so far, for IH_COMP_NONE
+ * @priv:	State for the decompressor
+ */
+struct image_decomp_stream {
+	int comp;
+	void *load_buf;
+	ulong unc_len;
+	ulong pos;
+	void *priv;
+};
+
+/**
+ * image_decomp_stream_start() - start decompressing an image piece by piece
+ *
+ * This allows an image to be decompressed while it is being read, so that
+ * loading and decompression overlap and there is no need to hold the whole
+ * compressed image in memory. Only gzip and zstd are supported, along with
+ * IH_COMP_NONE which just copies the data.
+ *
+ * @ds:		Stream state to set up
+ * @comp:	Compression algorithm that is used (IH_COMP_...)
+ * @load_buf:	Place to decompress to
+ * @unc_len:	Available space for decompression
+ * Return: 0 if OK, -ENOSYS if @comp is not supported, other -ve on error
+ */
+int image_decomp_stream_start(struct image_decomp_stream *ds, int comp,
+			      void *load_buf, ulong unc_len);
+
+/**
+ * image_decomp_stream_write() - decompress the next piece of an image
+ *
+ * The first piece must be large enough to hold the compression header.
+ *
+ * @ds:		Stream state
+ * @buf:	Next compressed data
+ * @len:	Number of bytes in @buf
+ * Return: 0 if OK, -ENOSPC if out of space, other -ve on error
+ */
+int image_decomp_stream_write(struct image_decomp_stream *ds, const void *buf,
+			      ulong len);
+
+/**
+ * image_decomp_stream_end() - finish decompressing an image
+ *
+ * This frees the stream state, whether or not decompression succeeded.
+ *
+ * @ds:		Stream state
+ * @lenp:	Returns the number of uncompressed bytes
+ * Return: 0 if OK, -ve if the data was incomplete or on error
+ */
+int image_decomp_stream_end(struct image_decomp_stream *ds, ulong *lenp);
+
 /**
  * Set up properties in the FDT
  *
@@ -1264,6 +1322,93 @@ int fit_image_verify_with_data(const void *fit, int image_noffset,
 			       const void *key_blob, const void *data,
 			       size_t size);
 
+/* Most hash nodes an image can have for streaming verification */
+#define FIT_HASH_STREAM_MAX	4
+/* Amount of data copied and hashed at a time */
+#define FIT_STREAM_CHUNK_SIZE	0x10000
+
+/**
+ * struct fit_hash_stream - state for hashing image data as it arrives
+ *
+ * @count: Number of hash nodes being calculated
+ * @node: Hash nodes being calculated
+ * @node.algo: Hash algorithm
+ * @node.ctx: Progressive hash context, NULL once finished or failed
+ * @node.noffset: Offset of the hash node in the FIT
+ */
+struct fit_hash_stream {
+	int count;
+	struct fit_hash_stream_node {
+		struct hash_algo *algo;
+		void *ctx;
+		int noffset;
+	} node[FIT_HASH_STREAM_MAX];
+};
+
+/**
+ * fit_image_hash_start() - Start hashing image data as it is loaded
+ *
+ * This sets up a progressive hash for each hash node of an image, so that
+ * the data can be fed in as it is read, avoiding a separate pass over the
+ * whole image once it is in memory. Images which are signed or ciphered, or
+ * use a hash without progressive support, cannot be handled this way and
+ * must be verified with fit_image_verify_with_data() instead.
+ *
+ * @fit:	Pointer to the FIT format image header
+ * @image_noffset: Offset in @fit of image to verify
+ * @hs:		Returns the hash state
+ * Return: 0 if OK, -ENOSYS if the image cannot be verified this way
+ */
+int fit_image_hash_start(const void *fit, int image_noffset,
+			 struct fit_hash_stream *hs);
+
+/**
+ * fit_image_hash_update() - Add the next piece of image data to the hashes
+ *
+ * @hs:		Hash state from fit_image_hash_start()
+ * @data:	Next image data
+ * @size:	Size of data in bytes
+ * Return: 0 if OK, -EIO if hashing failed, in which case verification fails
+ */
+int fit_image_hash_update(struct fit_hash_stream *hs, const void *data,
+			  size_t size);
+
+/**
+ * fit_image_hash_copy() - Copy image data, adding it to the hashes
+ *
+ * The copy is done in chunks, each being hashed while it is in the cache.
+ *
+ * @hs:		Hash state from fit_image_hash_start()
+ * @dst:	Destination for the data
+ * @src:	Image data
+ * @size:	Size of data in bytes
+ * Return: 0 if OK, -EIO if hashing failed, in which case verification fails
+ */
+int fit_image_hash_copy(struct fit_hash_stream *hs, void *dst,
+			const void *src, size_t size);
+
+/**
+ * fit_image_hash_abort() - Abandon streaming verification
+ *
+ * @hs:		Hash state from fit_image_hash_start()
+ */
+void fit_image_hash_abort(struct fit_hash_stream *hs);
+
+/**
+ * fit_image_verify_stream() - Check hashes worked out while loading an image
+ *
+ * This is the streaming equivalent of fit_image_verify_with_data(), to be
+ * called once all the image data has been passed to fit_image_hash_update()
+ *
+ * @fit:	Pointer to the FIT format image header
+ * @image_noffset: Offset in @fit of image to verify
+ * @key_blob:	FDT containing public keys
+ * @hs:		Hash state from fit_image_hash_start()
+ * Return: 1 if all hashes are valid, 0 otherwise
+ */
+int fit_image_verify_stream(const void *fit, int image_noffset,
+			    const void *key_blob, struct fit_hash_stream *hs);
+
 int fit_image_verify(const void *fit, int noffset);
 #if CONFIG_IS_ENABLED(FIT_SIGNATURE)
 int fit_config_verify(const void *fit, int conf_noffset);
@@ -455,4 +455,48 @@ struct abuf;
  */
 int zstd_decompress(struct abuf *in, struct abuf *out);
 
+/**
+ * struct zstd_stream - state for decompressing Zstandard data piece by piece
+ *
+ * @dstream: Decompression stream, set up when the frame header is seen
+ * @workspace: Memory used by @dstream
+ * @out: Destination buffer and how much of it has been written
+ * @done: true once the end of the frame has been seen
+ */
+struct zstd_stream {
+	zstd_dstream *dstream;
+	void *workspace;
+	zstd_out_buffer out;
+	bool done;
+};
+
+/**
+ * zstd_stream_start() - Start decompressing Zstandard data as it arrives
+ *
+ * @zs: Stream state to set up
+ * @dst: Destination for uncompressed data
+ * @dst_len: Size of destination buffer
+ */
+void zstd_stream_start(struct zstd_stream *zs, void *dst, size_t dst_len);
+
+/**
+ * zstd_stream_write() - Decompress the next piece of Zstandard data
+ *
+ * The first piece must hold the whole frame header, which sets the size of
+ * the window to allocate. Data after the end of the frame is ignored.
+ *
+ * Return: 0 if OK, -ENOMEM if out of memory, -ENOSPC if the destination
+ *	buffer is full, -EINVAL if the data is corrupt
+ */
+int zstd_stream_write(struct zstd_stream *zs, const void *src, size_t len);
+
+/**
+ * zstd_stream_end() - Finish decompressing and free the stream
+ *
+ * @zs: Stream state
+ * @lenp: Returns the number of bytes of uncompressed data
+ * Return: 0 if OK, -EINVAL if the compressed data was incomplete
+ */
+int zstd_stream_end(struct zstd_stream *zs, ulong *lenp);
+
 #endif  /* LINUX_ZSTD_H */
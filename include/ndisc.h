@@ -91,6 +91,17 @@ int ndisc_receive(struct ethernet_hdr *et, struct ip6_hdr *ip6, int len);
  */
 void ndisc_request(void);
 
+/**
+ * ndisc_lookup() - Find the MAC address to send to, from the neighbour cache
+ *
+ * For a host outside our prefix this looks up the gateway instead
+ *
+ * @ip6:	IPv6 address the packet is for
+ * @ethaddr:	returns the MAC address, if found
+ * Return: true if found, false if it must be resolved with ndisc_request()
+ */
+bool ndisc_lookup(struct in6_addr *ip6, uchar *ethaddr);
+
 /**
  * ndisc_init() - Check ND response timeout
  *
@@ -114,6 +125,11 @@ static inline void ndisc_request(void)
 {
 }
 
+static inline bool ndisc_lookup(struct in6_addr *ip6, uchar *ethaddr)
+{
+	return false;
+}
+
 static inline int ndisc_timeout_check(void)
 {
 	return 0;
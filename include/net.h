@@ -254,7 +254,44 @@ extern void (*push_packet)(void *packet, int length);
 #endif
 int eth_rx(void);			/* Check for received packets */
 void eth_halt(void);			/* stop SCC */
+
+/**
+ * eth_start_all() - Start all Ethernet devices
+ *
+ * This probes every Ethernet device and starts those which are not already
+ * running, so that packets can be sent and received on all of them at once.
+ * Devices which fail to start are skipped.
+ *
+ * Return: number of devices now running
+ */
+int eth_start_all(void);
+
+/**
+ * eth_halt_others() - Stop all running devices except the current one
+ */
+void eth_halt_others(void);
+
+/**
+ * eth_next_running() - Iterate through the running Ethernet devices
+ *
+ * @dev: Previous device, or NULL to get the first one
+ * Return: next running device after @dev, or NULL if there are no more
+ */
+struct udevice *eth_next_running(struct udevice *dev);
+
 const char *eth_get_name(void);		/* get name of current device */
+
+/**
+ * eth_mcast_join() - Join or leave an IPv4 multicast group
+ *
+ * This asks the current Ethernet device to accept (or no longer accept)
+ * frames sent to the MAC address of the group.
+ *
+ * @mcast_addr: Address of the group
+ * @join: 1 to join, 0 to leave
+ * Return: 0 if OK, -ENOSYS if the device cannot filter multicast frames,
+ * other -ve on error
+ */
 int eth_mcast_join(struct in_addr mcast_addr, int join);
 
 /**********************************************************************/
@@ -499,6 +536,7 @@ extern u8		net_ethaddr[ARP_HLEN];		/* Our ethernet address */
 extern u8		net_server_ethaddr[ARP_HLEN];	/* Boot server enet address */
 extern struct in_addr	net_ip;		/* Our    IP addr (0 = unknown) */
 extern struct in_addr	net_server_ip;	/* Server IP addr (0 = unknown) */
+extern struct in_addr	net_mcast_addr;	/* Multicast group joined (0 = none) */
 extern uchar		*net_tx_packet;		/* THE transmit packet */
 extern uchar		*net_rx_packets[PKTBUFSRX]; /* Receive packets */
 extern uchar		*net_rx_packet;		/* Current receive packet */
@@ -564,6 +602,28 @@ int net_loop(enum proto_t);
 /* Load failed.	 Start again. */
 int net_start_again(void);
 
+/**
+ * net_foreach_dev() - Call a function for each interface in use
+ *
+ * While discovering on all interfaces (CONFIG_NET_DISCOVER_ALL), this makes
+ * each running interface current in turn, with its MAC address in
+ * net_ethaddr, and calls @func so that it can send or receive on it.
+ * Otherwise @func is called once, for the current interface.
+ *
+ * @func: Function to call
+ */
+void net_foreach_dev(void (*func)(void));
+
+/**
+ * net_discover_done() - Select the interface to use after discovery
+ *
+ * This makes @dev the current interface and stops all the others. It does
+ * nothing if discovery on all interfaces is not in progress.
+ *
+ * @dev: Interface which received the chosen offer
+ */
+void net_discover_done(struct udevice *dev);
+
 /* Get size of the ethernet header when we send */
 int net_eth_hdr_size(void);
 
@@ -0,0 +1,129 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * Neighbour cache, shared by ARP and IPv6 neighbour discovery
+ */
+
+#ifndef __NET_NEIGH_H__
+#define __NET_NEIGH_H__
+
+#include <net.h>
+#include <net6.h>
+
+struct udevice;
+
+/**
+ * struct neigh_entry - An entry in the neighbour cache
+ *
+ * @dev: Ethernet device the neighbour was seen on, NULL if the entry is free
+ * @ip6: true if this is an IPv6 (NDISC) entry, false for IPv4 (ARP)
+ * @addr: IPv4 address of the neighbour, if !@ip6
+ * @addr6: IPv6 address of the neighbour, if @ip6
+ * @ethaddr: MAC address of the neighbour
+ * @confirmed: Time when the address was last seen in a reply, from get_timer()
+ * @used: Time when the entry was last looked up, from get_timer()
+ */
+struct neigh_entry {
+	struct udevice *dev;
+	bool ip6;
+	union {
+		struct in_addr addr;
+		struct in6_addr addr6;
+	};
+	uchar ethaddr[ARP_HLEN];
+	ulong confirmed;
+	ulong used;
+};
+
+#if IS_ENABLED(CONFIG_NET_NEIGH)
+/**
+ * neigh_update() - Record the MAC address of an IPv4 neighbour
+ *
+ * This adds or refreshes the entry for @ip on the current Ethernet device. If
+ * the cache is full, the least recently used entry is replaced.
+ *
+ * @ip: IPv4 address; nothing is recorded if this is 0
+ * @ethaddr: MAC address which answers for @ip
+ */
+void neigh_update(struct in_addr ip, const uchar *ethaddr);
+
+/**
+ * neigh_lookup() - Look up the MAC address of an IPv4 neighbour
+ *
+ * Entries older than CONFIG_NET_NEIGH_TIMEOUT seconds are ignored
+ *
+ * @ip: IPv4 address to look up
+ * @ethaddr: Returns the MAC address, if found
+ * Return: true if found, false if not
+ */
+bool neigh_lookup(struct in_addr ip, uchar *ethaddr);
+
+/**
+ * neigh_update6() - Record the MAC address of an IPv6 neighbour
+ *
+ * @ip6: IPv6 address; nothing is recorded if this is unspecified
+ * @ethaddr: MAC address which answers for @ip6
+ */
+void neigh_update6(const struct in6_addr *ip6, const uchar *ethaddr);
+
+/**
+ * neigh_lookup6() - Look up the MAC address of an IPv6 neighbour
+ *
+ * @ip6: IPv6 address to look up
+ * @ethaddr: Returns the MAC address, if found
+ * Return: true if found, false if not
+ */
+bool neigh_lookup6(const struct in6_addr *ip6, uchar *ethaddr);
+
+/**
+ * neigh_remove_dev() - Drop all entries for an Ethernet device
+ *
+ * @dev: Device being removed
+ */
+void neigh_remove_dev(struct udevice *dev);
+
+/**
+ * neigh_flush() - Drop all entries from the cache
+ */
+void neigh_flush(void);
+
+/**
+ * neigh_show() - Show the entries in the cache which have not expired
+ *
+ * Return: number of entries shown
+ */
+int neigh_show(void);
+#else
+static inline void neigh_update(struct in_addr ip, const uchar *ethaddr)
+{
+}
+
+static inline bool neigh_lookup(struct in_addr ip, uchar *ethaddr)
+{
+	return false;
+}
+
+static inline void neigh_update6(const struct in6_addr *ip6,
+				 const uchar *ethaddr)
+{
+}
+
+static inline bool neigh_lookup6(const struct in6_addr *ip6, uchar *ethaddr)
+{
+	return false;
+}
+
+static inline void neigh_remove_dev(struct udevice *dev)
+{
+}
+
+static inline void neigh_flush(void)
+{
+}
+
+static inline int neigh_show(void)
+{
+	return 0;
+}
+#endif
+
+#endif /* __NET_NEIGH_H__ */
@@ -87,6 +87,9 @@ struct ip_tcp_hdr {
 #define TCP_OPT_LEN_A	0x0a		/* Timestamp Length		*/
 #define TCP_MSS		1460		/* Max segment size		*/
 #define TCP_SCALE	0x01		/* Scale			*/
+#define TCP_MAX_SCALE	14		/* Largest scale, RFC 7323	*/
+#define TCP_DELAYED_ACK_SEGS	2	/* Segments before ACK is due	*/
+#define TCP_DELAYED_ACK_MS	20	/* Longest delay of an ACK	*/
 
 /**
  * struct tcp_mss - TCP option structure for MSS (Max segment size)
@@ -281,6 +284,9 @@ enum tcp_state tcp_get_tcp_state(void);
 void tcp_set_tcp_state(enum tcp_state new_state);
 int tcp_set_tcp_header(uchar *pkt, int dport, int sport, int payload_len,
 		       u8 action, u32 tcp_seq_num, u32 tcp_ack_num);
+bool tcp_ack_due(void);
+bool tcp_ack_pending(void);
+u32 tcp_get_ack_edge(void);
 
 /**
  * rxhand_tcp() - An incoming packet handler.
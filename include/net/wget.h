@@ -8,6 +8,39 @@
  */
 void wget_start(void);
 
+#if IS_ENABLED(CONFIG_WGET_STORAGE)
+/**
+ * wget_set_blk() - write the next download to a block device
+ *
+ * The data is written from the start of the partition, through a
+ * write-behind buffer, instead of to memory
+ *
+ * @ifname: Interface name, e.g. "mmc"
+ * @dev_part: Device and partition, e.g. "0:2"; partition 0 is the whole
+ *	device
+ * Return: 0 if OK, -ve on error
+ */
+int wget_set_blk(const char *ifname, const char *dev_part);
+
+/**
+ * wget_set_mtd() - write the next download to an MTD partition
+ *
+ * Each eraseblock is erased before it is written; bad blocks are skipped.
+ *
+ * @name: Name of the MTD device or partition
+ * Return: 0 if OK, -ve on error
+ */
+int wget_set_mtd(const char *name);
+
+/**
+ * wget_clear_storage() - go back to downloading to memory
+ *
+ * This releases the device and buffer set up by wget_set_blk() or
+ * wget_set_mtd()
+ */
+void wget_clear_storage(void);
+#endif
+
 enum wget_state {
 	WGET_CLOSED,
 	WGET_CONNECTING,
@@ -19,3 +52,5 @@ enum wget_state {
 #define DEBUG_WGET		0	/* Set to 1 for debug messages */
 #define WGET_RETRY_COUNT	30
 #define WGET_TIMEOUT		2000UL
+#define WGET_RESUME_RETRIES	4	/* Timeouts before reconnecting */
+#define WGET_RESUME_COUNT	5	/* Times to reconnect with a Range */
@@ -9,12 +9,41 @@
 #ifndef _OF_LIVE_H
 #define _OF_LIVE_H
 
+#include <dm/of.h>
+#include <linux/errno.h>
+
 struct abuf;
 struct device_node;
 
+/**
+ * struct of_live_stats - Memory and time used by a lazily expanded livetree
+ *
+ * @nodes: Number of nodes expanded so far
+ * @props: Number of properties expanded so far
+ * @size: Bytes allocated for the expanded nodes and properties
+ * @time_us: Time spent building the tree and expanding nodes, in microseconds
+ * @full_nodes: Number of nodes in the whole tree
+ * @full_props: Number of properties in the whole tree
+ * @full_size: Bytes needed to unflatten the whole tree
+ * @full_time_us: Time taken to unflatten the whole tree, in microseconds
+ */
+struct of_live_stats {
+	int nodes;
+	int props;
+	int size;
+	ulong time_us;
+	int full_nodes;
+	int full_props;
+	int full_size;
+	ulong full_time_us;
+};
+
 /**
  * of_live_build() - build a live (hierarchical) tree from a flat DT
  *
+ * With CONFIG_OF_LIVE_LAZY the tree is expanded lazily; see
+ * of_live_is_lazy()
+ *
  * @fdt_blob: Input tree to convert
  * @rootp: Returns live tree that was created
  * Return: 0 if OK, -ve on error
@@ -55,6 +84,59 @@ void of_live_free(struct device_node *root);
  */
 int of_live_create_empty(struct device_node **rootp);
 
+#if CONFIG_IS_ENABLED(OF_LIVE_LAZY)
+/**
+ * of_live_is_lazy() - Check whether a tree is expanded lazily
+ *
+ * With CONFIG_OF_LIVE_LAZY, of_live_build() creates only the root node.
+ * Other nodes are created from the flat tree as they are reached, with their
+ * properties pointing into the flat tree. The flat tree must therefore stay
+ * in place, unchanged, while the livetree is in use.
+ *
+ * @root: Root node of the tree
+ * Return: true if @root is the root of a lazily expanded tree
+ */
+bool of_live_is_lazy(const struct device_node *root);
+
+/**
+ * of_live_find_phandle() - Find a node in the lazy tree by its phandle
+ *
+ * This finds the node in the flat tree and expands only the path to it. Nodes
+ * added to the livetree, or whose phandle was changed there, are found among
+ * the nodes which are already expanded.
+ *
+ * @handle: Phandle to look up
+ * Return: node, or NULL if not found
+ */
+struct device_node *of_live_find_phandle(phandle handle);
+
+/**
+ * of_live_get_stats() - Get the memory and time used by the lazy tree
+ *
+ * To find the cost of expanding the whole tree, this unflattens a copy of it
+ * and then frees it again.
+ *
+ * @stats: Returns the statistics
+ * Return: 0 if OK, -ENOENT if there is no lazy tree, -ENOMEM if out of memory
+ */
+int of_live_get_stats(struct of_live_stats *stats);
+#else
+static inline bool of_live_is_lazy(const struct device_node *root)
+{
+	return false;
+}
+
+static inline struct device_node *of_live_find_phandle(phandle handle)
+{
+	return NULL;
+}
+
+static inline int of_live_get_stats(struct of_live_stats *stats)
+{
+	return -ENOENT;
+}
+#endif
+
 /**
  * of_live_flatten() - Create an FDT from a hierarchical tree
  *
@@ -64,4 +146,59 @@ int of_live_create_empty(struct device_node **rootp);
  */
 int of_live_flatten(const struct device_node *root, struct abuf *buf);
 
+struct of_live_overlay;
+
+/**
+ * of_live_overlay_begin() - Start applying overlays to a flat tree
+ *
+ * This unflattens @fdt and indexes its phandles and its __symbols__ node, so
+ * that any number of overlays can be applied with of_live_overlay_apply()
+ * without scanning the tree again for each one. The livetree points into
+ * @fdt, which must not change until of_live_overlay_end() or
+ * of_live_overlay_abort() is called.
+ *
+ * @fdt: Base tree
+ * @ovp: Returns the overlay session
+ * Return: 0 if OK, -EINVAL if @fdt is not valid, -ENOMEM if out of memory
+ */
+int of_live_overlay_begin(const void *fdt, struct of_live_overlay **ovp);
+
+/**
+ * of_live_overlay_apply() - Apply an overlay to the livetree
+ *
+ * This does the same as fdt_overlay_apply(). As there, the phandles in @fdto
+ * are updated in place, so it is left unusable. Its contents are copied, so it
+ * need not be kept afterwards.
+ *
+ * On error, the livetree may have been partly updated, so the session should
+ * be aborted. The base tree is not changed.
+ *
+ * @ov: Overlay session
+ * @fdto: Overlay to apply
+ * Return: 0 if OK, -EINVAL if @fdto is not a valid overlay, -ENOENT if a
+ *	symbol, target or fixed-up property is not found, -ENOMEM if out of
+ *	memory
+ */
+int of_live_overlay_apply(struct of_live_overlay *ov, void *fdto);
+
+/**
+ * of_live_overlay_end() - Write the livetree back to a flat tree
+ *
+ * This flattens the livetree, with the memory reservations of the base tree,
+ * into @fdt, then frees the session.
+ *
+ * @ov: Overlay session, which is freed even on error
+ * @fdt: Buffer for the result, which may be the base tree
+ * @size: Size of the buffer; this becomes the total size of the result
+ * Return: 0 if OK, -ENOSPC if the result does not fit, -ENOMEM if out of memory
+ */
+int of_live_overlay_end(struct of_live_overlay *ov, void *fdt, int size);
+
+/**
+ * of_live_overlay_abort() - Free an overlay session without writing it back
+ *
+ * @ov: Overlay session to free
+ */
+void of_live_overlay_abort(struct of_live_overlay *ov);
+
 #endif
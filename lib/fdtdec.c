@@ -24,6 +24,7 @@
 #include <gzip.h>
 #include <mapmem.h>
 #include <linux/libfdt.h>
+#include <linux/log2.h>
 #include <serial.h>
 #include <asm/global_data.h>
 #include <asm/sections.h>
@@ -632,6 +633,89 @@ int fdtdec_check_fdt(void)
 	return 0;
 }
 
+/* Phandle index of the tree which was searched last, see fdtdec.h */
+static struct {
+	const void *blob;
+	int *slot;		/* node offsets, -1 if empty */
+	uint mask;
+} fdt_phandle_cache;
+
+static bool fdtdec_phandle_cache_build(const void *blob)
+{
+	uint count = 0, size, i, phandle;
+	int offset;
+
+	free(fdt_phandle_cache.slot);
+	fdt_phandle_cache.slot = NULL;
+	fdt_phandle_cache.blob = NULL;
+
+	for (offset = fdt_next_node(blob, -1, NULL); offset >= 0;
+	     offset = fdt_next_node(blob, offset, NULL)) {
+		if (fdt_get_phandle(blob, offset))
+			count++;
+	}
+
+	size = roundup_pow_of_two(count * 2 + 1);
+	fdt_phandle_cache.slot = malloc(size * sizeof(int));
+	if (!fdt_phandle_cache.slot)
+		return false;
+	memset(fdt_phandle_cache.slot, 0xff, size * sizeof(int));
+	fdt_phandle_cache.mask = size - 1;
+
+	for (offset = fdt_next_node(blob, -1, NULL); offset >= 0;
+	     offset = fdt_next_node(blob, offset, NULL)) {
+		phandle = fdt_get_phandle(blob, offset);
+		if (!phandle)
+			continue;
+		for (i = phandle & fdt_phandle_cache.mask;
+		     fdt_phandle_cache.slot[i] >= 0;
+		     i = (i + 1) & fdt_phandle_cache.mask) {
+			/* A duplicate phandle, the first node found wins */
+			if (fdt_get_phandle(blob, fdt_phandle_cache.slot[i]) ==
+			    phandle)
+				break;
+		}
+		if (fdt_phandle_cache.slot[i] < 0)
+			fdt_phandle_cache.slot[i] = offset;
+	}
+	fdt_phandle_cache.blob = blob;
+
+	return true;
+}
+
+int fdtdec_node_offset_by_phandle(const void *blob, uint phandle)
+{
+	int offset;
+	uint i;
+
+	if (!CONFIG_IS_ENABLED(OF_PHANDLE_CACHE) ||
+	    !(gd->flags & GD_FLG_FULL_MALLOC_INIT) ||
+	    !phandle || phandle == (uint)-1)
+		return fdt_node_offset_by_phandle(blob, phandle);
+
+	if (fdt_phandle_cache.blob != blob &&
+	    !fdtdec_phandle_cache_build(blob))
+		return fdt_node_offset_by_phandle(blob, phandle);
+
+	for (i = phandle & fdt_phandle_cache.mask;
+	     (offset = fdt_phandle_cache.slot[i]) >= 0;
+	     i = (i + 1) & fdt_phandle_cache.mask) {
+		if (fdt_get_phandle(blob, offset) == phandle)
+			return offset;
+	}
+
+	/*
+	 * Either the phandle does not exist or the tree changed since it was
+	 * indexed. Find out the slow way, and index it again next time if the
+	 * node is there after all.
+	 */
+	offset = fdt_node_offset_by_phandle(blob, phandle);
+	if (offset >= 0)
+		fdt_phandle_cache.blob = NULL;
+
+	return offset;
+}
+
 int fdtdec_lookup_phandle(const void *blob, int node, const char *prop_name)
 {
 	const u32 *phandle;
@@ -642,7 +726,7 @@ int fdtdec_lookup_phandle(const void *blob, int node, const char *prop_name)
 	if (!phandle)
 		return -FDT_ERR_NOTFOUND;
 
-	lookup = fdt_node_offset_by_phandle(blob, fdt32_to_cpu(*phandle));
+	lookup = fdtdec_node_offset_by_phandle(blob, fdt32_to_cpu(*phandle));
 	return lookup;
 }
 
@@ -773,8 +857,8 @@ int fdtdec_parse_phandle_with_args(const void *blob, int src_node,
 			 * below.
 			 */
 			if (cells_name || cur_index == index) {
-				node = fdt_node_offset_by_phandle(blob,
-								  phandle);
+				node = fdtdec_node_offset_by_phandle(blob,
+								     phandle);
 				if (node < 0) {
 					debug("%s: could not find phandle\n",
 					      fdt_get_name(blob, src_node,
@@ -1496,7 +1580,7 @@ int fdtdec_get_carveout(const void *blob, const char *node,
 
 	phandle = fdt32_to_cpu(prop[index]);
 
-	offset = fdt_node_offset_by_phandle(blob, phandle);
+	offset = fdtdec_node_offset_by_phandle(blob, phandle);
 	if (offset < 0) {
 		debug("failed to find node for phandle %u\n", phandle);
 		return offset;
@@ -4,6 +4,7 @@
  */
 
 #include <common.h>
+#include <bootstage.h>
 #include <efi.h>
 #include <initcall.h>
 #include <log.h>
@@ -55,6 +56,7 @@ int initcall_run_list(const init_fnc_t init_sequence[])
 	enum event_t type;
 	init_fnc_t func;
 	int ret = 0;
+	int span;
 
 	for (ptr = init_sequence; func = *ptr, !ret && func; ptr++) {
 		type = initcall_is_event(func);
@@ -71,7 +73,15 @@ int initcall_run_list(const init_fnc_t init_sequence[])
 			debug("initcall: %p\n", (char *)func - reloc_ofs);
 		}
 
+		if (type)
+			span = bootstage_span_start(BOOTSTAGE_SPAN_EVENT,
+						    event_type_name(type), 0);
+		else
+			span = bootstage_span_start(BOOTSTAGE_SPAN_INITCALL,
+						    NULL,
+						    (ulong)func - reloc_ofs);
 		ret = type ? event_notify_null(type) : func();
+		bootstage_span_end(span);
 	}
 
 	if (ret) {
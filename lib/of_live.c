@@ -12,10 +12,12 @@
 
 #include <common.h>
 #include <abuf.h>
+#include <fdtdec.h>
 #include <log.h>
 #include <linux/libfdt.h>
 #include <of_live.h>
 #include <malloc.h>
+#include <time.h>
 #include <dm/of_access.h>
 #include <linux/err.h>
 #include <linux/sizes.h>
@@ -294,6 +296,9 @@ int unflatten_device_tree(const void *blob, struct device_node **mynodes)
 
 	debug("  size is %lx, allocating...\n", size);
 
+	/* The new tree may reuse the memory of one indexed earlier */
+	of_phandle_cache_invalidate();
+
 	/* Allocate memory for the expanded device tree */
 	mem = memalign(__alignof__(struct device_node), size + 4);
 	memset(mem, '\0', size);
@@ -319,12 +324,327 @@ int unflatten_device_tree(const void *blob, struct device_node **mynodes)
 	return 0;
 }
 
+#if CONFIG_IS_ENABLED(OF_LIVE_LAZY)
+/**
+ * struct of_lazy_chunk - Block of memory holding expanded nodes and properties
+ *
+ * @next: Next chunk, or NULL if none
+ * @size: Size of @data in bytes
+ * @used: Number of bytes of @data used so far
+ * @data: Memory for nodes and properties
+ */
+struct of_lazy_chunk {
+	struct of_lazy_chunk *next;
+	ulong size;
+	ulong used;
+	char data[] __aligned(sizeof(long));
+};
+
+/**
+ * struct of_lazy - State of the lazily expanded tree
+ *
+ * Only one tree can be expanded lazily at a time; this is the control tree
+ * built by of_live_build()
+ *
+ * @blob: Flat tree being expanded
+ * @root: Root node of the livetree, or NULL if none
+ * @chunks: Memory allocated for the tree, most recent first
+ * @stats: Nodes, properties, memory and time used so far
+ */
+static struct of_lazy {
+	const void *blob;
+	struct device_node *root;
+	struct of_lazy_chunk *chunks;
+	struct of_live_stats stats;
+} of_lazy;
+
+static void *of_lazy_alloc(ulong size)
+{
+	struct of_lazy_chunk *chunk = of_lazy.chunks;
+	void *ptr;
+
+	size = ALIGN(size, sizeof(long));
+	if (!chunk || chunk->used + size > chunk->size) {
+		ulong csize = max_t(ulong, size, SZ_4K);
+
+		chunk = malloc(sizeof(*chunk) + csize);
+		if (!chunk)
+			return NULL;
+		chunk->size = csize;
+		chunk->used = 0;
+		chunk->next = of_lazy.chunks;
+		of_lazy.chunks = chunk;
+	}
+	ptr = chunk->data + chunk->used;
+	chunk->used += size;
+	of_lazy.stats.size += size;
+	memset(ptr, '\0', size);
+
+	return ptr;
+}
+
+/**
+ * of_lazy_new_node() - Create a node from the flat tree
+ *
+ * The properties and subnodes are left in the flat tree until needed
+ *
+ * @parent: Parent node, or NULL for the root node
+ * @offset: Offset of the node in the flat tree
+ * Return: new node, or NULL if out of memory
+ */
+static struct device_node *of_lazy_new_node(struct device_node *parent,
+					    int offset)
+{
+	const void *blob = of_lazy.blob;
+	struct device_node *np;
+	const char *name;
+	int len, plen;
+	char *fn;
+
+	name = fdt_get_name(blob, offset, &len);
+	if (!name)
+		return NULL;
+
+	/* Children of the root node don't need its "/" */
+	plen = parent && parent->parent ? strlen(parent->full_name) : 0;
+	np = of_lazy_alloc(sizeof(*np) + plen + 1 + len + 1);
+	if (!np)
+		return NULL;
+	fn = (char *)np + sizeof(*np);
+	if (plen)
+		memcpy(fn, parent->full_name, plen);
+	fn[plen] = '/';
+	memcpy(fn + plen + 1, name, len + 1);
+
+	np->name = name;
+	np->full_name = fn;
+	np->parent = parent;
+	np->phandle = fdt_get_phandle(blob, offset);
+	np->type = fdt_getprop(blob, offset, "device_type", NULL);
+	if (!np->type)
+		np->type = "<NULL>";
+	np->offset = offset;
+	np->lazy = OF_LAZY_CHILDREN | OF_LAZY_PROPS;
+	of_lazy.stats.nodes++;
+
+	return np;
+}
+
+static int of_lazy_expand_children(struct device_node *np)
+{
+	struct device_node *child, **tailp = &np->child;
+	int node;
+
+	fdt_for_each_subnode(node, of_lazy.blob, np->offset) {
+		child = of_lazy_new_node(np, node);
+		if (!child) {
+			np->child = NULL;
+			return -ENOMEM;
+		}
+		*tailp = child;
+		tailp = &child->sibling;
+	}
+
+	return 0;
+}
+
+static int of_lazy_expand_props(struct device_node *np)
+{
+	const void *blob = of_lazy.blob;
+	struct property *pp;
+	int count, offset, i;
+
+	count = 0;
+	fdt_for_each_property_offset(offset, blob, np->offset)
+		count++;
+	if (!count)
+		return 0;
+
+	pp = of_lazy_alloc(sizeof(*pp) * count);
+	if (!pp)
+		return -ENOMEM;
+
+	/* The names and values stay in the flat tree */
+	i = 0;
+	fdt_for_each_property_offset(offset, blob, np->offset) {
+		const char *pname;
+
+		pp[i].value = (void *)fdt_getprop_by_offset(blob, offset,
+							    &pname,
+							    &pp[i].length);
+		pp[i].name = (char *)pname;
+		pp[i].next = i + 1 < count ? &pp[i + 1] : NULL;
+		i++;
+	}
+	np->properties = pp;
+	of_lazy.stats.props += count;
+
+	return 0;
+}
+
+void of_live_expand(struct device_node *np, uint what)
+{
+	ulong start = timer_get_us();
+	int ret = 0;
+
+	what &= np->lazy;
+	if (what & OF_LAZY_CHILDREN)
+		ret = of_lazy_expand_children(np);
+	if (!ret && (what & OF_LAZY_PROPS))
+		ret = of_lazy_expand_props(np);
+	if (ret) {
+		log_err("Cannot expand node '%s' (err=%dE)\n", np->full_name,
+			ret);
+		return;
+	}
+	np->lazy &= ~what;
+	of_lazy.stats.time_us += timer_get_us() - start;
+}
+
+bool of_live_is_lazy(const struct device_node *root)
+{
+	return root && root == of_lazy.root;
+}
+
+/**
+ * of_lazy_find_expanded() - Find a phandle among the expanded nodes
+ *
+ * Nodes which are still in the flat tree are not expanded here
+ *
+ * @handle: Phandle to look up
+ * Return: node, or NULL if not found
+ */
+static struct device_node *of_lazy_find_expanded(phandle handle)
+{
+	struct device_node *np = of_lazy.root;
+
+	while (np) {
+		if (np->phandle == handle)
+			return np;
+		if (np->child) {
+			np = np->child;
+			continue;
+		}
+		while (np && !np->sibling)
+			np = np->parent;
+		if (np)
+			np = np->sibling;
+	}
+
+	return NULL;
+}
+
+struct device_node *of_live_find_phandle(phandle handle)
+{
+	const void *blob = of_lazy.blob;
+	struct device_node *np;
+	int offset, depth, level, parent;
+
+	/*
+	 * Nodes added to the livetree, or with a phandle written there, are
+	 * not in the flat tree, but they must have been expanded
+	 */
+	offset = fdtdec_node_offset_by_phandle(blob, handle);
+	if (offset < 0)
+		return of_lazy_find_expanded(handle);
+
+	/* Follow the path down from the root, expanding it as we go */
+	depth = fdt_node_depth(blob, offset);
+	np = of_lazy.root;
+	for (level = 1; np && level <= depth; level++) {
+		parent = fdt_supernode_atdepth_offset(blob, offset, level,
+						      NULL);
+		for (np = of_node_child(np); np; np = np->sibling) {
+			if (np->offset == parent)
+				break;
+		}
+	}
+
+	/* The node may have been removed or its phandle changed since */
+	if (!np || np->phandle != handle)
+		return of_lazy_find_expanded(handle);
+
+	return np;
+}
+
+static int of_lazy_build(const void *blob, struct device_node **rootp)
+{
+	struct device_node *root;
+	ulong start;
+
+	/*
+	 * Old trees may lack "name" properties, which are created when
+	 * unflattening, and only one tree can be lazy
+	 */
+	if (fdt_check_header(blob) || fdt_version(blob) < 0x10 ||
+	    of_lazy.root)
+		return unflatten_device_tree(blob, rootp);
+
+	start = timer_get_us();
+	memset(&of_lazy, '\0', sizeof(of_lazy));
+	of_lazy.blob = blob;
+	root = of_lazy_new_node(NULL, 0);
+	if (!root)
+		return -ENOMEM;
+	of_lazy.root = root;
+	of_lazy.stats.time_us = timer_get_us() - start;
+	*rootp = root;
+
+	return 0;
+}
+
+static void of_lazy_free(void)
+{
+	struct of_lazy_chunk *chunk, *next;
+
+	for (chunk = of_lazy.chunks; chunk; chunk = next) {
+		next = chunk->next;
+		free(chunk);
+	}
+	memset(&of_lazy, '\0', sizeof(of_lazy));
+}
+
+int of_live_get_stats(struct of_live_stats *stats)
+{
+	const void *blob = of_lazy.blob;
+	struct device_node *root;
+	int offset, prop, start;
+	ulong time;
+
+	if (!of_lazy.root)
+		return -ENOENT;
+	*stats = of_lazy.stats;
+
+	for (offset = 0; offset >= 0; offset = fdt_next_node(blob, offset,
+							      NULL)) {
+		stats->full_nodes++;
+		fdt_for_each_property_offset(prop, blob, offset)
+			stats->full_props++;
+	}
+	start = 0;
+	stats->full_size = (ulong)unflatten_dt_node(blob, NULL, &start, NULL,
+						    NULL, 0, true);
+
+	time = timer_get_us();
+	if (unflatten_device_tree(blob, &root))
+		return -ENOMEM;
+	stats->full_time_us = timer_get_us() - time;
+	free(root);
+
+	return 0;
+}
+#endif /* OF_LIVE_LAZY */
+
 int of_live_build(const void *fdt_blob, struct device_node **rootp)
 {
 	int ret;
 
 	debug("%s: start\n", __func__);
+#if CONFIG_IS_ENABLED(OF_LIVE_LAZY)
+	ret = of_lazy_build(fdt_blob, rootp);
+#else
 	ret = unflatten_device_tree(fdt_blob, rootp);
+#endif
 	if (ret) {
 		debug("Failed to create live tree: err=%d\n", ret);
 		return ret;
@@ -341,6 +661,13 @@ int of_live_build(const void *fdt_blob, struct device_node **rootp)
 
 void of_live_free(struct device_node *root)
 {
+	of_phandle_cache_invalidate();
+#if CONFIG_IS_ENABLED(OF_LIVE_LAZY)
+	if (of_live_is_lazy(root)) {
+		of_lazy_free();
+		return;
+	}
+#endif
 	/* the tree is stored as a contiguous block of memory */
 	free(root);
 }
@@ -380,6 +707,76 @@ static int check_space(int ret, struct abuf *buf)
 	return 0;
 }
 
+/**
+ * dedup_strings() - Remove duplicate property names from a flat tree
+ *
+ * fdt_property() looks up each name with a linear search of the strings
+ * block, which is slow when there are many different names, e.g. in a large
+ * __symbols__ node. So the tree is written without de-duplication and the
+ * duplicates are removed here, using a hash table. Names are kept in the
+ * order they are first used.
+ *
+ * @fdt: Finished flat tree, with the strings block last
+ * Return: 0 if OK, -ENOMEM if out of memory
+ */
+static int dedup_strings(void *fdt)
+{
+	char *strings = fdt + fdt_off_dt_strings(fdt);
+	int offset, next, count, tag;
+	uint mask, *table;
+	int out_size = 0;
+	char *out;
+
+	count = 0;
+	for (offset = 0; (tag = fdt_next_tag(fdt, offset, &next)) != FDT_END;
+	     offset = next)
+		count += tag == FDT_PROP;
+
+	for (mask = 63; mask < count * 2; mask = mask * 2 + 1)
+		;
+	table = calloc(mask + 1, sizeof(*table));
+	out = malloc(fdt_size_dt_strings(fdt));
+	if (!table || !out) {
+		free(table);
+		free(out);
+		return log_msg_ret("ddp", -ENOMEM);
+	}
+
+	for (offset = 0; (tag = fdt_next_tag(fdt, offset, &next)) != FDT_END;
+	     offset = next) {
+		struct fdt_property *prop;
+		const char *name;
+		uint hash, pos;
+
+		if (tag != FDT_PROP)
+			continue;
+		prop = fdt_offset_ptr_w(fdt, offset, sizeof(*prop));
+		name = strings + fdt32_to_cpu(prop->nameoff);
+
+		/* FNV-1a; table entries hold the new offset plus one */
+		for (hash = 2166136261u, pos = 0; name[pos]; pos++)
+			hash = (hash ^ (u8)name[pos]) * 16777619;
+		for (pos = hash & mask; table[pos]; pos = (pos + 1) & mask) {
+			if (!strcmp(out + table[pos] - 1, name))
+				break;
+		}
+		if (!table[pos]) {
+			int len = strlen(name) + 1;
+
+			memcpy(out + out_size, name, len);
+			table[pos] = out_size + 1;
+			out_size += len;
+		}
+		prop->nameoff = cpu_to_fdt32(table[pos] - 1);
+	}
+	memcpy(strings, out, out_size);
+	fdt_set_size_dt_strings(fdt, out_size);
+	free(table);
+	free(out);
+
+	return 0;
+}
+
 /**
  * flatten_node() - Write out the node and its properties into a flat tree
  */
@@ -402,7 +799,7 @@ static int flatten_node(struct abuf *buf, const struct device_node *node)
 		return log_msg_ret("beg", ret);
 
 	/* First write out the properties */
-	for (pp = node->properties; !ret && pp; pp = pp->next) {
+	for (pp = of_node_properties(node); !ret && pp; pp = pp->next) {
 		ret = fdt_property(abuf_data(buf), pp->name, pp->value,
 				   pp->length);
 		ret = check_space(ret, buf);
@@ -413,7 +810,7 @@ static int flatten_node(struct abuf *buf, const struct device_node *node)
 	}
 
 	/* Next write out the subnodes */
-	for (np = node->child; np; np = np->sibling) {
+	for (np = of_node_child(node); np; np = np->sibling) {
 		ret = flatten_node(buf, np);
 		if (ret)
 			return log_msg_ret("sub", ret);
@@ -442,7 +839,8 @@ int of_live_flatten(const struct device_node *root, struct abuf *buf)
 	if (!abuf_realloc(buf, BUF_STEP))
 		return log_msg_ret("ini", -ENOMEM);
 
-	ret = fdt_create(abuf_data(buf), abuf_size(buf));
+	ret = fdt_create_with_flags(abuf_data(buf), abuf_size(buf),
+				    FDT_CREATE_FLAG_NO_NAME_DEDUP);
 	if (!ret)
 		ret = fdt_finish_reservemap(abuf_data(buf));
 	if (ret) {
@@ -466,6 +864,10 @@ int of_live_flatten(const struct device_node *root, struct abuf *buf)
 	if (ret)
 		return log_msg_ret("fin", ret);
 
+	ret = dedup_strings(abuf_data(buf));
+	if (ret)
+		return log_msg_ret("ddp", ret);
+
 	ret = fdt_pack(abuf_data(buf));
 	if (ret) {
 		log_debug("Failed to pack (err=%d)\n", ret);
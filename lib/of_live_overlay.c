@@ -0,0 +1,862 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Applying devicetree overlays to a livetree
+ *
+ * fdt_overlay_apply() works on the flat tree: for each overlay it scans the
+ * whole base tree for its largest phandle, walks a path for each symbol and
+ * target, and moves the rest of the tree for each property and node it adds.
+ * With many overlays this adds up. Here the base tree is unflattened once,
+ * its phandles and symbols are kept in hash tables, each overlay is merged
+ * into the livetree and the result is flattened once at the end.
+ */
+
+#define LOG_CATEGORY	LOGC_DT
+
+#include <common.h>
+#include <abuf.h>
+#include <log.h>
+#include <malloc.h>
+#include <of_live.h>
+#include <asm/unaligned.h>
+#include <linux/libfdt.h>
+#include <linux/sizes.h>
+
+enum {
+	OV_MIN_TABLE	= 64,	/* Initial number of hash-table entries */
+};
+
+/**
+ * struct of_ov_chunk - Block of memory holding what overlays add to the tree
+ *
+ * @next: Next chunk, or NULL if none
+ * @size: Size of @data in bytes
+ * @used: Number of bytes of @data used so far
+ * @data: Memory for nodes, properties, names and values
+ */
+struct of_ov_chunk {
+	struct of_ov_chunk *next;
+	ulong size;
+	ulong used;
+	char data[] __aligned(sizeof(long));
+};
+
+/**
+ * struct of_ov_phandle - Entry in the phandle table
+ *
+ * @phandle: Phandle of the node
+ * @np: Node, or NULL if the entry is empty
+ */
+struct of_ov_phandle {
+	phandle phandle;
+	struct device_node *np;
+};
+
+/**
+ * struct of_ov_symbol - Entry in the symbol table
+ *
+ * @name: Label of the node, or NULL if the entry is empty
+ * @path: Path to the node
+ * @np: Node, or NULL if not looked up yet
+ */
+struct of_ov_symbol {
+	const char *name;
+	const char *path;
+	struct device_node *np;
+};
+
+/**
+ * struct of_live_overlay - An overlay session
+ *
+ * @fdt: Base tree, which the livetree points into
+ * @root: Root node of the livetree
+ * @symbols: __symbols__ node of the livetree, or NULL if none
+ * @max_phandle: Largest phandle in the livetree
+ * @phandles: Hash table of nodes with a phandle
+ * @phandle_size: Number of entries in @phandles, a power of two
+ * @phandle_count: Number of entries used in @phandles
+ * @syms: Hash table of symbols
+ * @sym_size: Number of entries in @syms, a power of two
+ * @sym_count: Number of entries used in @syms
+ * @chunks: Memory allocated for what overlays add, most recent first
+ */
+struct of_live_overlay {
+	const void *fdt;
+	struct device_node *root;
+	struct device_node *symbols;
+	phandle max_phandle;
+	struct of_ov_phandle *phandles;
+	uint phandle_size;
+	uint phandle_count;
+	struct of_ov_symbol *syms;
+	uint sym_size;
+	uint sym_count;
+	struct of_ov_chunk *chunks;
+};
+
+static void *ov_alloc(struct of_live_overlay *ov, ulong size)
+{
+	struct of_ov_chunk *chunk = ov->chunks;
+	void *ptr;
+
+	size = ALIGN(size, sizeof(long));
+	if (!chunk || chunk->used + size > chunk->size) {
+		ulong csize = max_t(ulong, size, SZ_4K);
+
+		chunk = malloc(sizeof(*chunk) + csize);
+		if (!chunk)
+			return NULL;
+		chunk->size = csize;
+		chunk->used = 0;
+		chunk->next = ov->chunks;
+		ov->chunks = chunk;
+	}
+	ptr = chunk->data + chunk->used;
+	chunk->used += size;
+	memset(ptr, '\0', size);
+
+	return ptr;
+}
+
+static char *ov_strdup(struct of_live_overlay *ov, const char *str, int len)
+{
+	char *copy;
+
+	copy = ov_alloc(ov, len + 1);
+	if (copy)
+		memcpy(copy, str, len);
+
+	return copy;
+}
+
+static uint ov_hash_phandle(phandle handle)
+{
+	return handle * 0x9e3779b1;
+}
+
+/* FNV-1a */
+static uint ov_hash_name(const char *name)
+{
+	u32 hash = 0x811c9dc5;
+
+	while (*name) {
+		hash ^= (u8)*name++;
+		hash *= 0x01000193;
+	}
+
+	return hash;
+}
+
+static struct of_ov_phandle *ov_phandle_slot(struct of_live_overlay *ov,
+					     phandle handle)
+{
+	uint mask = ov->phandle_size - 1;
+	struct of_ov_phandle *slot;
+	uint i;
+
+	for (i = ov_hash_phandle(handle) & mask;; i = (i + 1) & mask) {
+		slot = &ov->phandles[i];
+		if (!slot->np || slot->phandle == handle)
+			return slot;
+	}
+}
+
+static struct of_ov_symbol *ov_sym_slot(struct of_live_overlay *ov,
+					const char *name)
+{
+	uint mask = ov->sym_size - 1;
+	struct of_ov_symbol *slot;
+	uint i;
+
+	for (i = ov_hash_name(name) & mask;; i = (i + 1) & mask) {
+		slot = &ov->syms[i];
+		if (!slot->name || !strcmp(slot->name, name))
+			return slot;
+	}
+}
+
+static int ov_grow_phandles(struct of_live_overlay *ov)
+{
+	struct of_ov_phandle *old = ov->phandles;
+	uint old_size = ov->phandle_size;
+	uint i;
+
+	ov->phandle_size = max_t(uint, old_size * 2, OV_MIN_TABLE);
+	ov->phandles = calloc(ov->phandle_size, sizeof(*old));
+	if (!ov->phandles) {
+		ov->phandles = old;
+		ov->phandle_size = old_size;
+		return -ENOMEM;
+	}
+	for (i = 0; i < old_size; i++) {
+		if (old[i].np)
+			*ov_phandle_slot(ov, old[i].phandle) = old[i];
+	}
+	free(old);
+
+	return 0;
+}
+
+static int ov_grow_syms(struct of_live_overlay *ov)
+{
+	struct of_ov_symbol *old = ov->syms;
+	uint old_size = ov->sym_size;
+	uint i;
+
+	ov->sym_size = max_t(uint, old_size * 2, OV_MIN_TABLE);
+	ov->syms = calloc(ov->sym_size, sizeof(*old));
+	if (!ov->syms) {
+		ov->syms = old;
+		ov->sym_size = old_size;
+		return -ENOMEM;
+	}
+	for (i = 0; i < old_size; i++) {
+		if (old[i].name)
+			*ov_sym_slot(ov, old[i].name) = old[i];
+	}
+	free(old);
+
+	return 0;
+}
+
+static int ov_add_phandle(struct of_live_overlay *ov, struct device_node *np)
+{
+	struct of_ov_phandle *slot;
+	int ret;
+
+	if (!np->phandle || np->phandle == (phandle)-1)
+		return 0;
+	if ((ov->phandle_count + 1) * 2 > ov->phandle_size) {
+		ret = ov_grow_phandles(ov);
+		if (ret)
+			return ret;
+	}
+	slot = ov_phandle_slot(ov, np->phandle);
+	if (!slot->np)
+		ov->phandle_count++;
+	slot->phandle = np->phandle;
+	slot->np = np;
+	ov->max_phandle = max(ov->max_phandle, np->phandle);
+
+	return 0;
+}
+
+static struct device_node *ov_find_phandle(struct of_live_overlay *ov,
+					   phandle handle)
+{
+	if (!ov->phandle_size)
+		return NULL;
+
+	return ov_phandle_slot(ov, handle)->np;
+}
+
+/* Add or replace a symbol; @name and @path must stay valid */
+static int ov_add_symbol(struct of_live_overlay *ov, const char *name,
+			 const char *path)
+{
+	struct of_ov_symbol *slot;
+	int ret;
+
+	if ((ov->sym_count + 1) * 2 > ov->sym_size) {
+		ret = ov_grow_syms(ov);
+		if (ret)
+			return ret;
+	}
+	slot = ov_sym_slot(ov, name);
+	if (!slot->name)
+		ov->sym_count++;
+	slot->name = name;
+	slot->path = path;
+	slot->np = NULL;
+
+	return 0;
+}
+
+static struct property *ov_find_prop(const struct device_node *np,
+				     const char *name, int len)
+{
+	struct property *pp;
+
+	for (pp = of_node_properties(np); pp; pp = pp->next) {
+		if (!strncmp(pp->name, name, len) && !pp->name[len])
+			return pp;
+	}
+
+	return NULL;
+}
+
+/*
+ * Find a subnode by name. As with fdt_subnode_offset(), a name without a unit
+ * address matches a node which has one.
+ */
+static struct device_node *ov_find_child(const struct device_node *parent,
+					 const char *name, int len)
+{
+	struct device_node *np;
+
+	for (np = of_node_child(parent); np; np = np->sibling) {
+		if (strncmp(np->name, name, len))
+			continue;
+		if (!np->name[len] ||
+		    (np->name[len] == '@' && !memchr(name, '@', len)))
+			return np;
+	}
+
+	return NULL;
+}
+
+/* Find a node by its path, which may start with an alias */
+static struct device_node *ov_find_path(struct of_live_overlay *ov,
+					const char *path)
+{
+	struct device_node *np = ov->root;
+	const char *p = path, *q;
+
+	if (*p != '/') {
+		struct device_node *aliases;
+		struct property *pp;
+
+		q = strchrnul(p, '/');
+		aliases = ov_find_child(ov->root, "aliases", 7);
+		pp = aliases ? ov_find_prop(aliases, p, q - p) : NULL;
+		if (!pp || !pp->length || *(char *)pp->value != '/')
+			return NULL;
+		np = ov_find_path(ov, pp->value);
+		p = q;
+	}
+
+	while (np && *p) {
+		if (*p == '/') {
+			p++;
+			continue;
+		}
+		q = strchrnul(p, '/');
+		np = ov_find_child(np, p, q - p);
+		p = q;
+	}
+
+	return np;
+}
+
+static struct device_node *ov_find_symbol(struct of_live_overlay *ov,
+					  const char *name)
+{
+	struct of_ov_symbol *slot;
+
+	if (!ov->sym_size)
+		return NULL;
+	slot = ov_sym_slot(ov, name);
+	if (slot->name && !slot->np)
+		slot->np = ov_find_path(ov, slot->path);
+
+	return slot->np;
+}
+
+static struct device_node *ov_new_node(struct of_live_overlay *ov,
+				       struct device_node *parent,
+				       const char *name, int len)
+{
+	struct device_node *np;
+	int parent_len;
+	char *full;
+
+	/* The root node's full name is "/" but its children's do not use it */
+	parent_len = parent->parent ? strlen(parent->full_name) : 0;
+	np = ov_alloc(ov, sizeof(*np));
+	full = ov_alloc(ov, parent_len + 1 + len + 1);
+	if (!np || !full)
+		return NULL;
+	np->name = ov_strdup(ov, name, len);
+	if (!np->name)
+		return NULL;
+	memcpy(full, parent->full_name, parent_len);
+	full[parent_len] = '/';
+	memcpy(full + parent_len + 1, name, len);
+	np->full_name = full;
+	np->type = "<NULL>";
+	np->parent = parent;
+
+	/* Add it first, as fdt_add_subnode() does, so the output is the same */
+	np->sibling = parent->child;
+	parent->child = np;
+
+	return np;
+}
+
+/* Set a property, copying its value */
+static int ov_set_prop(struct of_live_overlay *ov, struct device_node *np,
+		       const char *name, const void *val, int len,
+		       struct property **ppp)
+{
+	struct property *pp;
+	void *copy;
+
+	copy = ov_alloc(ov, len);
+	if (!copy)
+		return -ENOMEM;
+	memcpy(copy, val, len);
+
+	pp = ov_find_prop(np, name, strlen(name));
+	if (!pp) {
+		pp = ov_alloc(ov, sizeof(*pp));
+		if (!pp)
+			return -ENOMEM;
+		pp->name = ov_strdup(ov, name, strlen(name));
+		if (!pp->name)
+			return -ENOMEM;
+		/* As with fdt_setprop(), new properties go first */
+		pp->next = np->properties;
+		np->properties = pp;
+	}
+	pp->value = copy;
+	pp->length = len;
+	if (ppp)
+		*ppp = pp;
+
+	if (!strcmp(name, "phandle") || !strcmp(name, "linux,phandle")) {
+		if (len != sizeof(fdt32_t))
+			return -EINVAL;
+		np->phandle = get_unaligned_be32(copy);
+		return ov_add_phandle(ov, np);
+	}
+
+	return 0;
+}
+
+/* Move the overlay's phandles above those in the livetree */
+static int ov_adjust_phandles(struct of_live_overlay *ov, void *fdto,
+			      u32 delta)
+{
+	static const char *const names[] = { "phandle", "linux,phandle" };
+	phandle max = 0;
+	int node, len, i;
+	fdt32_t *val;
+	u32 handle;
+
+	for (node = 0; node >= 0; node = fdt_next_node(fdto, node, NULL)) {
+		for (i = 0; i < ARRAY_SIZE(names); i++) {
+			val = fdt_getprop_w(fdto, node, names[i], &len);
+			if (!val)
+				continue;
+			if (len != sizeof(*val))
+				return -EINVAL;
+			handle = fdt32_to_cpu(*val) + delta;
+			if (handle < delta || handle == (phandle)-1)
+				return -E2BIG;
+			*val = cpu_to_fdt32(handle);
+			max = max(max, handle);
+		}
+	}
+	if (node != -FDT_ERR_NOTFOUND)
+		return -EINVAL;
+	ov->max_phandle = max(ov->max_phandle, max);
+
+	return 0;
+}
+
+/* Apply __local_fixups__, which mark where the overlay uses its own phandles */
+static int ov_local_fixups(void *fdto, int node, int fixups, u32 delta)
+{
+	const fdt32_t *offsets;
+	const char *name;
+	int prop, sub, len, vlen, i;
+	void *val;
+
+	fdt_for_each_property_offset(prop, fdto, fixups) {
+		offsets = fdt_getprop_by_offset(fdto, prop, &name, &len);
+		if (!offsets || len % sizeof(*offsets))
+			return -EINVAL;
+		val = fdt_getprop_w(fdto, node, name, &vlen);
+		if (!val)
+			return -ENOENT;
+		for (i = 0; i < len / sizeof(*offsets); i++) {
+			u32 off = fdt32_to_cpu(offsets[i]);
+
+			if (off + sizeof(fdt32_t) > vlen)
+				return -EINVAL;
+			put_unaligned_be32(get_unaligned_be32(val + off) + delta,
+					   val + off);
+		}
+	}
+
+	fdt_for_each_subnode(sub, fdto, fixups) {
+		int target, ret;
+
+		name = fdt_get_name(fdto, sub, &len);
+		target = fdt_subnode_offset_namelen(fdto, node, name, len);
+		if (target < 0)
+			return -ENOENT;
+		ret = ov_local_fixups(fdto, target, sub, delta);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+/* Write a phandle into the overlay at a location "path:prop:offset" */
+static int ov_fixup_one(void *fdto, const char *loc, phandle handle)
+{
+	const char *name, *end;
+	char *endp;
+	int node, len;
+	ulong off;
+	void *val;
+
+	end = strchr(loc, ':');
+	name = end ? end + 1 : NULL;
+	end = name ? strchr(name, ':') : NULL;
+	if (!end)
+		return -EINVAL;
+	off = simple_strtoul(end + 1, &endp, 10);
+	if (endp == end + 1 || *endp)
+		return -EINVAL;
+
+	node = fdt_path_offset_namelen(fdto, loc, name - 1 - loc);
+	if (node < 0)
+		return -ENOENT;
+	val = fdt_getprop_namelen_w(fdto, node, name, end - name, &len);
+	if (!val)
+		return -ENOENT;
+	if (len < sizeof(fdt32_t) || off > len - sizeof(fdt32_t))
+		return -EINVAL;
+	put_unaligned_be32(handle, val + off);
+
+	return 0;
+}
+
+/* Apply __fixups__, which mark where the overlay uses symbols from the tree */
+static int ov_fixups(struct of_live_overlay *ov, void *fdto)
+{
+	const char *label, *list, *loc;
+	struct device_node *np;
+	int fixups, prop, len;
+	int ret;
+
+	fixups = fdt_subnode_offset(fdto, 0, "__fixups__");
+	if (fixups == -FDT_ERR_NOTFOUND)
+		return 0;
+	if (fixups < 0)
+		return -EINVAL;
+
+	fdt_for_each_property_offset(prop, fdto, fixups) {
+		list = fdt_getprop_by_offset(fdto, prop, &label, &len);
+		if (!list || len <= 0 || list[len - 1])
+			return -EINVAL;
+		np = ov_find_symbol(ov, label);
+		if (!np || !np->phandle) {
+			log_debug("Symbol '%s' not found\n", label);
+			return -ENOENT;
+		}
+		for (loc = list; loc < list + len; loc += strlen(loc) + 1) {
+			ret = ov_fixup_one(fdto, loc, np->phandle);
+			if (ret) {
+				log_debug("Cannot fix up '%s': %dE\n", loc,
+					  ret);
+				return ret;
+			}
+		}
+	}
+
+	return 0;
+}
+
+/* Find the node in the livetree which a fragment applies to */
+static int ov_frag_target(struct of_live_overlay *ov, const void *fdto,
+			  int frag, struct device_node **npp)
+{
+	const fdt32_t *handle;
+	const char *path;
+	int len;
+
+	handle = fdt_getprop(fdto, frag, "target", &len);
+	if (handle) {
+		if (len != sizeof(*handle))
+			return -EINVAL;
+		*npp = ov_find_phandle(ov, fdt32_to_cpu(*handle));
+	} else {
+		path = fdt_getprop(fdto, frag, "target-path", &len);
+		if (!path || len < 1 || path[len - 1])
+			return -EINVAL;
+		*npp = ov_find_path(ov, path);
+	}
+	if (!*npp) {
+		log_debug("Target of '%s' not found\n",
+			  fdt_get_name(fdto, frag, NULL));
+		return -ENOENT;
+	}
+
+	return 0;
+}
+
+/* Copy the properties and subnodes of an overlay node into a node */
+static int ov_merge_node(struct of_live_overlay *ov, struct device_node *np,
+			 const void *fdto, int node)
+{
+	struct device_node *child;
+	const char *name;
+	const void *val;
+	int prop, sub, len;
+	int ret;
+
+	fdt_for_each_property_offset(prop, fdto, node) {
+		val = fdt_getprop_by_offset(fdto, prop, &name, &len);
+		if (!val)
+			return -EINVAL;
+		ret = ov_set_prop(ov, np, name, val, len, NULL);
+		if (ret)
+			return ret;
+	}
+
+	fdt_for_each_subnode(sub, fdto, node) {
+		name = fdt_get_name(fdto, sub, &len);
+		child = ov_find_child(np, name, len);
+		if (!child) {
+			child = ov_new_node(ov, np, name, len);
+			if (!child)
+				return -ENOMEM;
+		}
+		ret = ov_merge_node(ov, child, fdto, sub);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+static int ov_merge(struct of_live_overlay *ov, const void *fdto)
+{
+	struct device_node *target;
+	int frag, node;
+	int ret;
+
+	fdt_for_each_subnode(frag, fdto, 0) {
+		node = fdt_subnode_offset(fdto, frag, "__overlay__");
+		if (node == -FDT_ERR_NOTFOUND)
+			continue;
+		if (node < 0)
+			return -EINVAL;
+		ret = ov_frag_target(ov, fdto, frag, &target);
+		if (ret)
+			return ret;
+		ret = ov_merge_node(ov, target, fdto, node);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+/*
+ * Add the overlay's symbols to __symbols__, changing each path from the
+ * fragment's __overlay__ node to the node it was merged into
+ */
+static int ov_update_symbols(struct of_live_overlay *ov, const void *fdto)
+{
+	const char *name, *path, *frag_end, *rel;
+	struct device_node *target;
+	int syms, prop, frag, len;
+	int prefix_len, rel_len;
+	struct property *pp;
+	char *new_path;
+	int ret;
+
+	syms = fdt_subnode_offset(fdto, 0, "__symbols__");
+	if (syms == -FDT_ERR_NOTFOUND)
+		return 0;
+	if (syms < 0)
+		return -EINVAL;
+
+	fdt_for_each_property_offset(prop, fdto, syms) {
+		path = fdt_getprop_by_offset(fdto, prop, &name, &len);
+		if (!path || len < 2 || path[len - 1] || *path != '/')
+			return -EINVAL;
+
+		/* Skip symbols which do not refer to nodes in a fragment */
+		frag_end = strchr(path + 1, '/');
+		if (!frag_end || strncmp(frag_end, "/__overlay__", 12))
+			continue;
+		rel = frag_end + 12;
+		if (*rel && *rel != '/')
+			continue;
+
+		frag = fdt_subnode_offset_namelen(fdto, 0, path + 1,
+						  frag_end - path - 1);
+		if (frag < 0)
+			return -EINVAL;
+		ret = ov_frag_target(ov, fdto, frag, &target);
+		if (ret)
+			return ret;
+
+		prefix_len = target->parent ? strlen(target->full_name) : 0;
+		rel_len = strlen(rel);
+		new_path = ov_alloc(ov, prefix_len + rel_len + 2);
+		if (!new_path)
+			return -ENOMEM;
+		memcpy(new_path, target->full_name, prefix_len);
+		strcpy(new_path + prefix_len, prefix_len + rel_len ? rel : "/");
+
+		if (!ov->symbols) {
+			ov->symbols = ov_new_node(ov, ov->root, "__symbols__",
+						  11);
+			if (!ov->symbols)
+				return -ENOMEM;
+		}
+		ret = ov_set_prop(ov, ov->symbols, name, new_path,
+				  strlen(new_path) + 1, &pp);
+		if (!ret)
+			ret = ov_add_symbol(ov, pp->name, pp->value);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+/* Get the next node in depth-first order */
+static struct device_node *ov_next_node(struct device_node *np)
+{
+	if (of_node_child(np))
+		return of_node_child(np);
+	while (np && !np->sibling)
+		np = np->parent;
+
+	return np ? np->sibling : NULL;
+}
+
+int of_live_overlay_begin(const void *fdt, struct of_live_overlay **ovp)
+{
+	struct of_live_overlay *ov;
+	struct device_node *np;
+	struct property *pp;
+	int ret;
+
+	ov = calloc(1, sizeof(*ov));
+	if (!ov)
+		return log_msg_ret("ov", -ENOMEM);
+	ov->fdt = fdt;
+	ret = unflatten_device_tree(fdt, &ov->root);
+	if (ret) {
+		free(ov);
+		return log_msg_ret("unf", ret);
+	}
+
+	for (np = ov->root; np; np = ov_next_node(np)) {
+		ret = ov_add_phandle(ov, np);
+		if (ret)
+			goto err;
+	}
+
+	ov->symbols = ov_find_child(ov->root, "__symbols__", 11);
+	if (ov->symbols) {
+		for (pp = of_node_properties(ov->symbols); pp; pp = pp->next) {
+			if (!pp->length || ((char *)pp->value)[pp->length - 1])
+				continue;
+			ret = ov_add_symbol(ov, pp->name, pp->value);
+			if (ret)
+				goto err;
+		}
+	}
+	*ovp = ov;
+
+	return 0;
+
+err:
+	of_live_overlay_abort(ov);
+
+	return log_msg_ret("idx", ret);
+}
+
+int of_live_overlay_apply(struct of_live_overlay *ov, void *fdto)
+{
+	u32 delta = ov->max_phandle;
+	int fixups;
+	int ret;
+
+	if (fdt_check_header(fdto))
+		return log_msg_ret("hdr", -EINVAL);
+
+	ret = ov_adjust_phandles(ov, fdto, delta);
+	if (ret)
+		return log_msg_ret("adj", ret);
+	fixups = fdt_subnode_offset(fdto, 0, "__local_fixups__");
+	if (fixups >= 0)
+		ret = ov_local_fixups(fdto, 0, fixups, delta);
+	else if (fixups != -FDT_ERR_NOTFOUND)
+		ret = -EINVAL;
+	if (ret)
+		return log_msg_ret("loc", ret);
+	ret = ov_fixups(ov, fdto);
+	if (ret)
+		return log_msg_ret("fix", ret);
+	ret = ov_merge(ov, fdto);
+	if (ret)
+		return log_msg_ret("mrg", ret);
+	ret = ov_update_symbols(ov, fdto);
+	if (ret)
+		return log_msg_ret("sym", ret);
+
+	return 0;
+}
+
+int of_live_overlay_end(struct of_live_overlay *ov, void *fdt, int size)
+{
+	u64 *rsv = NULL;
+	struct abuf buf;
+	int count, i;
+	int ret;
+
+	/* Take the reservations first, since @fdt may be the base tree */
+	count = fdt_num_mem_rsv(ov->fdt);
+	if (count < 0) {
+		ret = -EINVAL;
+		goto err;
+	}
+	rsv = malloc(max(count, 1) * 2 * sizeof(u64));
+	if (!rsv) {
+		ret = -ENOMEM;
+		goto err;
+	}
+	for (i = 0; i < count; i++)
+		fdt_get_mem_rsv(ov->fdt, i, &rsv[i * 2], &rsv[i * 2 + 1]);
+
+	ret = of_live_flatten(ov->root, &buf);
+	if (ret)
+		goto err_buf;
+	if (fdt_totalsize(abuf_data(&buf)) +
+	    count * sizeof(struct fdt_reserve_entry) > size) {
+		ret = -ENOSPC;
+		goto err_buf;
+	}
+
+	/* From here on the base tree may be overwritten */
+	ret = fdt_open_into(abuf_data(&buf), fdt, size);
+	for (i = 0; !ret && i < count; i++)
+		ret = fdt_add_mem_rsv(fdt, rsv[i * 2], rsv[i * 2 + 1]);
+	if (ret)
+		ret = -EFAULT;
+
+err_buf:
+	abuf_uninit(&buf);
+err:
+	free(rsv);
+	of_live_overlay_abort(ov);
+	if (ret)
+		return log_msg_ret("end", ret);
+
+	return 0;
+}
+
+void of_live_overlay_abort(struct of_live_overlay *ov)
+{
+	struct of_ov_chunk *chunk, *next;
+
+	for (chunk = ov->chunks; chunk; chunk = next) {
+		next = chunk->next;
+		free(chunk);
+	}
+	free(ov->phandles);
+	free(ov->syms);
+	/* the unflattened tree is a single block */
+	free(ov->root);
+	free(ov);
+}
@@ -59,3 +59,72 @@ do_free:
 	free(workspace);
 	return ret;
 }
+
+void zstd_stream_start(struct zstd_stream *zs, void *dst, size_t dst_len)
+{
+	zs->dstream = NULL;
+	zs->workspace = NULL;
+	zs->out.dst = dst;
+	zs->out.size = dst_len;
+	zs->out.pos = 0;
+	zs->done = false;
+}
+
+int zstd_stream_write(struct zstd_stream *zs, const void *src, size_t len)
+{
+	zstd_in_buffer in = { .src = src, .size = len, .pos = 0 };
+	zstd_frame_header hdr;
+	size_t wsize, ret;
+
+	if (zs->done)
+		return 0;
+
+	if (!zs->dstream) {
+		/* Only allocate the window which this frame needs */
+		ret = zstd_get_frame_header(&hdr, src, len);
+		if (ret) {
+			log_err("%s: bad frame header\n", __func__);
+			return -EINVAL;
+		}
+		wsize = zstd_dstream_workspace_bound(hdr.windowSize);
+		zs->workspace = malloc(wsize);
+		if (!zs->workspace) {
+			debug("%s: cannot allocate workspace of size %zu\n",
+			      __func__, wsize);
+			return -ENOMEM;
+		}
+		zs->dstream = zstd_init_dstream(hdr.windowSize, zs->workspace,
+						wsize);
+		if (!zs->dstream) {
+			log_err("%s: zstd_init_dstream() failed\n", __func__);
+			return -EPERM;
+		}
+	}
+
+	while (in.pos < in.size) {
+		ret = zstd_decompress_stream(zs->dstream, &zs->out, &in);
+		if (zstd_is_error(ret)) {
+			log_err("%s: failed to decompress: %d\n", __func__,
+				zstd_get_error_code(ret));
+			return -EINVAL;
+		}
+		if (!ret) {
+			zs->done = true;
+			break;
+		}
+		if (zs->out.pos == zs->out.size)
+			return -ENOSPC;
+	}
+
+	return 0;
+}
+
+int zstd_stream_end(struct zstd_stream *zs, ulong *lenp)
+{
+	*lenp = zs->out.pos;
+	free(zs->workspace);
+	zs->workspace = NULL;
+	zs->dstream = NULL;
+
+	return zs->done ? 0 : -EINVAL;
+}
@@ -14,6 +14,7 @@
 #include <log.h>
 #include <net.h>
 #include <linux/delay.h>
+#include <net/neigh.h>
 
 #include "arp.h"
 
@@ -85,6 +86,16 @@ void arp_request(void)
 	arp_raw_request(net_ip, net_null_ethaddr, net_arp_wait_reply_ip);
 }
 
+bool arp_lookup(struct in_addr ip, uchar *ethaddr)
+{
+	/* hosts on other networks are reached through the gateway */
+	if ((ip.s_addr & net_netmask.s_addr) !=
+	    (net_ip.s_addr & net_netmask.s_addr) && net_gateway.s_addr)
+		ip = net_gateway;
+
+	return neigh_lookup(ip, ethaddr);
+}
+
 int arp_timeout_check(void)
 {
 	ulong t;
@@ -148,6 +159,9 @@ void arp_receive(struct ethernet_hdr *et, struct ip_udp_hdr *ip, int len)
 	if (net_read_ip(&arp->ar_tpa).s_addr != net_ip.s_addr)
 		return;
 
+	/* whether asking or answering, the sender has told us its address */
+	neigh_update(net_read_ip(&arp->ar_spa), &arp->ar_sha);
+
 	switch (ntohs(arp->ar_op)) {
 	case ARPOP_REQUEST:
 		/* reply with our IP address */
@@ -26,6 +26,17 @@ void arp_init(void);
 void arp_request(void);
 void arp_raw_request(struct in_addr source_ip, const uchar *targetEther,
 	struct in_addr target_ip);
+
+/**
+ * arp_lookup() - Find the MAC address to send to, from the neighbour cache
+ *
+ * For a host on another network this looks up the gateway instead
+ *
+ * @ip: IP address the packet is for
+ * @ethaddr: Returns the MAC address, if found
+ * Return: true if found, false if it must be resolved with arp_request()
+ */
+bool arp_lookup(struct in_addr ip, uchar *ethaddr);
 int arp_timeout_check(void);
 void arp_receive(struct ethernet_hdr *et, struct ip_udp_hdr *ip, int len);
 
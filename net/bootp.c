@@ -47,8 +47,13 @@
 #endif
 
 #ifndef CFG_BOOTP_ID_CACHE_SIZE
+#if IS_ENABLED(CONFIG_NET_DISCOVER_ALL)
+/* each request is sent on every interface */
+#define CFG_BOOTP_ID_CACHE_SIZE 16
+#else
 #define CFG_BOOTP_ID_CACHE_SIZE 4
 #endif
+#endif
 
 u32		bootp_ids[CFG_BOOTP_ID_CACHE_SIZE];
 unsigned int	bootp_num_ids;
@@ -385,6 +390,7 @@ static void bootp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 	bootstage_mark_name(BOOTSTAGE_ID_BOOTP_STOP, "bootp_stop");
 
 	debug("Got good BOOTP\n");
+	net_discover_done(eth_get_dev());
 
 	net_auto_load();
 }
@@ -717,46 +723,17 @@ void bootp_reset(void)
 	bootp_timeout = 250;
 }
 
-void bootp_request(void)
+/* Build a BOOTP/DHCP discover packet for the current device and send it */
+static void bootp_send_request(void)
 {
 	uchar *pkt, *iphdr;
 	struct bootp_hdr *bp;
 	int extlen, pktlen, iplen;
 	int eth_hdr_size;
-#ifdef CONFIG_BOOTP_RANDOM_DELAY
-	ulong rand_ms;
-#endif
 	u32 bootp_id;
 	struct in_addr zero_ip;
 	struct in_addr bcast_ip;
-	char *ep;  /* Environment pointer */
-
-	bootstage_mark_name(BOOTSTAGE_ID_BOOTP_START, "bootp_start");
-#if defined(CONFIG_CMD_DHCP)
-	dhcp_state = INIT;
-#endif
-
-	ep = env_get("bootpretryperiod");
-	if (ep != NULL)
-		time_taken_max = dectoul(ep, NULL);
-	else
-		time_taken_max = TIMEOUT_MS;
 
-#ifdef CONFIG_BOOTP_RANDOM_DELAY		/* Random BOOTP delay */
-	if (bootp_try == 0)
-		srand_mac();
-
-	if (bootp_try <= 2)	/* Start with max 1024 * 1ms */
-		rand_ms = rand() >> (22 - bootp_try);
-	else		/* After 3rd BOOTP request max 8192 * 1ms */
-		rand_ms = rand() >> 19;
-
-	printf("Random delay: %ld ms...\n", rand_ms);
-	mdelay(rand_ms);
-
-#endif	/* CONFIG_BOOTP_RANDOM_DELAY */
-
-	printf("BOOTP broadcast %d\n", ++bootp_try);
 	pkt = net_tx_packet;
 	memset((void *)pkt, 0, PKTSIZE);
 
@@ -822,6 +799,42 @@ void bootp_request(void)
 	pktlen = eth_hdr_size + IP_UDP_HDR_SIZE + iplen;
 	bcast_ip.s_addr = 0xFFFFFFFFL;
 	net_set_udp_header(iphdr, bcast_ip, PORT_BOOTPS, PORT_BOOTPC, iplen);
+	net_send_packet(net_tx_packet, pktlen);
+}
+
+void bootp_request(void)
+{
+#ifdef CONFIG_BOOTP_RANDOM_DELAY
+	ulong rand_ms;
+#endif
+	char *ep;  /* Environment pointer */
+
+	bootstage_mark_name(BOOTSTAGE_ID_BOOTP_START, "bootp_start");
+#if defined(CONFIG_CMD_DHCP)
+	dhcp_state = INIT;
+#endif
+
+	ep = env_get("bootpretryperiod");
+	if (ep != NULL)
+		time_taken_max = dectoul(ep, NULL);
+	else
+		time_taken_max = TIMEOUT_MS;
+
+#ifdef CONFIG_BOOTP_RANDOM_DELAY		/* Random BOOTP delay */
+	if (bootp_try == 0)
+		srand_mac();
+
+	if (bootp_try <= 2)	/* Start with max 1024 * 1ms */
+		rand_ms = rand() >> (22 - bootp_try);
+	else		/* After 3rd BOOTP request max 8192 * 1ms */
+		rand_ms = rand() >> 19;
+
+	printf("Random delay: %ld ms...\n", rand_ms);
+	mdelay(rand_ms);
+
+#endif	/* CONFIG_BOOTP_RANDOM_DELAY */
+
+	printf("BOOTP broadcast %d\n", ++bootp_try);
 	net_set_timeout_handler(bootp_timeout, bootp_timeout_handler);
 
 #if defined(CONFIG_CMD_DHCP)
@@ -830,7 +843,7 @@ void bootp_request(void)
 #else
 	net_set_udp_handler(bootp_handler);
 #endif
-	net_send_packet(net_tx_packet, pktlen);
+	net_foreach_dev(bootp_send_request);
 }
 
 #if defined(CONFIG_CMD_DHCP)
@@ -1094,6 +1107,8 @@ static void dhcp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 			    CONFIG_SYS_BOOTFILE_PREFIX,
 			    strlen(CONFIG_SYS_BOOTFILE_PREFIX)) == 0) {
 #endif	/* CONFIG_SYS_BOOTFILE_PREFIX */
+			/* the request must go out on the same interface */
+			net_discover_done(eth_get_dev());
 			if (CONFIG_IS_ENABLED(UNIT_TEST) &&
 			    dhcp_message_type((u8 *)bp->bp_vend) == -1) {
 				debug("got BOOTP response; transitioning to BOUND\n");
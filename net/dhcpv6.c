@@ -41,6 +41,13 @@ static void dhcp6_handler(uchar *pkt, unsigned int dest, struct in_addr sip,
 	if (dest != PORT_DHCP6_C || src != PORT_DHCP6_S)
 		return;
 
+	/*
+	 * The client ID depends on the interface which received the packet,
+	 * since SOLICIT may have been sent on several
+	 */
+	memcpy(((struct dhcp6_option_duid_ll *)sm_params.duid)->ll_addr,
+	       net_ethaddr, ETH_ALEN);
+
 	dhcp6_state_machine(false, pkt, len);
 }
 
@@ -486,6 +493,7 @@ static int dhcp6_check_advertise_packet(uchar *rx_pkt, unsigned int len)
 
 			sm_params.server_uid.uid_size = rx_uid_size;
 			sm_params.server_uid.preference = sm_params.rx_status.preference;
+			sm_params.server_uid.dev = eth_get_dev();
 		}
 
 		/* If the first SOLICIT and preference code is 255, use right away.
@@ -650,6 +658,8 @@ static void dhcp6_state_machine(bool timeout, uchar *rx_pkt, unsigned int len)
 			sm_params.mrd_ms = 0;
 
 		} else if (sm_params.next_state == DHCP6_REQUEST) {
+			/* use the interface which got the chosen ADVERTISE */
+			net_discover_done(sm_params.server_uid.dev);
 			/* init timestamp variables  */
 			sm_params.dhcp6_retry_start_ms = get_timer(0);
 			sm_params.dhcp6_retry_ms = sm_params.dhcp6_start_ms;
@@ -696,7 +706,7 @@ static void dhcp6_state_machine(bool timeout, uchar *rx_pkt, unsigned int len)
 
 	if (sm_params.curr_state == DHCP6_SOLICIT) {
 		/* send solicit packet */
-		dhcp6_send_solicit_packet();
+		net_foreach_dev(dhcp6_send_solicit_packet);
 		printf("DHCP6 SOLICIT %d\n", sm_params.retry_cnt);
 	} else if (sm_params.curr_state == DHCP6_REQUEST) {
 		/* send request packet */
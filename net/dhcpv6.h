@@ -155,11 +155,13 @@ struct dhcp6_rx_pkt_status {
  * @uid_ptr: Dynamically allocated and copied server UID
  * @uid_size: Size of the server UID in uid_ptr (in bytes)
  * @preference: Preference code associated with this server UID
+ * @dev: Ethernet device on which the ADVERTISE was received
  */
 struct dhcp6_server_uid {
 	uchar	*uid_ptr;
 	u16	uid_size;
 	u8	preference;
+	struct udevice	*dev;
 };
 
 /**
@@ -18,6 +18,7 @@
 #include <asm/global_data.h>
 #include <dm/device-internal.h>
 #include <dm/uclass-internal.h>
+#include <net/neigh.h>
 #include <net/pcap.h>
 #include "eth_internal.h"
 #include <eth_phy.h>
@@ -365,6 +366,67 @@ void eth_halt(void)
 	priv->running = false;
 }
 
+int eth_start_all(void)
+{
+	struct udevice *dev;
+	int count = 0;
+	int ret;
+
+	uclass_foreach_dev_probe(UCLASS_ETH, dev) {
+		struct eth_device_priv *priv = dev_get_uclass_priv(dev);
+
+		if (!priv->running) {
+			ret = eth_get_ops(dev)->start(dev);
+			if (ret < 0) {
+				debug("%s: start() returned error %d\n",
+				      dev->name, ret);
+				continue;
+			}
+			priv->state = ETH_STATE_ACTIVE;
+			priv->running = true;
+		}
+		count++;
+	}
+
+	return count;
+}
+
+void eth_halt_others(void)
+{
+	struct udevice *current = eth_get_dev();
+	struct udevice *dev;
+
+	for (dev = eth_next_running(NULL); dev; dev = eth_next_running(dev)) {
+		struct eth_device_priv *priv = dev_get_uclass_priv(dev);
+
+		if (dev == current)
+			continue;
+		eth_get_ops(dev)->stop(dev);
+		priv->state = ETH_STATE_PASSIVE;
+		priv->running = false;
+	}
+}
+
+struct udevice *eth_next_running(struct udevice *dev)
+{
+	if (dev)
+		uclass_find_next_device(&dev);
+	else
+		uclass_find_first_device(UCLASS_ETH, &dev);
+
+	for (; dev; uclass_find_next_device(&dev)) {
+		struct eth_device_priv *priv;
+
+		if (!device_active(dev))
+			continue;
+		priv = dev_get_uclass_priv(dev);
+		if (priv->running)
+			return dev;
+	}
+
+	return NULL;
+}
+
 int eth_is_active(struct udevice *dev)
 {
 	struct eth_device_priv *priv;
@@ -436,6 +498,30 @@ int eth_rx(void)
 	return ret;
 }
 
+int eth_mcast_join(struct in_addr mcast_addr, int join)
+{
+	struct udevice *current;
+	u32 ip = ntohl(mcast_addr.s_addr);
+	u8 mcast_mac[ARP_HLEN];
+
+	current = eth_get_dev();
+	if (!current)
+		return -ENODEV;
+
+	if (!eth_get_ops(current)->mcast)
+		return -ENOSYS;
+
+	/* 01:00:5e followed by the low 23 bits of the group (RFC 1112) */
+	mcast_mac[0] = 0x01;
+	mcast_mac[1] = 0x00;
+	mcast_mac[2] = 0x5e;
+	mcast_mac[3] = (ip >> 16) & 0x7f;
+	mcast_mac[4] = (ip >> 8) & 0xff;
+	mcast_mac[5] = ip & 0xff;
+
+	return eth_get_ops(current)->mcast(current, mcast_mac, join);
+}
+
 int eth_initialize(void)
 {
 	int num_devices = 0;
@@ -614,6 +700,7 @@ static int eth_pre_remove(struct udevice *dev)
 	struct eth_pdata *pdata = dev_get_plat(dev);
 
 	eth_get_ops(dev)->stop(dev);
+	neigh_remove_dev(dev);
 
 	/* clear the MAC address */
 	memset(pdata->enetaddr, 0, ARP_HLEN);
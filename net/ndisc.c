@@ -15,6 +15,7 @@
 #include <ndisc.h>
 #include <stdlib.h>
 #include <linux/delay.h>
+#include <net/neigh.h>
 
 /* IPv6 destination address of packet waiting for ND */
 struct in6_addr net_nd_sol_packet_ip6 = ZERO_IPV6_ADDR;
@@ -276,6 +277,16 @@ void ndisc_request(void)
 	ip6_send_ns(&net_nd_rep_packet_ip6);
 }
 
+bool ndisc_lookup(struct in6_addr *ip6, uchar *ethaddr)
+{
+	/* hosts on other networks are reached through the gateway */
+	if (!ip6_addr_in_subnet(&net_ip6, ip6, net_prefix_length) &&
+	    !ip6_is_unspecified_addr(&net_gateway6))
+		ip6 = &net_gateway6;
+
+	return neigh_lookup6(ip6, ethaddr);
+}
+
 int ndisc_timeout_check(void)
 {
 	ulong t;
@@ -445,24 +456,27 @@ int ndisc_receive(struct ethernet_hdr *et, struct ip6_hdr *ip6, int len)
 		if (ip6_is_our_addr(&ndisc->target) &&
 		    ndisc_has_option(ip6, ND_OPT_SOURCE_LL_ADDR)) {
 			ndisc_extract_enetaddr(ndisc, neigh_eth_addr);
+			neigh_update6(&ip6->saddr, neigh_eth_addr);
 			ip6_send_na(neigh_eth_addr, &ip6->saddr,
 				    &ndisc->target);
 		}
 		break;
 
 	case IPV6_NDISC_NEIGHBOUR_ADVERTISEMENT:
+		if (!ndisc_has_option(ip6, ND_OPT_TARGET_LL_ADDR))
+			break;
+		ndisc_extract_enetaddr(ndisc, neigh_eth_addr);
+		neigh_update6(&ndisc->target, neigh_eth_addr);
+
 		/* are we waiting for a reply ? */
 		if (ip6_is_unspecified_addr(&net_nd_sol_packet_ip6))
 			break;
 
-		if ((memcmp(&ndisc->target, &net_nd_rep_packet_ip6,
-			    sizeof(struct in6_addr)) == 0) &&
-		    ndisc_has_option(ip6, ND_OPT_TARGET_LL_ADDR)) {
-			ndisc_extract_enetaddr(ndisc, neigh_eth_addr);
-
+		if (memcmp(&ndisc->target, &net_nd_rep_packet_ip6,
+			   sizeof(struct in6_addr)) == 0) {
 			/* save address for later use */
-			if (!net_nd_packet_mac)
-				net_nd_packet_mac = neigh_eth_addr;
+			if (net_nd_packet_mac)
+				memcpy(net_nd_packet_mac, neigh_eth_addr, 6);
 
 			/* modify header, and transmit it */
 			memcpy(((struct ethernet_hdr *)net_nd_tx_packet)->et_dest,
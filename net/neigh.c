@@ -0,0 +1,152 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Neighbour cache, shared by ARP and IPv6 neighbour discovery
+ *
+ * This remembers the MAC addresses of the hosts and gateways which have
+ * answered us, so that a new transfer to the same server does not need to
+ * resolve its address again. The table is small: entries expire after
+ * CONFIG_NET_NEIGH_TIMEOUT seconds and, when it is full, the least recently
+ * used entry is replaced.
+ */
+
+#include <common.h>
+#include <dm.h>
+#include <net.h>
+#include <net6.h>
+#include <time.h>
+#include <net/neigh.h>
+
+static struct neigh_entry neigh_table[CONFIG_NET_NEIGH_SIZE];
+
+static bool neigh_is_valid(const struct neigh_entry *ent)
+{
+	return ent->dev &&
+		get_timer(ent->confirmed) < CONFIG_NET_NEIGH_TIMEOUT * 1000UL;
+}
+
+static struct neigh_entry *neigh_find(bool ip6, const void *addr)
+{
+	struct udevice *dev = eth_get_dev();
+	int size = ip6 ? sizeof(struct in6_addr) : sizeof(struct in_addr);
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(neigh_table); i++) {
+		struct neigh_entry *ent = &neigh_table[i];
+
+		if (ent->dev == dev && ent->ip6 == ip6 &&
+		    !memcmp(&ent->addr6, addr, size))
+			return ent;
+	}
+
+	return NULL;
+}
+
+static void neigh_add(bool ip6, const void *addr, const uchar *ethaddr)
+{
+	struct udevice *dev = eth_get_dev();
+	struct neigh_entry *ent;
+	int i;
+
+	if (!dev || !is_valid_ethaddr(ethaddr))
+		return;
+
+	ent = neigh_find(ip6, addr);
+	if (!ent) {
+		/* use a free or expired entry, else the least recently used */
+		for (i = 0; i < ARRAY_SIZE(neigh_table); i++) {
+			struct neigh_entry *try = &neigh_table[i];
+
+			if (!neigh_is_valid(try)) {
+				ent = try;
+				break;
+			}
+			if (!ent || try->used < ent->used)
+				ent = try;
+		}
+		memset(ent, '\0', sizeof(*ent));
+		ent->dev = dev;
+		ent->ip6 = ip6;
+		if (ip6)
+			net_copy_ip6(&ent->addr6, addr);
+		else
+			memcpy(&ent->addr, addr, sizeof(ent->addr));
+		ent->used = get_timer(0);
+	}
+	memcpy(ent->ethaddr, ethaddr, ARP_HLEN);
+	ent->confirmed = get_timer(0);
+}
+
+static bool neigh_get(bool ip6, const void *addr, uchar *ethaddr)
+{
+	struct neigh_entry *ent;
+
+	ent = neigh_find(ip6, addr);
+	if (!ent || !neigh_is_valid(ent))
+		return false;
+	ent->used = get_timer(0);
+	memcpy(ethaddr, ent->ethaddr, ARP_HLEN);
+
+	return true;
+}
+
+void neigh_update(struct in_addr ip, const uchar *ethaddr)
+{
+	if (ip.s_addr)
+		neigh_add(false, &ip, ethaddr);
+}
+
+bool neigh_lookup(struct in_addr ip, uchar *ethaddr)
+{
+	return neigh_get(false, &ip, ethaddr);
+}
+
+void neigh_update6(const struct in6_addr *ip6, const uchar *ethaddr)
+{
+	if (!ip6_is_unspecified_addr((struct in6_addr *)ip6))
+		neigh_add(true, ip6, ethaddr);
+}
+
+bool neigh_lookup6(const struct in6_addr *ip6, uchar *ethaddr)
+{
+	return neigh_get(true, ip6, ethaddr);
+}
+
+void neigh_remove_dev(struct udevice *dev)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(neigh_table); i++) {
+		if (neigh_table[i].dev == dev)
+			neigh_table[i].dev = NULL;
+	}
+}
+
+void neigh_flush(void)
+{
+	memset(neigh_table, '\0', sizeof(neigh_table));
+}
+
+int neigh_show(void)
+{
+	char addr[48];
+	int count = 0;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(neigh_table); i++) {
+		const struct neigh_entry *ent = &neigh_table[i];
+
+		if (!neigh_is_valid(ent))
+			continue;
+		if (!count++)
+			printf("%-39s  %-17s  %-16s  %s\n", "Address",
+			       "MAC address", "Device", "Age");
+		if (ent->ip6)
+			snprintf(addr, sizeof(addr), "%pI6c", &ent->addr6);
+		else
+			snprintf(addr, sizeof(addr), "%pI4", &ent->addr);
+		printf("%-39s  %pM  %-16s  %lus\n", addr, ent->ethaddr,
+		       ent->dev->name, get_timer(ent->confirmed) / 1000);
+	}
+
+	return count;
+}
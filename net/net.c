@@ -124,6 +124,7 @@
 #include "wol.h"
 #endif
 #include "dhcpv6.h"
+#include "eth_internal.h"
 #include "net_rand.h"
 
 /** BOOTP EXTENTIONS **/
@@ -151,6 +152,8 @@ u8 net_server_ethaddr[6];
 struct in_addr	net_ip;
 /* Server IP addr (0 = unknown) */
 struct in_addr	net_server_ip;
+/* Multicast group joined (0 = none) */
+struct in_addr	net_mcast_addr;
 /* Current receive packet */
 uchar *net_rx_packet;
 /* Current rx packet length */
@@ -171,6 +174,8 @@ int		net_restart_wrap;
 static int	net_restarted;
 /* At least one device configured */
 static int	net_dev_exists;
+/* Discovering on all running devices at once */
+static bool	net_discover_all;
 
 /* XXX in both little & big endian machines 0xFFFF == ntohs(-1) */
 /* default is without VLAN */
@@ -381,6 +386,87 @@ static int net_init_loop(void)
 	return 0;
 }
 
+/* Make @dev the current device and pick up its addresses */
+static void net_set_current_dev(struct udevice *dev)
+{
+	eth_set_dev(dev);
+	memcpy(net_ethaddr, eth_get_ethaddr(), 6);
+
+	if (IS_ENABLED(CONFIG_IPV6)) {
+		bool lladdr = !memcmp(&net_ip6, &net_link_local_ip6,
+				      sizeof(struct in6_addr));
+
+		ip6_make_lladdr(&net_link_local_ip6, net_ethaddr);
+		if (lladdr)
+			memcpy(&net_ip6, &net_link_local_ip6,
+			       sizeof(struct in6_addr));
+	}
+}
+
+void net_foreach_dev(void (*func)(void))
+{
+	struct udevice *current = eth_get_dev();
+	struct udevice *dev;
+
+	if (!net_discover_all) {
+		func();
+		return;
+	}
+
+	for (dev = eth_next_running(NULL); dev; dev = eth_next_running(dev)) {
+		net_set_current_dev(dev);
+		func();
+		/* stop if @func picked this device */
+		if (!net_discover_all)
+			return;
+	}
+	net_set_current_dev(current);
+}
+
+/*
+ * Start discovery on all devices, if enabled. This is only useful for
+ * protocols which broadcast a request and take the first answer.
+ */
+static void net_discover_start(enum proto_t protocol)
+{
+	char *ethrotate;
+
+	if (!IS_ENABLED(CONFIG_NET_DISCOVER_ALL) || !eth_is_on_demand_init())
+		return;
+	if (protocol != BOOTP && protocol != DHCP && protocol != DHCP6)
+		return;
+
+	/* the user wants to stick to 'ethact' */
+	ethrotate = env_get("ethrotate");
+	if (ethrotate && !strcmp(ethrotate, "no"))
+		return;
+
+	net_discover_all = eth_start_all() > 1;
+}
+
+static void net_discover_stop(void)
+{
+	if (!net_discover_all)
+		return;
+	net_discover_all = false;
+	eth_halt_others();
+}
+
+void net_discover_done(struct udevice *dev)
+{
+	if (!net_discover_all)
+		return;
+	net_set_current_dev(dev);
+	net_discover_stop();
+	eth_current_changed();
+	printf("Using %s device\n", eth_get_name());
+}
+
+static void net_rx(void)
+{
+	eth_rx();
+}
+
 static void net_clear_handlers(void)
 {
 	net_set_udp_handler(NULL);
@@ -388,9 +474,19 @@ static void net_clear_handlers(void)
 	net_set_timeout_handler(0, NULL);
 }
 
+/* Leave any multicast group joined by the protocol */
+static void net_mcast_leave(void)
+{
+	if (net_mcast_addr.s_addr) {
+		eth_mcast_join(net_mcast_addr, 0);
+		net_mcast_addr.s_addr = 0;
+	}
+}
+
 static void net_cleanup_loop(void)
 {
 	net_clear_handlers();
+	net_mcast_leave();
 }
 
 int net_init(void)
@@ -469,6 +565,7 @@ restart:
 #ifdef CONFIG_USB_KEYBOARD
 	net_busy_flag = 0;
 #endif
+	net_mcast_leave();
 	net_set_state(NETLOOP_CONTINUE);
 
 	/*
@@ -496,6 +593,7 @@ restart:
 	case 0:
 		net_dev_exists = 1;
 		net_boot_file_size = 0;
+		net_discover_start(protocol);
 		switch (protocol) {
 #ifdef CONFIG_CMD_TFTPBOOT
 		case TFTPGET:
@@ -647,7 +745,7 @@ restart:
 		 *	Most drivers return the most recent packet size, but not
 		 *	errors that may have happened.
 		 */
-		eth_rx();
+		net_foreach_dev(net_rx);
 
 		/*
 		 *	Abort if ctrl-c was pressed.
@@ -749,6 +847,7 @@ done:
 #ifdef CONFIG_USB_KEYBOARD
 	net_busy_flag = 0;
 #endif
+	net_discover_stop();
 #ifdef CONFIG_CMD_TFTPPUT
 	/* Clear out the handlers */
 	net_set_udp_handler(NULL);
@@ -775,6 +874,7 @@ int net_start_again(void)
 	char *nretry;
 	int retry_forever = 0;
 	unsigned long retrycnt = 0;
+	bool tried_all;
 	int ret;
 
 	nretry = env_get("netretry");
@@ -792,6 +892,10 @@ int net_start_again(void)
 		retry_forever = 0;
 	}
 
+	/* all devices have been tried at once, so there is no other to try */
+	tried_all = net_discover_all;
+	net_discover_stop();
+
 	if ((!retry_forever) && (net_try_count > retrycnt)) {
 		eth_halt();
 		net_set_state(NETLOOP_FAIL);
@@ -805,9 +909,13 @@ int net_start_again(void)
 	net_try_count++;
 
 	eth_halt();
+	if (tried_all) {
+		net_restart_wrap = 1;
+	} else {
 #if !defined(CONFIG_NET_DO_NOT_TRY_ANOTHER)
-	eth_try_another(!net_restarted);
+		eth_try_another(!net_restarted);
 #endif
+	}
 	ret = eth_init();
 	if (net_restart_wrap) {
 		net_restart_wrap = 0;
@@ -930,6 +1038,9 @@ int net_send_ip_packet(uchar *ether, struct in_addr dest, int dport, int sport,
 	/* if broadcast, make the ether address a broadcast and don't do ARP */
 	if (dest.s_addr == 0xFFFFFFFF)
 		ether = (uchar *)net_bcast_ethaddr;
+	/* otherwise try the neighbour cache before resorting to ARP */
+	else if (!memcmp(ether, net_null_ethaddr, 6))
+		arp_lookup(dest, ether);
 
 	pkt = (uchar *)net_tx_packet;
 
@@ -1345,7 +1456,9 @@ void net_process_received_packet(uchar *in_packet, int len)
 		/* If it is not for us, ignore it */
 		dst_ip = net_read_ip(&ip->ip_dst);
 		if (net_ip.s_addr && dst_ip.s_addr != net_ip.s_addr &&
-		    dst_ip.s_addr != 0xFFFFFFFF) {
+		    dst_ip.s_addr != 0xFFFFFFFF &&
+		    (!net_mcast_addr.s_addr ||
+		     dst_ip.s_addr != net_mcast_addr.s_addr)) {
 				return;
 		}
 		/* Read source IP address for later use */
@@ -344,10 +344,10 @@ int net_send_udp_packet6(uchar *ether, struct in6_addr *dest, int dport,
 	udp->udp_xsum = csum_ipv6_magic(&net_ip6, dest, len + UDP_HDR_SIZE,
 					IPPROTO_UDP, csum_p);
 
-	/* if MAC address was not discovered yet, save the packet and do
-	 * neighbour discovery
+	/* if MAC address was not discovered yet, try the neighbour cache;
+	 * failing that, save the packet and do neighbour discovery
 	 */
-	if (!memcmp(ether, net_null_ethaddr, 6)) {
+	if (!memcmp(ether, net_null_ethaddr, 6) && !ndisc_lookup(dest, ether)) {
 		net_copy_ip6(&net_nd_sol_packet_ip6, dest);
 		net_nd_packet_mac = ether;
 
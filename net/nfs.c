@@ -33,6 +33,7 @@
 #include <common.h>
 #include <command.h>
 #include <display_options.h>
+#include <env.h>
 #ifdef CONFIG_SYS_DIRECT_FLASH_NFS
 #include <flash.h>
 #endif
@@ -44,6 +45,8 @@
 #include "nfs.h"
 #include "bootp.h"
 #include <time.h>
+#include <linux/kernel.h>
+#include <linux/log2.h>
 
 #define HASHES_PER_LINE 65	/* Number of "loading" hashes per line	*/
 #define NFS_RETRY_COUNT 30
@@ -51,12 +54,36 @@
 #define NFS_RPC_ERR	1
 #define NFS_RPC_DROP	124
 
+#define NFS_MAX_WINDOW	16	/* Most READ requests in flight */
+#define NFS_V2_MAX_READ_SIZE	8192	/* NFS_MAXDATA in RFC 1094 */
+#define NFS_MAX_READ_SIZE	32768
+/* Space for the RPC header and the file attributes in a READ reply */
+#define NFS_READ_OVERHEAD	((6 + NFS_MAX_ATTRS) * sizeof(uint32_t))
+
+/**
+ * struct nfs_read_slot - A READ request waiting for its reply
+ *
+ * @id: RPC transaction ID (XID) of the request, or 0 if the slot is free
+ * @offset: Offset in the file of the data requested
+ * @len: Number of bytes requested
+ */
+struct nfs_read_slot {
+	ulong id;
+	uint offset;
+	uint len;
+};
+
 static int fs_mounted;
 static unsigned long rpc_id;
-static int nfs_offset = -1;
-static int nfs_len;
 static const ulong nfs_timeout = CONFIG_NFS_TIMEOUT;
 
+static struct nfs_read_slot nfs_slots[NFS_MAX_WINDOW];
+static uint nfs_window;		/* Number of READ requests to keep in flight */
+static uint nfs_read_size;	/* Number of bytes to request in each READ */
+static uint nfs_next_offset;	/* Offset for the next new READ request */
+static uint nfs_eof_offset;	/* Size of the file, or UINT_MAX if not known */
+static ulong nfs_received;	/* Number of bytes received, for progress */
+
 static char dirfh[NFS_FHSIZE];	/* NFSv2 / NFSv3 file handle of directory */
 static char filefh[NFS3_FHSIZE]; /* NFSv2 / NFSv3 file handle */
 static unsigned int filefh3_length;	/* (variable) length of filefh when NFSv3 */
@@ -425,6 +452,130 @@ static void nfs_read_req(int offset, int readlen)
 	rpc_req(PROG_NFS, NFS_READ, data, len);
 }
 
+/**
+ * nfs_read_start() - Set up the READ window for a new file
+ *
+ * The read size is limited to what fits in a (possibly reassembled) IP
+ * datagram and what the NFS version allows
+ */
+static void nfs_read_start(void)
+{
+	int max_defrag;
+	uint max_size;
+
+	max_defrag = config_opt_enabled(CONFIG_IP_DEFRAG, CONFIG_NET_MAXDEFRAG,
+					0);
+	if (max_defrag) {
+		max_size = max_defrag - IP_UDP_HDR_SIZE - NFS_READ_OVERHEAD;
+		max_size = rounddown_pow_of_two(max_size);
+		max_size = clamp_t(uint, max_size, NFS_READ_SIZE,
+				   NFS_MAX_READ_SIZE);
+	} else {
+		max_size = NFS_READ_SIZE;
+	}
+	if (choosen_nfs_version != NFS_V3)
+		max_size = min_t(uint, max_size, NFS_V2_MAX_READ_SIZE);
+
+	nfs_read_size = env_get_ulong("nfsreadsize", 10, CONFIG_NFS_READ_SIZE);
+	nfs_read_size = clamp_t(uint, nfs_read_size, 4, max_size) & ~3;
+	nfs_window = env_get_ulong("nfswindowsize", 10,
+				   CONFIG_NFS_READ_WINDOW);
+	nfs_window = clamp_t(uint, nfs_window, 1, NFS_MAX_WINDOW);
+	debug("NFS read size %u, window %u\n", nfs_read_size, nfs_window);
+
+	memset(nfs_slots, '\0', sizeof(nfs_slots));
+	nfs_next_offset = 0;
+	nfs_eof_offset = UINT_MAX;
+	nfs_received = 0;
+}
+
+static void nfs_read_send_slot(struct nfs_read_slot *slot)
+{
+	nfs_read_req(slot->offset, slot->len);
+	slot->id = rpc_id;
+}
+
+/**
+ * nfs_read_fill() - Send new READ requests until the window is full
+ *
+ * No requests are sent beyond the end of the file, once that is known
+ */
+static void nfs_read_fill(void)
+{
+	struct nfs_read_slot *slot;
+
+	for (slot = nfs_slots; slot < nfs_slots + nfs_window; slot++) {
+		if (slot->id)
+			continue;
+		if (nfs_next_offset >= nfs_eof_offset)
+			break;
+		slot->offset = nfs_next_offset;
+		slot->len = nfs_read_size;
+		nfs_next_offset += nfs_read_size;
+		nfs_read_send_slot(slot);
+	}
+}
+
+/**
+ * nfs_read_send() - Resend the READ requests in flight, then fill the window
+ *
+ * The resent requests have new IDs, so a late reply to an old one is dropped
+ */
+static void nfs_read_send(void)
+{
+	struct nfs_read_slot *slot;
+
+	for (slot = nfs_slots; slot < nfs_slots + nfs_window; slot++) {
+		if (slot->id)
+			nfs_read_send_slot(slot);
+	}
+	nfs_read_fill();
+}
+
+/**
+ * nfs_read_set_eof() - Record the end of the file
+ *
+ * Requests beyond the end are dropped, along with any reply to them
+ *
+ * @offset: Size of the file
+ */
+static void nfs_read_set_eof(uint offset)
+{
+	struct nfs_read_slot *slot;
+
+	nfs_eof_offset = min(nfs_eof_offset, offset);
+	for (slot = nfs_slots; slot < nfs_slots + nfs_window; slot++) {
+		if (slot->offset >= nfs_eof_offset)
+			slot->id = 0;
+	}
+}
+
+/**
+ * nfs_read_done() - Check whether the whole file has been read
+ *
+ * Return: true if the end of the file is known and all the data before it
+ *	has been received
+ */
+static bool nfs_read_done(void)
+{
+	struct nfs_read_slot *slot;
+
+	if (nfs_eof_offset == UINT_MAX)
+		return false;
+	for (slot = nfs_slots; slot < nfs_slots + nfs_window; slot++) {
+		if (slot->id)
+			return false;
+	}
+
+	return true;
+}
+
+/* Drop all READ requests, so that any replies are ignored */
+static void nfs_read_cancel(void)
+{
+	memset(nfs_slots, '\0', sizeof(nfs_slots));
+}
+
 /**************************************************************************
 RPC request dispatcher
 **************************************************************************/
@@ -455,7 +606,7 @@ static void nfs_send(void)
 		nfs_lookup_req(nfs_filename);
 		break;
 	case STATE_READ_REQ:
-		nfs_read_req(nfs_offset, nfs_len);
+		nfs_read_send();
 		break;
 	case STATE_READLINK_REQ:
 		nfs_readlink_req();
@@ -704,20 +855,53 @@ static int nfs_readlink_reply(uchar *pkt, unsigned len)
 	return 0;
 }
 
+/* Print a hash for every 5KB received */
+static void nfs_show_progress(uint len)
+{
+	const ulong marker = NFS_READ_SIZE / 2 * 10;
+	ulong count;
+
+	for (count = DIV_ROUND_UP(nfs_received, marker),
+	     nfs_received += len; count * marker < nfs_received; count++) {
+		if (count && !(count % HASHES_PER_LINE))
+			puts("\n\t ");
+		putc('#');
+	}
+}
+
+/**
+ * nfs_read_reply() - Handle the reply to a READ request
+ *
+ * The data is stored at the offset of the request, so replies can arrive in
+ * any order. If the server returns less data than requested, the rest is
+ * requested again, unless the end of the file has been reached.
+ *
+ * @pkt: Reply packet, which may be larger than struct rpc_t
+ * @len: Length of the reply
+ * Return: number of bytes read, -NFS_RPC_DROP if the reply does not match a
+ *	request, else another -ve error
+ */
 static int nfs_read_reply(uchar *pkt, unsigned len)
 {
+	struct nfs_read_slot *slot;
 	struct rpc_t rpc_pkt;
-	int rlen;
-	uchar *data_ptr;
+	uint offset, rlen;
+	bool eof;
+	int data_off;
 
 	debug("%s\n", __func__);
 
-	memcpy(&rpc_pkt.u.data[0], pkt, sizeof(rpc_pkt.u.reply));
+	/* Only the header and attributes are copied; the data is used in place */
+	memcpy(&rpc_pkt.u.data[0], pkt, min_t(uint, len,
+					      sizeof(rpc_pkt.u.reply)));
 
-	if (ntohl(rpc_pkt.u.reply.id) > rpc_id)
-		return -NFS_RPC_ERR;
-	else if (ntohl(rpc_pkt.u.reply.id) < rpc_id)
+	for (slot = nfs_slots; slot < nfs_slots + nfs_window; slot++) {
+		if (slot->id && slot->id == ntohl(rpc_pkt.u.reply.id))
+			break;
+	}
+	if (slot == nfs_slots + nfs_window)
 		return -NFS_RPC_DROP;
+	slot->id = 0;
 
 	if (rpc_pkt.u.reply.rstatus  ||
 	    rpc_pkt.u.reply.verifier ||
@@ -730,34 +914,37 @@ static int nfs_read_reply(uchar *pkt, unsigned len)
 		return -ntohl(rpc_pkt.u.reply.data[0]);
 	}
 
-	if ((nfs_offset != 0) && !((nfs_offset) %
-			(NFS_READ_SIZE / 2 * 10 * HASHES_PER_LINE)))
-		puts("\n\t ");
-	if (!(nfs_offset % ((NFS_READ_SIZE / 2) * 10)))
-		putc('#');
-
 	if (choosen_nfs_version != NFS_V3) {
 		rlen = ntohl(rpc_pkt.u.reply.data[18]);
-		data_ptr = (uchar *)&(rpc_pkt.u.reply.data[19]);
+		data_off = 19;
+		eof = false;
 	} else {  /* NFS_V3 */
 		int nfsv3_data_offset =
 			nfs3_get_attributes_offset(rpc_pkt.u.reply.data);
 
 		/* count value */
 		rlen = ntohl(rpc_pkt.u.reply.data[1 + nfsv3_data_offset]);
-		/* Skip unused values :
-			EOF:		32 bits value,
-			data_size:	32 bits value,
-		*/
-		data_ptr = (uchar *)
-			&(rpc_pkt.u.reply.data[4 + nfsv3_data_offset]);
+		eof = ntohl(rpc_pkt.u.reply.data[2 + nfsv3_data_offset]);
+		/* Skip unused value data_size: 32 bits value */
+		data_off = 4 + nfsv3_data_offset;
+	}
+	data_off = (uchar *)&rpc_pkt.u.reply.data[data_off] - (uchar *)&rpc_pkt;
+
+	if (rlen > slot->len || data_off + rlen > len)
+		return -9999;
+
+	offset = slot->offset;
+	if (store_block(pkt + data_off, offset, rlen))
+		return -9999;
+	nfs_show_progress(rlen);
+
+	if (!rlen || eof) {
+		nfs_read_set_eof(offset + rlen);
+	} else if (rlen < slot->len) {
+		slot->offset += rlen;
+		slot->len -= rlen;
+		nfs_read_send_slot(slot);
 	}
-
-	if (((uchar *)&(rpc_pkt.u.reply.data[0]) - (uchar *)(&rpc_pkt) + rlen) > len)
-			return -9999;
-
-	if (store_block(data_ptr, nfs_offset, rlen))
-			return -9999;
 
 	return rlen;
 }
@@ -787,7 +974,10 @@ static void nfs_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 
 	debug("%s\n", __func__);
 
-	if (len > sizeof(struct rpc_t))
+	/* READ replies may be larger, up to the read size */
+	if (len > sizeof(struct rpc_t) &&
+	    (nfs_state != STATE_READ_REQ ||
+	     len > NFS_READ_OVERHEAD + nfs_read_size))
 		return;
 
 	if (dest != nfs_our_port)
@@ -858,8 +1048,7 @@ static void nfs_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 			nfs_send();
 		} else {
 			nfs_state = STATE_READ_REQ;
-			nfs_offset = 0;
-			nfs_len = NFS_READ_SIZE;
+			nfs_read_start();
 			nfs_send();
 		}
 		break;
@@ -887,18 +1076,19 @@ static void nfs_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 		if (rlen == -NFS_RPC_DROP)
 			break;
 		net_set_timeout_handler(nfs_timeout, nfs_timeout_handler);
-		if (rlen > 0) {
-			nfs_offset += rlen;
-			nfs_send();
+		if (rlen >= 0 && !nfs_read_done()) {
+			nfs_read_fill();
 		} else if ((rlen == -NFSERR_ISDIR) || (rlen == -NFSERR_INVAL)) {
 			/* symbolic link */
+			nfs_read_cancel();
 			nfs_state = STATE_READLINK_REQ;
 			nfs_send();
 		} else {
-			if (!rlen)
+			if (rlen >= 0)
 				nfs_download_state = NETLOOP_SUCCESS;
 			if (rlen < 0)
 				debug("NFS READ error (%d)\n", rlen);
+			nfs_read_cancel();
 			nfs_state = STATE_UMOUNT_REQ;
 			nfs_send();
 		}
@@ -35,24 +35,33 @@ static u32 loc_timestamp;
 static u32 rmt_timestamp;
 
 static u32 tcp_seq_init;
+/* Next sequence number expected, i.e. the cumulative ACK we send */
 static u32 tcp_ack_edge;
 
 static int tcp_activity_count;
 
 /*
- * Search for TCP_SACK and review the comments before the code section
- * TCP_SACK is the number of packets at the front of the stream
+ * Data received beyond a hole, as a list of non-overlapping ranges sorted by
+ * sequence number. These are reported to the sender as SACK blocks and are
+ * folded into tcp_ack_edge once the hole is filled.
  */
+static struct sack_edges tcp_ooo[TCP_SACK];
+static unsigned int tcp_ooo_cnt;
+/* Index in tcp_ooo of the range holding the most recent segment */
+static int tcp_ooo_last;
 
-enum pkt_state {PKT, NOPKT};
-struct sack_r {
-	struct sack_edges se;
-	enum pkt_state st;
-};
+/* Options agreed with the peer in its SYN */
+static bool tcp_peer_sack;
+static bool tcp_peer_scale;
+/* Window scale shift we advertise */
+static u8 tcp_rcv_scale;
 
-static struct sack_r edge_a[TCP_SACK];
-static unsigned int sack_idx;
-static unsigned int prev_len;
+/* Delayed ACK state */
+static unsigned int tcp_unacked_segs;
+static bool tcp_ack_now;
+
+#define SEQ_LT(a, b)	((s32)((a) - (b)) < 0)
+#define SEQ_LEQ(a, b)	((s32)((a) - (b)) <= 0)
 
 /*
  * TCP lengths are stored as a rounded up number of 32 bit words.
@@ -109,6 +118,64 @@ void tcp_set_tcp_handler(rxhand_tcp *f)
 		tcp_packet_handler = f;
 }
 
+/**
+ * tcp_rcv_window() - get the receive window we advertise, in bytes
+ *
+ * The window is not limited by the receive ring (PKTBUFSRX): each segment is
+ * handed to the application, which copies it to its destination, before the
+ * driver is polled again. The ring only holds the frames which arrive
+ * between two polls, so its size does not depend on the window.
+ *
+ * Return: receive window
+ */
+static u32 tcp_rcv_window(void)
+{
+	if (CONFIG_PROT_TCP_RCV_WINDOW)
+		return CONFIG_PROT_TCP_RCV_WINDOW;
+
+	return PKTBUFSRX * TCP_MSS;
+}
+
+/**
+ * tcp_ack_due() - check whether received data should be acknowledged now
+ *
+ * ACKs are delayed until two full segments have arrived, as in RFC 1122,
+ * but are sent straight away for duplicate or out-of-order segments and for
+ * segments which fill a hole, so that the sender can recover quickly.
+ *
+ * Return: true if an ACK should be sent now
+ */
+bool tcp_ack_due(void)
+{
+	return tcp_ack_now || tcp_unacked_segs >= TCP_DELAYED_ACK_SEGS;
+}
+
+/**
+ * tcp_ack_pending() - check whether any received data is still unacknowledged
+ *
+ * Every ACK sent acknowledges all the data received so far, so this is false
+ * once one has gone out, whichever part of the stack sent it.
+ *
+ * Return: true if an ACK is owed to the peer
+ */
+bool tcp_ack_pending(void)
+{
+	return tcp_ack_now || tcp_unacked_segs;
+}
+
+/**
+ * tcp_get_ack_edge() - get the end of the data received in order
+ *
+ * Everything before this sequence number has been received, so an app which
+ * writes its data out as it goes can safely pass on the data up to here.
+ *
+ * Return: sequence number of the next byte expected from the peer
+ */
+u32 tcp_get_ack_edge(void)
+{
+	return tcp_ack_edge;
+}
+
 /**
  * tcp_set_pseudo_header() - set TCP pseudo header
  * @pkt: the packet
@@ -165,7 +232,7 @@ int net_set_ack_options(union tcp_build_pkt *b)
 	b->sack.sack_v.len = 0;
 
 	if (IS_ENABLED(CONFIG_PROT_TCP_SACK)) {
-		if (tcp_lost.len > TCP_OPT_LEN_2) {
+		if (tcp_peer_sack && tcp_lost.len > TCP_OPT_LEN_2) {
 			debug_cond(DEBUG_DEV_PKT, "TCP ack opt lost.len %x\n",
 				   tcp_lost.len);
 			b->sack.sack_v.len = tcp_lost.len;
@@ -185,11 +252,13 @@ int net_set_ack_options(union tcp_build_pkt *b)
 			b->sack.sack_v.hill[2].r = htonl(tcp_lost.hill[2].r);
 			b->sack.sack_v.hill[3].l = TCP_O_NOP;
 			b->sack.sack_v.hill[3].r = TCP_O_NOP;
+			b->sack.hdr.tcp_hlen = SHIFT_TO_TCPHDRLEN_FIELD(ROUND_TCPHDR_LEN(TCP_HDR_SIZE +
+											 TCP_TSOPT_SIZE +
+											 tcp_lost.len));
+		} else {
+			b->sack.hdr.tcp_hlen = SHIFT_TO_TCPHDRLEN_FIELD(ROUND_TCPHDR_LEN(TCP_HDR_SIZE +
+											 TCP_TSOPT_SIZE));
 		}
-
-		b->sack.hdr.tcp_hlen = SHIFT_TO_TCPHDRLEN_FIELD(ROUND_TCPHDR_LEN(TCP_HDR_SIZE +
-										 TCP_TSOPT_SIZE +
-										 tcp_lost.len));
 	} else {
 		b->sack.sack_v.kind = 0;
 		b->sack.hdr.tcp_hlen = SHIFT_TO_TCPHDRLEN_FIELD(ROUND_TCPHDR_LEN(TCP_HDR_SIZE +
@@ -210,8 +279,20 @@ int net_set_ack_options(union tcp_build_pkt *b)
  */
 void net_set_syn_options(union tcp_build_pkt *b)
 {
+	u32 win = tcp_rcv_window();
+
 	if (IS_ENABLED(CONFIG_PROT_TCP_SACK))
 		tcp_lost.len = 0;
+	tcp_ooo_cnt = 0;
+	tcp_peer_sack = false;
+	tcp_peer_scale = false;
+	tcp_unacked_segs = 0;
+	tcp_ack_now = false;
+
+	/* Use the smallest scale which lets the window fit in 16 bits */
+	for (tcp_rcv_scale = 0; tcp_rcv_scale < TCP_MAX_SCALE &&
+	     (win >> tcp_rcv_scale) > 0xffff; tcp_rcv_scale++)
+		;
 
 	b->ip.hdr.tcp_hlen = 0xa0;
 
@@ -219,7 +300,7 @@ void net_set_syn_options(union tcp_build_pkt *b)
 	b->ip.mss.len = TCP_OPT_LEN_4;
 	b->ip.mss.mss = htons(TCP_MSS);
 	b->ip.scale.kind = TCP_O_SCL;
-	b->ip.scale.scale = TCP_SCALE;
+	b->ip.scale.scale = tcp_rcv_scale;
 	b->ip.scale.len = TCP_OPT_LEN_3;
 	if (IS_ENABLED(CONFIG_PROT_TCP_SACK)) {
 		b->ip.sack_p.kind = TCP_P_SACK;
@@ -318,7 +399,18 @@ int tcp_set_tcp_header(uchar *pkt, int dport, int sport, int payload_len,
 	pkt_len	= pkt_hdr_len + payload_len;
 	tcp_len	= pkt_len - IP_HDR_SIZE;
 
-	tcp_ack_edge = tcp_ack_num;
+	/*
+	 * Once the connection is established we always acknowledge all the
+	 * contiguous data received so far, whatever the app asked for, and
+	 * any delayed ACK is now sent
+	 */
+	if (current_tcp_state < TCP_ESTABLISHED) {
+		tcp_ack_edge = tcp_ack_num;
+	} else {
+		tcp_ack_num = tcp_ack_edge;
+		tcp_unacked_segs = 0;
+		tcp_ack_now = false;
+	}
 	/* TCP Header */
 	b->ip.hdr.tcp_ack = htonl(tcp_ack_edge);
 	b->ip.hdr.tcp_src = htons(sport);
@@ -340,7 +432,10 @@ int tcp_set_tcp_header(uchar *pkt, int dport, int sport, int payload_len,
 	 * it is, then the u-boot tftp or nfs kernel netboot should be
 	 * considered.
 	 */
-	b->ip.hdr.tcp_win = htons(PKTBUFSRX * TCP_MSS >> TCP_SCALE);
+	if (!(action & TCP_SYN) && tcp_peer_scale)
+		b->ip.hdr.tcp_win = htons(tcp_rcv_window() >> tcp_rcv_scale);
+	else	/* the window in a SYN is never scaled */
+		b->ip.hdr.tcp_win = htons(min_t(u32, tcp_rcv_window(), 0xffff));
 
 	b->ip.hdr.tcp_xsum = 0;
 	b->ip.hdr.tcp_ugr = 0;
@@ -355,111 +450,106 @@ int tcp_set_tcp_header(uchar *pkt, int dport, int sport, int payload_len,
 }
 
 /**
- * tcp_hole() - Selective Acknowledgment (Essential for fast stream transfer)
- * @tcp_seq_num: TCP sequence start number
- * @len: the length of sequence numbers
+ * tcp_set_sack() - set up the SACK blocks to report received ranges
+ *
+ * The first block holds the most recently received segment, as RFC 2018
+ * asks; the rest follow in sequence order. Only three blocks fit alongside
+ * the timestamp option.
  */
-void tcp_hole(u32 tcp_seq_num, u32 len)
+static void tcp_set_sack(void)
 {
-	u32 idx_sack, sack_in;
-	u32 sack_end = TCP_SACK - 1;
-	u32 hill = 0;
-	enum pkt_state expect = PKT;
-	u32 seq = tcp_seq_num - tcp_seq_init;
-	u32 hol_l = tcp_ack_edge - tcp_seq_init;
-	u32 hol_r = 0;
-
-	/* Place new seq number in correct place in receive array */
-	if (prev_len == 0)
-		prev_len = len;
-
-	idx_sack = sack_idx + ((tcp_seq_num - tcp_ack_edge) / prev_len);
-	if (idx_sack < TCP_SACK) {
-		edge_a[idx_sack].se.l = tcp_seq_num;
-		edge_a[idx_sack].se.r = tcp_seq_num + len;
-		edge_a[idx_sack].st = PKT;
+	unsigned int i, hill = 0;
 
-		/*
-		 * The fin (last) packet is not the same length as data
-		 * packets, and if it's length is recorded and used for
-		 *  array index calculation, calculation breaks.
-		 */
-		if (prev_len < len)
-			prev_len = len;
-	}
+	if (!IS_ENABLED(CONFIG_PROT_TCP_SACK))
+		return;
 
-	debug_cond(DEBUG_DEV_PKT,
-		   "TCP 1 seq %d, edg %d, len %d, sack_idx %d, sack_end %d\n",
-		    seq, hol_l, len, sack_idx, sack_end);
+	tcp_lost.len = TCP_OPT_LEN_2;
+	if (tcp_ooo_last >= 0 && tcp_ooo_last < (int)tcp_ooo_cnt)
+		tcp_lost.hill[hill++] = tcp_ooo[tcp_ooo_last];
+	for (i = 0; i < tcp_ooo_cnt && hill < TCP_SACK_HILLS - 1; i++) {
+		if ((int)i != tcp_ooo_last)
+			tcp_lost.hill[hill++] = tcp_ooo[i];
+	}
+	tcp_lost.len += hill * TCP_OPT_LEN_8;
+}
 
-	/* Right edge of contiguous stream, is the left edge of first hill */
-	hol_l = tcp_seq_num - tcp_seq_init;
-	hol_r = hol_l + len;
+/**
+ * tcp_hole() - track received data, holes and SACK blocks
+ * @tcp_seq_num: TCP sequence start number
+ * @len: the length of sequence numbers
+ *
+ * In-order data moves the ACK edge forward, absorbing any ranges already
+ * received beyond it. Data after a hole is recorded as a range so that it can
+ * be reported in SACK blocks; the app stores it at its final place anyway.
+ */
+void tcp_hole(u32 tcp_seq_num, u32 len)
+{
+	u32 l = tcp_seq_num;
+	u32 r = tcp_seq_num + len;
+	unsigned int i, j;
 
-	if (IS_ENABLED(CONFIG_PROT_TCP_SACK))
-		tcp_lost.len = TCP_OPT_LEN_2;
+	debug_cond(DEBUG_DEV_PKT, "TCP hole seq %u, len %u, edge %u, ranges %u\n",
+		   tcp_seq_num - tcp_seq_init, len,
+		   tcp_ack_edge - tcp_seq_init, tcp_ooo_cnt);
 
-	debug_cond(DEBUG_DEV_PKT,
-		   "TCP 1 in %d, seq %d, pkt_l %d, pkt_r %d, sack_idx %d, sack_end %d\n",
-		   idx_sack, seq, hol_l, hol_r, sack_idx, sack_end);
-
-	for (sack_in = sack_idx; sack_in < sack_end && hill < TCP_SACK_HILLS;
-	     sack_in++)  {
-		switch (expect) {
-		case NOPKT:
-			switch (edge_a[sack_in].st) {
-			case NOPKT:
-				debug_cond(DEBUG_INT_STATE, "N");
-				break;
-			case PKT:
-				debug_cond(DEBUG_INT_STATE, "n");
-				if (IS_ENABLED(CONFIG_PROT_TCP_SACK)) {
-					tcp_lost.hill[hill].l =
-						edge_a[sack_in].se.l;
-					tcp_lost.hill[hill].r =
-						edge_a[sack_in].se.r;
-				}
-				expect = PKT;
-				break;
-			}
-			break;
-		case PKT:
-			switch (edge_a[sack_in].st) {
-			case NOPKT:
-				debug_cond(DEBUG_INT_STATE, "p");
-				if (sack_in > sack_idx &&
-				    hill < TCP_SACK_HILLS) {
-					hill++;
-					if (IS_ENABLED(CONFIG_PROT_TCP_SACK))
-						tcp_lost.len += TCP_OPT_LEN_8;
-				}
-				expect = NOPKT;
-				break;
-			case PKT:
-				debug_cond(DEBUG_INT_STATE, "P");
-
-				if (tcp_ack_edge == edge_a[sack_in].se.l) {
-					tcp_ack_edge = edge_a[sack_in].se.r;
-					edge_a[sack_in].st = NOPKT;
-					sack_idx++;
-				} else {
-					if (IS_ENABLED(CONFIG_PROT_TCP_SACK) &&
-					    hill < TCP_SACK_HILLS)
-						tcp_lost.hill[hill].r =
-							edge_a[sack_in].se.r;
-				if (IS_ENABLED(CONFIG_PROT_TCP_SACK) &&
-				    sack_in == sack_end - 1)
-					tcp_lost.hill[hill].r =
-						edge_a[sack_in].se.r;
-				}
-				break;
+	if (SEQ_LEQ(r, tcp_ack_edge)) {
+		/* Duplicate: the sender needs to hear from us */
+		tcp_ack_now = true;
+		return;
+	}
+	if (SEQ_LT(l, tcp_ack_edge))
+		l = tcp_ack_edge;
+
+	if (l == tcp_ack_edge) {
+		tcp_ack_edge = r;
+		tcp_unacked_segs++;
+		/* Absorb any ranges which are now contiguous */
+		while (tcp_ooo_cnt && SEQ_LEQ(tcp_ooo[0].l, tcp_ack_edge)) {
+			if (SEQ_LT(tcp_ack_edge, tcp_ooo[0].r))
+				tcp_ack_edge = tcp_ooo[0].r;
+			memmove(&tcp_ooo[0], &tcp_ooo[1],
+				--tcp_ooo_cnt * sizeof(tcp_ooo[0]));
+			tcp_ooo_last = -1;
+			tcp_ack_now = true;
+		}
+	} else {
+		tcp_ack_now = true;
+
+		/* Find the first range which ends at or after this one starts */
+		for (i = 0; i < tcp_ooo_cnt && SEQ_LT(tcp_ooo[i].r, l); i++)
+			;
+		if (i < tcp_ooo_cnt && SEQ_LEQ(tcp_ooo[i].l, r)) {
+			/* Merge with this range and any it now reaches */
+			if (SEQ_LT(l, tcp_ooo[i].l))
+				tcp_ooo[i].l = l;
+			if (SEQ_LT(tcp_ooo[i].r, r))
+				tcp_ooo[i].r = r;
+			for (j = i + 1; j < tcp_ooo_cnt &&
+			     SEQ_LEQ(tcp_ooo[j].l, tcp_ooo[i].r); j++) {
+				if (SEQ_LT(tcp_ooo[i].r, tcp_ooo[j].r))
+					tcp_ooo[i].r = tcp_ooo[j].r;
 			}
-			break;
+			memmove(&tcp_ooo[i + 1], &tcp_ooo[j],
+				(tcp_ooo_cnt - j) * sizeof(tcp_ooo[0]));
+			tcp_ooo_cnt -= j - i - 1;
+			tcp_ooo_last = i;
+		} else if (i < TCP_SACK) {
+			/*
+			 * Insert a new range, dropping the highest one if the
+			 * list is full; the sender will resend that data.
+			 */
+			if (tcp_ooo_cnt == TCP_SACK)
+				tcp_ooo_cnt--;
+			memmove(&tcp_ooo[i + 1], &tcp_ooo[i],
+				(tcp_ooo_cnt - i) * sizeof(tcp_ooo[0]));
+			tcp_ooo[i].l = l;
+			tcp_ooo[i].r = r;
+			tcp_ooo_cnt++;
+			tcp_ooo_last = i;
 		}
 	}
-	debug_cond(DEBUG_INT_STATE, "\n");
-	if (!IS_ENABLED(CONFIG_PROT_TCP_SACK) || tcp_lost.len <= TCP_OPT_LEN_2)
-		sack_idx = 0;
+
+	tcp_set_sack();
 }
 
 /**
@@ -472,31 +562,33 @@ void tcp_parse_options(uchar *o, int o_len)
 	struct tcp_t_opt  *tsopt;
 	uchar *p = o;
 
-	/*
-	 * NOPs are options with a zero length, and thus are special.
-	 * All other options have length fields.
-	 */
-	for (p = o; p < (o + o_len); p = p + p[1]) {
-		if (!p[1])
-			return; /* Finished processing options */
+	while (p < o + o_len) {
+		/* NOPs and the end marker are single bytes */
+		if (p[0] == TCP_O_END)
+			return;
+		if (p[0] == TCP_1_NOP) {
+			p++;
+			continue;
+		}
+		if (p + 1 >= o + o_len || p[1] < TCP_OPT_LEN_2)
+			return;
 
 		switch (p[0]) {
-		case TCP_O_END:
-			return;
-		case TCP_O_MSS:
 		case TCP_O_SCL:
+			tcp_peer_scale = true;
+			break;
 		case TCP_P_SACK:
-		case TCP_V_SACK:
+			tcp_peer_sack = true;
 			break;
 		case TCP_O_TS:
 			tsopt = (struct tcp_t_opt *)p;
 			rmt_timestamp = tsopt->t_snd;
-			return;
+			break;
+		case TCP_O_MSS:
+		case TCP_V_SACK:
+			break;
 		}
-
-		/* Process optional NOPs */
-		if (p[0] == TCP_O_NOP)
-			p++;
+		p += p[1];
 	}
 }
 
@@ -508,7 +600,6 @@ static u8 tcp_state_machine(u8 tcp_flags, u32 tcp_seq_num, int payload_len)
 	u8 tcp_push = tcp_flags & TCP_PUSH;
 	u8 tcp_ack = tcp_flags & TCP_ACK;
 	u8 action = TCP_DATA;
-	int i;
 
 	/*
 	 * tcp_flags are examined to determine TX action in a given state
@@ -551,13 +642,9 @@ static u8 tcp_state_machine(u8 tcp_flags, u32 tcp_seq_num, int payload_len)
 			action |= TCP_ACK;
 			tcp_seq_init = tcp_seq_num;
 			tcp_ack_edge = tcp_seq_num + 1;
-			sack_idx = 0;
-			edge_a[sack_idx].se.l = tcp_ack_edge;
-			edge_a[sack_idx].se.r = tcp_ack_edge;
-			prev_len = 0;
+			tcp_ooo_cnt = 0;
+			tcp_ooo_last = -1;
 			current_tcp_state = TCP_ESTABLISHED;
-			for (i = 0; i < TCP_SACK; i++)
-				edge_a[i].st = NOPKT;
 
 			if (tcp_syn && tcp_ack)
 				action |= TCP_PUSH;
@@ -572,9 +659,10 @@ static u8 tcp_state_machine(u8 tcp_flags, u32 tcp_seq_num, int payload_len)
 			tcp_fin = TCP_DATA;  /* cause standalone FIN */
 		}
 
-		if ((tcp_fin) &&
-		    (!IS_ENABLED(CONFIG_PROT_TCP_SACK) ||
-		     tcp_lost.len <= TCP_OPT_LEN_2)) {
+		/* Only accept a FIN once all the data before it is here */
+		if (tcp_fin && !tcp_ooo_cnt &&
+		    tcp_seq_num + payload_len == tcp_ack_edge) {
+			tcp_ack_edge++;
 			action = action | TCP_FIN | TCP_PUSH | TCP_ACK;
 			current_tcp_state = TCP_CLOSE_WAIT;
 		} else if (tcp_ack) {
@@ -8,6 +8,7 @@
 #include <common.h>
 #include <command.h>
 #include <display_options.h>
+#include <div64.h>
 #include <efi_loader.h>
 #include <env.h>
 #include <image.h>
@@ -98,6 +99,21 @@ static ushort	tftp_windowsize;
 static ushort	tftp_next_ack;
 /* Last nack block we send */
 static ushort	tftp_last_nack;
+/*
+ * Reassembly bitmap for blocks received ahead of a gap. Bit n is set when
+ * the block whose 16-bit sequence number is n modulo TFTP_REASM_BLOCKS has
+ * already been stored at its final address.
+ */
+#define TFTP_REASM_BLOCKS	1024
+static u8	tftp_reasm_map[TFTP_REASM_BLOCKS / 8];
+/* Sequence number of the short (final) block, if it arrived out of order */
+static ushort	tftp_final_block;
+static bool	tftp_final_seen;
+/* Transfer statistics, used to adapt the options for the next transfer */
+static ulong	tftp_blocks_rcvd;
+static ulong	tftp_ooo_blocks;
+static ulong	tftp_gaps;
+static ulong	tftp_timeouts;
 #ifdef CONFIG_CMD_TFTPPUT
 /* 1 if writing, else 0 */
 static int	tftp_put_active;
@@ -152,6 +168,36 @@ static char tftp_filename[MAX_LEN];
 static unsigned short tftp_block_size = TFTP_BLOCK_SIZE;
 static unsigned short tftp_block_size_option = CONFIG_TFTP_BLOCKSIZE;
 static unsigned short tftp_window_size_option = TFTP_WINDOWSIZE;
+/*
+ * Options requested in the RRQ. With CONFIG_TFTP_ADAPTIVE these are adjusted
+ * after each transfer according to the loss seen, bounded by the options
+ * above; otherwise they are the same.
+ */
+static unsigned short tftp_block_size_req;
+static unsigned short tftp_window_size_req;
+static unsigned short tftp_adapt_block_size;
+static unsigned short tftp_adapt_window_size;
+
+/* Block size below which a block fits in one Ethernet frame */
+#define TFTP_UNFRAG_BLOCKSIZE	1468
+
+#ifdef CONFIG_TFTP_MULTICAST
+/*
+ * Multicast transfer (RFC 2090). The server sends each block once to the
+ * group and only the master client ACKs. Since the master ACKs the last block
+ * of its contiguous run, that ACK asks for its first missing block, which all
+ * clients then see again. Blocks may therefore arrive in any order; each is
+ * stored at its final address and marked in tftp_mcast_map.
+ */
+static bool	tftp_mcast_active;
+static bool	tftp_mcast_master;
+static int	tftp_mcast_port;
+/* First block not yet received */
+static ulong	tftp_mcast_next;
+/* The short (final) block, 0 until it has arrived */
+static ulong	tftp_mcast_final;
+static u8	tftp_mcast_map[TFTP_SEQUENCE_SIZE / 8];
+#endif
 
 static inline int store_block(int block, uchar *src, unsigned int len)
 {
@@ -184,12 +230,37 @@ static inline int store_block(int block, uchar *src, unsigned int len)
 	return 0;
 }
 
+static bool reasm_test(ushort block)
+{
+	block %= TFTP_REASM_BLOCKS;
+
+	return tftp_reasm_map[block / 8] & (1 << (block % 8));
+}
+
+static void reasm_set(ushort block)
+{
+	block %= TFTP_REASM_BLOCKS;
+	tftp_reasm_map[block / 8] |= 1 << (block % 8);
+}
+
+static void reasm_clear(ushort block)
+{
+	block %= TFTP_REASM_BLOCKS;
+	tftp_reasm_map[block / 8] &= ~(1 << (block % 8));
+}
+
 /* Clear our state ready for a new transfer */
 static void new_transfer(void)
 {
 	tftp_prev_block = 0;
 	tftp_block_wrap = 0;
 	tftp_block_wrap_offset = 0;
+	memset(tftp_reasm_map, '\0', sizeof(tftp_reasm_map));
+	tftp_final_seen = false;
+	tftp_blocks_rcvd = 0;
+	tftp_ooo_blocks = 0;
+	tftp_gaps = 0;
+	tftp_timeouts = 0;
 #ifdef CONFIG_CMD_TFTPPUT
 	tftp_put_final_block_sent = 0;
 #endif
@@ -283,6 +354,33 @@ static void update_block_number(void)
 	show_block_marker();
 }
 
+/*
+ * Adjust the window and block size requested by the next transfer according
+ * to the loss measured in this one. More than 1% of blocks lost halves the
+ * window and, if blocks are being fragmented, drops back to a block which
+ * fits in one frame, since losing one fragment loses the whole block. Less
+ * than 0.1% lost doubles both again, up to the configured options.
+ */
+static void tftp_adapt(void)
+{
+	ulong lost = tftp_gaps + tftp_timeouts;
+	ulong blocks = max(tftp_blocks_rcvd, 1UL);
+
+	if (!IS_ENABLED(CONFIG_TFTP_ADAPTIVE) || tftp_put_active)
+		return;
+
+	if (lost * 100 > blocks) {
+		tftp_adapt_window_size = max(tftp_windowsize / 2, 1);
+		if (tftp_block_size > TFTP_UNFRAG_BLOCKSIZE)
+			tftp_adapt_block_size = TFTP_UNFRAG_BLOCKSIZE;
+	} else if (lost * 1000 < blocks) {
+		tftp_adapt_window_size = min(tftp_windowsize * 2, 0xffff);
+		tftp_adapt_block_size = min(tftp_block_size * 2, 0xffff);
+	}
+	debug("TFTP lost %lu of %lu blocks, next window %d, blksize %d\n",
+	      lost, blocks, tftp_adapt_window_size, tftp_adapt_block_size);
+}
+
 /* The TFTP get or put is complete */
 static void tftp_complete(void)
 {
@@ -298,9 +396,15 @@ static void tftp_complete(void)
 	time_start = get_timer(time_start);
 	if (time_start > 0) {
 		puts("\n\t ");	/* Line up with "Loading: " */
-		print_size(net_boot_file_size /
-			time_start * 1000, "/s");
+		print_size(lldiv((u64)net_boot_file_size * 1000, time_start),
+			   "/s");
 	}
+	if (!tftp_put_active && (tftp_windowsize > 1 || tftp_gaps)) {
+		printf("\n\t window %d, blksize %d, %lu out of order, %lu re-ACKs",
+		       tftp_windowsize, tftp_block_size, tftp_ooo_blocks,
+		       tftp_gaps);
+	}
+	tftp_adapt();
 	puts("\ndone\n");
 	if (IS_ENABLED(CONFIG_CMD_BOOTEFI)) {
 		if (!tftp_put_active)
@@ -356,15 +460,21 @@ static void tftp_send(void)
 #endif
 		/* try for more effic. blk size */
 		pkt += sprintf((char *)pkt, "blksize%c%d%c",
-				0, tftp_block_size_option, 0);
+				0, tftp_block_size_req, 0);
 
 		/* try for more effic. window size.
 		 * Implemented only for tftp get.
 		 * Don't bother sending if it's 1
 		 */
-		if (tftp_state == STATE_SEND_RRQ && tftp_window_size_option > 1)
+		if (tftp_state == STATE_SEND_RRQ && tftp_window_size_req > 1)
 			pkt += sprintf((char *)pkt, "windowsize%c%d%c",
-					0, tftp_window_size_option, 0);
+					0, tftp_window_size_req, 0);
+#ifdef CONFIG_TFTP_MULTICAST
+		/* RFC 2090: the option is sent with an empty value */
+		if (tftp_state == STATE_SEND_RRQ &&
+		    !(IS_ENABLED(CONFIG_IPV6) && use_ip6))
+			pkt += sprintf((char *)pkt, "multicast%c%c", 0, 0);
+#endif
 		len = pkt - xp;
 		break;
 
@@ -442,6 +552,112 @@ static void tftp_send(void)
 		net_set_state(NETLOOP_FAIL);
 }
 
+#ifdef CONFIG_TFTP_MULTICAST
+static bool mcast_test(ulong block)
+{
+	return tftp_mcast_map[block / 8] & (1 << (block % 8));
+}
+
+/*
+ * Handle the value of the "multicast" option, "<addr>,<port>,<mc>". The group
+ * address and port are only given in the first OACK; later ones just change
+ * which client is master.
+ */
+static int mcast_option(const char *opt)
+{
+	const char *port, *mc;
+	struct in_addr addr;
+	int ret;
+
+	port = strchr(opt, ',');
+	mc = port ? strchr(port + 1, ',') : NULL;
+	if (!mc)
+		return -EINVAL;
+	tftp_mcast_master = dectoul(mc + 1, NULL) == 1;
+	if (tftp_mcast_active)
+		return 0;
+
+	addr = string_to_ip(opt);
+	tftp_mcast_port = dectoul(port + 1, NULL);
+	if ((ntohl(addr.s_addr) & 0xf0000000) != 0xe0000000 ||
+	    !tftp_mcast_port) {
+		printf("Invalid multicast option '%s'\n", opt);
+		return -EINVAL;
+	}
+	ret = eth_mcast_join(addr, 1);
+	if (ret) {
+		printf("Cannot join multicast group %pI4 (err=%d)\n", &addr,
+		       ret);
+		return ret;
+	}
+	debug("Multicast %pI4:%d, %smaster\n", &addr, tftp_mcast_port,
+	      tftp_mcast_master ? "" : "not ");
+	net_mcast_addr = addr;
+	tftp_mcast_active = true;
+	tftp_mcast_next = 1;
+	tftp_mcast_final = 0;
+	memset(tftp_mcast_map, '\0', sizeof(tftp_mcast_map));
+
+	return 0;
+}
+
+/* A later OACK, sent by the server when it chooses a new master */
+static void mcast_oack(uchar *pkt, unsigned len)
+{
+	int i;
+
+	for (i = 0; i + 10 < len; i++) {
+		if (strcasecmp((char *)pkt + i, "multicast") == 0)
+			mcast_option((char *)pkt + i + 10);
+	}
+
+	/* Tell the server where we are up to */
+	if (tftp_mcast_master)
+		tftp_send();
+}
+
+static void mcast_data(ushort block, uchar *pkt, unsigned len)
+{
+	if (block && !mcast_test(block) &&
+	    (!tftp_mcast_final || block < tftp_mcast_final)) {
+		if (block == TFTP_SEQUENCE_SIZE - 1 && len == tftp_block_size) {
+			puts("\nTFTP error: file too large for multicast\n");
+			eth_halt();
+			net_set_state(NETLOOP_FAIL);
+			return;
+		}
+		if (store_block(block, pkt, len)) {
+			eth_halt();
+			net_set_state(NETLOOP_FAIL);
+			return;
+		}
+		tftp_mcast_map[block / 8] |= 1 << (block % 8);
+		tftp_blocks_rcvd++;
+		if (block != tftp_mcast_next)
+			tftp_ooo_blocks++;
+		if (len < tftp_block_size)
+			tftp_mcast_final = block;
+
+		while (tftp_mcast_next < TFTP_SEQUENCE_SIZE &&
+		       mcast_test(tftp_mcast_next)) {
+			tftp_cur_block = tftp_mcast_next++;
+			show_block_marker();
+		}
+	}
+	net_set_timeout_handler(timeout_ms, tftp_timeout_handler);
+
+	/*
+	 * The ACK (from the master) or a timeout (from the others) carries the
+	 * last block of the contiguous run, i.e. asks for the next one
+	 */
+	tftp_cur_block = tftp_mcast_next - 1;
+	if (tftp_mcast_master)
+		tftp_send();
+	if (tftp_mcast_final && tftp_mcast_next > tftp_mcast_final)
+		tftp_complete();
+}
+#endif
+
 #ifdef CONFIG_CMD_TFTPPUT
 static void icmp_handler(unsigned type, unsigned code, unsigned dest,
 			 struct in_addr sip, unsigned src, uchar *pkt,
@@ -463,6 +679,9 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 	u16 timeout_val_rcvd;
 
 	if (dest != tftp_our_port) {
+#ifdef CONFIG_TFTP_MULTICAST
+		if (!tftp_mcast_active || dest != tftp_mcast_port)
+#endif
 			return;
 	}
 	if (tftp_state != STATE_SEND_RRQ && src != tftp_remote_port &&
@@ -526,6 +745,12 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 				debug("%c", pkt[i]);
 		}
 		debug("\n");
+#ifdef CONFIG_TFTP_MULTICAST
+		if (tftp_mcast_active) {
+			mcast_oack(pkt, len);
+			break;
+		}
+#endif
 		tftp_state = STATE_OACK;
 		tftp_remote_port = src;
 		/*
@@ -570,10 +795,26 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 				debug("windowsize = %s, %d\n",
 				      (char *)pkt + i + 11, tftp_windowsize);
 			}
+#ifdef CONFIG_TFTP_MULTICAST
+			if (strcasecmp((char *)pkt + i, "multicast") == 0 &&
+			    tftp_state == STATE_OACK &&
+			    mcast_option((char *)pkt + i + 10))
+				tftp_state = STATE_INVALID_OPTION;
+#endif
 		}
 
 		tftp_next_ack = tftp_windowsize;
 
+#ifdef CONFIG_TFTP_MULTICAST
+		if (tftp_mcast_active && tftp_state == STATE_OACK) {
+			/* Only the master ACKs; the others wait for data */
+			new_transfer();
+			tftp_state = STATE_DATA;
+			if (!tftp_mcast_master)
+				break;
+		}
+#endif
+
 #ifdef CONFIG_CMD_TFTPPUT
 		if (tftp_put_active && tftp_state == STATE_OACK) {
 			/* Get ready to send the first block */
@@ -588,10 +829,18 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 			return;
 		len -= 2;
 
+#ifdef CONFIG_TFTP_MULTICAST
+		if (tftp_mcast_active) {
+			mcast_data(ntohs(*(__be16 *)pkt), pkt + 2, len);
+			break;
+		}
+#endif
 		if (ntohs(*(__be16 *)pkt) != (ushort)(tftp_cur_block + 1)) {
+			ushort block = ntohs(*(__be16 *)pkt);
+			ushort ahead = block - (ushort)(tftp_cur_block + 1);
+
 			debug("Received unexpected block: %d, expected: %d\n",
-			      ntohs(*(__be16 *)pkt),
-			      (ushort)(tftp_cur_block + 1));
+			      block, (ushort)(tftp_cur_block + 1));
 			/*
 			 * Only ACK if the block count received is greater than
 			 * the expected block count, otherwise skip ACK.
@@ -600,6 +849,28 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 			 */
 			if ((ushort)(tftp_cur_block + 1) - (short)(ntohs(*(__be16 *)pkt)) > 0)
 				break;
+
+			/*
+			 * Keep blocks which arrive after a gap, storing them
+			 * straight at their final address, so that only the
+			 * missing ones need to come again
+			 */
+			if (tftp_state == STATE_DATA &&
+			    ahead < TFTP_REASM_BLOCKS && !reasm_test(block)) {
+				if (store_block(tftp_cur_block + 1 + ahead,
+						pkt + 2, len)) {
+					eth_halt();
+					net_set_state(NETLOOP_FAIL);
+					break;
+				}
+				reasm_set(block);
+				tftp_ooo_blocks++;
+				if (len < tftp_block_size) {
+					tftp_final_block = block;
+					tftp_final_seen = true;
+				}
+			}
+
 			/*
 			 * If one packet is dropped most likely
 			 * all other buffers in the window
@@ -611,6 +882,7 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 				tftp_last_nack = tftp_cur_block;
 				tftp_next_ack = (ushort)(tftp_cur_block +
 							 tftp_windowsize);
+				tftp_gaps++;
 			}
 			break;
 		}
@@ -655,6 +927,7 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 			net_set_state(NETLOOP_FAIL);
 			break;
 		}
+		tftp_blocks_rcvd++;
 
 		if (len < tftp_block_size) {
 			tftp_send();
@@ -662,6 +935,35 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 			break;
 		}
 
+		/* Move past any blocks that already arrived after the gap */
+		reasm_clear(tftp_cur_block);
+		if (reasm_test(tftp_cur_block + 1)) {
+			while (reasm_test(tftp_cur_block + 1)) {
+				tftp_cur_block++;
+				tftp_cur_block %= TFTP_SEQUENCE_SIZE;
+				reasm_clear(tftp_cur_block);
+				update_block_number();
+				tftp_prev_block = tftp_cur_block;
+				tftp_blocks_rcvd++;
+				if (tftp_final_seen &&
+				    tftp_cur_block == tftp_final_block) {
+					tftp_send();
+					tftp_complete();
+					return;
+				}
+			}
+
+			/*
+			 * Acknowledge the highest block we now have straight
+			 * away, so the server moves on rather than sending
+			 * the rest of the window again
+			 */
+			tftp_send();
+			tftp_next_ack = (ushort)(tftp_cur_block +
+						 tftp_windowsize);
+			break;
+		}
+
 		/*
 		 *	Acknowledge the block just received, which will prompt
 		 *	the remote for the next one.
@@ -704,6 +1006,7 @@ static void tftp_timeout_handler(void)
 		restart("Retry count exceeded");
 	} else {
 		puts("T ");
+		tftp_timeouts++;
 		net_set_timeout_handler(timeout_ms, tftp_timeout_handler);
 		if (tftp_state != STATE_RECV_WRQ)
 			tftp_send();
@@ -815,8 +1118,20 @@ void tftp_start(enum proto_t protocol)
 
 	sanitize_tftp_block_size_option(protocol);
 
+	tftp_block_size_req = tftp_block_size_option;
+	tftp_window_size_req = tftp_window_size_option;
+	if (IS_ENABLED(CONFIG_TFTP_ADAPTIVE) && protocol == TFTPGET) {
+		if (tftp_adapt_block_size)
+			tftp_block_size_req = clamp_t(int, tftp_adapt_block_size,
+						      TFTP_BLOCK_SIZE,
+						      tftp_block_size_option);
+		if (tftp_adapt_window_size)
+			tftp_window_size_req = min(tftp_adapt_window_size,
+						   tftp_window_size_option);
+	}
+
 	debug("TFTP blocksize = %i, TFTP windowsize = %d timeout = %ld ms\n",
-	      tftp_block_size_option, tftp_window_size_option, timeout_ms);
+	      tftp_block_size_req, tftp_window_size_req, timeout_ms);
 
 	if (IS_ENABLED(CONFIG_IPV6))
 		tftp_remote_ip6 = net_server_ip6;
@@ -862,6 +1177,8 @@ void tftp_start(enum proto_t protocol)
 
 		if (tftp_block_size_option > TFTP_MTU_BLOCKSIZE6)
 			tftp_block_size_option = TFTP_MTU_BLOCKSIZE6;
+		if (tftp_block_size_req > TFTP_MTU_BLOCKSIZE6)
+			tftp_block_size_req = TFTP_MTU_BLOCKSIZE6;
 	} else {
 		printf("TFTP %s server %pI4; our IP address is %pI4",
 #ifdef CONFIG_CMD_TFTPPUT
@@ -946,6 +1263,10 @@ void tftp_start(enum proto_t protocol)
 	tftp_cur_block = 0;
 	tftp_windowsize = 1;
 	tftp_last_nack = 0;
+#ifdef CONFIG_TFTP_MULTICAST
+	tftp_mcast_active = false;
+	tftp_mcast_master = false;
+#endif
 	/* zero out server ether in case the server ip has changed */
 	memset(net_server_ethaddr, 0, 6);
 	/* Revert tftp_block_size to dflt */
@@ -4,13 +4,18 @@
  * Copyright Duncan Hare <dh@synoia.com> 2017
  */
 
+#include <blk.h>
 #include <command.h>
 #include <common.h>
 #include <display_options.h>
 #include <env.h>
 #include <image.h>
+#include <malloc.h>
 #include <mapmem.h>
+#include <mtd.h>
 #include <net.h>
+#include <part.h>
+#include <linux/ctype.h>
 #include <net/tcp.h>
 #include <net/wget.h>
 
@@ -18,17 +23,17 @@
 #define SERVER_PORT		80
 
 static const char bootfile1[] = "GET ";
-static const char bootfile3[] = " HTTP/1.0\r\n\r\n";
+static const char bootfile3[] = " HTTP/1.0\r\n";
 static const char http_eom[] = "\r\n\r\n";
-static const char http_ok[] = "200";
 static const char content_len[] = "Content-Length";
+static const char content_range[] = "Content-Range: bytes ";
 static const char linefeed[] = "\r\n";
 static struct in_addr web_server_ip;
 static int our_port;
 static int wget_timeout_count;
 
 struct pkt_qd {
-	uchar *pkt;
+	ulong addr;
 	unsigned int tcp_seq_num;
 	unsigned int len;
 };
@@ -46,6 +51,48 @@ static unsigned int packets;
 
 static unsigned int initial_data_seq_num;
 
+#define HTTP_STATUS_OK		200
+#define HTTP_STATUS_PARTIAL	206
+
+/*
+ * After a lost connection the download is resumed by asking for the rest of
+ * the file with a Range header. The server may ignore that and send the
+ * whole file again, so the body starts at wget_range_base, which is 0 or
+ * wget_range_start.
+ */
+static ulong wget_range_start;	/* file offset asked for in the request */
+static ulong wget_range_base;	/* file offset of the first byte of the body */
+static ulong wget_done;		/* bytes of the file received in order */
+static int wget_resume_count;
+
+/**
+ * struct wget_stream - write-behind state when downloading to storage
+ *
+ * @desc: Block device to write to, or NULL
+ * @start: First block of the partition on @desc
+ * @mtd: MTD device to write to, or NULL
+ * @pos: Offset in @mtd of the next write, which is past @base if bad blocks
+ *	have been skipped
+ * @limit: Size of the partition in bytes
+ * @align: Writes are a multiple of this many bytes
+ * @buf: Write-behind buffer, followed by space for the packet queue
+ * @size: Size of the write-behind part of @buf in bytes
+ * @base: File offset of @buf[0]; everything before this has been written
+ */
+struct wget_stream {
+	struct blk_desc *desc;
+	lbaint_t start;
+	struct mtd_info *mtd;
+	loff_t pos;
+	u64 limit;
+	ulong align;
+	uchar *buf;
+	ulong size;
+	ulong base;
+};
+
+static struct wget_stream wget_stream;
+
 static enum  wget_state current_wget_state;
 
 static char *image_url;
@@ -59,22 +106,168 @@ static unsigned int retry_tcp_ack_num;	/* TCP retry acknowledge number*/
 static unsigned int retry_tcp_seq_num;	/* TCP retry sequence number */
 static int retry_len;			/* TCP retry length */
 
+static bool wget_resume(void);
+
+static bool wget_to_storage(void)
+{
+	return IS_ENABLED(CONFIG_WGET_STORAGE) && wget_stream.buf;
+}
+
 /**
- * store_block() - store block in memory
+ * wget_stream_write() - write from the start of the write-behind buffer
+ * @len: number of bytes to write, a multiple of the alignment
+ *
+ * Return: 0 if OK, -ve on error
+ */
+static int wget_stream_write(ulong len)
+{
+	struct wget_stream *s = &wget_stream;
+	struct mtd_info *mtd = s->mtd;
+	uchar *buf = s->buf;
+	size_t chunk, retlen;
+	lbaint_t cnt;
+	int ret;
+
+	if (s->base + len > s->limit)
+		return -EFBIG;
+
+	if (s->desc) {
+		cnt = len / s->desc->blksz;
+		if (blk_dwrite(s->desc, s->start + s->base / s->desc->blksz,
+			       cnt, buf) != cnt)
+			return -EIO;
+		return 0;
+	}
+
+	if (!IS_ENABLED(CONFIG_MTD))
+		return -ENOSYS;
+	while (len) {
+		if (!(s->pos % mtd->erasesize)) {
+			struct erase_info erase = {
+				.mtd = mtd,
+				.len = mtd->erasesize,
+			};
+
+			while (s->pos < mtd->size &&
+			       mtd_block_isbad(mtd, s->pos) > 0) {
+				printf("Skipping bad block at 0x%llx\n", s->pos);
+				s->pos += mtd->erasesize;
+			}
+			if (s->pos >= mtd->size)
+				return -EFBIG;
+			erase.addr = s->pos;
+			ret = mtd_erase(mtd, &erase);
+			if (ret)
+				return ret;
+		}
+		chunk = min_t(ulong, len,
+			      mtd->erasesize - s->pos % mtd->erasesize);
+		ret = mtd_write(mtd, s->pos, chunk, &retlen, buf);
+		if (ret)
+			return ret;
+		s->pos += chunk;
+		buf += chunk;
+		len -= chunk;
+	}
+
+	return 0;
+}
+
+/**
+ * wget_stream_flush() - write out the data received in order
+ * @final: true at the end of the file, to write everything that is left,
+ *	padded to the alignment. Otherwise nothing is written until half the
+ *	buffer is full, so that writes are large.
+ *
+ * Return: 0 if OK, -ve on error
+ */
+static int wget_stream_flush(bool final)
+{
+	struct wget_stream *s = &wget_stream;
+	ulong len, top;
+	int ret;
+
+	if (final) {
+		len = net_boot_file_size - s->base;
+		if (!len)
+			return 0;
+		top = roundup(len, s->align);
+		memset(s->buf + len, s->desc ? 0 : 0xff, top - len);
+		len = top;
+	} else {
+		len = wget_done - s->base;
+		if (len < s->size / 2)
+			return 0;
+		len = rounddown(len, s->align);
+	}
+
+	ret = wget_stream_write(len);
+	if (ret) {
+		printf("wget: Write failed at offset 0x%lx (err=%d)\n",
+		       s->base, ret);
+		return ret;
+	}
+
+	/* Keep anything which has arrived after a hole */
+	top = net_boot_file_size - s->base;
+	if (top > len)
+		memmove(s->buf, s->buf + len, top - len);
+	s->base += len;
+
+	return 0;
+}
+
+/**
+ * wget_stream_store() - put data into the write-behind buffer
  * @src: source of data
- * @offset: offset
+ * @pos: offset in the file
+ * @len: length
+ *
+ * Return: 0 if OK, -ve on error
+ */
+static int wget_stream_store(uchar *src, ulong pos, unsigned int len)
+{
+	struct wget_stream *s = &wget_stream;
+
+	/* This can be sent again by a server which ignored a Range */
+	if (pos + len <= s->base)
+		return 0;
+	if (pos < s->base) {
+		src += s->base - pos;
+		len -= s->base - pos;
+		pos = s->base;
+	}
+	if (pos + len > s->base + s->size) {
+		printf("wget: Write-behind buffer too small\n");
+		return -ENOSPC;
+	}
+	memcpy(s->buf + pos - s->base, src, len);
+
+	return 0;
+}
+
+/**
+ * store_block() - store block in memory, or in the write-behind buffer
+ * @src: source of data
+ * @offset: offset in the HTTP body
  * @len: length
  */
 static inline int store_block(uchar *src, unsigned int offset, unsigned int len)
 {
-	ulong newsize = offset + len;
+	ulong pos = wget_range_base + offset;
+	ulong newsize = pos + len;
 	uchar *ptr;
 
-	ptr = map_sysmem(image_load_addr + offset, len);
-	memcpy(ptr, src, len);
-	unmap_sysmem(ptr);
+	if (wget_to_storage()) {
+		if (wget_stream_store(src, pos, len))
+			return -1;
+	} else {
+		ptr = map_sysmem(image_load_addr + pos, len);
+		memcpy(ptr, src, len);
+		unmap_sysmem(ptr);
+	}
 
-	if (net_boot_file_size < (offset + len))
+	if (net_boot_file_size < newsize)
 		net_boot_file_size = newsize;
 
 	return 0;
@@ -124,6 +317,14 @@ static void wget_send_stored(void)
 
 		memcpy(offset, &bootfile3, strlen(bootfile3));
 		offset += strlen(bootfile3);
+
+		if (wget_range_start)
+			offset += sprintf((char *)offset,
+					  "Range: bytes=%lu-\r\n",
+					  wget_range_start);
+
+		memcpy(offset, &linefeed, strlen(linefeed));
+		offset += strlen(linefeed);
 		net_send_tcp_packet((offset - ptr), server_port, our_port,
 				    TCP_PUSH, tcp_seq_num, tcp_ack_num);
 		current_wget_state = WGET_CONNECTED;
@@ -168,7 +369,10 @@ void wget_success(u8 action, unsigned int tcp_seq_num,
  */
 static void wget_timeout_handler(void)
 {
-	if (++wget_timeout_count > WGET_RETRY_COUNT) {
+	if (++wget_timeout_count > WGET_RESUME_RETRIES && wget_resume())
+		return;
+
+	if (wget_timeout_count > WGET_RETRY_COUNT) {
 		puts("\nRetry count exceeded; starting again\n");
 		wget_send(TCP_RST, 0, 0, 0);
 		net_start_again();
@@ -181,16 +385,61 @@ static void wget_timeout_handler(void)
 	}
 }
 
+/*
+ * Send an ACK which the TCP layer held back, waiting for a second segment
+ * which did not arrive in time. If an ACK has gone out since, this just
+ * cancels the timer, since a second ACK for the same data would look like a
+ * duplicate to the server.
+ */
+static void wget_delayed_ack_handler(void)
+{
+	net_set_timeout_handler(wget_timeout, wget_timeout_handler);
+	if (tcp_ack_pending())
+		wget_send_stored();
+}
+
 #define PKT_QUEUE_OFFSET 0x20000
 #define PKT_QUEUE_PACKET_SIZE 0x800
 
+/**
+ * wget_status() - get the status code from the HTTP status line
+ * @pkt: start of the HTTP header, nul-terminated
+ *
+ * Return: status code, e.g. 200, or 0 if there is none
+ */
+static int wget_status(const char *pkt)
+{
+	const char *pos = strchr(pkt, ' ');
+
+	return pos ? simple_strtoul(pos + 1, NULL, 10) : 0;
+}
+
+/**
+ * wget_range_ok() - check that a partial reply starts where we asked
+ * @pkt: start of the HTTP header, nul-terminated
+ *
+ * Return: true if the Content-Range starts at wget_range_start
+ */
+static bool wget_range_ok(const char *pkt)
+{
+	const char *pos = strstr(pkt, content_range);
+
+	if (!pos)
+		return false;
+	pos += sizeof(content_range) - 1;
+
+	return isdigit(*pos) &&
+		simple_strtoul(pos, NULL, 10) == wget_range_start;
+}
+
 static void wget_connected(uchar *pkt, unsigned int tcp_seq_num,
 			   u8 action, unsigned int tcp_ack_num, unsigned int len)
 {
-	uchar *pkt_in_q;
+	ulong pkt_in_q;
 	char *pos;
 	int hlen, i;
 	uchar *ptr1;
+	int status;
 
 	pkt[len] = '\0';
 	pos = strstr((char *)pkt, http_eom);
@@ -198,14 +447,18 @@ static void wget_connected(uchar *pkt, unsigned int tcp_seq_num,
 	if (!pos) {
 		debug_cond(DEBUG_WGET,
 			   "wget: Connected, data before Header %p\n", pkt);
-		pkt_in_q = (void *)image_load_addr + PKT_QUEUE_OFFSET +
-			(pkt_q_idx * PKT_QUEUE_PACKET_SIZE);
+		if (wget_to_storage())
+			pkt_in_q = map_to_sysmem(wget_stream.buf +
+						 wget_stream.size);
+		else
+			pkt_in_q = image_load_addr + PKT_QUEUE_OFFSET;
+		pkt_in_q += pkt_q_idx * PKT_QUEUE_PACKET_SIZE;
 
-		ptr1 = map_sysmem((phys_addr_t)pkt_in_q, len);
+		ptr1 = map_sysmem(pkt_in_q, len);
 		memcpy(ptr1, pkt, len);
 		unmap_sysmem(ptr1);
 
-		pkt_q[pkt_q_idx].pkt = pkt_in_q;
+		pkt_q[pkt_q_idx].addr = pkt_in_q;
 		pkt_q[pkt_q_idx].tcp_seq_num = tcp_seq_num;
 		pkt_q[pkt_q_idx].len = len;
 		pkt_q_idx++;
@@ -229,7 +482,16 @@ static void wget_connected(uchar *pkt, unsigned int tcp_seq_num,
 
 		current_wget_state = WGET_TRANSFERRING;
 
-		if (strstr((char *)pkt, http_ok) == 0) {
+		status = wget_status((char *)pkt);
+		if (status == HTTP_STATUS_PARTIAL &&
+		    !wget_range_ok((char *)pkt)) {
+			wget_fail("Content-Range does not match the request\n",
+				  tcp_seq_num, tcp_ack_num, TCP_RST);
+			net_set_state(NETLOOP_FAIL);
+			return;
+		}
+		if (status != HTTP_STATUS_OK &&
+		    status != HTTP_STATUS_PARTIAL) {
 			debug_cond(DEBUG_WGET,
 				   "wget: Connected Bad Xfer\n");
 			initial_data_seq_num = tcp_seq_num + hlen;
@@ -240,20 +502,27 @@ static void wget_connected(uchar *pkt, unsigned int tcp_seq_num,
 				   "wget: Connctd pkt %p  hlen %x\n",
 				   pkt, hlen);
 			initial_data_seq_num = tcp_seq_num + hlen;
+			if (status == HTTP_STATUS_PARTIAL)
+				wget_range_base = wget_range_start;
+			else
+				wget_range_base = 0;
 
+			content_length = -1;
 			pos = strstr((char *)pkt, content_len);
-			if (!pos) {
-				content_length = -1;
-			} else {
-				pos += sizeof(content_len) + 2;
-				strict_strtoul(pos, 10, &content_length);
+			if (pos) {
+				/* Skip the ": " and any more white space */
+				pos += sizeof(content_len) - 1;
+				if (*pos == ':')
+					pos++;
+				while (*pos == ' ' || *pos == '\t')
+					pos++;
+				if (isdigit(*pos))
+					content_length = simple_strtoul(pos, NULL, 10);
 				debug_cond(DEBUG_WGET,
 					   "wget: Connected Len %lu\n",
 					   content_length);
 			}
 
-			net_boot_file_size = 0;
-
 			if (len > hlen)
 				store_block(pkt + hlen, 0, len - hlen);
 
@@ -262,23 +531,43 @@ static void wget_connected(uchar *pkt, unsigned int tcp_seq_num,
 				   pkt, hlen);
 
 			for (i = 0; i < pkt_q_idx; i++) {
-				ptr1 = map_sysmem(
-					(phys_addr_t)(pkt_q[i].pkt),
-					pkt_q[i].len);
+				ptr1 = map_sysmem(pkt_q[i].addr,
+						  pkt_q[i].len);
 				store_block(ptr1,
 					    pkt_q[i].tcp_seq_num -
 					    initial_data_seq_num,
 					    pkt_q[i].len);
 				unmap_sysmem(ptr1);
 				debug_cond(DEBUG_WGET,
-					   "wget: Connctd pkt Q %p len %x\n",
-					   pkt_q[i].pkt, pkt_q[i].len);
+					   "wget: Connctd pkt Q %lx len %x\n",
+					   pkt_q[i].addr, pkt_q[i].len);
 			}
 		}
 	}
 	wget_send(action, tcp_seq_num, tcp_ack_num, len);
 }
 
+/**
+ * wget_update_done() - note how much of the file has been received in order
+ * @state: TCP state after the last packet
+ */
+static void wget_update_done(enum tcp_state state)
+{
+	ulong done;
+
+	if (state == TCP_ESTABLISHED)
+		done = wget_range_base + tcp_get_ack_edge() -
+			initial_data_seq_num;
+	else if (state == TCP_CLOSE_WAIT)
+		/* The FIN is only accepted once there are no holes */
+		done = net_boot_file_size;
+	else
+		return;
+
+	if (done > wget_done)
+		wget_done = done;
+}
+
 /**
  * wget_handler() - TCP handler of wget
  * @pkt: pointer to the application packet
@@ -344,6 +633,16 @@ static void wget_handler(uchar *pkt, u16 dport,
 				len) != 0) {
 			wget_fail("wget: store error\n",
 				  tcp_seq_num, tcp_ack_num, action);
+			net_set_state(NETLOOP_FAIL);
+			return;
+		}
+
+		wget_update_done(wget_tcp_state);
+		if (wget_to_storage() && wget_loop_state != NETLOOP_FAIL &&
+		    wget_stream_flush(false)) {
+			wget_fail("wget: write error\n",
+				  tcp_seq_num, tcp_ack_num, action);
+			net_set_state(NETLOOP_FAIL);
 			return;
 		}
 
@@ -359,12 +658,34 @@ static void wget_handler(uchar *pkt, u16 dport,
 			net_set_state(NETLOOP_FAIL);
 			break;
 		case TCP_ESTABLISHED:
-			wget_send(TCP_ACK, tcp_seq_num, tcp_ack_num,
-				  len);
-			wget_loop_state = NETLOOP_SUCCESS;
+			if (tcp_ack_due()) {
+				wget_send(TCP_ACK, tcp_seq_num, tcp_ack_num,
+					  len);
+			} else {
+				/* Record it so the delayed ACK covers it */
+				retry_action = TCP_ACK;
+				retry_tcp_ack_num = tcp_ack_num;
+				retry_tcp_seq_num = tcp_seq_num;
+				retry_len = len;
+				net_set_timeout_handler(TCP_DELAYED_ACK_MS,
+							wget_delayed_ack_handler);
+			}
+			if (wget_loop_state != NETLOOP_FAIL)
+				wget_loop_state = NETLOOP_SUCCESS;
 			break;
 		case TCP_CLOSE_WAIT:     /* End of transfer */
+			if (content_length != -1 &&
+			    wget_done < wget_range_base + content_length) {
+				if (wget_resume())
+					break;
+				puts("\nwget: Connection closed early\n");
+				wget_loop_state = NETLOOP_FAIL;
+			}
 			current_wget_state = WGET_TRANSFERRED;
+			/* Nothing more is written once the transfer has failed */
+			if (wget_to_storage() && wget_loop_state != NETLOOP_FAIL &&
+			    wget_stream_flush(true))
+				wget_loop_state = NETLOOP_FAIL;
 			wget_send(action | TCP_ACK | TCP_FIN,
 				  tcp_seq_num, tcp_ack_num, len);
 			break;
@@ -393,6 +714,30 @@ static unsigned int random_port(void)
 	return RANDOM_PORT_START + (get_timer(0) % RANDOM_PORT_RANGE);
 }
 
+/**
+ * wget_connect() - open a new connection to the server
+ */
+static void wget_connect(void)
+{
+	net_set_timeout_handler(wget_timeout, wget_timeout_handler);
+	tcp_set_tcp_handler(wget_handler);
+
+	wget_timeout_count = 0;
+	current_wget_state = WGET_CLOSED;
+
+	our_port = random_port();
+
+	/*
+	 * Zero out server ether to force arp resolution in case
+	 * the server ip for the previous u-boot command, for example dns
+	 * is not the same as the web server ip.
+	 */
+
+	memset(net_server_ethaddr, 0, 6);
+
+	wget_send(TCP_SYN, 0, 0, 0);
+}
+
 #define BLOCKSIZE 512
 
 void wget_start(void)
@@ -434,21 +779,105 @@ void wget_start(void)
 	debug_cond(DEBUG_WGET,
 		   "\nwget:Load address: 0x%lx\nLoading: *\b", image_load_addr);
 
-	net_set_timeout_handler(wget_timeout, wget_timeout_handler);
-	tcp_set_tcp_handler(wget_handler);
+	net_boot_file_size = 0;
+	content_length = -1;
+	wget_range_start = 0;
+	wget_range_base = 0;
+	wget_done = 0;
+	wget_resume_count = 0;
+	wget_loop_state = NETLOOP_SUCCESS;
+	wget_stream.base = 0;
+	wget_stream.pos = 0;
+
+	wget_connect();
+}
 
-	wget_timeout_count = 0;
-	current_wget_state = WGET_CLOSED;
+/**
+ * wget_resume() - reconnect and ask for the rest of the file
+ *
+ * This is only possible once the server has told us the size of the file.
+ *
+ * Return: true if a new connection has been started, false if the download
+ * cannot be resumed
+ */
+static bool wget_resume(void)
+{
+	if (content_length == -1 || current_wget_state == WGET_TRANSFERRED ||
+	    wget_resume_count >= WGET_RESUME_COUNT)
+		return false;
+
+	wget_resume_count++;
+	wget_range_start = wget_done;
+	printf("\nwget: Connection lost; resuming at %lu bytes\n", wget_done);
+	if (current_wget_state > WGET_CONNECTING)
+		wget_send(TCP_RST, 0, 0, 0);
+	else
+		tcp_set_tcp_state(TCP_CLOSED);
+	wget_connect();
 
-	our_port = random_port();
+	return true;
+}
 
-	/*
-	 * Zero out server ether to force arp resolution in case
-	 * the server ip for the previous u-boot command, for example dns
-	 * is not the same as the web server ip.
-	 */
+#if IS_ENABLED(CONFIG_WGET_STORAGE)
+static int wget_stream_init(ulong align)
+{
+	struct wget_stream *s = &wget_stream;
+
+	s->align = align;
+	s->size = roundup(CONFIG_WGET_STREAM_BUF_SIZE, align);
+	s->buf = malloc(s->size + PKTQ_SZ * PKT_QUEUE_PACKET_SIZE);
+	if (!s->buf) {
+		wget_clear_storage();
+		return -ENOMEM;
+	}
 
-	memset(net_server_ethaddr, 0, 6);
+	return 0;
+}
 
-	wget_send(TCP_SYN, 0, 0, 0);
+int wget_set_blk(const char *ifname, const char *dev_part)
+{
+	struct disk_partition info;
+	struct blk_desc *desc;
+
+	wget_clear_storage();
+	if (blk_get_device_part_str(ifname, dev_part, &desc, &info, 1) < 0)
+		return -ENODEV;
+
+	wget_stream.desc = desc;
+	wget_stream.start = info.start;
+	wget_stream.limit = (u64)info.size * desc->blksz;
+
+	return wget_stream_init(desc->blksz);
+}
+
+int wget_set_mtd(const char *name)
+{
+	struct mtd_info *mtd;
+
+	if (!IS_ENABLED(CONFIG_MTD))
+		return -ENOSYS;
+
+	wget_clear_storage();
+	mtd_probe_devices();
+	mtd = get_mtd_device_nm(name);
+	if (IS_ERR_OR_NULL(mtd)) {
+		printf("MTD device %s not found\n", name);
+		return -ENODEV;
+	}
+
+	wget_stream.mtd = mtd;
+	wget_stream.limit = mtd->size;
+
+	return wget_stream_init(mtd->writesize);
+}
+
+void wget_clear_storage(void)
+{
+	struct wget_stream *s = &wget_stream;
+
+	if (IS_ENABLED(CONFIG_MTD) && s->mtd)
+		put_mtd_device(s->mtd);
+	free(s->buf);
+	memset(s, '\0', sizeof(*s));
 }
+#endif
@@ -0,0 +1,312 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Test for batched devicetree fixups
+ *
+ * Copyright 2023 Google LLC
+ */
+
+#include <common.h>
+#include <fdt_support.h>
+#include <log.h>
+#include <malloc.h>
+#include <time.h>
+#include <test/suites.h>
+#include <test/ut.h>
+#include "bootstd_common.h"
+
+/* Number of nodes in the devicetree used for the benchmark */
+#define BENCH_NODES	500
+
+/* Create a devicetree with @count device nodes, in a buffer of @size bytes */
+static int make_tree(struct unit_test_state *uts, void *buf, int size,
+		     int count)
+{
+	char name[20];
+	int i;
+
+	ut_assertok(fdt_create(buf, size));
+	ut_assertok(fdt_add_reservemap_entry(buf, 0x1000, 0x100));
+	ut_assertok(fdt_finish_reservemap(buf));
+	ut_assertok(fdt_begin_node(buf, ""));
+	ut_assertok(fdt_property_u32(buf, "#address-cells", 1));
+	ut_assertok(fdt_begin_node(buf, "aliases"));
+	ut_assertok(fdt_end_node(buf));
+	for (i = 0; i < count; i++) {
+		snprintf(name, sizeof(name), "dev@%x", i);
+		ut_assertok(fdt_begin_node(buf, name));
+		ut_assertok(fdt_property_string(buf, "compatible",
+						"vendor,dev"));
+		if (!(i % 3))
+			ut_assertok(fdt_property_string(buf, "status",
+							"disabled"));
+		ut_assertok(fdt_property_u32(buf, "reg", i));
+		if (!(i % 5)) {
+			ut_assertok(fdt_begin_node(buf, "child"));
+			ut_assertok(fdt_property_u32(buf, "val", i));
+			ut_assertok(fdt_end_node(buf));
+		}
+		ut_assertok(fdt_end_node(buf));
+	}
+	ut_assertok(fdt_end_node(buf));
+	ut_assertok(fdt_finish(buf));
+
+	return 0;
+}
+
+/*
+ * Make a set of fixups to a devicetree, either directly with libfdt or, if
+ * @batch is not NULL, through the batch
+ */
+static int do_fixups(struct unit_test_state *uts, void *fdt,
+		     struct fdt_batch *batch)
+{
+	int node, sub, i = 0;
+
+	fdt_for_each_subnode(node, fdt, 0) {
+		bool has_status = fdt_getprop(fdt, node, "status", NULL);
+		bool has_reg = fdt_getprop(fdt, node, "reg", NULL);
+
+		if (batch) {
+			ut_assertok(fdt_batch_setprop_u32(batch, node,
+							  "u-boot,fixup", i));
+			if (has_status)
+				ut_assertok(fdt_batch_setprop_string(batch,
+						node, "status", "okay"));
+			if (has_reg && !(i % 7))
+				ut_assertok(fdt_batch_delprop(batch, node,
+							      "reg"));
+		} else {
+			ut_assertok(fdt_setprop_u32(fdt, node, "u-boot,fixup",
+						    i));
+			if (has_status)
+				ut_assertok(fdt_setprop_string(fdt, node,
+							       "status",
+							       "okay"));
+			if (has_reg && !(i % 7))
+				ut_assertok(fdt_delprop(fdt, node, "reg"));
+		}
+		i++;
+	}
+
+	if (batch) {
+		sub = fdt_batch_subnode(batch, 0, "chosen");
+		ut_assert(sub >= FDT_BATCH_NEW_NODE);
+		ut_asserteq(sub, fdt_batch_subnode(batch, 0, "chosen"));
+		ut_assertok(fdt_batch_setprop_string(batch, sub, "bootargs",
+						     "console=ttyS0"));
+		sub = fdt_batch_subnode(batch, sub, "inner");
+		ut_assertok(fdt_batch_setprop_u32(batch, sub, "val", 5));
+		sub = fdt_batch_subnode(batch, 0, "memory");
+		ut_assertok(fdt_batch_setprop_string(batch, sub, "device_type",
+						     "memory"));
+		ut_assertok(fdt_batch_setprop_u64(batch, sub, "reg",
+						  0x80000000));
+		sub = fdt_batch_subnode(batch, 0, "aliases");
+		ut_asserteq(fdt_path_offset(fdt, "/aliases"), sub);
+		ut_assertok(fdt_batch_setprop_string(batch, sub, "serial0",
+						     "/dev@1"));
+		ut_assertok(fdt_batch_add_mem_rsv(batch, 0x2000, 0x200));
+	} else {
+		sub = fdt_add_subnode(fdt, 0, "chosen");
+		ut_assert(sub >= 0);
+		ut_assertok(fdt_setprop_string(fdt, sub, "bootargs",
+					       "console=ttyS0"));
+		sub = fdt_add_subnode(fdt, sub, "inner");
+		ut_assert(sub >= 0);
+		ut_assertok(fdt_setprop_u32(fdt, sub, "val", 5));
+		sub = fdt_add_subnode(fdt, 0, "memory");
+		ut_assert(sub >= 0);
+		ut_assertok(fdt_setprop_string(fdt, sub, "device_type",
+					       "memory"));
+		ut_assertok(fdt_setprop_u64(fdt, sub, "reg", 0x80000000));
+		sub = fdt_path_offset(fdt, "/aliases");
+		ut_assertok(fdt_setprop_string(fdt, sub, "serial0", "/dev@1"));
+		ut_assertok(fdt_add_mem_rsv(fdt, 0x2000, 0x200));
+	}
+
+	return 0;
+}
+
+/* Get the next tag in a devicetree, skipping NOPs */
+static u32 next_tag(const void *fdt, int *offsetp, int *nextp)
+{
+	u32 tag;
+
+	do {
+		*offsetp = *nextp;
+		tag = fdt_next_tag(fdt, *offsetp, nextp);
+	} while (tag == FDT_NOP);
+
+	return tag;
+}
+
+/* Check that two devicetrees have the same nodes and properties in order */
+static int check_same(struct unit_test_state *uts, const void *fdt1,
+		      const void *fdt2)
+{
+	int off1, off2, next1 = 0, next2 = 0;
+	const char *name1, *name2;
+	const void *val1, *val2;
+	u64 addr1, size1, addr2, size2;
+	int len1, len2, i;
+	u32 tag;
+
+	ut_asserteq(fdt_num_mem_rsv(fdt1), fdt_num_mem_rsv(fdt2));
+	for (i = 0; i < fdt_num_mem_rsv(fdt1); i++) {
+		ut_assertok(fdt_get_mem_rsv(fdt1, i, &addr1, &size1));
+		ut_assertok(fdt_get_mem_rsv(fdt2, i, &addr2, &size2));
+		ut_asserteq_64(addr1, addr2);
+		ut_asserteq_64(size1, size2);
+	}
+
+	do {
+		tag = next_tag(fdt1, &off1, &next1);
+		ut_asserteq(tag, next_tag(fdt2, &off2, &next2));
+		if (tag == FDT_BEGIN_NODE) {
+			ut_asserteq_str(fdt_get_name(fdt1, off1, NULL),
+					fdt_get_name(fdt2, off2, NULL));
+		} else if (tag == FDT_PROP) {
+			val1 = fdt_getprop_by_offset(fdt1, off1, &name1, &len1);
+			val2 = fdt_getprop_by_offset(fdt2, off2, &name2, &len2);
+			ut_asserteq_str(name1, name2);
+			ut_asserteq(len1, len2);
+			ut_asserteq_mem(val1, val2, len1);
+		}
+	} while (tag != FDT_END);
+
+	return 0;
+}
+
+/* Test that a batch gives the same result as editing with libfdt */
+static int fdt_batch_test_fixup(struct unit_test_state *uts)
+{
+	const int size = 0x10000;
+	struct fdt_batch batch;
+	void *base, *fdt1, *fdt2;
+
+	base = malloc(size);
+	fdt1 = malloc(size);
+	fdt2 = malloc(size);
+	ut_assertnonnull(base);
+	ut_assertnonnull(fdt1);
+	ut_assertnonnull(fdt2);
+	ut_assertok(make_tree(uts, base, size, 20));
+	ut_assertok(fdt_open_into(base, fdt1, size));
+	ut_assertok(fdt_open_into(base, fdt2, size));
+
+	ut_assertok(do_fixups(uts, fdt1, NULL));
+
+	ut_assertok(fdt_batch_init(&batch, fdt2));
+	ut_assertok(do_fixups(uts, fdt2, &batch));
+	ut_assertok(fdt_batch_apply(&batch, fdt2, size));
+	fdt_batch_uninit(&batch);
+
+	ut_assertok(fdt_check_full(fdt2, size));
+	ut_asserteq(size, fdt_totalsize(fdt2));
+	ut_assertok(check_same(uts, fdt1, fdt2));
+
+	free(fdt2);
+	free(fdt1);
+	free(base);
+
+	return 0;
+}
+BOOTSTD_TEST(fdt_batch_test_fixup, 0);
+
+/* Test error handling */
+static int fdt_batch_test_errors(struct unit_test_state *uts)
+{
+	const int size = 0x1000;
+	struct fdt_batch batch;
+	void *fdt, *copy;
+	int node;
+
+	fdt = malloc(size);
+	copy = malloc(size);
+	ut_assertnonnull(fdt);
+	ut_assertnonnull(copy);
+	ut_assertok(make_tree(uts, fdt, size, 3));
+	ut_assertok(fdt_open_into(fdt, fdt, size));
+	memcpy(copy, fdt, size);
+
+	/* Offsets must be those of nodes */
+	ut_assertok(fdt_batch_init(&batch, fdt));
+	node = fdt_path_offset(fdt, "/dev@1");
+	ut_assert(node > 0);
+	ut_asserteq(-FDT_ERR_BADOFFSET,
+		    fdt_batch_setprop_u32(&batch, node + 4, "val", 1));
+
+	/* The error sticks, so later edits and the apply fail too */
+	ut_asserteq(-FDT_ERR_BADOFFSET,
+		    fdt_batch_setprop_u32(&batch, node, "val", 1));
+	ut_asserteq(-FDT_ERR_BADOFFSET, fdt_batch_apply(&batch, fdt, size));
+	fdt_batch_uninit(&batch);
+	ut_asserteq_mem(copy, fdt, size);
+
+	/* Handles must be those of new nodes */
+	ut_assertok(fdt_batch_init(&batch, fdt));
+	ut_asserteq(-FDT_ERR_BADOFFSET,
+		    fdt_batch_subnode(&batch, FDT_BATCH_NEW_NODE, "node"));
+	fdt_batch_uninit(&batch);
+
+	/* If the result does not fit, the devicetree is left unchanged */
+	ut_assertok(fdt_batch_init(&batch, fdt));
+	ut_assertok(fdt_batch_setprop(&batch, node, "big", copy, size));
+	ut_asserteq(-FDT_ERR_NOSPACE, fdt_batch_apply(&batch, fdt, size));
+	fdt_batch_uninit(&batch);
+	ut_asserteq_mem(copy, fdt, size);
+
+	/* Deleting a missing property is fine */
+	ut_assertok(fdt_batch_init(&batch, fdt));
+	ut_assertok(fdt_batch_delprop(&batch, node, "missing"));
+	ut_assertok(fdt_batch_apply(&batch, fdt, size));
+	fdt_batch_uninit(&batch);
+	ut_assertok(check_same(uts, copy, fdt));
+
+	free(copy);
+	free(fdt);
+
+	return 0;
+}
+BOOTSTD_TEST(fdt_batch_test_errors, 0);
+
+/* Compare the time taken by libfdt and a batch to fix up a large devicetree */
+static int fdt_batch_test_bench(struct unit_test_state *uts)
+{
+	const int size = BENCH_NODES * 0x100 + 0x1000;
+	ulong libfdt_us, batch_us, start;
+	struct fdt_batch batch;
+	void *base, *fdt1, *fdt2;
+
+	base = malloc(size);
+	fdt1 = malloc(size);
+	fdt2 = malloc(size);
+	ut_assertnonnull(base);
+	ut_assertnonnull(fdt1);
+	ut_assertnonnull(fdt2);
+	ut_assertok(make_tree(uts, base, size, BENCH_NODES));
+	ut_assertok(fdt_open_into(base, fdt1, size));
+	ut_assertok(fdt_open_into(base, fdt2, size));
+
+	start = timer_get_us();
+	ut_assertok(do_fixups(uts, fdt1, NULL));
+	libfdt_us = timer_get_us() - start;
+
+	start = timer_get_us();
+	ut_assertok(fdt_batch_init(&batch, fdt2));
+	ut_assertok(do_fixups(uts, fdt2, &batch));
+	ut_assertok(fdt_batch_apply(&batch, fdt2, size));
+	batch_us = timer_get_us() - start;
+	fdt_batch_uninit(&batch);
+
+	ut_assertok(check_same(uts, fdt1, fdt2));
+	log_debug("%d nodes, %d bytes: libfdt %lu us, batch %lu us\n",
+		  BENCH_NODES, fdt_size_dt_struct(fdt2), libfdt_us, batch_us);
+
+	free(fdt2);
+	free(fdt1);
+	free(base);
+
+	return 0;
+}
+BOOTSTD_TEST(fdt_batch_test_bench, 0);
@@ -7,7 +7,11 @@
  */
 
 #include <common.h>
+#include <hash.h>
 #include <image.h>
+#include <malloc.h>
+#include <mapmem.h>
+#include <u-boot/sha256.h>
 #include <test/suites.h>
 #include <test/ut.h>
 #include "bootstd_common.h"
@@ -34,3 +38,110 @@ static int test_image_phase(struct unit_test_state *uts)
 	return 0;
 }
 BOOTSTD_TEST(test_image_phase, 0);
+
+#if CONFIG_IS_ENABLED(FIT_STREAM_VERIFY)
+#define FIT_TEST_SIZE	0x1000
+#define FIT_TEST_DATA	0x2345
+
+/* Build a FIT holding a kernel, with a sha256 hash which may be wrong */
+static int make_stream_fit(struct unit_test_state *uts, void *fit,
+			   const u8 *data, ulong load, bool corrupt)
+{
+	u8 value[SHA256_SUM_LEN];
+	int images, node, hash;
+	int value_len = sizeof(value);
+
+	ut_assertok(fdt_create_empty_tree(fit, FIT_TEST_DATA + FIT_TEST_SIZE));
+	ut_assertok(fdt_setprop_string(fit, 0, FIT_DESC_PROP, "test"));
+	ut_assertok(fdt_setprop_u32(fit, 0, FIT_TIMESTAMP_PROP, 0));
+	images = fdt_add_subnode(fit, 0, "images");
+	ut_assert(images >= 0);
+	node = fdt_add_subnode(fit, images, "kernel");
+	ut_assert(node >= 0);
+	ut_assertok(fdt_setprop(fit, node, FIT_DATA_PROP, data, FIT_TEST_DATA));
+	ut_assertok(fdt_setprop_string(fit, node, FIT_TYPE_PROP, "kernel"));
+	ut_assertok(fdt_setprop_string(fit, node, FIT_OS_PROP, "linux"));
+	ut_assertok(fdt_setprop_string(fit, node, FIT_ARCH_PROP, "sandbox"));
+	ut_assertok(fdt_setprop_string(fit, node, FIT_COMP_PROP, "none"));
+	ut_assertok(fdt_setprop_u32(fit, node, FIT_LOAD_PROP, load));
+
+	hash = fdt_add_subnode(fit, node, "hash-1");
+	ut_assert(hash >= 0);
+	ut_assertok(fdt_setprop_string(fit, hash, FIT_ALGO_PROP, "sha256"));
+	ut_assertok(hash_block("sha256", data, FIT_TEST_DATA, value,
+			       &value_len));
+	if (corrupt)
+		value[0] ^= 1;
+	ut_assertok(fdt_setprop(fit, hash, FIT_VALUE_PROP, value, value_len));
+
+	return 0;
+}
+
+/* Load a FIT kernel, hashing it while it is copied; return the result */
+static int load_stream_fit(struct unit_test_state *uts, bool corrupt,
+			   int *retp)
+{
+	struct bootm_headers images;
+	const char *uname = "kernel";
+	u8 *fit, *data, *load;
+	ulong load_addr, datap, lenp;
+	const void *buf;
+	size_t size;
+	int i;
+
+	fit = malloc(FIT_TEST_DATA + FIT_TEST_SIZE);
+	data = malloc(FIT_TEST_DATA);
+	load = calloc(1, FIT_TEST_DATA);
+	ut_assertnonnull(fit);
+	ut_assertnonnull(data);
+	ut_assertnonnull(load);
+	for (i = 0; i < FIT_TEST_DATA; i++)
+		data[i] = i * 7;
+	load_addr = map_to_sysmem(load);
+	ut_assertok(make_stream_fit(uts, fit, data, load_addr, corrupt));
+	ut_assertok(fit_image_get_data_and_size(fit,
+			fdt_path_offset(fit, "/images/kernel"), &buf, &size));
+
+	memset(&images, '\0', sizeof(images));
+	images.verify = 1;
+	console_record_reset_enable();
+	*retp = fit_image_load(&images, map_to_sysmem(fit), &uname, NULL,
+			       IH_ARCH_SANDBOX, IH_TYPE_KERNEL, 0,
+			       FIT_LOAD_REQUIRED, &datap, &lenp);
+
+	/* The hash is checked after the copy, not before it */
+	ut_assert_skip_to_line("   Loading kernel from 0x%08lx to 0x%08lx",
+			       map_to_sysmem(buf), load_addr);
+	if (corrupt) {
+		ut_assert_nextline("   Verifying Hash Integrity ... sha256 error!");
+		ut_assert_nextline("Bad hash value for 'hash-1' hash node in 'kernel' image node");
+		ut_assert_nextline("Bad Data Hash");
+	} else {
+		ut_assert_nextline("   Verifying Hash Integrity ... sha256+ OK");
+		ut_asserteq(load_addr, datap);
+		ut_asserteq(FIT_TEST_DATA, lenp);
+	}
+	ut_asserteq_mem(data, load, FIT_TEST_DATA);
+
+	free(load);
+	free(data);
+	free(fit);
+
+	return 0;
+}
+
+/* Test hashing a FIT image while it is loaded */
+static int test_image_stream_verify(struct unit_test_state *uts)
+{
+	int ret;
+
+	ut_assertok(load_stream_fit(uts, false, &ret));
+	ut_assert(ret >= 0);
+
+	ut_assertok(load_stream_fit(uts, true, &ret));
+	ut_asserteq(-EACCES, ret);
+
+	return 0;
+}
+BOOTSTD_TEST(test_image_stream_verify, UT_TESTF_CONSOLE_REC);
+#endif
@@ -1366,8 +1366,8 @@ FDT_TEST(fdt_test_chosen, UT_TESTF_CONSOLE_REC);
 
 static int fdt_test_apply(struct unit_test_state *uts)
 {
-	char fdt[8192], fdto[8192];
-	ulong addr, addro;
+	char fdt[8192], fdto[8192], fdto2[8192];
+	ulong addr, addro, addro2;
 
 	/* Create base DT with __symbols__ node */
 	ut_assertok(fdt_create(fdt, sizeof(fdt)));
@@ -1512,10 +1512,136 @@ static int fdt_test_apply(struct unit_test_state *uts)
 	ut_assert_nextline("};");
 	ut_assertok(ut_check_console_end(uts));
 
+	/*
+	 * Create two DTOs to apply together, where the second uses a symbol
+	 * added by the first:
+	 * - the first adds a subnode with a phandle, which becomes 2
+	 * - the second modifies a property in that subnode via the phandle
+	 */
+	ut_assertok(fdt_create(fdto, sizeof(fdto)));
+	ut_assertok(fdt_finish_reservemap(fdto));
+	ut_assert(fdt_begin_node(fdto, "") >= 0);
+	ut_assert(fdt_begin_node(fdto, "fragment@0") >= 0);
+	ut_assertok(fdt_property_string(fdto, "target-path", "/"));
+	ut_assert(fdt_begin_node(fdto, "__overlay__") >= 0);
+	ut_assert(fdt_begin_node(fdto, "other") >= 0);
+	ut_assertok(fdt_property_u32(fdto, "phandle", 0x01));
+	ut_assertok(fdt_property_u32(fdto, "otheru32", 0x1));
+	ut_assertok(fdt_end_node(fdto));
+	ut_assertok(fdt_end_node(fdto));
+	ut_assertok(fdt_end_node(fdto));
+	ut_assert(fdt_begin_node(fdto, "__symbols__") >= 0);
+	ut_assertok(fdt_property_string(fdto, "otherphandle", "/fragment@0/__overlay__/other"));
+	ut_assertok(fdt_end_node(fdto));
+	ut_assertok(fdt_end_node(fdto));
+	ut_assertok(fdt_finish(fdto));
+	addro = map_to_sysmem(fdto);
+
+	ut_assertok(fdt_create(fdto2, sizeof(fdto2)));
+	ut_assertok(fdt_finish_reservemap(fdto2));
+	ut_assert(fdt_begin_node(fdto2, "") >= 0);
+	ut_assert(fdt_begin_node(fdto2, "fragment@0") >= 0);
+	ut_assertok(fdt_property_u32(fdto2, "target", 0xffffffff));
+	ut_assert(fdt_begin_node(fdto2, "__overlay__") >= 0);
+	ut_assertok(fdt_property_u32(fdto2, "otheru32", 0x2));
+	ut_assertok(fdt_end_node(fdto2));
+	ut_assertok(fdt_end_node(fdto2));
+	ut_assert(fdt_begin_node(fdto2, "__fixups__") >= 0);
+	ut_assertok(fdt_property_string(fdto2, "otherphandle", "/fragment@0:target:0"));
+	ut_assertok(fdt_end_node(fdto2));
+	ut_assertok(fdt_end_node(fdto2));
+	ut_assertok(fdt_finish(fdto2));
+	addro2 = map_to_sysmem(fdto2);
+
+	/* Test applying both DTOs in one command, showing the time taken */
+	ut_assertok(console_record_reset_enable());
+	ut_assertok(run_commandf("fdt apply -t 0x%08lx 0x%08lx", addro, addro2));
+	ut_assert_nextlinen("Applied 2 overlays in ");
+	ut_assertok(run_commandf("fdt print /other"));
+	ut_assert_nextline("other {");
+	ut_assert_nextline("\totheru32 = <0x00000002>;");
+	ut_assert_nextline("\tphandle = <0x00000002>;");
+	ut_assert_nextline("};");
+	ut_assertok(run_commandf("fdt print /__symbols__"));
+	ut_assert_nextline("__symbols__ {");
+	ut_assert_nextline("\totherphandle = \"/other\";");
+	ut_assert_nextline("\tsubnodephandle = \"/subnode\";");
+	ut_assert_nextline("};");
+	ut_assertok(ut_check_console_end(uts));
+
 	return 0;
 }
 FDT_TEST(fdt_test_apply, UT_TESTF_CONSOLE_REC);
 
+/* Check that the base DT is unchanged if one of several DTOs fails */
+static int fdt_test_apply_fail(struct unit_test_state *uts)
+{
+	char fdt[8192], copy[8192], fdto[8192], fdto2[8192];
+	ulong addro, addro2;
+
+	if (!IS_ENABLED(CONFIG_OF_LIBFDT_OVERLAY_LIVE))
+		return -EAGAIN;
+
+	/* Create base DT with __symbols__ node */
+	ut_assertok(fdt_create(fdt, sizeof(fdt)));
+	ut_assertok(fdt_finish_reservemap(fdt));
+	ut_assert(fdt_begin_node(fdt, "") >= 0);
+	ut_assert(fdt_begin_node(fdt, "__symbols__") >= 0);
+	ut_assertok(fdt_end_node(fdt));
+	ut_assertok(fdt_end_node(fdt));
+	ut_assertok(fdt_finish(fdt));
+	fdt_shrink_to_minimum(fdt, 4096);	/* Resize with 4096 extra bytes */
+	set_working_fdt_addr(map_to_sysmem(fdt));
+	memcpy(copy, fdt, sizeof(copy));
+
+	/* Create DTO which adds single property to root node / */
+	ut_assertok(fdt_create(fdto, sizeof(fdto)));
+	ut_assertok(fdt_finish_reservemap(fdto));
+	ut_assert(fdt_begin_node(fdto, "") >= 0);
+	ut_assert(fdt_begin_node(fdto, "fragment") >= 0);
+	ut_assertok(fdt_property_string(fdto, "target-path", "/"));
+	ut_assert(fdt_begin_node(fdto, "__overlay__") >= 0);
+	ut_assertok(fdt_property_string(fdto, "newstring", "newvalue"));
+	ut_assertok(fdt_end_node(fdto));
+	ut_assertok(fdt_end_node(fdto));
+	ut_assertok(fdt_finish(fdto));
+	addro = map_to_sysmem(fdto);
+
+	/* Create DTO which refers to a symbol missing from the base DT */
+	ut_assertok(fdt_create(fdto2, sizeof(fdto2)));
+	ut_assertok(fdt_finish_reservemap(fdto2));
+	ut_assert(fdt_begin_node(fdto2, "") >= 0);
+	ut_assert(fdt_begin_node(fdto2, "fragment@0") >= 0);
+	ut_assertok(fdt_property_u32(fdto2, "target", 0xffffffff));
+	ut_assert(fdt_begin_node(fdto2, "__overlay__") >= 0);
+	ut_assertok(fdt_property_u32(fdto2, "otheru32", 0x2));
+	ut_assertok(fdt_end_node(fdto2));
+	ut_assertok(fdt_end_node(fdto2));
+	ut_assert(fdt_begin_node(fdto2, "__fixups__") >= 0);
+	ut_assertok(fdt_property_string(fdto2, "missing", "/fragment@0:target:0"));
+	ut_assertok(fdt_end_node(fdto2));
+	ut_assertok(fdt_end_node(fdto2));
+	ut_assertok(fdt_finish(fdto2));
+	addro2 = map_to_sysmem(fdto2);
+
+	/* The first DTO applies but the second does not */
+	ut_assertok(console_record_reset_enable());
+	ut_asserteq(1, run_commandf("fdt apply 0x%08lx 0x%08lx", addro, addro2));
+	ut_assert_nextlinen("failed to apply overlay 1: ");
+	ut_assertok(ut_check_console_end(uts));
+	ut_asserteq_mem(copy, fdt, fdt_totalsize(copy));
+
+	ut_assertok(run_commandf("fdt print /"));
+	ut_assert_nextline("/ {");
+	ut_assert_nextline("\t__symbols__ {");
+	ut_assert_nextline("\t};");
+	ut_assert_nextline("};");
+	ut_assertok(ut_check_console_end(uts));
+
+	return 0;
+}
+FDT_TEST(fdt_test_apply_fail, UT_TESTF_CONSOLE_REC);
+
 int do_ut_fdt(struct cmd_tbl *cmdtp, int flag, int argc, char *const argv[])
 {
 	struct unit_test *tests = UNIT_TEST_SUITE_START(fdt_test);
@@ -0,0 +1,84 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Test for loadz command
+ */
+
+#include <common.h>
+#include <command.h>
+#include <console.h>
+#include <env.h>
+#include <gzip.h>
+#include <lmb.h>
+#include <malloc.h>
+#include <mapmem.h>
+#include <os.h>
+#include <asm/global_data.h>
+#include <dm/test.h>
+#include <test/test.h>
+#include <test/ut.h>
+
+DECLARE_GLOBAL_DATA_PTR;
+
+#define LOADZ_FNAME	"loadz_test.gz"
+#define LOADZ_ADDR	0x10000
+#define LOADZ_SIZE	0x4000
+
+/* Check that loadz decompresses a gzip file and respects its limits */
+static int dm_test_cmd_loadz(struct unit_test_state *uts)
+{
+	ulong comp_size = LOADZ_SIZE;
+	phys_size_t free_size;
+	char *plain, *comp, *buf;
+	struct lmb lmb;
+	ulong addr;
+	int i;
+
+	plain = malloc(LOADZ_SIZE);
+	ut_assertnonnull(plain);
+	comp = malloc(LOADZ_SIZE);
+	ut_assertnonnull(comp);
+	for (i = 0; i < LOADZ_SIZE; i++)
+		plain[i] = i / 64;
+	ut_assertok(gzip(comp, &comp_size, (uchar *)plain, LOADZ_SIZE));
+	ut_assertok(os_write_file(LOADZ_FNAME, comp, comp_size));
+
+	buf = map_sysmem(LOADZ_ADDR, LOADZ_SIZE);
+	memset(buf, '\0', LOADZ_SIZE);
+	ut_assertok(console_record_reset_enable());
+	ut_assertok(run_commandf("loadz hostfs - %x %s", LOADZ_ADDR,
+				 LOADZ_FNAME));
+	ut_assert_nextlinen("%lu bytes read, %d bytes written in ", comp_size,
+			    LOADZ_SIZE);
+	ut_assert_console_end();
+	ut_asserteq(LOADZ_ADDR, env_get_hex("fileaddr", 0));
+	ut_asserteq(LOADZ_SIZE, env_get_hex("filesize", 0));
+	ut_asserteq_mem(plain, buf, LOADZ_SIZE);
+	unmap_sysmem(buf);
+
+	/* max_bytes too small */
+	ut_asserteq(1, run_commandf("loadz hostfs - %x %s 100", LOADZ_ADDR,
+				    LOADZ_FNAME));
+	ut_assert_nextline("Image too large: increase max_bytes or move it away from reserved memory");
+	ut_assert_nextline("Failed to load '%s' (err=%d)", LOADZ_FNAME,
+			   -ENOSPC);
+	ut_assert_console_end();
+
+	/* the output must stop before the end of the free region */
+	lmb_init_and_reserve(&lmb, gd->bd, (void *)gd->fdt_blob);
+	free_size = lmb_get_free_size(&lmb, LOADZ_ADDR);
+	ut_assert(free_size > LOADZ_SIZE);
+	addr = LOADZ_ADDR + free_size - LOADZ_SIZE / 2;
+	ut_asserteq(1, run_commandf("loadz hostfs - %lx %s", addr,
+				    LOADZ_FNAME));
+	ut_assert_nextline("Image too large: increase max_bytes or move it away from reserved memory");
+	ut_assert_nextline("Failed to load '%s' (err=%d)", LOADZ_FNAME,
+			   -ENOSPC);
+	ut_assert_console_end();
+
+	os_unlink(LOADZ_FNAME);
+	free(comp);
+	free(plain);
+
+	return 0;
+}
+DM_TEST(dm_test_cmd_loadz, UT_TESTF_CONSOLE_REC);
@@ -7,6 +7,7 @@
  */
 
 #include <common.h>
+#include <blk.h>
 #include <command.h>
 #include <dm.h>
 #include <env.h>
@@ -14,9 +15,15 @@
 #include <log.h>
 #include <malloc.h>
 #include <net.h>
+#include <mtd.h>
+#include <os.h>
+#include <part.h>
+#include <spi_flash.h>
 #include <net/tcp.h>
 #include <net/wget.h>
 #include <asm/eth.h>
+#include <asm/state.h>
+#include <asm/unaligned.h>
 #include <dm/test.h>
 #include <dm/device-internal.h>
 #include <dm/uclass-internal.h>
@@ -204,3 +211,600 @@ static int net_test_wget(struct unit_test_state *uts)
 }
 
 LIB_TEST(net_test_wget, 0);
+
+#if IS_ENABLED(CONFIG_WGET_STORAGE)
+static int net_test_wget_blk(struct unit_test_state *uts)
+{
+	const char *expect = "\r\n<html><body>Hi</body></html>\r\n";
+	struct blk_desc *desc;
+	char buf[512];
+
+	sandbox_eth_set_tx_handler(0, sb_http_handler);
+	sandbox_eth_set_priv(0, uts);
+
+	env_set("ethact", "eth@10002000");
+	env_set("ethrotate", "no");
+	ut_assertok(run_command("wget -b mmc 0:0 1.1.2.2:/index.html", 0));
+
+	sandbox_eth_set_tx_handler(0, NULL);
+
+	ut_asserteq(0x20, env_get_hex("filesize", 0));
+	ut_assertok(blk_get_device_by_str("mmc", "0", &desc));
+	ut_asserteq(1, blk_dread(desc, 0, 1, buf));
+	ut_asserteq_mem(expect, buf, strlen(expect));
+
+	/* The rest of the last block is padded */
+	ut_asserteq(0, buf[strlen(expect)]);
+
+	return 0;
+}
+
+LIB_TEST(net_test_wget_blk, 0);
+
+#define WGET_TEST_SEG		1024	/* Bytes of the file in each segment */
+
+/**
+ * struct wget_test_srv - fake HTTP server for the storage tests
+ *
+ * @size: Size of the file
+ * @close_at: The first connection is closed once the file has been sent up
+ *	to this offset; 0 to send the whole file
+ * @ignore_range: Send the whole file with a 200 reply, even if a Range is
+ *	requested
+ * @range_skew: Added to the start of the Content-Range in a 206 reply
+ * @syn_opts: Offer window scaling and SACK in the SYN-ACK
+ * @lose_at: Hold back the segment at this offset in the file until the
+ *	client has acknowledged the one after it, as if it were lost; 0 for
+ *	none
+ * @conns: Number of connections made
+ * @range: Start of the Range in the last request, 0 if there was none
+ * @sending: true once the request has been answered
+ * @fin: true once the FIN has been sent
+ * @seq: Sequence number of the next byte to send
+ * @pos: Offset in the file of the next byte to send
+ * @end: Offset in the file at which this connection is closed
+ * @win_scale: Window scale offered in the client's SYN, -1 if none
+ * @sack_ok: true if the client's SYN permits SACK
+ * @win: Window in the client's last ACK
+ * @sack_seen: true if the client has sent a SACK block
+ * @sacked: true if the client reported the segment after the lost one in a
+ *	SACK block
+ * @lost_seq: Sequence number of the lost segment
+ * @lost_pos: Offset in the file of the lost segment
+ * @lost_len: Length of the lost segment, 0 if none has been held back
+ * @resent: true once the lost segment has been sent
+ */
+struct wget_test_srv {
+	ulong size;
+	ulong close_at;
+	bool ignore_range;
+	ulong range_skew;
+	bool syn_opts;
+	ulong lose_at;
+	int conns;
+	ulong range;
+	bool sending;
+	bool fin;
+	u32 seq;
+	ulong pos;
+	ulong end;
+	int win_scale;
+	bool sack_ok;
+	uint win;
+	bool sack_seen;
+	bool sacked;
+	u32 lost_seq;
+	ulong lost_pos;
+	int lost_len;
+	bool resent;
+};
+
+static u8 wget_test_byte(ulong pos)
+{
+	return pos * 3 + (pos >> 10);
+}
+
+static int sb_wget_send(struct udevice *dev, void *packet, u8 flags,
+			u32 seq, u32 ack, const u8 *opts, int opt_len,
+			const void *data, int data_len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct ethernet_hdr *eth = packet;
+	struct ip_tcp_hdr *tcp = packet + ETHER_HDR_SIZE;
+	struct ethernet_hdr *eth_send;
+	struct ip_tcp_hdr *tcp_send;
+	int pkt_len;
+
+	/* Don't allow the buffer to overrun */
+	if (priv->recv_packets >= PKTBUFSRX)
+		return 0;
+
+	eth_send = (void *)priv->recv_packet_buffer[priv->recv_packets];
+	memcpy(eth_send->et_dest, eth->et_src, ARP_HLEN);
+	memcpy(eth_send->et_src, priv->fake_host_hwaddr, ARP_HLEN);
+	eth_send->et_protlen = htons(PROT_IP);
+	tcp_send = (void *)eth_send + ETHER_HDR_SIZE;
+	tcp_send->tcp_src = tcp->tcp_dst;
+	tcp_send->tcp_dst = tcp->tcp_src;
+	tcp_send->tcp_seq = htonl(seq);
+	tcp_send->tcp_ack = htonl(ack);
+	tcp_send->tcp_flags = flags;
+	memcpy((void *)tcp_send + IP_TCP_HDR_SIZE, opts, opt_len);
+	memcpy((void *)tcp_send + IP_TCP_HDR_SIZE + opt_len, data, data_len);
+
+	tcp_send->tcp_hlen =
+		SHIFT_TO_TCPHDRLEN_FIELD(LEN_B_TO_DW(TCP_HDR_SIZE + opt_len));
+	tcp_send->tcp_win = htons(PKTBUFSRX * TCP_MSS >> TCP_SCALE);
+	tcp_send->tcp_xsum = 0;
+	tcp_send->tcp_ugr = 0;
+	pkt_len = IP_TCP_HDR_SIZE + opt_len + data_len;
+	tcp_send->tcp_xsum = tcp_set_pseudo_header((uchar *)tcp_send,
+						   tcp->ip_src,
+						   tcp->ip_dst,
+						   pkt_len - IP_HDR_SIZE,
+						   pkt_len);
+	net_set_ip_header((uchar *)tcp_send,
+			  tcp->ip_src,
+			  tcp->ip_dst,
+			  pkt_len,
+			  IPPROTO_TCP);
+
+	priv->recv_packet_length[priv->recv_packets] =
+		ETHER_HDR_SIZE + pkt_len;
+	++priv->recv_packets;
+
+	return 0;
+}
+
+static int sb_wget_reply(struct udevice *dev, void *packet, u8 flags,
+			 u32 seq, u32 ack, const void *data, int data_len)
+{
+	return sb_wget_send(dev, packet, flags, seq, ack, NULL, 0, data,
+			    data_len);
+}
+
+/* Answer a SYN, offering window scaling and SACK */
+static int sb_wget_syn_opts(struct udevice *dev, void *packet)
+{
+	struct ip_tcp_hdr *tcp = packet + ETHER_HDR_SIZE;
+	static const u8 opts[] = {
+		TCP_O_MSS, TCP_OPT_LEN_4, TCP_MSS >> 8, TCP_MSS & 0xff,
+		TCP_1_NOP, TCP_O_SCL, TCP_OPT_LEN_3, 0,
+		TCP_P_SACK, TCP_OPT_LEN_2, TCP_1_NOP, TCP_1_NOP,
+	};
+
+	return sb_wget_send(dev, packet, TCP_SYN | TCP_ACK, 0,
+			    ntohl(tcp->tcp_seq) + 1, opts, sizeof(opts), NULL,
+			    0);
+}
+
+/* Record the options which the client sends */
+static void sb_wget_parse_opts(struct wget_test_srv *srv,
+			       struct ip_tcp_hdr *tcp, int hdr_len)
+{
+	u8 *p = (u8 *)tcp + IP_TCP_HDR_SIZE;
+	u8 *end = (u8 *)tcp + hdr_len;
+
+	while (p < end && *p != TCP_O_END) {
+		if (*p == TCP_1_NOP) {
+			p++;
+			continue;
+		}
+		if (p + 1 >= end || p[1] < TCP_OPT_LEN_2)
+			break;
+		switch (*p) {
+		case TCP_O_SCL:
+			srv->win_scale = p[2];
+			break;
+		case TCP_P_SACK:
+			srv->sack_ok = true;
+			break;
+		case TCP_V_SACK:
+			srv->sack_seen = true;
+			if (srv->lost_len && !srv->resent)
+				srv->sacked = get_unaligned_be32(p + 2) ==
+					srv->lost_seq + srv->lost_len &&
+					get_unaligned_be32(p + 6) == srv->seq;
+			break;
+		}
+		p += p[1];
+	}
+}
+
+/* Answer a request, honouring its Range unless told not to */
+static int sb_wget_request(struct udevice *dev, void *packet, u32 ack,
+			   const char *req, int req_len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct wget_test_srv *srv = priv->priv;
+	const char *range_hdr = "Range: bytes=";
+	char buf[256], hdr[256];
+	const char *pos;
+	ulong start;
+	int hlen;
+
+	req_len = min_t(int, req_len, sizeof(buf) - 1);
+	memcpy(buf, req, req_len);
+	buf[req_len] = '\0';
+	pos = strstr(buf, range_hdr);
+	srv->range = pos ? simple_strtoul(pos + strlen(range_hdr), NULL, 10) :
+		0;
+
+	start = srv->ignore_range ? 0 : srv->range;
+	if (start)
+		hlen = sprintf(hdr, "HTTP/1.1 206 Partial Content\r\n"
+			       "Content-Range: bytes %lu-%lu/%lu\r\n"
+			       "Content-Length: %lu\r\n\r\n",
+			       start + srv->range_skew, srv->size - 1,
+			       srv->size, srv->size - start);
+	else
+		hlen = sprintf(hdr, "HTTP/1.1 200 OK\r\n"
+			       "Content-Length: %lu\r\n\r\n", srv->size);
+
+	srv->sending = true;
+	srv->pos = start;
+	srv->end = srv->conns == 1 && srv->close_at ? srv->close_at :
+		srv->size;
+	srv->seq = 1 + hlen;
+
+	return sb_wget_reply(dev, packet, TCP_ACK, 1, ack, hdr, hlen);
+}
+
+/* Send the next two segments, or the FIN once all the data is sent */
+static int sb_wget_data(struct udevice *dev, void *packet, u32 ack)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct wget_test_srv *srv = priv->priv;
+	uchar seg[WGET_TEST_SEG];
+	int i, j, len, ret;
+
+	if (srv->pos == srv->end) {
+		srv->fin = true;
+		return sb_wget_reply(dev, packet, TCP_ACK | TCP_FIN, srv->seq,
+				     ack, NULL, 0);
+	}
+
+	for (i = 0; i < 2 && srv->pos < srv->end; i++) {
+		len = min_t(ulong, WGET_TEST_SEG, srv->end - srv->pos);
+		if (srv->lose_at && srv->pos == srv->lose_at &&
+		    !srv->lost_len) {
+			srv->lost_seq = srv->seq;
+			srv->lost_pos = srv->pos;
+			srv->lost_len = len;
+		} else {
+			for (j = 0; j < len; j++)
+				seg[j] = wget_test_byte(srv->pos + j);
+			ret = sb_wget_reply(dev, packet, TCP_ACK, srv->seq,
+					    ack, seg, len);
+			if (ret)
+				return ret;
+		}
+		srv->seq += len;
+		srv->pos += len;
+	}
+
+	return 0;
+}
+
+/* Send the segment which was held back */
+static int sb_wget_resend(struct udevice *dev, void *packet, u32 ack)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct wget_test_srv *srv = priv->priv;
+	uchar seg[WGET_TEST_SEG];
+	int j;
+
+	for (j = 0; j < srv->lost_len; j++)
+		seg[j] = wget_test_byte(srv->lost_pos + j);
+	srv->resent = true;
+
+	return sb_wget_reply(dev, packet, TCP_ACK, srv->lost_seq, ack, seg,
+			     srv->lost_len);
+}
+
+static int sb_wget_srv_handler(struct udevice *dev, void *packet,
+			       unsigned int len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct wget_test_srv *srv = priv->priv;
+	struct ethernet_hdr *eth = packet;
+	struct ip_tcp_hdr *tcp = packet + ETHER_HDR_SIZE;
+	int hdr_len, payload_len;
+	u32 ack;
+
+	if (ntohs(eth->et_protlen) == PROT_ARP)
+		return sb_arp_handler(dev, packet, len);
+	if (ntohs(eth->et_protlen) != PROT_IP || tcp->ip_p != IPPROTO_TCP)
+		return -EPROTONOSUPPORT;
+
+	if (tcp->tcp_flags & TCP_RST)
+		return 0;
+	hdr_len = IP_HDR_SIZE + (tcp->tcp_hlen >> 2);
+	if (tcp->tcp_flags == TCP_SYN) {
+		srv->conns++;
+		srv->sending = false;
+		srv->fin = false;
+		srv->win_scale = -1;
+		srv->sack_ok = false;
+		sb_wget_parse_opts(srv, tcp, hdr_len);
+		if (srv->syn_opts)
+			return sb_wget_syn_opts(dev, packet);
+		return sb_syn_handler(dev, packet, len);
+	}
+
+	sb_wget_parse_opts(srv, tcp, hdr_len);
+	srv->win = ntohs(tcp->tcp_win);
+	payload_len = ntohs(tcp->ip_len) - hdr_len;
+	ack = ntohl(tcp->tcp_seq) + payload_len;
+
+	/* Acknowledge the FIN which ends the transfer */
+	if (tcp->tcp_flags & TCP_FIN)
+		return sb_wget_reply(dev, packet, TCP_ACK, srv->seq + 1,
+				     ack + 1, NULL, 0);
+	if (payload_len > 0 && !srv->sending)
+		return sb_wget_request(dev, packet, ack,
+				       (void *)tcp + hdr_len, payload_len);
+
+	/* Resend a lost segment once the client reports the hole */
+	if (srv->lost_len && !srv->resent &&
+	    ntohl(tcp->tcp_ack) == srv->lost_seq)
+		return sb_wget_resend(dev, packet, ack);
+
+	/* Carry on once everything sent so far is acknowledged */
+	if (srv->sending && !srv->fin && ntohl(tcp->tcp_ack) == srv->seq)
+		return sb_wget_data(dev, packet, ack);
+
+	return 0;
+}
+
+/* Fetch a file of @size bytes with the fake server, writing to storage */
+static int wget_test_storage(struct unit_test_state *uts,
+			     struct wget_test_srv *srv, const char *args)
+{
+	int ret;
+
+	srv->conns = 0;
+	srv->range = 0;
+	sandbox_eth_set_tx_handler(0, sb_wget_srv_handler);
+	sandbox_eth_set_priv(0, srv);
+
+	env_set("ethact", "eth@10002000");
+	env_set("ethrotate", "no");
+	ret = run_commandf("wget %s 1.1.2.2:/file.img", args);
+
+	sandbox_eth_set_tx_handler(0, NULL);
+	sandbox_eth_set_priv(0, NULL);
+
+	return ret;
+}
+
+/* Check the data written to a block device */
+static int wget_test_check_blk(struct unit_test_state *uts, const char *ifname,
+			       const char *dev_str, ulong size)
+{
+	struct blk_desc *desc;
+	lbaint_t blks;
+	uchar *buf;
+	ulong i;
+
+	ut_asserteq(size, env_get_hex("filesize", 0));
+	ut_assert(blk_get_device_by_str(ifname, dev_str, &desc) >= 0);
+	blks = DIV_ROUND_UP(size, desc->blksz);
+	buf = malloc(blks * desc->blksz);
+	ut_assertnonnull(buf);
+	ut_asserteq(blks, blk_dread(desc, 0, blks, buf));
+	for (i = 0; i < size; i++)
+		ut_asserteq(wget_test_byte(i), buf[i]);
+
+	/* The rest of the last block is padded */
+	for (; i < blks * desc->blksz; i++)
+		ut_asserteq(0, buf[i]);
+	free(buf);
+
+	return 0;
+}
+
+/* Check that the write-behind buffer is written out as it fills */
+static int net_test_wget_blk_flush(struct unit_test_state *uts)
+{
+	ulong fsize = CONFIG_WGET_STREAM_BUF_SIZE * 2;
+	struct wget_test_srv srv = {
+		/* This only fits if half the buffer is written at a time */
+		.size = CONFIG_WGET_STREAM_BUF_SIZE * 3 / 2 + 100,
+	};
+	char *buf;
+
+	buf = calloc(1, fsize);
+	ut_assertnonnull(buf);
+	ut_assertok(os_write_file("wget.img", buf, fsize));
+	free(buf);
+	ut_assertok(run_command("host bind 0 wget.img", 0));
+
+	ut_assertok(wget_test_storage(uts, &srv, "-b host 0"));
+	ut_asserteq(1, srv.conns);
+	ut_assertok(wget_test_check_blk(uts, "host", "0", srv.size));
+
+	ut_assertok(run_command("host unbind 0", 0));
+	os_unlink("wget.img");
+
+	return 0;
+}
+
+LIB_TEST(net_test_wget_blk_flush, 0);
+
+/* Check that a dropped connection is resumed with a Range request */
+static int net_test_wget_resume(struct unit_test_state *uts)
+{
+	struct wget_test_srv srv = {
+		.size = 0x6000 + 100,
+		.close_at = 0x2345,
+	};
+
+	ut_assertok(wget_test_storage(uts, &srv, "-b mmc 0:0"));
+	ut_asserteq(2, srv.conns);
+	ut_asserteq(0x2345, srv.range);
+	ut_assertok(wget_test_check_blk(uts, "mmc", "0", srv.size));
+
+	return 0;
+}
+
+LIB_TEST(net_test_wget_resume, 0);
+
+/* Check resuming with a server which sends the whole file again */
+static int net_test_wget_range_ignored(struct unit_test_state *uts)
+{
+	struct wget_test_srv srv = {
+		.size = 0x6000 + 100,
+		.close_at = 0x2345,
+		.ignore_range = true,
+	};
+
+	ut_assertok(wget_test_storage(uts, &srv, "-b mmc 0:0"));
+	ut_asserteq(2, srv.conns);
+	ut_asserteq(0x2345, srv.range);
+	ut_assertok(wget_test_check_blk(uts, "mmc", "0", srv.size));
+
+	return 0;
+}
+
+LIB_TEST(net_test_wget_range_ignored, 0);
+
+/* Check that a reply for the wrong part of the file is rejected */
+static int net_test_wget_range_bad(struct unit_test_state *uts)
+{
+	struct wget_test_srv srv = {
+		.size = 0x6000 + 100,
+		.close_at = 0x2345,
+		.range_skew = 0x10,
+	};
+
+	ut_asserteq(1, wget_test_storage(uts, &srv, "-b mmc 0:0"));
+	ut_asserteq(2, srv.conns);
+	ut_asserteq(0x2345, srv.range);
+
+	return 0;
+}
+
+LIB_TEST(net_test_wget_range_bad, 0);
+
+/* Get the receive window which the client should advertise */
+static uint wget_test_rcv_window(void)
+{
+	return CONFIG_PROT_TCP_RCV_WINDOW ?: PKTBUFSRX * TCP_MSS;
+}
+
+/* Check that the window is scaled only if the server agrees */
+static int net_test_wget_win_scale(struct unit_test_state *uts)
+{
+	struct wget_test_srv srv = {
+		.size = 0x3000,
+		.syn_opts = true,
+	};
+	uint win = wget_test_rcv_window();
+	int scale;
+
+	for (scale = 0; (win >> scale) > 0xffff; scale++)
+		;
+
+	ut_assertok(wget_test_storage(uts, &srv, "-b mmc 0:0"));
+	ut_asserteq(scale, srv.win_scale);
+	ut_asserteq(win >> scale, srv.win);
+	ut_assertok(wget_test_check_blk(uts, "mmc", "0", srv.size));
+
+	/* Without the server's agreement the window is not scaled */
+	srv.syn_opts = false;
+	ut_assertok(wget_test_storage(uts, &srv, "-b mmc 0:0"));
+	ut_asserteq(scale, srv.win_scale);
+	ut_asserteq(min_t(uint, win, 0xffff), srv.win);
+	ut_assertok(wget_test_check_blk(uts, "mmc", "0", srv.size));
+
+	return 0;
+}
+
+LIB_TEST(net_test_wget_win_scale, 0);
+
+/* Check that a lost segment is reported with SACK if the server allows it */
+static int net_test_wget_sack(struct unit_test_state *uts)
+{
+	struct wget_test_srv srv = {
+		.size = 0x6000 + 100,
+		.syn_opts = true,
+		.lose_at = 0x1000,
+	};
+
+	ut_assertok(wget_test_storage(uts, &srv, "-b mmc 0:0"));
+	ut_asserteq(1, srv.conns);
+	ut_assert(srv.resent);
+	ut_asserteq(IS_ENABLED(CONFIG_PROT_TCP_SACK), srv.sack_ok);
+	ut_asserteq(IS_ENABLED(CONFIG_PROT_TCP_SACK), srv.sack_seen);
+	ut_asserteq(IS_ENABLED(CONFIG_PROT_TCP_SACK), srv.sacked);
+	ut_assertok(wget_test_check_blk(uts, "mmc", "0", srv.size));
+
+	/* No SACK blocks unless the server permits them */
+	memset(&srv, '\0', sizeof(srv));
+	srv.size = 0x6000 + 100;
+	srv.lose_at = 0x1000;
+	ut_assertok(wget_test_storage(uts, &srv, "-b mmc 0:0"));
+	ut_assert(srv.resent);
+	ut_assert(!srv.sack_seen);
+	ut_assertok(wget_test_check_blk(uts, "mmc", "0", srv.size));
+
+	return 0;
+}
+
+LIB_TEST(net_test_wget_sack, 0);
+
+#if IS_ENABLED(CONFIG_SPI_FLASH_MTD)
+/* Check writing to an MTD device, using the sandbox SPI flash */
+static int dm_test_wget_mtd(struct unit_test_state *uts)
+{
+	struct sandbox_state *state = state_get_current();
+	struct wget_test_srv srv = {
+		.size = 0x18000 + 100,
+	};
+	ulong fsize = 0x200000;
+	struct mtd_info *mtd;
+	size_t retlen;
+	uchar *buf;
+	ulong i, top;
+	int cs;
+
+	buf = calloc(1, fsize);
+	ut_assertnonnull(buf);
+	ut_assertok(os_write_file("spi.bin", buf, fsize));
+
+	ut_assertok(wget_test_storage(uts, &srv, "-m nor0"));
+	ut_asserteq(1, srv.conns);
+	ut_asserteq(srv.size, env_get_hex("filesize", 0));
+
+	mtd = get_mtd_device_nm("nor0");
+	ut_assert(!IS_ERR_OR_NULL(mtd));
+	ut_assertok(mtd_read(mtd, 0, fsize, &retlen, buf));
+	ut_asserteq(fsize, retlen);
+	for (i = 0; i < srv.size; i++)
+		ut_asserteq(wget_test_byte(i), buf[i]);
+
+	/* The rest of the last eraseblock is erased; the next is untouched */
+	top = roundup(srv.size, mtd->erasesize);
+	for (; i < top; i++)
+		ut_asserteq(0xff, buf[i]);
+	for (; i < top + mtd->erasesize; i++)
+		ut_asserteq(0, buf[i]);
+	put_mtd_device(mtd);
+	free(buf);
+
+	/*
+	 * Since we are about to destroy all devices, we must tell sandbox
+	 * to forget the emulation devices
+	 */
+	for (cs = 0; cs < CONFIG_SANDBOX_SPI_MAX_CS; cs++) {
+		if (state->spi[0][cs].emul)
+			sandbox_sf_unbind_emul(state, 0, cs);
+	}
+
+	return 0;
+}
+
+DM_TEST(dm_test_wget_mtd, UT_TESTF_SCAN_PDATA | UT_TESTF_SCAN_FDT);
+#endif
+#endif
@@ -0,0 +1,108 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Unit tests for the bootstage tree
+ */
+
+#include <common.h>
+#include <bootstage.h>
+#include <console.h>
+#include <malloc.h>
+#include <asm/global_data.h>
+#include <linux/delay.h>
+#include <test/common.h>
+#include <test/test.h>
+#include <test/ut.h>
+
+DECLARE_GLOBAL_DATA_PTR;
+
+/* Width of the Start, Total and Self columns in 'bootstage tree' */
+#define TREE_TIME_WIDTH		33
+
+static int check_tree(struct unit_test_state *uts)
+{
+	console_record_reset_enable();
+	bootstage_tree_report();
+	ut_assert_nextline("Boot-time tree in microseconds (3 spans):");
+	ut_assert_nextline("      Start      Total       Self  Type     Name");
+
+	/* The slow device comes first, since it has the most self time */
+	ut_assert_skipline();
+	ut_asserteq_str("  initcall initcall 0x1234",
+			uts->actual_str + TREE_TIME_WIDTH);
+	ut_assert_skipline();
+	ut_asserteq_str("  probe      slow", uts->actual_str + TREE_TIME_WIDTH);
+	ut_assert_skipline();
+	ut_asserteq_str("  bind       fast", uts->actual_str + TREE_TIME_WIDTH);
+	ut_assert_console_end();
+
+	return 0;
+}
+
+static int check_trace(struct unit_test_state *uts)
+{
+	char buf[1024];
+	int len;
+
+	len = bootstage_trace_export(NULL, 0);
+	ut_assert(len > 0 && len < sizeof(buf));
+	ut_asserteq(len, bootstage_trace_export(buf, sizeof(buf)));
+	ut_asserteq(len, strlen(buf));
+	ut_asserteq_strn("{\"traceEvents\":[", buf);
+	ut_assertnonnull(strstr(buf, "{\"name\":\"reset\",\"cat\":\"mark\","));
+	ut_assertnonnull(strstr(buf,
+		"{\"name\":\"initcall 0x1234\",\"cat\":\"initcall\","));
+	ut_assertnonnull(strstr(buf, "{\"name\":\"slow\",\"cat\":\"probe\","));
+	ut_assertnonnull(strstr(buf, "{\"name\":\"fast\",\"cat\":\"bind\","));
+	ut_assertnonnull(strstr(buf, "\"dropped_spans\":0}}\n"));
+
+	/* A short buffer gets truncated output, but the full length back */
+	ut_asserteq(len, bootstage_trace_export(buf, 10));
+	ut_asserteq(9, strlen(buf));
+
+	return 0;
+}
+
+static int check_spans(struct unit_test_state *uts)
+{
+	int outer, fast, slow;
+	int i;
+
+	outer = bootstage_span_start(BOOTSTAGE_SPAN_INITCALL, NULL, 0x1234);
+	ut_assertok(outer);
+	fast = bootstage_span_start(BOOTSTAGE_SPAN_BIND, "fast", 0);
+	ut_asserteq(1, fast);
+	bootstage_span_end(fast);
+	slow = bootstage_span_start(BOOTSTAGE_SPAN_PROBE, "slow", 0);
+	ut_asserteq(2, slow);
+	mdelay(5);
+	bootstage_span_end(slow);
+	bootstage_span_end(outer);
+
+	ut_assertok(check_tree(uts));
+	ut_assertok(check_trace(uts));
+
+	/* Fill up the table, so that the next span is dropped */
+	for (i = 3; i < CONFIG_BOOTSTAGE_TREE_COUNT; i++)
+		bootstage_span_end(bootstage_span_start(BOOTSTAGE_SPAN_BIND,
+							"", 0));
+	ut_asserteq(-ENOSPC, bootstage_span_start(BOOTSTAGE_SPAN_BIND, "", 0));
+
+	return 0;
+}
+
+/* Test recording nested spans and reporting them */
+static int test_bootstage_tree(struct unit_test_state *uts)
+{
+	struct bootstage_data *old = gd->bootstage;
+	int ret;
+
+	/* Use a new table, so the spans from boot do not get in the way */
+	ut_assertok(bootstage_init(true));
+	ret = check_spans(uts);
+	free(gd->bootstage);
+	gd->bootstage = old;
+	ut_assertok(ret);
+
+	return 0;
+}
+COMMON_TEST(test_bootstage_tree, 0);
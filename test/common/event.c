@@ -9,10 +9,14 @@
 #include <common.h>
 #include <dm.h>
 #include <event.h>
+#include <event_internal.h>
+#include <asm/global_data.h>
 #include <test/common.h>
 #include <test/test.h>
 #include <test/ut.h>
 
+DECLARE_GLOBAL_DATA_PTR;
+
 struct test_state {
 	struct udevice *dev;
 	int val;
@@ -105,3 +109,48 @@ static int test_event_probe(struct unit_test_state *uts)
 	return 0;
 }
 COMMON_TEST(test_event_probe, UT_TESTF_DM | UT_TESTF_SCAN_FDT);
+
+/* Check that spies are indexed by type and events are counted */
+static int test_event_stats(struct unit_test_state *uts)
+{
+	struct evspy_info *start =
+		ll_entry_start(struct evspy_info, evspy_info);
+	struct event_state *ev_state = gd_event_state();
+	struct event_type_info *info = &ev_state->type[EVT_TEST];
+	struct test_state state;
+	struct evspy_info *spy;
+	int signal, found;
+	uint count;
+
+	if (!CONFIG_IS_ENABLED(EVENT_DEBUG))
+		return -EAGAIN;
+
+	/* Make sure the index is set up */
+	ut_assertok(event_notify_null(EVT_TEST));
+	ut_assert(ev_state->indexed);
+
+	/* The static spy for this type is in its range */
+	found = 0;
+	for (spy = start + info->first; spy < start + info->end; spy++) {
+		if (spy->type == EVT_TEST)
+			found++;
+	}
+	ut_asserteq(1, found);
+
+	count = info->count;
+	state.val = 0;
+	ut_asserteq(0, info->dynamic);
+	ut_assertok(event_register("wibble", EVT_TEST, h_adder, &state));
+	ut_asserteq(1, info->dynamic);
+
+	signal = 5;
+	ut_assertok(event_notify(EVT_TEST, &signal, sizeof(signal)));
+	ut_asserteq(5, state.val);
+	ut_asserteq(count + 1, info->count);
+
+	/* Other types are not affected */
+	ut_asserteq(0, ev_state->type[EVT_MAIN_LOOP].dynamic);
+
+	return 0;
+}
+COMMON_TEST(test_event_stats, 0);
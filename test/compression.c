@@ -610,6 +610,95 @@ static int compression_test_bootm_none(struct unit_test_state *uts)
 }
 COMPRESSION_TEST(compression_test_bootm_none, 0);
 
+/* Size of each piece passed to the stream decompressors after the first */
+#define STREAM_PIECE	7
+
+static int compression_test_gunzip_stream(struct unit_test_state *uts)
+{
+	const ulong plain_size = sizeof(plain) - 1;
+	struct gunzip_stream gs;
+	char comp[TEST_BUFFER_SIZE], out[TEST_BUFFER_SIZE];
+	ulong comp_size, pos, len;
+	int ret;
+
+	ut_assertok(compress_using_gzip(uts, (void *)plain, plain_size, comp,
+					sizeof(comp), &comp_size));
+
+	/* the first piece must hold the header; feed the rest bit by bit */
+	memset(out, '\0', sizeof(out));
+	ut_assertok(gunzip_stream_start(&gs, out, sizeof(out)));
+	ut_assertok(gunzip_stream_write(&gs, comp, 16));
+	for (pos = 16; pos < comp_size; pos += len) {
+		len = min_t(ulong, comp_size - pos, STREAM_PIECE);
+		ut_assertok(gunzip_stream_write(&gs, comp + pos, len));
+	}
+	ut_assertok(gunzip_stream_end(&gs, &len));
+	ut_asserteq(plain_size, len);
+	ut_asserteq_mem(plain, out, plain_size);
+
+	/* output buffer too small */
+	ut_assertok(gunzip_stream_start(&gs, out, 10));
+	ret = gunzip_stream_write(&gs, comp, comp_size);
+	ut_asserteq(-ENOSPC, ret);
+	ut_asserteq(-EINVAL, gunzip_stream_end(&gs, &len));
+	ut_asserteq(10, len);
+
+	/* truncated input */
+	ut_assertok(gunzip_stream_start(&gs, out, sizeof(out)));
+	ut_assertok(gunzip_stream_write(&gs, comp, comp_size / 2));
+	ut_asserteq(-EINVAL, gunzip_stream_end(&gs, &len));
+
+	/* bad header */
+	ut_assertok(gunzip_stream_start(&gs, out, sizeof(out)));
+	ut_asserteq(-EINVAL, gunzip_stream_write(&gs, plain, 16));
+	ut_asserteq(-EINVAL, gunzip_stream_end(&gs, &len));
+
+	return 0;
+}
+COMPRESSION_TEST(compression_test_gunzip_stream, 0);
+
+static int compression_test_zstd_stream(struct unit_test_state *uts)
+{
+	const ulong plain_size = sizeof(plain) - 1;
+	struct zstd_stream zs;
+	char out[TEST_BUFFER_SIZE];
+	ulong pos, len;
+	int ret;
+
+	/* the first piece must hold the frame header */
+	memset(out, '\0', sizeof(out));
+	zstd_stream_start(&zs, out, sizeof(out));
+	ut_assertok(zstd_stream_write(&zs, zstd_compressed, 32));
+	for (pos = 32; pos < zstd_compressed_size; pos += len) {
+		len = min_t(ulong, zstd_compressed_size - pos, STREAM_PIECE);
+		ut_assertok(zstd_stream_write(&zs, zstd_compressed + pos, len));
+	}
+	ut_assertok(zstd_stream_end(&zs, &len));
+	ut_asserteq(plain_size, len);
+	ut_asserteq_mem(plain, out, plain_size);
+
+	/* output buffer too small */
+	zstd_stream_start(&zs, out, 10);
+	ret = zstd_stream_write(&zs, zstd_compressed, zstd_compressed_size);
+	ut_asserteq(-ENOSPC, ret);
+	ut_asserteq(-EINVAL, zstd_stream_end(&zs, &len));
+	ut_asserteq(10, len);
+
+	/* truncated input */
+	zstd_stream_start(&zs, out, sizeof(out));
+	ut_assertok(zstd_stream_write(&zs, zstd_compressed,
+				      zstd_compressed_size / 2));
+	ut_asserteq(-EINVAL, zstd_stream_end(&zs, &len));
+
+	/* bad frame header */
+	zstd_stream_start(&zs, out, sizeof(out));
+	ut_asserteq(-EINVAL, zstd_stream_write(&zs, plain, 32));
+	ut_asserteq(-EINVAL, zstd_stream_end(&zs, &len));
+
+	return 0;
+}
+COMPRESSION_TEST(compression_test_zstd_stream, 0);
+
 int do_ut_compression(struct cmd_tbl *cmdtp, int flag, int argc,
 		      char *const argv[])
 {
@@ -6,11 +6,14 @@
 #include <common.h>
 #include <blk.h>
 #include <dm.h>
+#include <malloc.h>
 #include <part.h>
 #include <sandbox_host.h>
 #include <usb.h>
 #include <asm/global_data.h>
 #include <asm/state.h>
+#include <dm/device-internal.h>
+#include <dm/root.h>
 #include <dm/test.h>
 #include <test/test.h>
 #include <test/ut.h>
@@ -335,3 +338,217 @@ static int dm_test_blk_foreach(struct unit_test_state *uts)
 	return 0;
 }
 DM_TEST(dm_test_blk_foreach, UT_TESTF_SCAN_PDATA | UT_TESTF_SCAN_FDT);
+
+#if CONFIG_IS_ENABLED(BLOCK_CACHE)
+/* Test the block cache, including read-ahead for sequential streams */
+static int dm_test_blk_cache(struct unit_test_state *uts)
+{
+	struct block_cache_stats stats;
+	struct blk_desc *desc;
+	char write[16 * 512], read[16 * 512];
+	int i;
+
+	ut_assertok(blk_get_device_by_str("mmc", "0", &desc));
+	ut_asserteq(512, desc->blksz);
+	for (i = 0; i < sizeof(write); i++)
+		write[i] = i / 3;
+	ut_asserteq(16, blk_dwrite(desc, 0, 16, write));
+
+	blkcache_configure(8, 32);
+	blkcache_configure_dev(0, 64);
+	blkcache_stats(&stats);
+
+	/* the same block twice: one miss then one hit */
+	ut_asserteq(1, blk_dread(desc, 5, 1, read));
+	ut_asserteq(1, blk_dread(desc, 5, 1, read));
+	ut_asserteq_mem(&write[5 * 512], read, 512);
+	blkcache_stats(&stats);
+	ut_asserteq(1, stats.hits);
+	ut_asserteq(1, stats.misses);
+	ut_asserteq(0, stats.readaheads);
+
+	/* a sequential stream reads ahead to the end of the next line */
+	blkcache_invalidate(-1, 0);
+	for (i = 0; i < 16; i++) {
+		ut_asserteq(1, blk_dread(desc, i, 1, &read[i * 512]));
+		blkcache_stats(&stats);
+		if (i < 2)
+			ut_asserteq(1, stats.misses);
+		else
+			ut_asserteq(1, stats.hits);
+		ut_asserteq(i == 1, stats.readaheads);
+	}
+	ut_asserteq_mem(write, read, sizeof(write));
+
+	/* writing invalidates the cache */
+	ut_asserteq(1, blk_dwrite(desc, 3, 1, write));
+	blkcache_stats(&stats);
+	ut_asserteq(0, stats.entries);
+
+	/* a per-device limit caps what is cached */
+	blkcache_configure_dev(2 * 512, 0);
+	for (i = 0; i < 4; i++)
+		ut_asserteq(1, blk_dread(desc, i * 8, 1, read));
+	blkcache_stats(&stats);
+	ut_asserteq(2, stats.entries);
+
+	blkcache_configure(CONFIG_BLOCK_CACHE_BLOCKS,
+			   CONFIG_BLOCK_CACHE_ENTRIES);
+	blkcache_configure_dev(CONFIG_BLOCK_CACHE_DEV_SIZE,
+			       CONFIG_BLOCK_CACHE_READAHEAD);
+
+	return 0;
+}
+DM_TEST(dm_test_blk_cache, UT_TESTF_SCAN_PDATA | UT_TESTF_SCAN_FDT);
+#endif
+
+#if IS_ENABLED(CONFIG_BOUNCE_BUFFER)
+#define BLK_TEST_ALIGN		64
+#define BLK_TEST_BLOCKS		16
+
+/* Contents of the blk_test_align device and a log of its transfers */
+static u8 blk_test_data[BLK_TEST_BLOCKS * 512];
+static int blk_test_xfers;
+static bool blk_test_bad_buf;
+static void *blk_test_reject;
+
+/* Buffers must be aligned and must not include the block at blk_test_reject */
+static bool blk_test_buf_ok(void *buf, ulong len)
+{
+	if (!IS_ALIGNED((ulong)buf, BLK_TEST_ALIGN))
+		return false;
+
+	return !blk_test_reject || buf + len <= blk_test_reject ||
+		buf >= blk_test_reject + 512;
+}
+
+static ulong blk_test_read(struct udevice *dev, lbaint_t start,
+			   lbaint_t blkcnt, void *buf)
+{
+	/* the partition scan reads past the end of this small device */
+	if (start >= BLK_TEST_BLOCKS)
+		return 0;
+	blkcnt = min_t(lbaint_t, blkcnt, BLK_TEST_BLOCKS - start);
+	if (!blk_test_buf_ok(buf, blkcnt * 512))
+		blk_test_bad_buf = true;
+	blk_test_xfers++;
+	memcpy(buf, blk_test_data + start * 512, blkcnt * 512);
+
+	return blkcnt;
+}
+
+static ulong blk_test_write(struct udevice *dev, lbaint_t start,
+			    lbaint_t blkcnt, const void *buf)
+{
+	if (start >= BLK_TEST_BLOCKS)
+		return 0;
+	blkcnt = min_t(lbaint_t, blkcnt, BLK_TEST_BLOCKS - start);
+	if (!blk_test_buf_ok((void *)buf, blkcnt * 512))
+		blk_test_bad_buf = true;
+	blk_test_xfers++;
+	memcpy(blk_test_data + start * 512, buf, blkcnt * 512);
+
+	return blkcnt;
+}
+
+static ulong blk_test_get_align(struct udevice *dev)
+{
+	return BLK_TEST_ALIGN;
+}
+
+static int blk_test_buffer_aligned(struct udevice *dev,
+				   struct bounce_buffer *state)
+{
+	return blk_test_buf_ok(state->bounce_buffer, state->len);
+}
+
+static const struct blk_ops blk_test_align_ops = {
+	.read		= blk_test_read,
+	.write		= blk_test_write,
+	.get_align	= blk_test_get_align,
+	.buffer_aligned	= blk_test_buffer_aligned,
+};
+
+U_BOOT_DRIVER(blk_test_align) = {
+	.name		= "blk_test_align",
+	.id		= UCLASS_BLK,
+	.ops		= &blk_test_align_ops,
+};
+
+/* Read @blkcnt blocks at @start into @buf and check the transfers used */
+static int blk_test_check_read(struct unit_test_state *uts,
+			       struct udevice *dev, lbaint_t start,
+			       lbaint_t blkcnt, void *buf, int xfers)
+{
+	blk_test_xfers = 0;
+	blk_test_bad_buf = false;
+	memset(buf, '\0', blkcnt * 512);
+	ut_asserteq(blkcnt, blk_read(dev, start, blkcnt, buf));
+	ut_asserteq(xfers, blk_test_xfers);
+	ut_assert(!blk_test_bad_buf);
+	ut_asserteq_mem(blk_test_data + start * 512, buf, blkcnt * 512);
+
+	return 0;
+}
+
+/* Test transfers with buffers that the driver cannot use directly */
+static int dm_test_blk_align(struct unit_test_state *uts)
+{
+	struct blk_desc *desc;
+	struct udevice *dev;
+	u8 *buf;
+	int i;
+
+	ut_assertok(blk_create_devicef(dm_root(), "blk_test_align", "align",
+				       UCLASS_HOST, -1, 512, BLK_TEST_BLOCKS,
+				       &dev));
+	ut_assertok(device_probe(dev));
+	desc = dev_get_uclass_plat(dev);
+	desc->bb = true;
+	ut_asserteq(BLK_TEST_ALIGN, blk_get_buffer_align(desc));
+#if CONFIG_IS_ENABLED(BLOCK_CACHE)
+	/* make sure that every read reaches the driver */
+	blkcache_configure(0, 0);
+#endif
+
+	for (i = 0; i < sizeof(blk_test_data); i++)
+		blk_test_data[i] = i / 3;
+	buf = memalign(BLK_TEST_ALIGN, (BLK_TEST_BLOCKS + 1) * 512);
+	ut_assertnonnull(buf);
+
+	/* an aligned buffer goes straight to the driver */
+	blk_test_reject = NULL;
+	ut_assertok(blk_test_check_read(uts, dev, 2, 8, buf, 1));
+
+	/* a misaligned buffer is bounced as a whole, in a single transfer */
+	ut_assertok(blk_test_check_read(uts, dev, 0, 8, buf + 1, 1));
+
+	blk_test_xfers = 0;
+	memset(buf + 1, 0xaa, 8 * 512);
+	ut_asserteq(8, blk_write(dev, 4, 8, buf + 1));
+	ut_asserteq(1, blk_test_xfers);
+	ut_assert(!blk_test_bad_buf);
+	ut_asserteq_mem(buf + 1, blk_test_data + 4 * 512, 8 * 512);
+
+	/* only a rejected block at the head or tail is bounced */
+	blk_test_reject = buf;
+	ut_assertok(blk_test_check_read(uts, dev, 0, 8, buf, 2));
+	blk_test_reject = buf + 7 * 512;
+	ut_assertok(blk_test_check_read(uts, dev, 0, 8, buf, 2));
+
+	/* a rejected block in the middle bounces the whole transfer */
+	blk_test_reject = buf + 3 * 512;
+	ut_assertok(blk_test_check_read(uts, dev, 0, 8, buf, 1));
+
+	free(buf);
+#if CONFIG_IS_ENABLED(BLOCK_CACHE)
+	blkcache_configure(CONFIG_BLOCK_CACHE_BLOCKS,
+			   CONFIG_BLOCK_CACHE_ENTRIES);
+#endif
+	ut_assertok(device_remove(dev, DM_REMOVE_NORMAL));
+	ut_assertok(device_unbind(dev));
+
+	return 0;
+}
+DM_TEST(dm_test_blk_align, UT_TESTF_SCAN_PDATA | UT_TESTF_SCAN_FDT);
+#endif
@@ -13,10 +13,12 @@
 #include <malloc.h>
 #include <asm/global_data.h>
 #include <dm/device-internal.h>
+#include <dm/lists.h>
 #include <dm/root.h>
 #include <dm/util.h>
 #include <dm/test.h>
 #include <dm/uclass-internal.h>
+#include <linux/err.h>
 #include <test/test.h>
 #include <test/ut.h>
 
@@ -81,6 +83,11 @@ static struct driver_info driver_info_act_dma_vital_clk = {
 	.name = "test_act_dma_vital_clk_drv",
 };
 
+static struct driver_info driver_info_defer = {
+	.name = "test_defer_drv",
+	.plat = &test_pdata_manual,
+};
+
 void dm_leak_check_start(struct unit_test_state *uts)
 {
 	uts->start = mallinfo();
@@ -1017,6 +1024,126 @@ static int dm_test_uclass_before_ready(struct unit_test_state *uts)
 }
 DM_TEST(dm_test_uclass_before_ready, 0);
 
+/* Test that uclass_find() looks uclasses up without walking the list */
+static int dm_test_uclass_find_array(struct unit_test_state *uts)
+{
+	int id, count = 0, found, bad;
+	struct list_head saved;
+	struct uclass *uc;
+
+	if (!CONFIG_IS_ENABLED(DM_UCLASS_ARRAY))
+		return -EAGAIN;
+
+	/* Create as many uclasses as possible */
+	for (id = UCLASS_ROOT + 1; id < UCLASS_COUNT; id++) {
+		if (!lists_uclass_lookup(id) || uclass_get(id, &uc))
+			continue;
+		ut_asserteq_ptr(uc, uclass_find(id));
+		count++;
+	}
+	ut_assert(count > 50);
+
+	/*
+	 * Hide the list of uclasses. Every lookup must still succeed, so none
+	 * of them can depend on the number of uclasses present. Put the list
+	 * back before checking anything, so a failure does not break other
+	 * tests.
+	 */
+	saved = *gd->uclass_root;
+	INIT_LIST_HEAD(gd->uclass_root);
+	for (id = 0, found = 0, bad = 0; id < UCLASS_COUNT; id++) {
+		uc = uclass_find(id);
+		if (uc) {
+			found++;
+			if (uc->uc_drv->id != id)
+				bad++;
+		}
+	}
+	*gd->uclass_root = saved;
+
+	ut_asserteq(0, bad);
+	/* The root uclass is there as well */
+	ut_asserteq(count + 1, found);
+	ut_assertnull(uclass_find(UCLASS_INVALID));
+
+	/* Destroying a uclass must remove it from the array too */
+	uc = uclass_find(UCLASS_TEST);
+	ut_assertok(uclass_destroy(uc));
+	ut_assertnull(uclass_find(UCLASS_TEST));
+	ut_assertok(uclass_get(UCLASS_TEST, &uc));
+	ut_asserteq_ptr(uc, uclass_find(UCLASS_TEST));
+
+	return 0;
+}
+DM_TEST(dm_test_uclass_find_array, 0);
+
+static int dm_test_defer_done(struct udevice *dev, void *ctx)
+{
+	int *count = ctx;
+
+	(*count)++;
+
+	return 0;
+}
+
+/* Test that drivers can defer waiting for their hardware while probing */
+static int dm_test_probe_defer(struct unit_test_state *uts)
+{
+	int probe = dm_testdrv_op_count[DM_TEST_OP_PROBE];
+	int post = dm_testdrv_op_count[DM_TEST_OP_POST_PROBE];
+	struct udevice *dev1, *dev2;
+	int done = 0;
+
+	if (!CONFIG_IS_ENABLED(DM_PROBE_ASYNC))
+		return -EAGAIN;
+
+	ut_assertok(device_bind_by_name(uts->root, false, &driver_info_defer,
+					&dev1));
+	ut_assertok(device_bind_by_name(uts->root, false, &driver_info_defer,
+					&dev2));
+
+	/* Normally probe() waits until the hardware is ready */
+	ut_assertok(device_probe(dev1));
+	ut_asserteq(DM_FLAG_ACTIVATED, dev_get_flags(dev1) &
+		    (DM_FLAG_ACTIVATED | DM_FLAG_PROBE_DEFERRED));
+	ut_asserteq(probe + 1, dm_testdrv_op_count[DM_TEST_OP_PROBE]);
+	ut_asserteq(post + 1, dm_testdrv_op_count[DM_TEST_OP_POST_PROBE]);
+	ut_assertok(device_remove(dev1, DM_REMOVE_NORMAL));
+
+	/* While probing asynchronously, both waits are recorded */
+	ut_assertok(dm_probe_async_begin());
+	ut_assertok(device_probe(dev1));
+	ut_assertok(device_probe(dev2));
+	ut_assert(dev_get_flags(dev1) & DM_FLAG_PROBE_DEFERRED);
+	ut_assert(dev_get_flags(dev2) & DM_FLAG_PROBE_DEFERRED);
+	ut_asserteq(probe + 1, dm_testdrv_op_count[DM_TEST_OP_PROBE]);
+	ut_asserteq(post + 1, dm_testdrv_op_count[DM_TEST_OP_POST_PROBE]);
+
+	/* Probing a waiting device again waits for that device alone */
+	ut_assertok(device_probe(dev2));
+	ut_asserteq(DM_FLAG_ACTIVATED, dev_get_flags(dev2) &
+		    (DM_FLAG_ACTIVATED | DM_FLAG_PROBE_DEFERRED));
+	ut_assert(dev_get_flags(dev1) & DM_FLAG_PROBE_DEFERRED);
+	ut_asserteq(probe + 2, dm_testdrv_op_count[DM_TEST_OP_PROBE]);
+	ut_asserteq(post + 2, dm_testdrv_op_count[DM_TEST_OP_POST_PROBE]);
+
+	/* Finishing completes the rest and reports both devices */
+	ut_assertok(dm_probe_async_end(dm_test_defer_done, &done));
+	ut_asserteq(DM_FLAG_ACTIVATED, dev_get_flags(dev1) &
+		    (DM_FLAG_ACTIVATED | DM_FLAG_PROBE_DEFERRED));
+	ut_asserteq(probe + 3, dm_testdrv_op_count[DM_TEST_OP_PROBE]);
+	ut_asserteq(post + 3, dm_testdrv_op_count[DM_TEST_OP_POST_PROBE]);
+	ut_asserteq(2, done);
+
+	ut_assertok(device_remove(dev1, DM_REMOVE_NORMAL));
+	ut_assertok(device_unbind(dev1));
+	ut_assertok(device_remove(dev2, DM_REMOVE_NORMAL));
+	ut_assertok(device_unbind(dev2));
+
+	return 0;
+}
+DM_TEST(dm_test_probe_defer, 0);
+
 static int dm_test_uclass_devices_find(struct unit_test_state *uts)
 {
 	struct udevice *dev;
@@ -1353,3 +1480,87 @@ static int dm_test_dev_get_mem(struct unit_test_state *uts)
 	return 0;
 }
 DM_TEST(dm_test_dev_get_mem, UT_TESTF_SCAN_FDT);
+
+#if CONFIG_IS_ENABLED(DM_COMPAT_INDEX)
+/* Check that the index and a list walk give the same driver for @compat */
+static int check_compat_lookup(struct unit_test_state *uts, const char *compat)
+{
+	struct lists_compat_index *idx = gd_dm_compat_index();
+	const struct udevice_id *id_idx = NULL, *id_walk = NULL;
+	struct driver *drv_idx, *drv_walk;
+
+	drv_idx = lists_driver_lookup_compat(compat, &id_idx);
+
+	/* an index which could not be built makes lookups walk the list */
+	gd_set_dm_compat_index(ERR_PTR(-ENOSPC));
+	drv_walk = lists_driver_lookup_compat(compat, &id_walk);
+	gd_set_dm_compat_index(idx);
+
+	ut_asserteq_ptr(drv_walk, drv_idx);
+	ut_asserteq_ptr(id_walk, id_idx);
+
+	return 0;
+}
+
+/* Check every compatible string of @node and its subnodes */
+static int check_compat_node(struct unit_test_state *uts, ofnode node)
+{
+	const char *compat;
+	ofnode subnode;
+	int i;
+
+	for (i = 0; !ofnode_read_string_index(node, "compatible", i, &compat);
+	     i++)
+		ut_assertok(check_compat_lookup(uts, compat));
+
+	ofnode_for_each_subnode(subnode, node)
+		ut_assertok(check_compat_node(uts, subnode));
+
+	return 0;
+}
+
+/* Test that indexed and linear driver lookups bind the same drivers */
+static int dm_test_compat_index(struct unit_test_state *uts)
+{
+	struct driver *drv = ll_entry_start(struct driver, driver);
+	const int n_ents = ll_entry_count(struct driver, driver);
+	const struct udevice_id *of_match;
+	struct lists_compat_index *idx;
+	struct udevice *dev_idx, *dev_walk;
+	struct driver *entry;
+	ofnode node;
+
+	/* binding devices has built the index */
+	ut_assertnonnull(gd_dm_compat_index());
+	ut_assert(!IS_ERR(gd_dm_compat_index()));
+
+	for (entry = drv; entry != drv + n_ents; entry++) {
+		for (of_match = entry->of_match;
+		     of_match && of_match->compatible; of_match++)
+			ut_assertok(check_compat_lookup(uts,
+							of_match->compatible));
+	}
+	ut_assertok(check_compat_node(uts, ofnode_root()));
+	ut_assertok(check_compat_lookup(uts, "sandbox,no-such-device"));
+
+	/* bind a node both ways */
+	node = ofnode_path("/a-test");
+	ut_assert(ofnode_valid(node));
+	ut_assertok(lists_bind_fdt(dm_root(), node, &dev_idx, NULL, false));
+	ut_assertnonnull(dev_idx);
+
+	idx = gd_dm_compat_index();
+	gd_set_dm_compat_index(ERR_PTR(-ENOSPC));
+	ut_assertok(lists_bind_fdt(dm_root(), node, &dev_walk, NULL, false));
+	gd_set_dm_compat_index(idx);
+	ut_assertnonnull(dev_walk);
+
+	ut_asserteq_ptr(dev_walk->driver, dev_idx->driver);
+	ut_asserteq(dev_get_driver_data(dev_walk), dev_get_driver_data(dev_idx));
+	ut_assertok(device_unbind(dev_walk));
+	ut_assertok(device_unbind(dev_idx));
+
+	return 0;
+}
+DM_TEST(dm_test_compat_index, UT_TESTF_SCAN_FDT);
+#endif
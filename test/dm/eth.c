@@ -7,20 +7,28 @@
  */
 
 #include <common.h>
+#include <command.h>
+#include <console.h>
 #include <dm.h>
 #include <env.h>
 #include <fdtdec.h>
 #include <log.h>
 #include <malloc.h>
+#include <mapmem.h>
 #include <net.h>
 #include <net6.h>
+#include <time.h>
 #include <asm/eth.h>
+#include <asm/unaligned.h>
 #include <dm/test.h>
 #include <dm/device-internal.h>
 #include <dm/uclass-internal.h>
+#include <net/neigh.h>
 #include <test/test.h>
 #include <test/ut.h>
 #include <ndisc.h>
+#include "../../net/bootp.h"
+#include "../../net/nfs.h"
 
 #define DM_TEST_ETH_NUM		4
 
@@ -609,6 +617,804 @@ static int dm_test_eth_async_ping_reply(struct unit_test_state *uts)
 
 DM_TEST(dm_test_eth_async_ping_reply, UT_TESTF_SCAN_FDT);
 
+#if IS_ENABLED(CONFIG_NET_NEIGH)
+/* Check adding, looking up and expiring entries in the neighbour cache */
+static int dm_test_eth_neigh(struct unit_test_state *uts)
+{
+	uchar mac[ARP_HLEN] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 };
+	uchar found[ARP_HLEN];
+	struct in_addr ip;
+	int i;
+
+	neigh_flush();
+	ip = string_to_ip("1.1.2.10");
+	ut_assert(!neigh_lookup(ip, found));
+	neigh_update(ip, mac);
+	ut_assert(neigh_lookup(ip, found));
+	ut_asserteq_mem(mac, found, ARP_HLEN);
+
+	/* fill the cache; looking up the first entry keeps it */
+	for (i = 1; i < CONFIG_NET_NEIGH_SIZE; i++) {
+		timer_test_add_offset(1);
+		ip.s_addr = htonl(ntohl(ip.s_addr) + 1);
+		mac[5]++;
+		neigh_update(ip, mac);
+	}
+	timer_test_add_offset(1);
+	ut_assert(neigh_lookup(string_to_ip("1.1.2.10"), found));
+
+	/* so adding another drops the second, now least recently used */
+	ip.s_addr = htonl(ntohl(ip.s_addr) + 1);
+	neigh_update(ip, mac);
+	ut_assert(neigh_lookup(string_to_ip("1.1.2.10"), found));
+	ut_assert(!neigh_lookup(string_to_ip("1.1.2.11"), found));
+	ut_assert(neigh_lookup(ip, found));
+
+	/* entries expire */
+	timer_test_add_offset(CONFIG_NET_NEIGH_TIMEOUT * 1000);
+	ut_assert(!neigh_lookup(ip, found));
+	ut_asserteq(0, neigh_show());
+
+	return 0;
+}
+DM_TEST(dm_test_eth_neigh, UT_TESTF_SCAN_FDT);
+
+/* Check that an ARP reply is cached and shown by the neigh command */
+static int dm_test_eth_neigh_arp(struct unit_test_state *uts)
+{
+	struct eth_sandbox_priv *priv;
+	uchar found[ARP_HLEN];
+	struct udevice *dev;
+
+	neigh_flush();
+	net_ping_ip = string_to_ip("1.1.2.2");
+	env_set("ethact", "eth@10002000");
+	ut_assertok(net_loop(PING));
+
+	ut_assertok(uclass_get_device_by_name(UCLASS_ETH, "eth@10002000",
+					      &dev));
+	priv = dev_get_priv(dev);
+	ut_assert(neigh_lookup(net_ping_ip, found));
+	ut_asserteq_mem(priv->fake_host_hwaddr, found, ARP_HLEN);
+
+	console_record_reset_enable();
+	ut_assertok(run_command("neigh", 0));
+	ut_assert_nextlinen("Address ");
+	ut_assert_nextlinen("1.1.2.2 ");
+	ut_assert_console_end();
+
+	ut_assertok(run_command("neigh flush", 0));
+	ut_assertok(run_command("neigh", 0));
+	ut_assert_nextline("No neighbours");
+	ut_assert_console_end();
+	env_set("ethact", NULL);
+
+	return 0;
+}
+DM_TEST(dm_test_eth_neigh_arp, UT_TESTF_SCAN_FDT | UT_TESTF_CONSOLE_REC);
+#endif
+
+#if IS_ENABLED(CONFIG_NET_DISCOVER_ALL)
+/* Reply to a BOOTP/DHCP discover with a plain BOOTP reply */
+static int sb_bootp_handler(struct udevice *dev, void *packet,
+			    unsigned int len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct ethernet_hdr *eth = packet;
+	struct ip_udp_hdr *ip = packet + ETHER_HDR_SIZE;
+	struct bootp_hdr *bp = (void *)ip + IP_UDP_HDR_SIZE;
+	struct ethernet_hdr *eth_recv;
+	struct ip_udp_hdr *ipr;
+	struct bootp_hdr *bpr;
+
+	if (ntohs(eth->et_protlen) != PROT_IP || ip->ip_p != IPPROTO_UDP ||
+	    ntohs(ip->udp_dst) != PORT_BOOTPS || bp->bp_op != OP_BOOTREQUEST)
+		return 0;
+
+	/* Don't allow the buffer to overrun */
+	if (priv->recv_packets >= PKTBUFSRX)
+		return 0;
+
+	priv->fake_host_ipaddr = string_to_ip("1.1.2.4");
+	eth_recv = (void *)priv->recv_packet_buffer[priv->recv_packets];
+	memcpy(eth_recv, packet, len);
+	ipr = (void *)eth_recv + ETHER_HDR_SIZE;
+	bpr = (void *)ipr + IP_UDP_HDR_SIZE;
+	memcpy(eth_recv->et_dest, eth->et_src, ARP_HLEN);
+	memcpy(eth_recv->et_src, priv->fake_host_hwaddr, ARP_HLEN);
+	ipr->ip_sum = 0;
+	ipr->ip_off = 0;
+	net_write_ip(&ipr->ip_dst, string_to_ip("1.1.2.2"));
+	net_write_ip(&ipr->ip_src, priv->fake_host_ipaddr);
+	ipr->ip_sum = compute_ip_checksum(ipr, IP_HDR_SIZE);
+	ipr->udp_src = ip->udp_dst;
+	ipr->udp_dst = ip->udp_src;
+
+	bpr->bp_op = OP_BOOTREPLY;
+	net_write_ip(&bpr->bp_yiaddr, string_to_ip("1.1.2.2"));
+	net_write_ip(&bpr->bp_siaddr, priv->fake_host_ipaddr);
+	memset(&bpr->bp_vend, 0, sizeof(bpr->bp_vend));
+
+	priv->recv_packet_length[priv->recv_packets] = len;
+	++priv->recv_packets;
+
+	return 0;
+}
+
+/* The asserts include a return on fail; cleanup in the caller */
+static int _dm_test_eth_discover_all(struct unit_test_state *uts)
+{
+	struct udevice *first, *server;
+
+	ut_assertok(uclass_get_device(UCLASS_ETH, 0, &first));
+	ut_assertok(uclass_get_device(UCLASS_ETH, 1, &server));
+
+	/* Only the second interface can reach the server */
+	sandbox_eth_set_tx_handler(1, sb_bootp_handler);
+	env_set("ethact", first->name);
+	env_set("autoload", "no");
+	net_ip.s_addr = 0;
+	ut_assertok(net_loop(DHCP));
+
+	/* The lease came without a retry, so the first device was not used */
+	ut_asserteq_str(server->name, env_get("ethact"));
+	ut_asserteq(string_to_ip("1.1.2.2").s_addr, net_ip.s_addr);
+	ut_asserteq(1, bootp_try);
+
+	/* All interfaces are stopped again */
+	ut_assertnull(eth_next_running(NULL));
+
+	return 0;
+}
+
+static int dm_test_eth_discover_all(struct unit_test_state *uts)
+{
+	struct in_addr old_ip = net_ip;
+	int retval;
+
+	retval = _dm_test_eth_discover_all(uts);
+
+	/* Restore the env */
+	sandbox_eth_set_tx_handler(1, NULL);
+	env_set("autoload", NULL);
+	env_set("ethact", NULL);
+	net_ip = old_ip;
+
+	return retval;
+}
+DM_TEST(dm_test_eth_discover_all, UT_TESTF_SCAN_FDT);
+#endif
+
+#if IS_ENABLED(CONFIG_TFTP_MULTICAST)
+#define MCAST_TFTP_TID		1069
+#define MCAST_TFTP_PORT		1758
+#define MCAST_TFTP_BLKSIZE	512
+#define MCAST_TFTP_BLOCKS	3
+#define MCAST_TFTP_SIZE		(2 * MCAST_TFTP_BLKSIZE + 100)
+
+/* State of the fake multicast TFTP server */
+struct sb_mcast_tftp {
+	int client_port;
+	bool mcast_requested;
+	uchar joined[ARP_HLEN];
+	int acks[4];
+	int num_acks;
+};
+
+static uchar sb_mcast_tftp_byte(int offset)
+{
+	return offset * 13 % 251;
+}
+
+/* Send a TFTP packet to the client, or to the group if @mcast */
+static void sb_mcast_tftp_reply(struct udevice *dev, void *packet, bool mcast,
+				const void *data, int len)
+{
+	const uchar mcast_ethaddr[ARP_HLEN] = { 0x01, 0x00, 0x5e, 1, 2, 3 };
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct sb_mcast_tftp *srv = priv->priv;
+	struct ethernet_hdr *eth = packet;
+	struct ip_udp_hdr *ip = packet + ETHER_HDR_SIZE;
+	struct ethernet_hdr *eth_recv;
+	struct ip_udp_hdr *ipr;
+
+	/* Don't allow the buffer to overrun */
+	if (priv->recv_packets >= PKTBUFSRX)
+		return;
+
+	eth_recv = (void *)priv->recv_packet_buffer[priv->recv_packets];
+	memcpy(eth_recv->et_dest, mcast ? mcast_ethaddr : eth->et_src,
+	       ARP_HLEN);
+	memcpy(eth_recv->et_src, priv->fake_host_hwaddr, ARP_HLEN);
+	eth_recv->et_protlen = htons(PROT_IP);
+
+	ipr = (void *)eth_recv + ETHER_HDR_SIZE;
+	net_set_ip_header((uchar *)ipr,
+			  mcast ? string_to_ip("239.1.2.3") :
+				  net_read_ip(&ip->ip_src),
+			  priv->fake_host_ipaddr, IP_UDP_HDR_SIZE + len,
+			  IPPROTO_UDP);
+	ipr->udp_src = htons(MCAST_TFTP_TID);
+	ipr->udp_dst = htons(mcast ? MCAST_TFTP_PORT : srv->client_port);
+	ipr->udp_len = htons(UDP_HDR_SIZE + len);
+	ipr->udp_xsum = 0;
+	memcpy((void *)ipr + IP_UDP_HDR_SIZE, data, len);
+
+	priv->recv_packet_length[priv->recv_packets] =
+		ETHER_HDR_SIZE + IP_UDP_HDR_SIZE + len;
+	++priv->recv_packets;
+}
+
+static void sb_mcast_tftp_block(struct udevice *dev, void *packet, int block)
+{
+	uchar data[4 + MCAST_TFTP_BLKSIZE];
+	int offset = (block - 1) * MCAST_TFTP_BLKSIZE;
+	int len = min(MCAST_TFTP_SIZE - offset, MCAST_TFTP_BLKSIZE);
+	int i;
+
+	put_unaligned_be16(3, data);	/* DATA */
+	put_unaligned_be16(block, data + 2);
+	for (i = 0; i < len; i++)
+		data[4 + i] = sb_mcast_tftp_byte(offset + i);
+	sb_mcast_tftp_reply(dev, packet, true, data, 4 + len);
+}
+
+/*
+ * Act as a multicast server (RFC 2090) which has already started sending the
+ * file to the group: the client first sees the last block only, then becomes
+ * master and must ask for the blocks it missed
+ */
+static int sb_mcast_tftp_handler(struct udevice *dev, void *packet,
+				 unsigned int len)
+{
+	static const char oack[] = "\0\6blksize\0" "512\0"
+				   "multicast\0" "239.1.2.3,1758,0";
+	static const char oack_master[] = "\0\6multicast\0" ",,1";
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct sb_mcast_tftp *srv = priv->priv;
+	struct ethernet_hdr *eth = packet;
+	struct ip_udp_hdr *ip = packet + ETHER_HDR_SIZE;
+	uchar *data = (uchar *)ip + IP_UDP_HDR_SIZE;
+	int data_len, block, i;
+
+	if (!sandbox_eth_arp_req_to_reply(dev, packet, len))
+		return 0;
+	if (ntohs(eth->et_protlen) != PROT_IP || ip->ip_p != IPPROTO_UDP)
+		return 0;
+
+	data_len = ntohs(ip->udp_len) - UDP_HDR_SIZE;
+	switch (get_unaligned_be16(data)) {
+	case 1:		/* RRQ */
+		srv->client_port = ntohs(ip->udp_src);
+		for (i = 0; i + 10 <= data_len; i++) {
+			if (!memcmp(data + i, "multicast", 10))
+				srv->mcast_requested = true;
+		}
+		sb_mcast_tftp_reply(dev, packet, false, oack, sizeof(oack));
+		sb_mcast_tftp_block(dev, packet, MCAST_TFTP_BLOCKS);
+		sb_mcast_tftp_reply(dev, packet, false, oack_master,
+				    sizeof(oack_master));
+		break;
+	case 4:		/* ACK */
+		if (!srv->num_acks)
+			memcpy(srv->joined, priv->mcast_hwaddr, ARP_HLEN);
+		block = get_unaligned_be16(data + 2);
+		if (srv->num_acks < ARRAY_SIZE(srv->acks))
+			srv->acks[srv->num_acks++] = block;
+		if (block < MCAST_TFTP_BLOCKS)
+			sb_mcast_tftp_block(dev, packet, block + 1);
+		break;
+	}
+
+	return 0;
+}
+
+/* The asserts include a return on fail; cleanup in the caller */
+static int _dm_test_eth_tftp_mcast(struct unit_test_state *uts)
+{
+	const uchar mcast_ethaddr[ARP_HLEN] = { 0x01, 0x00, 0x5e, 1, 2, 3 };
+	struct eth_sandbox_priv *priv;
+	uchar expect[MCAST_TFTP_SIZE];
+	struct sb_mcast_tftp srv;
+	struct udevice *dev;
+	void *buf;
+	int i;
+
+	ut_assertok(uclass_get_device_by_name(UCLASS_ETH, "eth@10002000",
+					      &dev));
+	priv = dev_get_priv(dev);
+	memset(&srv, '\0', sizeof(srv));
+	sandbox_eth_set_tx_handler(0, sb_mcast_tftp_handler);
+	sandbox_eth_set_priv(0, &srv);
+	env_set("ethact", "eth@10002000");
+	env_set("ethrotate", "no");
+	ut_assertok(run_command("tftpboot 0x20000 1.1.2.2:image.bin", 0));
+
+	/*
+	 * The client joined the group, then as master asked for block 1 by
+	 * ACKing block 0, and for block 2 by ACKing block 1. Block 3 was
+	 * already there, so the last ACK is for the whole file.
+	 */
+	ut_assert(srv.mcast_requested);
+	ut_asserteq_mem(mcast_ethaddr, srv.joined, ARP_HLEN);
+	ut_asserteq(3, srv.num_acks);
+	ut_asserteq(0, srv.acks[0]);
+	ut_asserteq(1, srv.acks[1]);
+	ut_asserteq(MCAST_TFTP_BLOCKS, srv.acks[2]);
+
+	ut_asserteq(MCAST_TFTP_SIZE, env_get_hex("filesize", 0));
+	for (i = 0; i < MCAST_TFTP_SIZE; i++)
+		expect[i] = sb_mcast_tftp_byte(i);
+	buf = map_sysmem(0x20000, MCAST_TFTP_SIZE);
+	ut_asserteq_mem(expect, buf, MCAST_TFTP_SIZE);
+	unmap_sysmem(buf);
+
+	/* The group is left once the transfer is done */
+	ut_assert(is_zero_ethaddr(priv->mcast_hwaddr));
+	ut_asserteq(0, net_mcast_addr.s_addr);
+
+	return 0;
+}
+
+static int dm_test_eth_tftp_mcast(struct unit_test_state *uts)
+{
+	int retval;
+
+	retval = _dm_test_eth_tftp_mcast(uts);
+
+	/* Restore the env */
+	sandbox_eth_set_tx_handler(0, NULL);
+	sandbox_eth_set_priv(0, NULL);
+	env_set("ethact", NULL);
+	env_set("ethrotate", NULL);
+
+	return retval;
+}
+DM_TEST(dm_test_eth_tftp_mcast, UT_TESTF_SCAN_FDT);
+#endif
+
+#if IS_ENABLED(CONFIG_NET_TFTP_VARS)
+#define WIN_TFTP_TID		1070
+#define WIN_TFTP_BLKSIZE	512
+#define WIN_TFTP_WINDOW		3
+#define WIN_TFTP_BLOCKS		8
+#define WIN_TFTP_SIZE		((WIN_TFTP_BLOCKS - 1) * WIN_TFTP_BLKSIZE + 100)
+
+/* State of the fake windowed TFTP server */
+struct sb_win_tftp {
+	int client_port;
+	bool swap;
+	int lose;
+	bool sent[WIN_TFTP_BLOCKS + 1];
+	int acks[8];
+	int num_acks;
+};
+
+static uchar sb_win_tftp_byte(int offset)
+{
+	return offset * 7 % 253;
+}
+
+static void sb_win_tftp_reply(struct udevice *dev, void *packet,
+			      const void *data, int len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct sb_win_tftp *srv = priv->priv;
+	struct ethernet_hdr *eth = packet;
+	struct ip_udp_hdr *ip = packet + ETHER_HDR_SIZE;
+	struct ethernet_hdr *eth_recv;
+	struct ip_udp_hdr *ipr;
+
+	/* Don't allow the buffer to overrun */
+	if (priv->recv_packets >= PKTBUFSRX)
+		return;
+
+	eth_recv = (void *)priv->recv_packet_buffer[priv->recv_packets];
+	memcpy(eth_recv->et_dest, eth->et_src, ARP_HLEN);
+	memcpy(eth_recv->et_src, priv->fake_host_hwaddr, ARP_HLEN);
+	eth_recv->et_protlen = htons(PROT_IP);
+
+	ipr = (void *)eth_recv + ETHER_HDR_SIZE;
+	net_set_ip_header((uchar *)ipr, net_read_ip(&ip->ip_src),
+			  priv->fake_host_ipaddr, IP_UDP_HDR_SIZE + len,
+			  IPPROTO_UDP);
+	ipr->udp_src = htons(WIN_TFTP_TID);
+	ipr->udp_dst = htons(srv->client_port);
+	ipr->udp_len = htons(UDP_HDR_SIZE + len);
+	ipr->udp_xsum = 0;
+	memcpy((void *)ipr + IP_UDP_HDR_SIZE, data, len);
+
+	priv->recv_packet_length[priv->recv_packets] =
+		ETHER_HDR_SIZE + IP_UDP_HDR_SIZE + len;
+	++priv->recv_packets;
+}
+
+static void sb_win_tftp_block(struct udevice *dev, void *packet, int block)
+{
+	uchar data[4 + WIN_TFTP_BLKSIZE];
+	int offset = (block - 1) * WIN_TFTP_BLKSIZE;
+	int len = min(WIN_TFTP_SIZE - offset, WIN_TFTP_BLKSIZE);
+	int i;
+
+	put_unaligned_be16(3, data);	/* DATA */
+	put_unaligned_be16(block, data + 2);
+	for (i = 0; i < len; i++)
+		data[4 + i] = sb_win_tftp_byte(offset + i);
+	sb_win_tftp_reply(dev, packet, data, 4 + len);
+}
+
+/*
+ * Act as a server using a window (RFC 7440). An ACK asks for the window which
+ * follows the block it names, but each block is only sent once unless it was
+ * lost, so the transfer stalls if the client throws away a block it was given.
+ * The second and third blocks of a window can be swapped, and one block can be
+ * lost the first time it is sent.
+ */
+static int sb_win_tftp_handler(struct udevice *dev, void *packet,
+			       unsigned int len)
+{
+	static const char oack[] = "\0\6blksize\0" "512\0" "windowsize\0" "3";
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct sb_win_tftp *srv = priv->priv;
+	struct ethernet_hdr *eth = packet;
+	struct ip_udp_hdr *ip = packet + ETHER_HDR_SIZE;
+	uchar *data = (uchar *)ip + IP_UDP_HDR_SIZE;
+	int blocks[WIN_TFTP_WINDOW];
+	int block, count, i;
+
+	if (!sandbox_eth_arp_req_to_reply(dev, packet, len))
+		return 0;
+	if (ntohs(eth->et_protlen) != PROT_IP || ip->ip_p != IPPROTO_UDP)
+		return 0;
+
+	switch (get_unaligned_be16(data)) {
+	case 1:		/* RRQ */
+		srv->client_port = ntohs(ip->udp_src);
+		sb_win_tftp_reply(dev, packet, oack, sizeof(oack));
+		break;
+	case 4:		/* ACK */
+		block = get_unaligned_be16(data + 2);
+		if (srv->num_acks < ARRAY_SIZE(srv->acks))
+			srv->acks[srv->num_acks++] = block;
+		count = 0;
+		for (i = block + 1; i <= min(block + WIN_TFTP_WINDOW,
+					     WIN_TFTP_BLOCKS); i++) {
+			if (!srv->sent[i])
+				blocks[count++] = i;
+		}
+		if (srv->swap && count == WIN_TFTP_WINDOW)
+			swap(blocks[1], blocks[2]);
+		for (i = 0; i < count; i++) {
+			if (blocks[i] == srv->lose) {
+				srv->lose = 0;
+				continue;
+			}
+			srv->sent[blocks[i]] = true;
+			sb_win_tftp_block(dev, packet, blocks[i]);
+		}
+		break;
+	}
+
+	return 0;
+}
+
+/* The asserts include a return on fail; cleanup in the caller */
+static int _dm_test_eth_tftp_window(struct unit_test_state *uts)
+{
+	static const struct {
+		bool swap;
+		int lose;
+		int acks[8];
+		int num_acks;
+	} cases[] = {
+		/* In order: one ACK per window */
+		{ false, 0, { 0, 3, 6, 8 }, 4 },
+		/* Out of order: the gap is reported once, then filled */
+		{ true, 0, { 0, 1, 3, 6, 8 }, 5 },
+		/*
+		 * Lost: the gap is reported and once block 5 comes again the
+		 * client ACKs block 6, which it kept, straight away
+		 */
+		{ false, 5, { 0, 3, 4, 6, 8 }, 5 },
+		/* Both */
+		{ true, 5, { 0, 1, 3, 4, 6, 8 }, 6 },
+	};
+	uchar expect[WIN_TFTP_SIZE];
+	struct sb_win_tftp srv;
+	void *buf;
+	int i, j;
+
+	for (i = 0; i < WIN_TFTP_SIZE; i++)
+		expect[i] = sb_win_tftp_byte(i);
+
+	sandbox_eth_set_tx_handler(0, sb_win_tftp_handler);
+	sandbox_eth_set_priv(0, &srv);
+	env_set("ethact", "eth@10002000");
+	env_set("ethrotate", "no");
+	env_set("tftpwindowsize", "3");
+	for (i = 0; i < ARRAY_SIZE(cases); i++) {
+		memset(&srv, '\0', sizeof(srv));
+		srv.swap = cases[i].swap;
+		srv.lose = cases[i].lose;
+		buf = map_sysmem(0x20000, WIN_TFTP_SIZE);
+		memset(buf, '\0', WIN_TFTP_SIZE);
+		ut_assertok(run_command("tftpboot 0x20000 1.1.2.2:image.bin",
+					0));
+
+		ut_asserteq(cases[i].num_acks, srv.num_acks);
+		for (j = 0; j < srv.num_acks; j++)
+			ut_asserteq(cases[i].acks[j], srv.acks[j]);
+		ut_asserteq(WIN_TFTP_SIZE, env_get_hex("filesize", 0));
+		ut_asserteq_mem(expect, buf, WIN_TFTP_SIZE);
+		unmap_sysmem(buf);
+	}
+
+	return 0;
+}
+
+static int dm_test_eth_tftp_window(struct unit_test_state *uts)
+{
+	int retval;
+
+	retval = _dm_test_eth_tftp_window(uts);
+
+	/* Restore the env */
+	sandbox_eth_set_tx_handler(0, NULL);
+	sandbox_eth_set_priv(0, NULL);
+	env_set("ethact", NULL);
+	env_set("ethrotate", NULL);
+	env_set("tftpwindowsize", NULL);
+
+	return retval;
+}
+DM_TEST(dm_test_eth_tftp_window, UT_TESTF_SCAN_FDT);
+#endif
+
+#if IS_ENABLED(CONFIG_CMD_NFS)
+#define NFS_TEST_MOUNT_PORT	635
+#define NFS_TEST_NFS_PORT	2049
+#define NFS_TEST_FH_LEN		8
+#define NFS_TEST_READ_SIZE	1024
+#define NFS_TEST_SIZE		5000
+
+/* State of the fake NFSv3 server */
+struct sb_nfs {
+	bool swap;
+	int lose;
+	bool dropping;
+	int last_offset;
+	int reads;
+	int retries;
+	int reordered;
+	bool umounted;
+};
+
+static uchar sb_nfs_byte(int offset)
+{
+	return offset * 11 % 241;
+}
+
+/*
+ * Send an RPC reply to the client. If @overtake, the reply goes ahead of the
+ * one before it, if that is still waiting to be received.
+ */
+static void sb_nfs_reply(struct udevice *dev, void *packet,
+			 const struct rpc_t *rpc, int len, bool overtake)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct sb_nfs *srv = priv->priv;
+	struct ethernet_hdr *eth = packet;
+	struct ip_udp_hdr *ip = packet + ETHER_HDR_SIZE;
+	struct ethernet_hdr *eth_recv;
+	struct ip_udp_hdr *ipr;
+	int n = priv->recv_packets;
+
+	/* Don't allow the buffer to overrun */
+	if (n >= PKTBUFSRX)
+		return;
+
+	eth_recv = (void *)priv->recv_packet_buffer[n];
+	memcpy(eth_recv->et_dest, eth->et_src, ARP_HLEN);
+	memcpy(eth_recv->et_src, priv->fake_host_hwaddr, ARP_HLEN);
+	eth_recv->et_protlen = htons(PROT_IP);
+
+	ipr = (void *)eth_recv + ETHER_HDR_SIZE;
+	net_set_ip_header((uchar *)ipr, net_read_ip(&ip->ip_src),
+			  priv->fake_host_ipaddr, IP_UDP_HDR_SIZE + len,
+			  IPPROTO_UDP);
+	ipr->udp_src = ip->udp_dst;
+	ipr->udp_dst = ip->udp_src;
+	ipr->udp_len = htons(UDP_HDR_SIZE + len);
+	ipr->udp_xsum = 0;
+	memcpy((void *)ipr + IP_UDP_HDR_SIZE, rpc, len);
+
+	priv->recv_packet_length[n] = ETHER_HDR_SIZE + IP_UDP_HDR_SIZE + len;
+	++priv->recv_packets;
+
+	/* The first packet may be the one being handled, so leave it alone */
+	if (overtake && n >= 2) {
+		swap(priv->recv_packet_buffer[n], priv->recv_packet_buffer[n - 1]);
+		swap(priv->recv_packet_length[n], priv->recv_packet_length[n - 1]);
+		srv->reordered++;
+	}
+}
+
+/*
+ * Handle a READ, returning the number of words in the reply, or -1 if the
+ * request is lost. Once the request at @srv->lose has been lost, all requests
+ * are lost until the client times out and asks again for something it asked
+ * for before. Time is skipped forward meanwhile, so the timeout comes at once.
+ */
+static int sb_nfs_read(struct sb_nfs *srv, uint32_t *data, int offset,
+		       int count)
+{
+	bool eof;
+	int i;
+
+	srv->reads++;
+	if (offset <= srv->last_offset) {
+		srv->retries++;
+		srv->dropping = false;
+	} else if (offset == srv->lose) {
+		srv->dropping = true;
+	}
+	srv->last_offset = max(srv->last_offset, offset);
+	if (srv->dropping) {
+		sandbox_eth_skip_timeout();
+		return -1;
+	}
+
+	count = clamp(NFS_TEST_SIZE - offset, 0, count);
+	eof = offset + count >= NFS_TEST_SIZE;
+	data[0] = 0;			/* status */
+	data[1] = 0;			/* no attributes follow */
+	data[2] = htonl(count);
+	data[3] = htonl(eof);
+	data[4] = htonl(count);
+	for (i = 0; i < count; i++)
+		((uchar *)&data[5])[i] = sb_nfs_byte(offset + i);
+
+	return 5 + DIV_ROUND_UP(count, 4);
+}
+
+/*
+ * Act as a portmapper and NFSv3 server with a single file. READ replies can
+ * overtake each other and some can be lost, as set up in struct sb_nfs
+ */
+static int sb_nfs_handler(struct udevice *dev, void *packet,
+			  unsigned int len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct sb_nfs *srv = priv->priv;
+	struct ethernet_hdr *eth = packet;
+	struct ip_udp_hdr *ip = packet + ETHER_HDR_SIZE;
+	struct rpc_t call, reply;
+	uint32_t *args;
+	int fh_words, words = 0;
+
+	if (!sandbox_eth_arp_req_to_reply(dev, packet, len))
+		return 0;
+	if (ntohs(eth->et_protlen) != PROT_IP || ip->ip_p != IPPROTO_UDP)
+		return 0;
+
+	memcpy(&call, (void *)ip + IP_UDP_HDR_SIZE,
+	       min_t(uint, ntohs(ip->udp_len) - UDP_HDR_SIZE, sizeof(call)));
+	memset(&reply, '\0', sizeof(reply));
+	reply.u.reply.id = call.u.call.id;
+	reply.u.reply.type = htonl(MSG_REPLY);
+
+	/* The arguments follow the credentials and verifier */
+	args = call.u.call.data + 9;
+	switch (ntohl(call.u.call.prog)) {
+	case PROG_PORTMAP:
+		reply.u.reply.data[0] =
+			htonl(ntohl(call.u.call.data[4]) == PROG_MOUNT ?
+			      NFS_TEST_MOUNT_PORT : NFS_TEST_NFS_PORT);
+		words = 1;
+		break;
+	case PROG_MOUNT:
+		if (ntohl(call.u.call.proc) == MOUNT_UMOUNTALL)
+			srv->umounted = true;
+		else
+			words = 1 + NFS_FHSIZE / 4;
+		break;
+	case PROG_NFS:
+		switch (ntohl(call.u.call.proc)) {
+		case NFS3PROC_LOOKUP:
+			reply.u.reply.data[1] = htonl(NFS_TEST_FH_LEN);
+			memset(&reply.u.reply.data[2], 0x5a, NFS_TEST_FH_LEN);
+			words = 2 + NFS_TEST_FH_LEN / 4;
+			break;
+		case NFS_READ:
+			fh_words = ntohl(args[0]) / 4;
+			words = sb_nfs_read(srv, reply.u.reply.data,
+					    ntohl(args[2 + fh_words]),
+					    ntohl(args[3 + fh_words]));
+			if (words < 0)
+				return 0;
+			sb_nfs_reply(dev, packet, &reply, 24 + words * 4, true);
+			return 0;
+		}
+		break;
+	}
+	sb_nfs_reply(dev, packet, &reply, 24 + words * 4, false);
+
+	return 0;
+}
+
+/* The asserts include a return on fail; cleanup in the caller */
+static int _dm_test_eth_nfs_window(struct unit_test_state *uts)
+{
+	static const struct {
+		bool swap;
+		int lose;
+	} cases[] = {
+		{ false, -1 },
+		{ true, -1 },
+		{ false, 2 * NFS_TEST_READ_SIZE },
+		{ true, 2 * NFS_TEST_READ_SIZE },
+		{ true, 0 },
+	};
+	uchar expect[NFS_TEST_SIZE];
+	struct sb_nfs srv;
+	void *buf;
+	int i;
+
+	for (i = 0; i < NFS_TEST_SIZE; i++)
+		expect[i] = sb_nfs_byte(i);
+
+	sandbox_eth_set_tx_handler(0, sb_nfs_handler);
+	sandbox_eth_set_priv(0, &srv);
+	env_set("ethact", "eth@10002000");
+	env_set("ethrotate", "no");
+	env_set("nfsreadsize", "1024");
+	env_set("nfswindowsize", "3");
+	for (i = 0; i < ARRAY_SIZE(cases); i++) {
+		memset(&srv, '\0', sizeof(srv));
+		srv.swap = cases[i].swap;
+		srv.lose = cases[i].lose;
+		srv.last_offset = -1;
+		buf = map_sysmem(0x20000, NFS_TEST_SIZE);
+		memset(buf, '\0', NFS_TEST_SIZE);
+		ut_assertok(run_command("nfs 0x20000 1.1.2.2:/export/image.bin",
+					0));
+
+		/* Replies only overtake each other if several are in flight */
+		if (cases[i].swap)
+			ut_assert(srv.reordered);
+		/* Anything lost is asked for again, nothing else is */
+		if (cases[i].lose != -1)
+			ut_assert(srv.retries);
+		else
+			ut_asserteq(0, srv.retries);
+		ut_assert(srv.umounted);
+		ut_asserteq(NFS_TEST_SIZE, env_get_hex("filesize", 0));
+		ut_asserteq_mem(expect, buf, NFS_TEST_SIZE);
+		unmap_sysmem(buf);
+	}
+
+	return 0;
+}
+
+static int dm_test_eth_nfs_window(struct unit_test_state *uts)
+{
+	int retval;
+
+	retval = _dm_test_eth_nfs_window(uts);
+
+	/* Restore the env */
+	sandbox_eth_set_tx_handler(0, NULL);
+	sandbox_eth_set_priv(0, NULL);
+	env_set("ethact", NULL);
+	env_set("ethrotate", NULL);
+	env_set("nfsreadsize", NULL);
+	env_set("nfswindowsize", NULL);
+
+	return retval;
+}
+DM_TEST(dm_test_eth_nfs_window, UT_TESTF_SCAN_FDT);
+#endif
+
 #if IS_ENABLED(CONFIG_IPV6_ROUTER_DISCOVERY)
 
 static u8 ip6_ra_buf[] = {0x60, 0xf, 0xc5, 0x4a, 0x0, 0x38, 0x3a, 0xff, 0xfe,
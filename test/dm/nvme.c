@@ -0,0 +1,77 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Tests for the NVMe driver, using the sandbox controller
+ */
+
+#include <common.h>
+#include <blk.h>
+#include <dm.h>
+#include <malloc.h>
+#include <memalign.h>
+#include <asm/test.h>
+#include <dm/device-internal.h>
+#include <dm/lists.h>
+#include <dm/root.h>
+#include <dm/test.h>
+#include <linux/sizes.h>
+#include <test/test.h>
+#include <test/ut.h>
+
+/* blocks per command with the sandbox controller's 32KB transfer limit */
+#define CMD_BLKS	64
+#define TEST_START	3
+#define TEST_BLKS	(8 * CMD_BLKS)
+
+/* Test reads and writes which keep several commands in flight */
+static int dm_test_nvme_queued(struct unit_test_state *uts)
+{
+	struct udevice *dev, *blk;
+	struct blk_desc *desc;
+	ulong size;
+	char *buf, *cmp;
+	int i;
+
+	sandbox_set_enable_memio(true);
+	ut_assertok(device_bind_driver(dm_root(), "sandbox_nvme", "nvme-test",
+				       &dev));
+	ut_assertok(device_probe(dev));
+	ut_assertok(blk_get_from_parent(dev, &blk));
+	desc = dev_get_uclass_plat(blk);
+	ut_asserteq(512, desc->blksz);
+
+	size = TEST_BLKS * desc->blksz;
+	buf = memalign(SZ_4K, size);
+	cmp = memalign(SZ_4K, size);
+	ut_assertnonnull(buf);
+	ut_assertnonnull(cmp);
+	for (i = 0; i < size; i++)
+		buf[i] = i ^ i >> 9;
+
+	/* each command has its own PRP list and all are queued together */
+	ut_asserteq(TEST_BLKS, blk_write(blk, TEST_START, TEST_BLKS, buf));
+	ut_asserteq(TEST_BLKS / CMD_BLKS, sandbox_nvme_get_max_inflight(dev));
+	memset(cmp, '\0', size);
+	ut_asserteq(TEST_BLKS, blk_read(blk, TEST_START, TEST_BLKS, cmp));
+	ut_asserteq_mem(buf, cmp, size);
+
+	/* a failure reports the blocks before the command which failed */
+	sandbox_nvme_set_fail_lba(dev, TEST_START + 100);
+	ut_asserteq(CMD_BLKS, blk_read(blk, TEST_START, TEST_BLKS, cmp));
+	sandbox_nvme_set_fail_lba(dev, TEST_START);
+	ut_asserteq(0, blk_write(blk, TEST_START, TEST_BLKS, buf));
+
+	/* all slots are free again afterwards */
+	sandbox_nvme_set_fail_lba(dev, -1);
+	memset(cmp, '\0', size);
+	ut_asserteq(TEST_BLKS, blk_read(blk, TEST_START, TEST_BLKS, cmp));
+	ut_asserteq_mem(buf, cmp, size);
+
+	free(cmp);
+	free(buf);
+	ut_assertok(device_remove(dev, DM_REMOVE_NORMAL));
+	ut_assertok(device_unbind(dev));
+	sandbox_set_enable_memio(false);
+
+	return 0;
+}
+DM_TEST(dm_test_nvme_queued, UT_TESTF_SCAN_FDT);
@@ -23,6 +23,7 @@
 #include <of_live.h>
 #include <dm/device-internal.h>
 #include <dm/lists.h>
+#include <dm/of_access.h>
 #include <dm/of_extra.h>
 #include <dm/root.h>
 #include <dm/test.h>
@@ -153,6 +154,79 @@ static int dm_test_ofnode_get_by_phandle_ot(struct unit_test_state *uts)
 DM_TEST(dm_test_ofnode_get_by_phandle_ot,
 	UT_TESTF_SCAN_FDT | UT_TESTF_OTHER_FDT);
 
+/* Find a node by walking the tree, without the phandle index */
+static struct device_node *walk_phandle(phandle handle)
+{
+	struct device_node *np;
+
+	for_each_of_allnodes(np) {
+		if (np->phandle == handle)
+			break;
+	}
+
+	return np;
+}
+
+/* Check that a phandle lookup finds the same node as a walk */
+static int check_phandle(struct unit_test_state *uts, phandle handle)
+{
+	ut_asserteq_ptr(walk_phandle(handle),
+			of_find_node_by_phandle(NULL, handle));
+
+	return 0;
+}
+
+/* test that indexed phandle lookups stay correct as the tree changes */
+static int dm_test_ofnode_phandle_cache(struct unit_test_state *uts)
+{
+	struct device_node *np;
+	phandle max = 0;
+	ofnode subnode;
+	fdt32_t val;
+
+	for_each_of_allnodes(np) {
+		if (!np->phandle)
+			continue;
+		ut_assertok(check_phandle(uts, np->phandle));
+		max = max(max, np->phandle);
+	}
+	ut_assertnull(of_find_node_by_phandle(NULL, max + 1));
+
+	/* a new node with a new phandle, after the index has been built */
+	ut_assertok(ofnode_add_subnode(ofnode_root(), "phandle-cache-test",
+				       &subnode));
+	np = ofnode_to_np(subnode);
+	val = cpu_to_fdt32(max + 1);
+	ut_assertok(ofnode_write_prop(subnode, "phandle", &val, sizeof(val),
+				      true));
+	ut_asserteq_ptr(np, of_find_node_by_phandle(NULL, max + 1));
+	ut_assertok(check_phandle(uts, max + 1));
+
+	/* a changed phandle */
+	val = cpu_to_fdt32(max + 2);
+	ut_assertok(ofnode_write_prop(subnode, "phandle", &val, sizeof(val),
+				      true));
+	ut_assertnull(of_find_node_by_phandle(NULL, max + 1));
+	ut_asserteq_ptr(np, of_find_node_by_phandle(NULL, max + 2));
+
+	/* a phandle changed without telling the index is still found */
+	np->phandle = max + 3;
+	ut_asserteq_ptr(np, of_find_node_by_phandle(NULL, max + 3));
+	ut_assertok(check_phandle(uts, max + 2));
+
+	/* a removed node */
+	ut_assertok(of_remove_node(np));
+	ut_assertnull(of_find_node_by_phandle(NULL, max + 3));
+
+	for_each_of_allnodes(np) {
+		if (np->phandle)
+			ut_assertok(check_phandle(uts, np->phandle));
+	}
+
+	return 0;
+}
+DM_TEST(dm_test_ofnode_phandle_cache, UT_TESTF_SCAN_FDT | UT_TESTF_LIVE_TREE);
+
 static int check_prop_values(struct unit_test_state *uts, ofnode start,
 			     const char *propname, const char *propval,
 			     int expect_count)
@@ -1347,6 +1421,39 @@ static int dm_test_livetree_align(struct unit_test_state *uts)
 }
 DM_TEST(dm_test_livetree_align, UT_TESTF_SCAN_FDT | UT_TESTF_LIVE_TREE);
 
+/* check that a lazy livetree is expanded only as needed */
+static int dm_test_livetree_lazy(struct unit_test_state *uts)
+{
+	const void *blob = gd->fdt_blob;
+	struct of_live_stats stats;
+	struct device_node *np;
+	int offset;
+
+	if (!CONFIG_IS_ENABLED(OF_LIVE_LAZY))
+		return -EAGAIN;
+	ut_assert(of_live_is_lazy(gd_of_root()));
+
+	/* Looking up a phandle finds the same node as the path */
+	offset = fdt_path_offset(blob, "/pinctrl-gpio/base-gpios");
+	ut_assert(offset >= 0);
+	np = of_find_node_by_phandle(NULL, fdt_get_phandle(blob, offset));
+	ut_assertnonnull(np);
+	ut_asserteq_str("/pinctrl-gpio/base-gpios", np->full_name);
+	ut_asserteq_ptr(np, of_find_node_by_path("/pinctrl-gpio/base-gpios"));
+
+	/* Properties come straight from the flat tree */
+	ut_asserteq_ptr(fdt_getprop(blob, offset, "compatible", NULL),
+			of_get_property(np, "compatible", NULL));
+
+	ut_assertok(of_live_get_stats(&stats));
+	ut_assert(stats.nodes <= stats.full_nodes);
+	ut_assert(stats.props <= stats.full_props);
+	ut_assert(stats.full_size > 0);
+
+	return 0;
+}
+DM_TEST(dm_test_livetree_lazy, UT_TESTF_SCAN_FDT | UT_TESTF_LIVE_TREE);
+
 /* check that it is possible to load an arbitrary livetree */
 static int dm_test_livetree_ensure(struct unit_test_state *uts)
 {
@@ -0,0 +1,144 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Tests for binding devices from a probe plan
+ */
+
+#include <common.h>
+#include <bloblist.h>
+#include <dm.h>
+#include <malloc.h>
+#include <mapmem.h>
+#include <asm/global_data.h>
+#include <dm/plan.h>
+#include <dm/root.h>
+#include <dm/test.h>
+#include <test/test.h>
+#include <test/ut.h>
+#include <u-boot/crc.h>
+
+DECLARE_GLOBAL_DATA_PTR;
+
+enum {
+	TEST_BLOBLIST_SIZE	= 0x8000,
+};
+
+/* Add up the name, driver and sequence number of each device */
+static u32 tree_crc(struct udevice *parent, u32 crc, int *countp)
+{
+	struct udevice *dev;
+
+	device_foreach_child(dev, parent) {
+		crc = crc32(crc, (uchar *)dev->name, strlen(dev->name));
+		crc = crc32(crc, (uchar *)&dev->driver, sizeof(dev->driver));
+		crc = crc32(crc, (uchar *)&dev->seq_, sizeof(dev->seq_));
+		crc = tree_crc(dev, crc, countp);
+		(*countp)++;
+	}
+
+	return crc;
+}
+
+/* Start again with an empty root, since dm_plan_scan() binds everything */
+static int clean_root(struct unit_test_state *uts)
+{
+	ut_assertok(dm_uninit());
+	ut_assertok(dm_init(false));
+	uts->root = dm_root();
+
+	return 0;
+}
+
+static int rescan(struct unit_test_state *uts, u32 *crcp, int *countp)
+{
+	ut_assertok(clean_root(uts));
+	ut_assertok(dm_plan_scan(false));
+	*countp = 0;
+	*crcp = tree_crc(dm_root(), 0, countp);
+
+	return 0;
+}
+
+static int check_plan(struct unit_test_state *uts)
+{
+	struct dm_plan_entry *entry;
+	struct dm_plan_hdr *hdr;
+	int count, new_count;
+	u32 crc, new_crc, key;
+	uint entries, i, node;
+
+	/* With no plan, this scans the devicetree and records a plan */
+	ut_assertnull(bloblist_find(BLOBLISTT_U_BOOT_DM_PLAN_R, 0));
+	ut_assertok(clean_root(uts));
+	ut_assertok(dm_plan_scan(false));
+	count = 0;
+	crc = tree_crc(dm_root(), 0, &count);
+	hdr = bloblist_find(BLOBLISTT_U_BOOT_DM_PLAN_R, 0);
+	ut_assertnonnull(hdr);
+	ut_asserteq(DM_PLAN_MAGIC, hdr->magic);
+	entries = hdr->count;
+	key = hdr->key;
+	ut_assert(entries > 10);
+	ut_assert(entries <= count);
+
+	/* Binding from the plan gives the same devices in the same order */
+	ut_assertok(rescan(uts, &new_crc, &new_count));
+	ut_asserteq(count, new_count);
+	ut_asserteq(crc, new_crc);
+
+	/* Check the plan is used, by dropping the last device from it */
+	hdr->count--;
+	ut_assertok(rescan(uts, &new_crc, &new_count));
+	ut_assert(new_count < count);
+	ut_asserteq(entries - 1, hdr->count);
+
+	/* With the wrong key, the devicetree is scanned and the plan redone */
+	hdr->key = ~key;
+	ut_assertok(rescan(uts, &new_crc, &new_count));
+	ut_asserteq(count, new_count);
+	ut_asserteq(crc, new_crc);
+	hdr = bloblist_find(BLOBLISTT_U_BOOT_DM_PLAN_R, 0);
+	ut_assertnonnull(hdr);
+	ut_asserteq(key, hdr->key);
+	ut_asserteq(entries, hdr->count);
+
+	/*
+	 * If a node is not compatible with the driver it was bound to, e.g.
+	 * because the drivers changed, the devicetree is scanned again
+	 */
+	entry = (struct dm_plan_entry *)(hdr + 1);
+	for (i = 0; i < hdr->count && entry->match == DM_PLAN_NO_MATCH; i++)
+		entry++;
+	ut_assert(i < hdr->count);
+	node = entry->node;
+	entry->node = 0;
+	ut_assertok(rescan(uts, &new_crc, &new_count));
+	ut_asserteq(count, new_count);
+	ut_asserteq(crc, new_crc);
+	hdr = bloblist_find(BLOBLISTT_U_BOOT_DM_PLAN_R, 0);
+	ut_assertnonnull(hdr);
+	entry = (struct dm_plan_entry *)(hdr + 1);
+	ut_asserteq(node, entry[i].node);
+
+	return 0;
+}
+
+/* Test binding devices from a probe plan */
+static int dm_test_plan(struct unit_test_state *uts)
+{
+	void *old_bloblist = gd->bloblist;
+	void *buf;
+	int ret;
+
+	/* Use a separate bloblist, with space for the plan */
+	buf = memalign(BLOBLIST_ALIGN, TEST_BLOBLIST_SIZE);
+	ut_assertnonnull(buf);
+	ut_assertok(bloblist_new(map_to_sysmem(buf), TEST_BLOBLIST_SIZE, 0));
+	ret = check_plan(uts);
+	gd->bloblist = old_bloblist;
+	free(buf);
+	ut_assertok(ret);
+
+	return 0;
+}
+/* The plan records node offsets, so it is only used with the flat tree */
+DM_TEST(dm_test_plan, UT_TESTF_SCAN_FDT | UT_TESTF_FLAT_TREE);
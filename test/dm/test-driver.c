@@ -198,3 +198,36 @@ U_BOOT_DRIVER(test_act_dma_vital_clk_drv) = {
 	.unbind	= test_manual_unbind,
 	.flags	= DM_FLAG_VITAL | DM_FLAG_ACTIVE_DMA,
 };
+
+/* Number of polls before the 'hardware' of test_defer_drv is ready */
+#define TEST_DEFER_POLLS	3
+
+static int test_defer_ready(struct udevice *dev)
+{
+	int *polls = dev_get_priv(dev);
+
+	return ++*polls < TEST_DEFER_POLLS ? -EAGAIN : 0;
+}
+
+static int test_defer_cont(struct udevice *dev)
+{
+	dm_testdrv_op_count[DM_TEST_OP_PROBE]++;
+
+	return 0;
+}
+
+static int test_defer_probe(struct udevice *dev)
+{
+	return dev_probe_defer(dev, test_defer_ready, test_defer_cont, 1000);
+}
+
+U_BOOT_DRIVER(test_defer_drv) = {
+	.name	= "test_defer_drv",
+	.id	= UCLASS_TEST,
+	.ops	= &test_manual_ops,
+	.bind	= test_manual_bind,
+	.probe	= test_defer_probe,
+	.remove	= test_manual_remove,
+	.unbind	= test_manual_unbind,
+	.priv_auto	= sizeof(int),
+};